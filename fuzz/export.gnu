@@ -251,6 +251,7 @@
 		fido_nfc_rx;
 		fido_nfc_tx;
 		fido_nl_free;
+		fido_nl_get_nfc_event;
 		fido_nl_get_nfc_target;
 		fido_nl_new;
 		fido_nl_power_nfc;
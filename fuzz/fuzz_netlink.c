@@ -125,6 +125,7 @@ test(const struct param *p)
 {
 	fido_nl_t *nl;
 	uint32_t target;
+	uint8_t event;
 
 	prng_init((unsigned int)p->seed);
 	fuzz_clock_reset();
@@ -147,6 +148,9 @@ test(const struct param *p)
 	if (fido_nl_get_nfc_target(nl, (uint32_t)p->dev, &target) == 0)
 		consume(&target, sizeof(target));
 
+	if (fido_nl_get_nfc_event(nl, (uint32_t)p->dev, &event) == 0)
+		consume(&event, sizeof(event));
+
 	fido_nl_free(&nl);
 }
 
@@ -20,6 +20,8 @@ static int (*xwrite)(void *, const u_char *, size_t);
 static void (*xconsume)(const void *, size_t);
 
 LONG __wrap_SCardEstablishContext(DWORD, LPCVOID, LPCVOID, LPSCARDCONTEXT);
+LONG __wrap_SCardGetStatusChange(SCARDCONTEXT, DWORD, SCARD_READERSTATE *,
+    DWORD);
 LONG __wrap_SCardListReaders(SCARDCONTEXT, LPCSTR, LPSTR, LPDWORD);
 LONG __wrap_SCardReleaseContext(SCARDCONTEXT);
 LONG __wrap_SCardConnect(SCARDCONTEXT, LPCSTR, DWORD, DWORD, LPSCARDHANDLE,
@@ -50,6 +52,27 @@ __wrap_SCardEstablishContext(DWORD dwScope, LPCVOID pvReserved1,
 	return SCARD_S_SUCCESS;
 }
 
+LONG
+__wrap_SCardGetStatusChange(SCARDCONTEXT hContext, DWORD dwTimeout,
+    SCARD_READERSTATE *rgReaderStates, DWORD cReaders)
+{
+	assert(hContext == 1);
+	assert(dwTimeout == 0);
+	assert(rgReaderStates != NULL);
+	assert(cReaders == 1);
+
+	/* never unchanged, so that readers are listed on every run */
+	if (uniform_random(400) < 1)
+		return SCARD_E_INVALID_HANDLE;
+	if (uniform_random(400) < 1)
+		return SCARD_E_NO_SERVICE;
+
+	rgReaderStates->dwEventState = SCARD_STATE_CHANGED |
+	    (uniform_random(400) << 16);
+
+	return SCARD_S_SUCCESS;
+}
+
 LONG
 __wrap_SCardListReaders(SCARDCONTEXT hContext, LPCSTR mszGroups,
     LPSTR mszReaders, LPDWORD pcchReaders)
@@ -8,7 +8,9 @@
 #undef NDEBUG
 
 #include <assert.h>
+#include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #define _FIDO_INTERNAL
 
@@ -342,6 +344,210 @@ valid_assert(void)
 	free_eddsa_pk(eddsa);
 }
 
+static void
+batch_verify(void)
+{
+	fido_assert_t *a;
+	es256_pk_t *es256;
+	rs256_pk_t *rs256;
+	eddsa_pk_t *eddsa;
+	const fido_assert_t *av[5];
+	const void *pk[5];
+	size_t idx[5];
+	int alg[5];
+	int status[5];
+
+	a = alloc_assert();
+	es256 = alloc_es256_pk();
+	rs256 = alloc_rs256_pk();
+	eddsa = alloc_eddsa_pk();
+	assert(es256_pk_from_ptr(es256, es256_pk, sizeof(es256_pk)) == FIDO_OK);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, "localhost") == FIDO_OK);
+	assert(fido_assert_set_count(a, 1) == FIDO_OK);
+	assert(fido_assert_set_authdata(a, 0, authdata,
+	    sizeof(authdata)) == FIDO_OK);
+	assert(fido_assert_set_up(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_uv(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_sig(a, 0, sig, sizeof(sig)) == FIDO_OK);
+	/* es256, rs256, es256 (shared key), eddsa, bad idx */
+	av[0] = av[1] = av[2] = av[3] = av[4] = a;
+	pk[0] = pk[2] = pk[4] = es256;
+	pk[1] = rs256;
+	pk[3] = eddsa;
+	alg[0] = alg[2] = alg[4] = COSE_ES256;
+	alg[1] = COSE_RS256;
+	alg[3] = COSE_EDDSA;
+	idx[0] = idx[1] = idx[2] = idx[3] = 0;
+	idx[4] = 1;
+	memset(status, 0xff, sizeof(status));
+	assert(fido_assert_verify_batch(av, idx, alg, pk, 5,
+	    status, 0) == FIDO_ERR_INVALID_SIG);
+	for (size_t i = 0; i < 5; i++)
+		assert(status[i] == fido_assert_verify(av[i], idx[i], alg[i],
+		    pk[i]));
+	assert(status[4] == FIDO_ERR_INVALID_ARGUMENT);
+	/* the same, spread over threads */
+	for (size_t t = 2; t < 8; t++) {
+		memset(status, 0xff, sizeof(status));
+		assert(fido_assert_verify_batch(av, idx, alg, pk, 5,
+		    status, t) == FIDO_ERR_INVALID_SIG);
+		for (size_t i = 0; i < 5; i++)
+			assert(status[i] == fido_assert_verify(av[i], idx[i],
+			    alg[i], pk[i]));
+	}
+	/* all valid */
+	assert(fido_assert_verify_batch(av, idx, alg, pk, 1,
+	    status, 0) == FIDO_OK);
+	assert(status[0] == FIDO_OK);
+	/* bad arguments */
+	pk[0] = NULL;
+	assert(fido_assert_verify_batch(av, idx, alg, pk, 1,
+	    status, 0) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(status[0] == FIDO_ERR_INVALID_ARGUMENT);
+	pk[0] = es256;
+	assert(fido_assert_verify_batch(av, idx, alg, pk, 0,
+	    status, 0) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_assert_verify_batch(av, idx, alg, pk, 1,
+	    NULL, 0) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_assert_verify_batch(NULL, idx, alg, pk, 1,
+	    status, 0) == FIDO_ERR_INVALID_ARGUMENT);
+	free_assert(a);
+	free_es256_pk(es256);
+	free_rs256_pk(rs256);
+	free_eddsa_pk(eddsa);
+}
+
+static double
+elapsed(const struct timespec *t0)
+{
+	struct timespec t1;
+
+	assert(timespec_get(&t1, TIME_UTC) == TIME_UTC);
+
+	return ((double)(t1.tv_sec - t0->tv_sec) +
+	    (double)(t1.tv_nsec - t0->tv_nsec) / 1e9);
+}
+
+/*
+ * fido_assert_verify() in a loop against fido_assert_verify_batch() on
+ * one and four threads. With an iteration count on the command line,
+ * report the rates; the regress run only checks the results.
+ */
+static void
+batch_bench(unsigned long iter)
+{
+	fido_assert_t *a;
+	es256_pk_t *es256;
+	const fido_assert_t **av;
+	const void **pk;
+	size_t *idx;
+	int *alg, *status;
+	struct timespec t0;
+	double t[3];
+
+	if (iter == 0)
+		return;
+
+	a = alloc_assert();
+	es256 = alloc_es256_pk();
+	assert(es256_pk_from_ptr(es256, es256_pk, sizeof(es256_pk)) == FIDO_OK);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, "localhost") == FIDO_OK);
+	assert(fido_assert_set_count(a, 1) == FIDO_OK);
+	assert(fido_assert_set_authdata(a, 0, authdata,
+	    sizeof(authdata)) == FIDO_OK);
+	assert(fido_assert_set_up(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_uv(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_sig(a, 0, sig, sizeof(sig)) == FIDO_OK);
+	assert((av = calloc(iter, sizeof(*av))) != NULL);
+	assert((pk = calloc(iter, sizeof(*pk))) != NULL);
+	assert((idx = calloc(iter, sizeof(*idx))) != NULL);
+	assert((alg = calloc(iter, sizeof(*alg))) != NULL);
+	assert((status = calloc(iter, sizeof(*status))) != NULL);
+	for (unsigned long i = 0; i < iter; i++) {
+		av[i] = a;
+		pk[i] = es256;
+		alg[i] = COSE_ES256;
+	}
+
+	assert(timespec_get(&t0, TIME_UTC) == TIME_UTC);
+	for (unsigned long i = 0; i < iter; i++)
+		assert(fido_assert_verify(av[i], idx[i], alg[i],
+		    pk[i]) == FIDO_OK);
+	t[0] = elapsed(&t0);
+	assert(timespec_get(&t0, TIME_UTC) == TIME_UTC);
+	assert(fido_assert_verify_batch(av, idx, alg, pk, iter, status,
+	    1) == FIDO_OK);
+	t[1] = elapsed(&t0);
+	assert(timespec_get(&t0, TIME_UTC) == TIME_UTC);
+	assert(fido_assert_verify_batch(av, idx, alg, pk, iter, status,
+	    4) == FIDO_OK);
+	t[2] = elapsed(&t0);
+
+	if (iter > 256 && t[0] > 0 && t[1] > 0 && t[2] > 0)
+		printf("%lu assertions: loop %.0f/sec, batch %.0f/sec, "
+		    "batch on 4 threads %.0f/sec\n", iter,
+		    (double)iter / t[0], (double)iter / t[1],
+		    (double)iter / t[2]);
+
+	free(av);
+	free(pk);
+	free(idx);
+	free(alg);
+	free(status);
+	free_assert(a);
+	free_es256_pk(es256);
+}
+
+static void
+verifier(void)
+{
+	fido_assert_t *a;
+	fido_verifier_t *v;
+	es256_pk_t *es256;
+	rs256_pk_t *rs256;
+	eddsa_pk_t *eddsa;
+
+	a = alloc_assert();
+	es256 = alloc_es256_pk();
+	rs256 = alloc_rs256_pk();
+	eddsa = alloc_eddsa_pk();
+	assert((v = fido_verifier_new()) != NULL);
+	assert(es256_pk_from_ptr(es256, es256_pk, sizeof(es256_pk)) == FIDO_OK);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, "localhost") == FIDO_OK);
+	assert(fido_assert_set_count(a, 1) == FIDO_OK);
+	assert(fido_assert_set_authdata(a, 0, authdata,
+	    sizeof(authdata)) == FIDO_OK);
+	assert(fido_assert_set_up(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_uv(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_assert_set_sig(a, 0, sig, sizeof(sig)) == FIDO_OK);
+	assert(fido_assert_verify_with(a, 0, NULL) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(NULL, COSE_ES256, es256) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(v, COSE_ES256, NULL) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(v, COSE_UNSPEC, es256) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(v, COSE_ES256, es256) == FIDO_OK);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_OK);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_OK);
+	assert(fido_assert_verify_with(a, 1, v) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(v, COSE_RS256, rs256) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_verifier_set_pk(v, COSE_EDDSA, eddsa) == FIDO_OK);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_ERR_INVALID_SIG);
+	assert(fido_verifier_set_pk(v, COSE_UNSPEC, es256) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_assert_verify_with(a, 0, v) == FIDO_ERR_INVALID_ARGUMENT);
+	fido_verifier_free(&v);
+	assert(v == NULL);
+	fido_verifier_free(&v);
+	fido_verifier_free(NULL);
+	free_assert(a);
+	free_es256_pk(es256);
+	free_rs256_pk(rs256);
+	free_eddsa_pk(eddsa);
+}
+
 static void
 no_cdh(void)
 {
@@ -614,12 +820,20 @@ es256_PKEY(void)
 }
 
 int
-main(void)
+main(int argc, char **argv)
 {
+	unsigned long iter = 256;
+
 	fido_init(0);
 
+	if (argc > 1)
+		iter = strtoul(argv[1], NULL, 10);
+
 	empty_assert_tests();
 	valid_assert();
+	batch_verify();
+	batch_bench(iter);
+	verifier();
 	no_cdh();
 	no_rp();
 	no_authdata();
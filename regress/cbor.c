@@ -0,0 +1,373 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#include <string.h>
+
+#define _FIDO_INTERNAL
+
+#include <fido.h>
+
+/*
+ * Differential tests of the direct-to-buffer request encoders against
+ * cbor_build_frame() with the libcbor items they replace.
+ */
+
+static const unsigned char cdh[32] = {
+	0xec, 0x8d, 0x8f, 0x78, 0x42, 0x4a, 0x2b, 0xb7,
+	0x82, 0x34, 0xaa, 0xca, 0x07, 0xa1, 0xf6, 0x56,
+	0x42, 0x1c, 0xb6, 0xf6, 0xb3, 0x00, 0x86, 0x52,
+	0x35, 0x2d, 0xa2, 0x62, 0x4a, 0xbe, 0x89, 0x76,
+};
+
+static const unsigned char user_id[32] = {
+	0x78, 0x1c, 0x78, 0x60, 0xad, 0x88, 0xd2, 0x63,
+	0x32, 0x62, 0x2a, 0xf1, 0x74, 0x5d, 0xed, 0xb2,
+	0xe7, 0xa4, 0x2b, 0x44, 0x89, 0x29, 0x39, 0xc5,
+	0x56, 0x64, 0x01, 0x27, 0x0d, 0xbb, 0xc4, 0x49,
+};
+
+static unsigned char big[70000];
+
+static char *
+long_string(size_t len)
+{
+	char *s;
+
+	assert((s = malloc(len + 1)) != NULL);
+	memset(s, 'x', len);
+	s[len] = '\0';
+
+	return (s);
+}
+
+static cbor_item_t *
+ref(cbor_item_t *item)
+{
+	return (item != NULL ? cbor_incref(item) : NULL);
+}
+
+static void
+assert_same(const fido_blob_t *a, const fido_blob_t *b)
+{
+	assert(a->len == b->len);
+	assert(memcmp(a->ptr, b->ptr, a->len) == 0);
+}
+
+static int
+makecred_tree(const fido_cred_t *cred, fido_opt_t uv, cbor_item_t *pin_auth,
+    cbor_item_t *pin_opt, fido_blob_t *f)
+{
+	cbor_item_t	*argv[9];
+	int		 ok = -1;
+
+	memset(argv, 0, sizeof(argv));
+
+	if ((argv[0] = fido_blob_encode(&cred->cdh)) == NULL ||
+	    (argv[1] = cbor_encode_rp_entity(&cred->rp)) == NULL ||
+	    (argv[2] = cbor_encode_user_entity(&cred->user)) == NULL ||
+	    (argv[3] = cbor_encode_pubkey_param(cred->type)) == NULL)
+		goto fail;
+	if (cred->excl.len &&
+	    (argv[4] = cbor_encode_pubkey_list(&cred->excl)) == NULL)
+		goto fail;
+	if (cred->ext.mask && (argv[5] = cbor_encode_cred_ext(&cred->ext,
+	    &cred->blob)) == NULL)
+		goto fail;
+	if ((cred->rk != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT) &&
+	    (argv[6] = cbor_encode_cred_opt(cred->rk, uv)) == NULL)
+		goto fail;
+	argv[7] = ref(pin_auth);
+	argv[8] = ref(pin_opt);
+
+	ok = cbor_build_frame(NULL, CTAP_CBOR_MAKECRED, argv, nitems(argv), f);
+fail:
+	cbor_vector_free(argv, nitems(argv));
+
+	return (ok);
+}
+
+static int
+get_assert_tree(const fido_assert_t *a, fido_opt_t uv,
+    cbor_item_t *hmac_secret, cbor_item_t *pin_auth, cbor_item_t *pin_opt,
+    fido_blob_t *f)
+{
+	cbor_item_t	*argv[7];
+	int		 ok = -1;
+
+	memset(argv, 0, sizeof(argv));
+
+	if ((argv[0] = cbor_build_string(a->rp_id)) == NULL ||
+	    (argv[1] = fido_blob_encode(&a->cdh)) == NULL)
+		goto fail;
+	if (a->allow_list.len &&
+	    (argv[2] = cbor_encode_pubkey_list(&a->allow_list)) == NULL)
+		goto fail;
+	if (a->ext.mask && (argv[3] = cbor_encode_assert_ext(&a->ext,
+	    hmac_secret)) == NULL)
+		goto fail;
+	if ((a->up != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT) &&
+	    (argv[4] = cbor_encode_assert_opt(a->up, uv)) == NULL)
+		goto fail;
+	argv[5] = ref(pin_auth);
+	argv[6] = ref(pin_opt);
+
+	ok = cbor_build_frame(NULL, CTAP_CBOR_ASSERT, argv, nitems(argv), f);
+fail:
+	cbor_vector_free(argv, nitems(argv));
+
+	return (ok);
+}
+
+static void
+check_makecred(const fido_cred_t *cred, fido_opt_t uv, cbor_item_t *pin_auth,
+    cbor_item_t *pin_opt)
+{
+	fido_blob_t tree, stream;
+
+	memset(&tree, 0, sizeof(tree));
+	memset(&stream, 0, sizeof(stream));
+
+	assert(makecred_tree(cred, uv, pin_auth, pin_opt, &tree) == 0);
+	assert(cbor_frame_makecred(NULL, cred, &cred->excl, uv, pin_auth,
+	    pin_opt, &stream) == 0);
+	assert(cbor_frame_makecred_len(cred, &cred->excl, uv, pin_auth,
+	    pin_opt) == stream.len);
+	assert_same(&tree, &stream);
+
+	free(tree.ptr);
+	free(stream.ptr);
+}
+
+static void
+check_get_assert(const fido_assert_t *a, fido_opt_t uv,
+    cbor_item_t *hmac_secret, cbor_item_t *pin_auth, cbor_item_t *pin_opt)
+{
+	fido_blob_t tree, stream;
+
+	memset(&tree, 0, sizeof(tree));
+	memset(&stream, 0, sizeof(stream));
+
+	assert(get_assert_tree(a, uv, hmac_secret, pin_auth, pin_opt,
+	    &tree) == 0);
+	assert(cbor_frame_get_assert(NULL, a, &a->allow_list, uv, hmac_secret,
+	    pin_auth, pin_opt, &stream) == 0);
+	assert(cbor_frame_get_assert_len(a, &a->allow_list, uv, hmac_secret,
+	    pin_auth, pin_opt) == stream.len);
+	assert_same(&tree, &stream);
+
+	free(tree.ptr);
+	free(stream.ptr);
+}
+
+static void
+refuse_makecred(const fido_cred_t *cred)
+{
+	fido_blob_t tree, stream;
+
+	memset(&tree, 0, sizeof(tree));
+	memset(&stream, 0, sizeof(stream));
+
+	assert(makecred_tree(cred, FIDO_OPT_OMIT, NULL, NULL, &tree) < 0);
+	assert(cbor_frame_makecred(NULL, cred, &cred->excl, FIDO_OPT_OMIT, NULL,
+	    NULL, &stream) < 0);
+	assert(tree.ptr == NULL && stream.ptr == NULL);
+}
+
+static void
+refuse_get_assert(const fido_assert_t *a)
+{
+	fido_blob_t tree, stream;
+
+	memset(&tree, 0, sizeof(tree));
+	memset(&stream, 0, sizeof(stream));
+
+	assert(get_assert_tree(a, FIDO_OPT_OMIT, NULL, NULL, NULL,
+	    &tree) < 0);
+	assert(cbor_frame_get_assert(NULL, a, &a->allow_list, FIDO_OPT_OMIT, NULL,
+	    NULL, NULL, &stream) < 0);
+	assert(tree.ptr == NULL && stream.ptr == NULL);
+}
+
+static void
+check_item(cbor_item_t *item)
+{
+	unsigned char	*ptr = NULL;
+	size_t		 len, alloc_len;
+	unsigned char	 buf[512];
+	cbor_enc_t	 e;
+
+	assert((len = cbor_serialize_alloc(item, &ptr, &alloc_len)) != 0);
+	assert(len <= sizeof(buf));
+
+	memset(&e, 0, sizeof(e));
+	cbor_enc_item(&e, item);
+	assert(!e.bad && e.len == len);
+
+	e.ptr = buf;
+	e.cap = e.len;
+	e.len = 0;
+	cbor_enc_item(&e, item);
+	assert(!e.bad && e.len == len);
+	assert(memcmp(buf, ptr, len) == 0);
+
+	free(ptr);
+	cbor_decref(&item);
+}
+
+static cbor_item_t *
+pair_map(cbor_item_t *k, cbor_item_t *v)
+{
+	cbor_item_t		*map;
+	struct cbor_pair	 pair;
+
+	assert((map = cbor_new_definite_map(1)) != NULL);
+	pair.key = cbor_move(k);
+	pair.value = cbor_move(v);
+	assert(cbor_map_add(map, pair));
+
+	return (map);
+}
+
+static void
+items(void)
+{
+	cbor_item_t *array;
+
+	check_item(cbor_build_uint8(0));
+	check_item(cbor_build_uint8(23));
+	check_item(cbor_build_uint8(24));
+	check_item(cbor_build_uint16(5));
+	check_item(cbor_build_uint32(0x10000));
+	check_item(cbor_build_uint64(7));
+	check_item(cbor_build_negint8(6));
+	check_item(cbor_build_negint16(256));
+	check_item(cbor_build_negint32(1));
+	check_item(cbor_build_negint64(UINT64_MAX));
+	check_item(cbor_build_bool(true));
+	check_item(cbor_build_bool(false));
+	check_item(cbor_build_bytestring(big, 0));
+	check_item(cbor_build_bytestring(big, 300));
+	check_item(cbor_build_string("hmac-secret"));
+	check_item(pair_map(cbor_build_uint8(1), cbor_build_string("x")));
+
+	assert((array = cbor_new_definite_array(3)) != NULL);
+	assert(cbor_array_push(array, cbor_move(cbor_build_uint16(1))));
+	assert(cbor_array_push(array, cbor_move(pair_map(cbor_build_uint8(2),
+	    cbor_build_bool(false)))));
+	assert(cbor_array_push(array, cbor_move(cbor_new_definite_array(0))));
+	check_item(array);
+}
+
+static void
+makecred(void)
+{
+	fido_cred_t	*cred;
+	cbor_item_t	*pin_auth, *pin_opt;
+	char		*name;
+
+	assert((pin_auth = cbor_build_bytestring(cdh, 16)) != NULL);
+	assert((pin_opt = cbor_build_uint8(2)) != NULL);
+	assert((name = long_string(65536)) != NULL);
+	assert((cred = fido_cred_new()) != NULL);
+
+	/* minimal */
+	assert(fido_cred_set_clientdata_hash(cred, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(cred, "localhost", NULL) == FIDO_OK);
+	assert(fido_cred_set_user(cred, NULL, 0, NULL, NULL, NULL) == FIDO_OK);
+	assert(fido_cred_set_type(cred, COSE_ES256) == FIDO_OK);
+	check_makecred(cred, FIDO_OPT_OMIT, NULL, NULL);
+	check_makecred(cred, FIDO_OPT_TRUE, NULL, NULL);
+
+	/* everything */
+	assert(fido_cred_set_rp(cred, "localhost", "Local Host") == FIDO_OK);
+	assert(fido_cred_set_user(cred, user_id, sizeof(user_id), "john smith",
+	    "jsmith", "https://example.com/icon.png") == FIDO_OK);
+	cred->type = COSE_RS256; /* fido_cred_set_type() only sets it once */
+	assert(fido_cred_exclude(cred, user_id, sizeof(user_id)) == FIDO_OK);
+	assert(fido_cred_exclude(cred, big, 300) == FIDO_OK);
+	assert(fido_cred_exclude(cred, big, sizeof(big)) == FIDO_OK);
+	assert(fido_cred_set_extensions(cred, FIDO_EXT_HMAC_SECRET |
+	    FIDO_EXT_LARGEBLOB_KEY) == FIDO_OK);
+	assert(fido_cred_set_prot(cred,
+	    FIDO_CRED_PROT_UV_REQUIRED) == FIDO_OK);
+	assert(fido_cred_set_blob(cred, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_pin_minlen(cred, 4) == FIDO_OK);
+	assert(fido_cred_set_rk(cred, FIDO_OPT_TRUE) == FIDO_OK);
+	check_makecred(cred, FIDO_OPT_FALSE, NULL, NULL);
+	check_makecred(cred, FIDO_OPT_OMIT, pin_auth, pin_opt);
+
+	/* long strings */
+	assert(fido_cred_set_user(cred, big, sizeof(big), name, name + 65280,
+	    NULL) == FIDO_OK);
+	cred->type = COSE_EDDSA;
+	check_makecred(cred, FIDO_OPT_OMIT, NULL, NULL);
+
+	/* what neither can encode */
+	cred->ext.prot = UINT8_MAX + 1;
+	refuse_makecred(cred);
+	cred->ext.prot = FIDO_CRED_PROT_UV_REQUIRED;
+	cred->type = 1;
+	refuse_makecred(cred);
+
+	fido_cred_free(&cred);
+	free(name);
+	cbor_decref(&pin_auth);
+	cbor_decref(&pin_opt);
+}
+
+static void
+get_assert(void)
+{
+	fido_assert_t	*a;
+	cbor_item_t	*hmac_secret, *pin_auth, *pin_opt;
+
+	assert((hmac_secret = pair_map(cbor_build_uint8(1),
+	    pair_map(cbor_build_negint8(0), cbor_build_bytestring(big,
+	    48)))) != NULL);
+	assert((pin_auth = cbor_build_bytestring(cdh, sizeof(cdh))) != NULL);
+	assert((pin_opt = cbor_build_uint8(1)) != NULL);
+	assert((a = fido_assert_new()) != NULL);
+
+	/* minimal */
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, "localhost") == FIDO_OK);
+	check_get_assert(a, FIDO_OPT_OMIT, NULL, NULL, NULL);
+
+	/* everything */
+	assert(fido_assert_allow_cred(a, user_id, sizeof(user_id)) == FIDO_OK);
+	assert(fido_assert_allow_cred(a, big, 24) == FIDO_OK);
+	assert(fido_assert_set_extensions(a, FIDO_EXT_CRED_BLOB |
+	    FIDO_EXT_HMAC_SECRET | FIDO_EXT_LARGEBLOB_KEY) == FIDO_OK);
+	assert(fido_assert_set_up(a, FIDO_OPT_FALSE) == FIDO_OK);
+	check_get_assert(a, FIDO_OPT_TRUE, hmac_secret, NULL, NULL);
+	check_get_assert(a, FIDO_OPT_OMIT, hmac_secret, pin_auth, pin_opt);
+
+	/* hmac-secret without its parameters */
+	refuse_get_assert(a);
+
+	fido_assert_free(&a);
+	cbor_decref(&hmac_secret);
+	cbor_decref(&pin_auth);
+	cbor_decref(&pin_opt);
+}
+
+int
+main(void)
+{
+	fido_init(0);
+
+	memset(big, 0xa5, sizeof(big));
+
+	items();
+	makecred();
+	get_assert();
+
+	exit(0);
+}
@@ -211,6 +211,38 @@ reopen(void)
 	wiredata_clear(&wiredata);
 }
 
+/* custom i/o from a fido_dev_info_t isn't asked for HID report lengths */
+static void
+new_with_info(void)
+{
+	const uint8_t	 cbor_info_data[] = { WIREDATA_CTAP_CBOR_INFO };
+	uint8_t		*wiredata;
+	fido_dev_info_t	*devlist;
+	fido_dev_t	*dev = NULL;
+	fido_dev_io_t	 io;
+
+	memset(&io, 0, sizeof(io));
+
+	io.open = dummy_open;
+	io.close = dummy_close;
+	io.read = dummy_read;
+	io.write = dummy_write;
+
+	assert((devlist = fido_dev_info_new(1)) != NULL);
+	assert(fido_dev_info_set(devlist, 0, "dummy", "manufacturer",
+	    "product", &io, NULL) == FIDO_OK);
+
+	wiredata = wiredata_setup(cbor_info_data, sizeof(cbor_info_data));
+	assert((dev = fido_dev_new_with_info(devlist)) != NULL);
+	assert(fido_dev_open_with_info(dev) == FIDO_OK);
+	assert(fido_dev_is_fido2(dev));
+	assert(fido_dev_close(dev) == FIDO_OK);
+	fido_dev_free(&dev);
+	wiredata_clear(&wiredata);
+
+	fido_dev_info_free(&devlist, 1);
+}
+
 static void
 double_open(void)
 {
@@ -420,6 +452,72 @@ timeout_misc(void)
 	fido_dev_free(&dev);
 }
 
+static void
+manifest(void)
+{
+	fido_dev_info_t	*devlist, *devlist2;
+	size_t		 ndevs, ndevs2;
+
+	assert((devlist = fido_dev_info_new(64)) != NULL);
+	assert((devlist2 = fido_dev_info_new(64)) != NULL);
+	assert(fido_dev_info_manifest_ms(devlist, 64, &ndevs,
+	    -2) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_info_manifest_ms(NULL, 0, &ndevs, 0) == FIDO_OK);
+	assert(ndevs == 0);
+	assert(fido_dev_info_manifest(devlist, 64, &ndevs) == FIDO_OK);
+	assert(fido_dev_info_manifest_ms(devlist2, 64, &ndevs2,
+	    -1) == FIDO_OK);
+	assert(ndevs == ndevs2);
+	fido_dev_info_free(&devlist2, 64);
+	assert((devlist2 = fido_dev_info_new(64)) != NULL);
+	assert(fido_dev_info_manifest_ms(devlist2, 64, &ndevs2, 0) == FIDO_OK);
+	assert(ndevs2 <= ndevs);
+	fido_dev_info_free(&devlist, 64);
+	fido_dev_info_free(&devlist2, 64);
+}
+
+static void
+registry(void)
+{
+	fido_dev_registry_t	*reg;
+	fido_dev_info_t		*devlist, *devlist2;
+	size_t			 ndevs, ndevs2;
+
+	if ((reg = fido_dev_registry_new()) == NULL)
+		return; /* no hotplug monitor */
+
+	assert(fido_dev_registry_pollfd(reg) >= 0);
+	assert(fido_dev_registry_update(reg) == FIDO_OK);
+	assert(fido_dev_registry_manifest(reg, NULL, 0, &ndevs) == FIDO_OK);
+	assert(ndevs == 0);
+
+	assert((devlist = fido_dev_info_new(64)) != NULL);
+	assert((devlist2 = fido_dev_info_new(64)) != NULL);
+	assert(fido_dev_registry_manifest(reg, devlist, 64, &ndevs) == FIDO_OK);
+	assert(fido_dev_info_manifest(devlist2, 64, &ndevs2) == FIDO_OK);
+	assert(ndevs == ndevs2);
+	for (size_t i = 0; i < ndevs; i++)
+		assert(strcmp(fido_dev_info_path(&devlist[i]),
+		    fido_dev_info_path(&devlist2[i])) == 0);
+
+	fido_dev_info_free(&devlist, 64);
+	fido_dev_info_free(&devlist2, 64);
+	fido_dev_registry_free(&reg);
+	assert(reg == NULL);
+}
+
+static void
+nfc_reader(void)
+{
+	fido_nfc_reader_t *reader = NULL;
+
+	fido_nfc_reader_free(NULL);
+	fido_nfc_reader_free(&reader);
+	assert(fido_nfc_reader_new(NULL) == NULL);
+	assert(fido_nfc_reader_new("/dev/hidraw0") == NULL);
+	assert(fido_nfc_reader_new("nfc:/sys/devices/nonexistent") == NULL);
+}
+
 int
 main(void)
 {
@@ -427,6 +525,7 @@ main(void)
 
 	open_iff_ok();
 	reopen();
+	new_with_info();
 	double_open();
 	double_close();
 	is_fido2();
@@ -434,6 +533,9 @@ main(void)
 	timeout_rx();
 	timeout_ok();
 	timeout_misc();
+	manifest();
+	registry();
+	nfc_reader();
 
 	exit(0);
 }
@@ -0,0 +1,2142 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include <openssl/crypto.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#define _FIDO_INTERNAL
+
+#include <fido.h>
+#include <fido/es256.h>
+
+#include "vauth.h"
+
+#define VAUTH_REPORT_LEN	CTAP_MAX_REPORT_LEN
+#define VAUTH_MAXMSG		(CTAP_MAX_REPORT_LEN - CTAP_INIT_HEADER_LEN + \
+				 128 * (CTAP_MAX_REPORT_LEN - CTAP_CONT_HEADER_LEN))
+#define VAUTH_MAXMSGSIZE	1200
+#define VAUTH_MAXCRED		256	/* resident and non-resident */
+#define VAUTH_MAXRK		64	/* resident only */
+#define VAUTH_MAXCREDLIST	8
+#define VAUTH_CRED_ID_LEN	32
+#define VAUTH_MAXLBLOB		4096
+#define VAUTH_PIN_RETRIES	8
+
+#define CTAP_CBOR_CRED_MGMT		0x0a
+
+#define SW_WRONG_LENGTH			0x6700
+#define SW_INS_NOT_SUPPORTED		0x6d00
+
+#define CTAP2_ERR_INTEGRITY_FAILURE	0x3c
+#define CTAP2_ERR_INVALID_SUBCOMMAND	0x3e
+
+struct vauth_cred {
+	bool		 used;
+	bool		 rk;
+	uint8_t		 prot;		/* credProtect, or 0 */
+	uint64_t	 seq;		/* creation order */
+	unsigned char	 id[VAUTH_CRED_ID_LEN];
+	unsigned char	 rp_hash[SHA256_DIGEST_LENGTH];
+	char		*rp_id;
+	char		*rp_name;
+	unsigned char	*user_id;
+	size_t		 user_id_len;
+	char		*user_name;
+	char		*user_display_name;
+	EVP_PKEY	*key;
+};
+
+struct vauth_iter {
+	size_t		 idx[VAUTH_MAXCRED];
+	size_t		 n;
+	size_t		 pos;
+};
+
+struct vauth {
+	struct vauth	*next;		/* registry */
+	char		*path;
+	unsigned char	 aaguid[16];
+	uint32_t	 next_cid;
+	uint8_t		 version[3];	/* major, minor, build */
+	uint32_t	 sign_count;
+	uint64_t	 seq;
+	uint64_t	 cbor_count;
+	uint64_t	 write_count;
+	uint64_t	 writev_count;
+	bool		 hold;		/* withhold replies */
+	bool		 absent;	/* no user to touch it */
+	struct vauth_handle *parked;	/* waiting for a touch */
+	struct vauth_handle *handles;	/* open handles */
+	bool		 unplugged;
+	uint64_t	 plug_gen;	/* bumped on unplug */
+	unsigned int	 keepalives;	/* sent before up-gated replies */
+	unsigned int	 u2f_refusals;	/* U2F signatures refused for now */
+	struct vauth_cred cred[VAUTH_MAXCRED];
+	/* clientPin, protocol 1 */
+	EVP_PKEY	*ka;		/* key agreement key */
+	unsigned char	 token[32];	/* pin token */
+	bool		 pin_set;
+	unsigned char	 pin_hash[16];
+	int		 pin_retries;
+	/* getNextAssertion */
+	struct vauth_iter assert_it;
+	unsigned char	 assert_cdh[SHA256_DIGEST_LENGTH];
+	uint8_t		 assert_flags;
+	/* credential management */
+	struct vauth_iter rp_it;
+	struct vauth_iter rk_it;
+	/* large blobs */
+	unsigned char	 lblob[VAUTH_MAXLBLOB];
+	size_t		 lblob_len;
+	unsigned char	 lblob_new[VAUTH_MAXLBLOB];
+	size_t		 lblob_new_len;
+	size_t		 lblob_new_off;
+};
+
+struct vauth_handle {
+	struct vauth	*va;
+	struct vauth_handle *next;	/* va->handles */
+	/* request reassembly */
+	bool		 busy;
+	uint32_t	 cid;
+	uint8_t		 cmd;
+	uint8_t		 seq;
+	size_t		 len;
+	size_t		 off;
+	unsigned char	 msg[VAUTH_MAXMSG];
+	/* pending reports */
+	unsigned char	*out;
+	size_t		 out_len;
+	size_t		 out_off;
+	int		 pipe[2];	/* one byte per pending report */
+	bool		 woken;		/* vauth_wakeup() pending */
+	uint64_t	 plug_gen;	/* va->plug_gen when opened */
+};
+
+static struct vauth *vauth_list;
+
+/*
+ * CBOR helpers.
+ */
+
+static const cbor_item_t *
+map_get(const cbor_item_t *map, int64_t k)
+{
+	const struct cbor_pair	*v;
+	size_t			 n;
+
+	if (map == NULL || !cbor_isa_map(map) || !cbor_map_is_definite(map))
+		return (NULL);
+
+	v = cbor_map_handle(map);
+	n = cbor_map_size(map);
+
+	for (size_t i = 0; i < n; i++) {
+		if (k >= 0 && cbor_isa_uint(v[i].key) &&
+		    cbor_get_int(v[i].key) == (uint64_t)k)
+			return (v[i].value);
+		if (k < 0 && cbor_isa_negint(v[i].key) &&
+		    cbor_get_int(v[i].key) == (uint64_t)(-(k + 1)))
+			return (v[i].value);
+	}
+
+	return (NULL);
+}
+
+static const cbor_item_t *
+map_get_str(const cbor_item_t *map, const char *k)
+{
+	const struct cbor_pair	*v;
+	size_t			 n;
+
+	if (map == NULL || !cbor_isa_map(map) || !cbor_map_is_definite(map))
+		return (NULL);
+
+	v = cbor_map_handle(map);
+	n = cbor_map_size(map);
+
+	for (size_t i = 0; i < n; i++)
+		if (cbor_isa_string(v[i].key) &&
+		    cbor_string_is_definite(v[i].key) &&
+		    cbor_string_length(v[i].key) == strlen(k) &&
+		    memcmp(cbor_string_handle(v[i].key), k, strlen(k)) == 0)
+			return (v[i].value);
+
+	return (NULL);
+}
+
+static int
+get_bytes(const cbor_item_t *item, const unsigned char **ptr, size_t *len)
+{
+	if (item == NULL || !cbor_isa_bytestring(item) ||
+	    !cbor_bytestring_is_definite(item))
+		return (-1);
+
+	*ptr = cbor_bytestring_handle(item);
+	*len = cbor_bytestring_length(item);
+
+	return (0);
+}
+
+static int
+get_uint(const cbor_item_t *item, uint64_t *v)
+{
+	if (item == NULL || !cbor_isa_uint(item))
+		return (-1);
+
+	*v = cbor_get_int(item);
+
+	return (0);
+}
+
+static int
+get_bool(const cbor_item_t *item, bool *v)
+{
+	if (item == NULL || !cbor_isa_float_ctrl(item) || !cbor_is_bool(item))
+		return (-1);
+
+	*v = cbor_get_bool(item);
+
+	return (0);
+}
+
+static char *
+dup_string(const cbor_item_t *item)
+{
+	char	*s;
+	size_t	 len;
+
+	if (item == NULL || !cbor_isa_string(item) ||
+	    !cbor_string_is_definite(item))
+		return (NULL);
+
+	len = cbor_string_length(item);
+	if ((s = calloc(1, len + 1)) == NULL)
+		return (NULL);
+	memcpy(s, cbor_string_handle(item), len);
+
+	return (s);
+}
+
+/* adds (k, v) to map, consuming both references */
+static int
+put(cbor_item_t *map, cbor_item_t *k, cbor_item_t *v)
+{
+	struct cbor_pair	pair;
+	bool			ok = false;
+
+	if (k != NULL && v != NULL) {
+		pair.key = k;
+		pair.value = v;
+		ok = cbor_map_add(map, pair);
+	}
+	if (k != NULL)
+		cbor_decref(&k);
+	if (v != NULL)
+		cbor_decref(&v);
+
+	return (ok ? 0 : -1);
+}
+
+static int
+put_uint(cbor_item_t *map, uint8_t k, cbor_item_t *v)
+{
+	return (put(map, cbor_build_uint8(k), v));
+}
+
+static int
+put_str(cbor_item_t *map, const char *k, cbor_item_t *v)
+{
+	return (put(map, cbor_build_string(k), v));
+}
+
+/*
+ * Crypto helpers.
+ */
+
+static EVP_PKEY *
+ec_keygen(void)
+{
+	EVP_PKEY_CTX	*ctx;
+	EVP_PKEY	*pkey = NULL;
+
+	if ((ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL)) == NULL ||
+	    EVP_PKEY_keygen_init(ctx) <= 0 ||
+	    EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx,
+	    NID_X9_62_prime256v1) <= 0 || EVP_PKEY_keygen(ctx, &pkey) <= 0)
+		pkey = NULL;
+
+	EVP_PKEY_CTX_free(ctx);
+
+	return (pkey);
+}
+
+static cbor_item_t *
+encode_cose(const EVP_PKEY *pkey, int alg)
+{
+	es256_pk_t	*pk;
+	cbor_item_t	*item = NULL;
+
+	if ((pk = es256_pk_new()) == NULL ||
+	    es256_pk_from_EVP_PKEY(pk, pkey) != FIDO_OK ||
+	    (item = cbor_new_definite_map(5)) == NULL)
+		goto fail;
+
+	if (put_uint(item, 1, cbor_build_uint8(COSE_KTY_EC2)) < 0 ||
+	    put_uint(item, 3, cbor_build_negint8((uint8_t)(-alg - 1))) < 0 ||
+	    put(item, cbor_build_negint8(0), cbor_build_uint8(COSE_P256)) < 0 ||
+	    put(item, cbor_build_negint8(1), cbor_build_bytestring(pk->x,
+	    sizeof(pk->x))) < 0 ||
+	    put(item, cbor_build_negint8(2), cbor_build_bytestring(pk->y,
+	    sizeof(pk->y))) < 0) {
+		cbor_decref(&item);
+		goto fail;
+	}
+fail:
+	es256_pk_free(&pk);
+
+	return (item);
+}
+
+static EVP_PKEY *
+decode_cose(const cbor_item_t *item)
+{
+	unsigned char		 buf[65];
+	const unsigned char	*x, *y;
+	size_t			 x_len, y_len;
+	es256_pk_t		*pk;
+	EVP_PKEY		*pkey = NULL;
+
+	if (get_bytes(map_get(item, -2), &x, &x_len) < 0 || x_len != 32 ||
+	    get_bytes(map_get(item, -3), &y, &y_len) < 0 || y_len != 32)
+		return (NULL);
+
+	buf[0] = 0x04;
+	memcpy(&buf[1], x, 32);
+	memcpy(&buf[33], y, 32);
+
+	if ((pk = es256_pk_new()) != NULL &&
+	    es256_pk_from_ptr(pk, buf, sizeof(buf)) == FIDO_OK)
+		pkey = es256_pk_to_EVP_PKEY(pk);
+
+	es256_pk_free(&pk);
+
+	return (pkey);
+}
+
+/* protocol 1: sha256 of the ecdh x-coordinate */
+static int
+shared_secret(const struct vauth *va, const cbor_item_t *cose,
+    unsigned char *key)
+{
+	EVP_PKEY	*peer;
+	EVP_PKEY_CTX	*ctx = NULL;
+	unsigned char	 z[32];
+	size_t		 z_len = sizeof(z);
+	int		 ok = -1;
+
+	if ((peer = decode_cose(cose)) == NULL)
+		return (-1);
+
+	if ((ctx = EVP_PKEY_CTX_new(va->ka, NULL)) == NULL ||
+	    EVP_PKEY_derive_init(ctx) <= 0 ||
+	    EVP_PKEY_derive_set_peer(ctx, peer) <= 0 ||
+	    EVP_PKEY_derive(ctx, z, &z_len) <= 0 || z_len != sizeof(z) ||
+	    SHA256(z, sizeof(z), key) != key)
+		goto fail;
+
+	ok = 0;
+fail:
+	EVP_PKEY_CTX_free(ctx);
+	EVP_PKEY_free(peer);
+	OPENSSL_cleanse(z, sizeof(z));
+
+	return (ok);
+}
+
+static int
+aes_cbc(const unsigned char *key, const unsigned char *in, size_t len,
+    unsigned char *out, int enc)
+{
+	EVP_CIPHER_CTX	*ctx;
+	unsigned char	 iv[16];
+	int		 n, ok = -1;
+
+	memset(iv, 0, sizeof(iv));
+
+	if (len % 16 != 0 || len > INT_MAX)
+		return (-1);
+
+	if ((ctx = EVP_CIPHER_CTX_new()) != NULL &&
+	    EVP_CipherInit_ex(ctx, EVP_aes_256_cbc(), NULL, key, iv, enc) == 1 &&
+	    EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+	    EVP_CipherUpdate(ctx, out, &n, in, (int)len) == 1 &&
+	    (size_t)n == len)
+		ok = 0;
+
+	EVP_CIPHER_CTX_free(ctx);
+
+	return (ok);
+}
+
+/* protocol 1: left 16 bytes of hmac-sha256 */
+static bool
+auth_ok(const unsigned char *key, size_t key_len, const unsigned char *data,
+    size_t data_len, const cbor_item_t *auth)
+{
+	unsigned char		 dgst[SHA256_DIGEST_LENGTH];
+	unsigned int		 dgst_len;
+	const unsigned char	*ptr;
+	size_t			 len;
+
+	if (get_bytes(auth, &ptr, &len) < 0 || len != 16)
+		return (false);
+	if (HMAC(EVP_sha256(), key, (int)key_len, data, data_len, dgst,
+	    &dgst_len) == NULL || dgst_len != sizeof(dgst))
+		return (false);
+
+	return (CRYPTO_memcmp(dgst, ptr, 16) == 0);
+}
+
+static cbor_item_t *
+sign(EVP_PKEY *key, const unsigned char *a, size_t a_len,
+    const unsigned char *b, size_t b_len)
+{
+	EVP_MD_CTX	*ctx;
+	unsigned char	 sig[128];
+	size_t		 sig_len = sizeof(sig);
+	cbor_item_t	*item = NULL;
+
+	if ((ctx = EVP_MD_CTX_new()) != NULL &&
+	    EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, key) == 1 &&
+	    EVP_DigestSignUpdate(ctx, a, a_len) == 1 &&
+	    EVP_DigestSignUpdate(ctx, b, b_len) == 1 &&
+	    EVP_DigestSignFinal(ctx, sig, &sig_len) == 1)
+		item = cbor_build_bytestring(sig, sig_len);
+
+	EVP_MD_CTX_free(ctx);
+
+	return (item);
+}
+
+/*
+ * Authenticator state.
+ */
+
+static void
+cred_reset(struct vauth_cred *c)
+{
+	free(c->rp_id);
+	free(c->rp_name);
+	free(c->user_id);
+	free(c->user_name);
+	free(c->user_display_name);
+	EVP_PKEY_free(c->key);
+	memset(c, 0, sizeof(*c));
+}
+
+static size_t
+rk_count(const struct vauth *va)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++)
+		if (va->cred[i].used && va->cred[i].rk)
+			n++;
+
+	return (n);
+}
+
+/* picks a free slot, evicting the oldest non-resident credential if needed */
+static struct vauth_cred *
+cred_alloc(struct vauth *va)
+{
+	struct vauth_cred *c = NULL;
+
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++) {
+		if (!va->cred[i].used)
+			return (&va->cred[i]);
+		if (!va->cred[i].rk && (c == NULL || va->cred[i].seq < c->seq))
+			c = &va->cred[i];
+	}
+	if (c != NULL)
+		cred_reset(c);
+
+	return (c);
+}
+
+static struct vauth_cred *
+cred_find(struct vauth *va, const unsigned char *rp_hash,
+    const cbor_item_t *desc)
+{
+	const unsigned char	*id;
+	size_t			 id_len;
+
+	if (get_bytes(map_get_str(desc, "id"), &id, &id_len) < 0 ||
+	    id_len != VAUTH_CRED_ID_LEN)
+		return (NULL);
+
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++) {
+		struct vauth_cred *c = &va->cred[i];
+		if (c->used && memcmp(c->id, id, id_len) == 0 &&
+		    (rp_hash == NULL || memcmp(c->rp_hash, rp_hash,
+		    sizeof(c->rp_hash)) == 0))
+			return (c);
+	}
+
+	return (NULL);
+}
+
+/* Whether c may be found through an allow or exclude list. */
+static bool
+cred_visible(const struct vauth_cred *c, bool uv)
+{
+	return (c->prot < FIDO_CRED_PROT_UV_REQUIRED || uv);
+}
+
+/* resident credentials matching rp_hash (or all if NULL), newest first */
+static void
+rk_collect(const struct vauth *va, const unsigned char *rp_hash,
+    struct vauth_iter *it)
+{
+	memset(it, 0, sizeof(*it));
+
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++) {
+		const struct vauth_cred *c = &va->cred[i];
+		size_t j;
+		if (!c->used || !c->rk || (rp_hash != NULL &&
+		    memcmp(c->rp_hash, rp_hash, sizeof(c->rp_hash)) != 0))
+			continue;
+		for (j = it->n; j > 0 && va->cred[it->idx[j - 1]].seq <
+		    c->seq; j--)
+			it->idx[j] = it->idx[j - 1];
+		it->idx[j] = i;
+		it->n++;
+	}
+}
+
+static void
+lblob_reset(struct vauth *va)
+{
+	va->lblob[0] = 0x80; /* empty cbor array */
+	SHA256(va->lblob, 1, &va->lblob[1]);
+	va->lblob_len = 1 + 16;
+	va->lblob_new_len = 0;
+	va->lblob_new_off = 0;
+}
+
+static int
+vauth_reset(struct vauth *va)
+{
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++)
+		cred_reset(&va->cred[i]);
+
+	EVP_PKEY_free(va->ka);
+	memset(&va->assert_it, 0, sizeof(va->assert_it));
+	memset(&va->rp_it, 0, sizeof(va->rp_it));
+	memset(&va->rk_it, 0, sizeof(va->rk_it));
+	va->pin_set = false;
+	va->pin_retries = VAUTH_PIN_RETRIES;
+	lblob_reset(va);
+
+	if ((va->ka = ec_keygen()) == NULL ||
+	    RAND_bytes(va->token, sizeof(va->token)) != 1)
+		return (-1);
+
+	return (0);
+}
+
+/*
+ * pinAuth handling shared by makeCredential, getAssertion, credMgmt and
+ * largeBlobs. Sets *uv if a valid pinAuth over data was supplied.
+ */
+static int
+check_pin_auth(const struct vauth *va, const unsigned char *data,
+    size_t data_len, const cbor_item_t *auth, const cbor_item_t *prot,
+    bool *uv)
+{
+	uint64_t p;
+
+	*uv = false;
+
+	if (auth == NULL)
+		return (FIDO_OK);
+	if (get_uint(prot, &p) < 0)
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (p != CTAP_PIN_PROTOCOL1)
+		return (FIDO_ERR_INVALID_PARAMETER);
+	if (!va->pin_set)
+		return (FIDO_ERR_PIN_NOT_SET);
+	if (!auth_ok(va->token, sizeof(va->token), data, data_len, auth))
+		return (FIDO_ERR_PIN_AUTH_INVALID);
+
+	*uv = true;
+
+	return (FIDO_OK);
+}
+
+/*
+ * authenticatorGetInfo
+ */
+
+static int
+cmd_getinfo(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	cbor_item_t *m, *v = NULL, *o = NULL, *p = NULL, *a = NULL, *alg;
+
+	(void)req;
+
+	if ((m = cbor_new_definite_map(10)) == NULL ||
+	    (v = cbor_new_definite_array(3)) == NULL ||
+	    !cbor_array_push(v, cbor_move(cbor_build_string("FIDO_2_0"))) ||
+	    !cbor_array_push(v, cbor_move(cbor_build_string("FIDO_2_1_PRE"))) ||
+	    !cbor_array_push(v, cbor_move(cbor_build_string("FIDO_2_1"))) ||
+	    (o = cbor_new_definite_map(6)) == NULL ||
+	    put_str(o, "rk", cbor_build_bool(true)) < 0 ||
+	    put_str(o, "up", cbor_build_bool(true)) < 0 ||
+	    put_str(o, "plat", cbor_build_bool(false)) < 0 ||
+	    put_str(o, "credMgmt", cbor_build_bool(true)) < 0 ||
+	    put_str(o, "clientPin", cbor_build_bool(va->pin_set)) < 0 ||
+	    put_str(o, "largeBlobs", cbor_build_bool(true)) < 0 ||
+	    (p = cbor_new_definite_array(1)) == NULL ||
+	    !cbor_array_push(p, cbor_move(cbor_build_uint8(
+	    CTAP_PIN_PROTOCOL1))) ||
+	    (a = cbor_new_definite_array(1)) == NULL ||
+	    (alg = cbor_new_definite_map(2)) == NULL)
+		goto fail;
+	if (put_str(alg, "alg", cbor_build_negint8(-COSE_ES256 - 1)) < 0 ||
+	    put_str(alg, "type", cbor_build_string("public-key")) < 0 ||
+	    !cbor_array_push(a, alg)) {
+		cbor_decref(&alg);
+		goto fail;
+	}
+	cbor_decref(&alg);
+
+	if (put_uint(m, 1, v) < 0 ||
+	    put_uint(m, 2, cbor_new_definite_array(0)) < 0 ||
+	    put_uint(m, 3, cbor_build_bytestring(va->aaguid,
+	    sizeof(va->aaguid))) < 0 ||
+	    put_uint(m, 4, o) < 0 ||
+	    put_uint(m, 5, cbor_build_uint16(VAUTH_MAXMSGSIZE)) < 0 ||
+	    put_uint(m, 6, p) < 0 ||
+	    put_uint(m, 7, cbor_build_uint8(VAUTH_MAXCREDLIST)) < 0 ||
+	    put_uint(m, 8, cbor_build_uint8(VAUTH_CRED_ID_LEN)) < 0 ||
+	    put_uint(m, 10, a) < 0 ||
+	    put_uint(m, 11, cbor_build_uint16(VAUTH_MAXLBLOB)) < 0) {
+		/* put() consumed v, o, p, a */
+		cbor_decref(&m);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	*resp = m;
+
+	return (FIDO_OK);
+fail:
+	if (m != NULL)
+		cbor_decref(&m);
+	if (v != NULL)
+		cbor_decref(&v);
+	if (o != NULL)
+		cbor_decref(&o);
+	if (p != NULL)
+		cbor_decref(&p);
+	if (a != NULL)
+		cbor_decref(&a);
+
+	return (FIDO_ERR_INTERNAL);
+}
+
+/*
+ * authenticatorMakeCredential
+ */
+
+static bool
+has_es256(const cbor_item_t *params)
+{
+	cbor_item_t **v;
+
+	if (params == NULL || !cbor_isa_array(params) ||
+	    !cbor_array_is_definite(params))
+		return (false);
+
+	v = cbor_array_handle(params);
+
+	for (size_t i = 0; i < cbor_array_size(params); i++) {
+		const cbor_item_t *alg = map_get_str(v[i], "alg");
+		if (alg != NULL && cbor_isa_negint(alg) &&
+		    cbor_get_int(alg) == (uint64_t)(-COSE_ES256 - 1))
+			return (true);
+	}
+
+	return (false);
+}
+
+static int
+get_options(const cbor_item_t *opt, bool *rk, bool *up, bool *uv)
+{
+	const cbor_item_t *v;
+
+	if (opt == NULL)
+		return (FIDO_OK);
+	if (!cbor_isa_map(opt))
+		return (FIDO_ERR_CBOR_UNEXPECTED_TYPE);
+	if ((v = map_get_str(opt, "rk")) != NULL &&
+	    (rk == NULL || get_bool(v, rk) < 0))
+		return (FIDO_ERR_INVALID_OPTION);
+	if ((v = map_get_str(opt, "up")) != NULL &&
+	    (up == NULL || get_bool(v, up) < 0))
+		return (FIDO_ERR_INVALID_OPTION);
+	if ((v = map_get_str(opt, "uv")) != NULL && (get_bool(v, uv) < 0))
+		return (FIDO_ERR_INVALID_OPTION);
+	if (*uv)
+		return (FIDO_ERR_UNSUPPORTED_OPTION); /* no built-in uv */
+
+	return (FIDO_OK);
+}
+
+static int
+set_user(struct vauth_cred *c, const cbor_item_t *user)
+{
+	const unsigned char	*id;
+	size_t			 id_len;
+	const cbor_item_t	*v;
+
+	if (get_bytes(map_get_str(user, "id"), &id, &id_len) < 0 ||
+	    id_len == 0 || id_len > 64)
+		return (-1);
+
+	free(c->user_id);
+	free(c->user_name);
+	free(c->user_display_name);
+	c->user_id = NULL;
+	c->user_name = NULL;
+	c->user_display_name = NULL;
+
+	if ((c->user_id = malloc(id_len)) == NULL)
+		return (-1);
+	memcpy(c->user_id, id, id_len);
+	c->user_id_len = id_len;
+
+	if ((v = map_get_str(user, "name")) != NULL &&
+	    (c->user_name = dup_string(v)) == NULL)
+		return (-1);
+	if ((v = map_get_str(user, "displayName")) != NULL &&
+	    (c->user_display_name = dup_string(v)) == NULL)
+		return (-1);
+
+	return (0);
+}
+
+static cbor_item_t *
+encode_user(const struct vauth_cred *c, bool full)
+{
+	cbor_item_t *m;
+
+	if ((m = cbor_new_definite_map(3)) == NULL)
+		return (NULL);
+	if (put_str(m, "id", cbor_build_bytestring(c->user_id,
+	    c->user_id_len)) < 0 ||
+	    (full && c->user_name != NULL && put_str(m, "name",
+	    cbor_build_string(c->user_name)) < 0) ||
+	    (full && c->user_display_name != NULL && put_str(m,
+	    "displayName", cbor_build_string(c->user_display_name)) < 0))
+		cbor_decref(&m);
+
+	return (m);
+}
+
+static cbor_item_t *
+encode_cred_id(const struct vauth_cred *c)
+{
+	cbor_item_t *m;
+
+	if ((m = cbor_new_definite_map(2)) == NULL)
+		return (NULL);
+	if (put_str(m, "id", cbor_build_bytestring(c->id,
+	    sizeof(c->id))) < 0 ||
+	    put_str(m, "type", cbor_build_string("public-key")) < 0)
+		cbor_decref(&m);
+
+	return (m);
+}
+
+static void
+put_be32(unsigned char *p, uint32_t v)
+{
+	p[0] = (unsigned char)(v >> 24);
+	p[1] = (unsigned char)(v >> 16);
+	p[2] = (unsigned char)(v >> 8);
+	p[3] = (unsigned char)v;
+}
+
+static cbor_item_t *
+makecred_reply(struct vauth *va, const struct vauth_cred *c, uint8_t flags,
+    const unsigned char *cdh, size_t cdh_len)
+{
+	cbor_item_t	*cose = NULL, *m = NULL, *att = NULL, *ext = NULL;
+	unsigned char	*cose_ptr = NULL, *ext_ptr = NULL, *ad = NULL;
+	size_t		 cose_len, cose_alloc, ext_len = 0, ext_alloc, ad_len;
+
+	if ((cose = encode_cose(c->key, COSE_ES256)) == NULL ||
+	    (cose_len = cbor_serialize_alloc(cose, &cose_ptr,
+	    &cose_alloc)) == 0)
+		goto fail;
+	if (c->prot != 0) {
+		if ((ext = cbor_new_definite_map(1)) == NULL ||
+		    put_str(ext, "credProtect", cbor_build_uint8(c->prot)) < 0 ||
+		    (ext_len = cbor_serialize_alloc(ext, &ext_ptr,
+		    &ext_alloc)) == 0)
+			goto fail;
+		flags |= CTAP_AUTHDATA_EXT_DATA;
+	}
+
+	/*
+	 * rpIdHash | flags | signCount | aaguid | credIdLen | credId | key |
+	 * extensions
+	 */
+	ad_len = 32 + 1 + 4 + 16 + 2 + sizeof(c->id) + cose_len + ext_len;
+	if ((ad = malloc(ad_len)) == NULL)
+		goto fail;
+	memcpy(ad, c->rp_hash, 32);
+	ad[32] = flags | CTAP_AUTHDATA_ATT_CRED;
+	put_be32(&ad[33], ++va->sign_count);
+	memcpy(&ad[37], va->aaguid, 16);
+	ad[53] = 0;
+	ad[54] = sizeof(c->id);
+	memcpy(&ad[55], c->id, sizeof(c->id));
+	memcpy(&ad[55 + sizeof(c->id)], cose_ptr, cose_len);
+	if (ext_len != 0)
+		memcpy(&ad[55 + sizeof(c->id) + cose_len], ext_ptr, ext_len);
+
+	/* packed self attestation */
+	if ((att = cbor_new_definite_map(2)) == NULL ||
+	    put_str(att, "alg", cbor_build_negint8(-COSE_ES256 - 1)) < 0 ||
+	    put_str(att, "sig", sign(c->key, ad, ad_len, cdh, cdh_len)) < 0 ||
+	    (m = cbor_new_definite_map(3)) == NULL ||
+	    put_uint(m, 1, cbor_build_string("packed")) < 0 ||
+	    put_uint(m, 2, cbor_build_bytestring(ad, ad_len)) < 0) {
+		if (m != NULL)
+			cbor_decref(&m);
+		goto fail;
+	}
+	if (put_uint(m, 3, att) < 0) {
+		att = NULL;
+		cbor_decref(&m);
+		goto fail;
+	}
+	att = NULL;
+fail:
+	if (cose != NULL)
+		cbor_decref(&cose);
+	if (att != NULL)
+		cbor_decref(&att);
+	if (ext != NULL)
+		cbor_decref(&ext);
+	free(cose_ptr);
+	free(ext_ptr);
+	free(ad);
+
+	return (m);
+}
+
+/* The credProtect level in a makeCredential extensions map, or 0. */
+static int
+get_cred_protect(const cbor_item_t *ext, uint8_t *prot)
+{
+	const cbor_item_t	*v;
+	uint64_t		 p;
+
+	*prot = 0;
+
+	if (ext == NULL || (v = map_get_str(ext, "credProtect")) == NULL)
+		return (FIDO_OK);
+	if (get_uint(v, &p) < 0 || p < FIDO_CRED_PROT_UV_OPTIONAL ||
+	    p > FIDO_CRED_PROT_UV_REQUIRED)
+		return (FIDO_ERR_INVALID_OPTION);
+
+	*prot = (uint8_t)p;
+
+	return (FIDO_OK);
+}
+
+static int
+cmd_makecred(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	const cbor_item_t	*rp, *user, *excl;
+	const unsigned char	*cdh;
+	size_t			 cdh_len;
+	unsigned char		 rp_hash[SHA256_DIGEST_LENGTH];
+	struct vauth_cred	*c;
+	char			*rp_id = NULL;
+	bool			 rk = false, uv = false, pin_uv;
+	uint8_t			 prot;
+	int			 r;
+
+	if (get_bytes(map_get(req, 1), &cdh, &cdh_len) < 0 ||
+	    (rp = map_get(req, 2)) == NULL || (user = map_get(req, 3)) == NULL ||
+	    map_get(req, 4) == NULL)
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (!has_es256(map_get(req, 4)))
+		return (FIDO_ERR_UNSUPPORTED_ALGORITHM);
+	if ((r = get_options(map_get(req, 7), &rk, NULL, &uv)) != FIDO_OK ||
+	    (r = get_cred_protect(map_get(req, 6), &prot)) != FIDO_OK)
+		return (r);
+	if ((r = check_pin_auth(va, cdh, cdh_len, map_get(req, 8),
+	    map_get(req, 9), &pin_uv)) != FIDO_OK)
+		return (r);
+	if (va->pin_set && !pin_uv)
+		return (FIDO_ERR_PIN_REQUIRED);
+	if ((rp_id = dup_string(map_get_str(rp, "id"))) == NULL)
+		return (FIDO_ERR_MISSING_PARAMETER);
+
+	SHA256((const unsigned char *)rp_id, strlen(rp_id), rp_hash);
+
+	if ((excl = map_get(req, 5)) != NULL && cbor_isa_array(excl) &&
+	    cbor_array_is_definite(excl)) {
+		cbor_item_t **v = cbor_array_handle(excl);
+		if (cbor_array_size(excl) > VAUTH_MAXCREDLIST) {
+			free(rp_id);
+			return (FIDO_ERR_LIMIT_EXCEEDED);
+		}
+		for (size_t i = 0; i < cbor_array_size(excl); i++) {
+			const struct vauth_cred *x;
+			if ((x = cred_find(va, rp_hash, v[i])) != NULL &&
+			    cred_visible(x, pin_uv)) {
+				free(rp_id);
+				return (FIDO_ERR_CREDENTIAL_EXCLUDED);
+			}
+		}
+	}
+
+	if (rk && rk_count(va) >= VAUTH_MAXRK) {
+		free(rp_id);
+		return (FIDO_ERR_KEY_STORE_FULL);
+	}
+	if ((c = cred_alloc(va)) == NULL) {
+		free(rp_id);
+		return (FIDO_ERR_KEY_STORE_FULL);
+	}
+
+	c->used = true;
+	c->rk = rk;
+	c->prot = prot;
+	c->seq = ++va->seq;
+	c->rp_id = rp_id;
+	memcpy(c->rp_hash, rp_hash, sizeof(rp_hash));
+
+	if (RAND_bytes(c->id, sizeof(c->id)) != 1 ||
+	    (c->key = ec_keygen()) == NULL || set_user(c, user) < 0 ||
+	    (map_get_str(rp, "name") != NULL &&
+	    (c->rp_name = dup_string(map_get_str(rp, "name"))) == NULL)) {
+		cred_reset(c);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	/* a new resident credential replaces one for the same user */
+	if (rk)
+		for (size_t i = 0; i < VAUTH_MAXCRED; i++) {
+			struct vauth_cred *o = &va->cred[i];
+			if (o != c && o->used && o->rk &&
+			    memcmp(o->rp_hash, c->rp_hash, 32) == 0 &&
+			    o->user_id_len == c->user_id_len &&
+			    memcmp(o->user_id, c->user_id,
+			    c->user_id_len) == 0)
+				cred_reset(o);
+		}
+
+	if ((*resp = makecred_reply(va, c, CTAP_AUTHDATA_USER_PRESENT |
+	    (pin_uv ? CTAP_AUTHDATA_USER_VERIFIED : 0), cdh, cdh_len)) == NULL) {
+		cred_reset(c);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	return (FIDO_OK);
+}
+
+/*
+ * authenticatorGetAssertion, authenticatorGetNextAssertion
+ */
+
+static int
+assert_reply(struct vauth *va, const struct vauth_cred *c, size_t total,
+    cbor_item_t **resp)
+{
+	unsigned char	 ad[32 + 1 + 4];
+	cbor_item_t	*m;
+
+	memcpy(ad, c->rp_hash, 32);
+	ad[32] = va->assert_flags;
+	put_be32(&ad[33], ++va->sign_count);
+
+	if ((m = cbor_new_definite_map(5)) == NULL)
+		return (FIDO_ERR_INTERNAL);
+	if (put_uint(m, 1, encode_cred_id(c)) < 0 ||
+	    put_uint(m, 2, cbor_build_bytestring(ad, sizeof(ad))) < 0 ||
+	    put_uint(m, 3, sign(c->key, ad, sizeof(ad), va->assert_cdh,
+	    sizeof(va->assert_cdh))) < 0 ||
+	    (c->rk && put_uint(m, 4, encode_user(c,
+	    va->assert_it.n > 1)) < 0) ||
+	    (total > 1 && put_uint(m, 5, cbor_build_uint8((uint8_t)total)) < 0)) {
+		cbor_decref(&m);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	*resp = m;
+
+	return (FIDO_OK);
+}
+
+static int
+cmd_getassert(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	const cbor_item_t	*allow;
+	const unsigned char	*cdh;
+	size_t			 cdh_len;
+	unsigned char		 rp_hash[SHA256_DIGEST_LENGTH];
+	struct vauth_iter	*it = &va->assert_it;
+	char			*rp_id;
+	bool			 up = true, uv = false, pin_uv;
+	int			 r;
+
+	memset(it, 0, sizeof(*it));
+
+	if ((rp_id = dup_string(map_get(req, 1))) == NULL ||
+	    get_bytes(map_get(req, 2), &cdh, &cdh_len) < 0 ||
+	    cdh_len != sizeof(va->assert_cdh)) {
+		free(rp_id);
+		return (FIDO_ERR_MISSING_PARAMETER);
+	}
+
+	SHA256((const unsigned char *)rp_id, strlen(rp_id), rp_hash);
+	free(rp_id);
+
+	if ((r = get_options(map_get(req, 5), NULL, &up, &uv)) != FIDO_OK)
+		return (r);
+	if ((r = check_pin_auth(va, cdh, cdh_len, map_get(req, 6),
+	    map_get(req, 7), &pin_uv)) != FIDO_OK)
+		return (r);
+
+	if ((allow = map_get(req, 3)) != NULL && cbor_isa_array(allow) &&
+	    cbor_array_is_definite(allow) && cbor_array_size(allow) > 0) {
+		cbor_item_t **v = cbor_array_handle(allow);
+		if (cbor_array_size(allow) > VAUTH_MAXCREDLIST)
+			return (FIDO_ERR_LIMIT_EXCEEDED);
+		for (size_t i = 0; i < cbor_array_size(allow); i++) {
+			const struct vauth_cred *c;
+			if ((c = cred_find(va, rp_hash, v[i])) != NULL &&
+			    cred_visible(c, pin_uv)) {
+				it->idx[0] = (size_t)(c - va->cred);
+				it->n = 1;
+				break;
+			}
+		}
+	} else
+		rk_collect(va, rp_hash, it);
+
+	if (it->n == 0)
+		return (FIDO_ERR_NO_CREDENTIALS);
+
+	memcpy(va->assert_cdh, cdh, cdh_len);
+	va->assert_flags = (uint8_t)((up ? CTAP_AUTHDATA_USER_PRESENT : 0) |
+	    (pin_uv ? CTAP_AUTHDATA_USER_VERIFIED : 0));
+	it->pos = 1;
+
+	return (assert_reply(va, &va->cred[it->idx[0]], it->n, resp));
+}
+
+static int
+cmd_nextassert(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	struct vauth_iter *it = &va->assert_it;
+
+	(void)req;
+
+	if (it->pos >= it->n)
+		return (FIDO_ERR_NOT_ALLOWED);
+
+	return (assert_reply(va, &va->cred[it->idx[it->pos++]], 1, resp));
+}
+
+/*
+ * authenticatorClientPIN, protocol 1
+ */
+
+static int
+check_pin_hash(struct vauth *va, const unsigned char *shared,
+    const cbor_item_t *enc)
+{
+	const unsigned char	*ptr;
+	size_t			 len;
+	unsigned char		 ph[16];
+
+	if (get_bytes(enc, &ptr, &len) < 0 || len != sizeof(ph))
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (va->pin_retries <= 0)
+		return (FIDO_ERR_PIN_BLOCKED);
+	if (aes_cbc(shared, ptr, len, ph, 0) < 0)
+		return (FIDO_ERR_INTERNAL);
+
+	if (CRYPTO_memcmp(ph, va->pin_hash, sizeof(ph)) != 0) {
+		va->pin_retries--;
+		EVP_PKEY_free(va->ka);
+		if ((va->ka = ec_keygen()) == NULL)
+			return (FIDO_ERR_INTERNAL);
+		return (va->pin_retries > 0 ? FIDO_ERR_PIN_INVALID :
+		    FIDO_ERR_PIN_BLOCKED);
+	}
+
+	va->pin_retries = VAUTH_PIN_RETRIES;
+
+	return (FIDO_OK);
+}
+
+static int
+set_pin(struct vauth *va, const unsigned char *shared, const cbor_item_t *enc)
+{
+	const unsigned char	*ptr;
+	size_t			 len, pin_len;
+	unsigned char		 pin[256];
+	unsigned char		 dgst[SHA256_DIGEST_LENGTH];
+
+	if (get_bytes(enc, &ptr, &len) < 0 || len < 64 || len > sizeof(pin))
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (aes_cbc(shared, ptr, len, pin, 0) < 0)
+		return (FIDO_ERR_INTERNAL);
+
+	for (pin_len = 0; pin_len < len && pin[pin_len] != 0; pin_len++)
+		continue;
+	if (pin_len < 4 || pin_len > 63) {
+		OPENSSL_cleanse(pin, sizeof(pin));
+		return (FIDO_ERR_PIN_POLICY_VIOLATION);
+	}
+
+	SHA256(pin, pin_len, dgst);
+	memcpy(va->pin_hash, dgst, sizeof(va->pin_hash));
+	va->pin_set = true;
+	va->pin_retries = VAUTH_PIN_RETRIES;
+	OPENSSL_cleanse(pin, sizeof(pin));
+
+	if (RAND_bytes(va->token, sizeof(va->token)) != 1)
+		return (FIDO_ERR_INTERNAL);
+
+	return (FIDO_OK);
+}
+
+static int
+cmd_clientpin(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	unsigned char		 shared[SHA256_DIGEST_LENGTH];
+	unsigned char		 token[sizeof(va->token)];
+	unsigned char		*data = NULL;
+	const unsigned char	*a, *b;
+	size_t			 a_len, b_len;
+	uint64_t		 prot, sub;
+	cbor_item_t		*m = NULL;
+	int			 r;
+
+	if (get_uint(map_get(req, 1), &prot) < 0 ||
+	    get_uint(map_get(req, 2), &sub) < 0)
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (prot != CTAP_PIN_PROTOCOL1)
+		return (FIDO_ERR_INVALID_PARAMETER);
+
+	switch (sub) {
+	case 1: /* getRetries */
+		if ((m = cbor_new_definite_map(1)) == NULL ||
+		    put_uint(m, 3, cbor_build_uint8((uint8_t)
+		    va->pin_retries)) < 0) {
+			r = FIDO_ERR_INTERNAL;
+			goto out;
+		}
+		break;
+	case 2: /* getKeyAgreement */
+		if ((m = cbor_new_definite_map(1)) == NULL ||
+		    put_uint(m, 1, encode_cose(va->ka, COSE_ECDH_ES256)) < 0) {
+			r = FIDO_ERR_INTERNAL;
+			goto out;
+		}
+		break;
+	case 3: /* setPIN */
+		if (va->pin_set) {
+			r = FIDO_ERR_NOT_ALLOWED;
+			goto out;
+		}
+		if (shared_secret(va, map_get(req, 3), shared) < 0 ||
+		    get_bytes(map_get(req, 5), &a, &a_len) < 0) {
+			r = FIDO_ERR_MISSING_PARAMETER;
+			goto out;
+		}
+		if (!auth_ok(shared, sizeof(shared), a, a_len,
+		    map_get(req, 4))) {
+			r = FIDO_ERR_PIN_AUTH_INVALID;
+			goto out;
+		}
+		if ((r = set_pin(va, shared, map_get(req, 5))) != FIDO_OK)
+			goto out;
+		break;
+	case 4: /* changePIN */
+		if (!va->pin_set) {
+			r = FIDO_ERR_PIN_NOT_SET;
+			goto out;
+		}
+		if (shared_secret(va, map_get(req, 3), shared) < 0 ||
+		    get_bytes(map_get(req, 5), &a, &a_len) < 0 ||
+		    get_bytes(map_get(req, 6), &b, &b_len) < 0 ||
+		    (data = malloc(a_len + b_len)) == NULL) {
+			r = FIDO_ERR_MISSING_PARAMETER;
+			goto out;
+		}
+		memcpy(data, a, a_len);
+		memcpy(data + a_len, b, b_len);
+		if (!auth_ok(shared, sizeof(shared), data, a_len + b_len,
+		    map_get(req, 4))) {
+			r = FIDO_ERR_PIN_AUTH_INVALID;
+			goto out;
+		}
+		if ((r = check_pin_hash(va, shared, map_get(req,
+		    6))) != FIDO_OK ||
+		    (r = set_pin(va, shared, map_get(req, 5))) != FIDO_OK)
+			goto out;
+		break;
+	case 5: /* getPinToken */
+		if (!va->pin_set) {
+			r = FIDO_ERR_PIN_NOT_SET;
+			goto out;
+		}
+		if (shared_secret(va, map_get(req, 3), shared) < 0) {
+			r = FIDO_ERR_MISSING_PARAMETER;
+			goto out;
+		}
+		if ((r = check_pin_hash(va, shared, map_get(req,
+		    6))) != FIDO_OK)
+			goto out;
+		if (aes_cbc(shared, va->token, sizeof(va->token), token,
+		    1) < 0 || (m = cbor_new_definite_map(1)) == NULL ||
+		    put_uint(m, 2, cbor_build_bytestring(token,
+		    sizeof(token))) < 0) {
+			r = FIDO_ERR_INTERNAL;
+			goto out;
+		}
+		break;
+	default:
+		r = CTAP2_ERR_INVALID_SUBCOMMAND;
+		goto out;
+	}
+
+	*resp = m;
+	m = NULL;
+	r = FIDO_OK;
+out:
+	if (m != NULL)
+		cbor_decref(&m);
+	free(data);
+	OPENSSL_cleanse(shared, sizeof(shared));
+
+	return (r);
+}
+
+/*
+ * authenticatorReset
+ */
+
+static int
+cmd_reset(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	(void)req;
+	(void)resp;
+
+	return (vauth_reset(va) < 0 ? FIDO_ERR_INTERNAL : FIDO_OK);
+}
+
+/*
+ * authenticatorCredentialManagement
+ */
+
+static int
+rp_reply(struct vauth *va, size_t total, cbor_item_t **resp)
+{
+	const struct vauth_cred	*c = &va->cred[va->rp_it.idx[va->rp_it.pos++]];
+	cbor_item_t		*m, *rp = NULL;
+
+	if ((m = cbor_new_definite_map(3)) == NULL ||
+	    (rp = cbor_new_definite_map(2)) == NULL ||
+	    put_str(rp, "id", cbor_build_string(c->rp_id)) < 0 ||
+	    (c->rp_name != NULL && put_str(rp, "name",
+	    cbor_build_string(c->rp_name)) < 0))
+		goto fail;
+	if (put_uint(m, 3, rp) < 0) {
+		rp = NULL;
+		goto fail;
+	}
+	rp = NULL;
+	if (put_uint(m, 4, cbor_build_bytestring(c->rp_hash,
+	    sizeof(c->rp_hash))) < 0 || (total > 0 && put_uint(m, 5,
+	    cbor_build_uint8((uint8_t)total)) < 0))
+		goto fail;
+
+	*resp = m;
+
+	return (FIDO_OK);
+fail:
+	if (m != NULL)
+		cbor_decref(&m);
+	if (rp != NULL)
+		cbor_decref(&rp);
+
+	return (FIDO_ERR_INTERNAL);
+}
+
+static int
+rk_reply(struct vauth *va, size_t total, cbor_item_t **resp)
+{
+	const struct vauth_cred	*c = &va->cred[va->rk_it.idx[va->rk_it.pos++]];
+	cbor_item_t		*m;
+
+	if ((m = cbor_new_definite_map(4)) == NULL)
+		return (FIDO_ERR_INTERNAL);
+	if (put_uint(m, 6, encode_user(c, true)) < 0 ||
+	    put_uint(m, 7, encode_cred_id(c)) < 0 ||
+	    put_uint(m, 8, encode_cose(c->key, COSE_ES256)) < 0 ||
+	    (total > 0 && put_uint(m, 9, cbor_build_uint8((uint8_t)total)) < 0)) {
+		cbor_decref(&m);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	*resp = m;
+
+	return (FIDO_OK);
+}
+
+static int
+cmd_credmgmt(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	const cbor_item_t	*param;
+	const unsigned char	*rp_hash;
+	size_t			 len;
+	unsigned char		*data = NULL;
+	size_t			 data_len, alloc_len;
+	struct vauth_cred	*c;
+	uint64_t		 sub;
+	bool			 uv;
+	int			 r;
+
+	if (get_uint(map_get(req, 1), &sub) < 0 || sub > UINT8_MAX)
+		return (FIDO_ERR_MISSING_PARAMETER);
+
+	param = map_get(req, 2);
+
+	/* everything except the enumerate-next calls requires a pinAuth */
+	if (sub != 3 && sub != 5) {
+		if (!va->pin_set)
+			return (FIDO_ERR_PIN_NOT_SET);
+		if (map_get(req, 4) == NULL)
+			return (FIDO_ERR_PIN_REQUIRED);
+		if (param == NULL)
+			data_len = 0;
+		else if ((data_len = cbor_serialize_alloc(param, &data,
+		    &alloc_len)) == 0)
+			return (FIDO_ERR_INTERNAL);
+		if ((data = realloc(data, data_len + 1)) == NULL)
+			return (FIDO_ERR_INTERNAL);
+		memmove(data + 1, data, data_len);
+		data[0] = (uint8_t)sub;
+		r = check_pin_auth(va, data, data_len + 1, map_get(req, 4),
+		    map_get(req, 3), &uv);
+		free(data);
+		if (r != FIDO_OK)
+			return (r);
+	}
+
+	switch (sub) {
+	case 1: /* getCredsMetadata */
+		if ((*resp = cbor_new_definite_map(2)) == NULL ||
+		    put_uint(*resp, 1, cbor_build_uint8((uint8_t)
+		    rk_count(va))) < 0 ||
+		    put_uint(*resp, 2, cbor_build_uint8((uint8_t)(VAUTH_MAXRK -
+		    rk_count(va)))) < 0)
+			return (FIDO_ERR_INTERNAL);
+		return (FIDO_OK);
+	case 2: /* enumerateRPsBegin */
+		rk_collect(va, NULL, &va->rp_it);
+		/* keep the newest credential of each rp */
+		for (size_t i = 0, n = 0; i < va->rp_it.n; i++) {
+			const struct vauth_cred *x = &va->cred[va->rp_it.idx[i]];
+			bool dup = false;
+			for (size_t j = 0; j < n; j++)
+				if (memcmp(va->cred[va->rp_it.idx[j]].rp_hash,
+				    x->rp_hash, sizeof(x->rp_hash)) == 0)
+					dup = true;
+			if (!dup)
+				va->rp_it.idx[n++] = va->rp_it.idx[i];
+			if (i + 1 == va->rp_it.n)
+				va->rp_it.n = n;
+		}
+		if (va->rp_it.n == 0) {
+			if ((*resp = cbor_new_definite_map(1)) == NULL ||
+			    put_uint(*resp, 5, cbor_build_uint8(0)) < 0)
+				return (FIDO_ERR_INTERNAL);
+			return (FIDO_OK);
+		}
+		return (rp_reply(va, va->rp_it.n, resp));
+	case 3: /* enumerateRPsGetNextRP */
+		if (va->rp_it.pos >= va->rp_it.n)
+			return (FIDO_ERR_NOT_ALLOWED);
+		return (rp_reply(va, 0, resp));
+	case 4: /* enumerateCredentialsBegin */
+		if (get_bytes(map_get(param, 1), &rp_hash, &len) < 0 ||
+		    len != SHA256_DIGEST_LENGTH)
+			return (FIDO_ERR_MISSING_PARAMETER);
+		rk_collect(va, rp_hash, &va->rk_it);
+		if (va->rk_it.n == 0)
+			return (FIDO_ERR_NO_CREDENTIALS);
+		return (rk_reply(va, va->rk_it.n, resp));
+	case 5: /* enumerateCredentialsGetNextCredential */
+		if (va->rk_it.pos >= va->rk_it.n)
+			return (FIDO_ERR_NOT_ALLOWED);
+		return (rk_reply(va, 0, resp));
+	case 6: /* deleteCredential */
+		if ((c = cred_find(va, NULL, map_get(param, 2))) == NULL ||
+		    !c->rk)
+			return (FIDO_ERR_NO_CREDENTIALS);
+		cred_reset(c);
+		return (FIDO_OK);
+	case 7: /* updateUserInformation */
+		if ((c = cred_find(va, NULL, map_get(param, 2))) == NULL ||
+		    !c->rk)
+			return (FIDO_ERR_NO_CREDENTIALS);
+		if (set_user(c, map_get(param, 3)) < 0)
+			return (FIDO_ERR_INVALID_PARAMETER);
+		return (FIDO_OK);
+	default:
+		return (CTAP2_ERR_INVALID_SUBCOMMAND);
+	}
+}
+
+/*
+ * authenticatorLargeBlobs
+ */
+
+static int
+cmd_largeblob(struct vauth *va, const cbor_item_t *req, cbor_item_t **resp)
+{
+	const unsigned char	*set;
+	unsigned char		 buf[32 + 2 + 4 + SHA256_DIGEST_LENGTH];
+	unsigned char		 dgst[SHA256_DIGEST_LENGTH];
+	size_t			 set_len, maxfrag;
+	uint64_t		 get, off, len;
+	bool			 uv;
+	int			 r;
+
+	maxfrag = VAUTH_MAXMSGSIZE - 64;
+
+	if (get_uint(map_get(req, 3), &off) < 0)
+		return (FIDO_ERR_MISSING_PARAMETER);
+
+	if (get_uint(map_get(req, 1), &get) == 0) {
+		if (map_get(req, 2) != NULL)
+			return (FIDO_ERR_INVALID_PARAMETER);
+		if (get > maxfrag)
+			return (FIDO_ERR_INVALID_LENGTH);
+		if (off > va->lblob_len)
+			return (FIDO_ERR_INVALID_SEQ);
+		if (get > va->lblob_len - off)
+			get = va->lblob_len - off;
+		if ((*resp = cbor_new_definite_map(1)) == NULL ||
+		    put_uint(*resp, 1, cbor_build_bytestring(va->lblob + off,
+		    (size_t)get)) < 0)
+			return (FIDO_ERR_INTERNAL);
+		return (FIDO_OK);
+	}
+
+	if (get_bytes(map_get(req, 2), &set, &set_len) < 0)
+		return (FIDO_ERR_MISSING_PARAMETER);
+	if (set_len > maxfrag)
+		return (FIDO_ERR_INVALID_LENGTH);
+
+	if (off == 0) {
+		if (get_uint(map_get(req, 4), &len) < 0)
+			return (FIDO_ERR_INVALID_PARAMETER);
+		if (len > VAUTH_MAXLBLOB)
+			return (FIDO_ERR_LARGEBLOB_STORAGE_FULL);
+		if (len < 17)
+			return (FIDO_ERR_INVALID_PARAMETER);
+		va->lblob_new_len = (size_t)len;
+		va->lblob_new_off = 0;
+	} else if (map_get(req, 4) != NULL)
+		return (FIDO_ERR_INVALID_PARAMETER);
+
+	if (off != va->lblob_new_off)
+		return (FIDO_ERR_INVALID_SEQ);
+	if (set_len > va->lblob_new_len - va->lblob_new_off)
+		return (FIDO_ERR_INVALID_PARAMETER);
+
+	if (va->pin_set || map_get(req, 5) != NULL) {
+		if (map_get(req, 5) == NULL)
+			return (FIDO_ERR_PIN_REQUIRED);
+		memset(buf, 0xff, 32);
+		buf[32] = CTAP_CBOR_LARGEBLOB;
+		buf[33] = 0x00;
+		buf[34] = (unsigned char)off;
+		buf[35] = (unsigned char)(off >> 8);
+		buf[36] = (unsigned char)(off >> 16);
+		buf[37] = (unsigned char)(off >> 24);
+		SHA256(set, set_len, &buf[38]);
+		if ((r = check_pin_auth(va, buf, sizeof(buf), map_get(req, 5),
+		    map_get(req, 6), &uv)) != FIDO_OK)
+			return (r);
+	}
+
+	memcpy(va->lblob_new + va->lblob_new_off, set, set_len);
+	va->lblob_new_off += set_len;
+
+	if (va->lblob_new_off == va->lblob_new_len) {
+		SHA256(va->lblob_new, va->lblob_new_len - 16, dgst);
+		if (memcmp(dgst, va->lblob_new + va->lblob_new_len - 16,
+		    16) != 0)
+			return (CTAP2_ERR_INTEGRITY_FAILURE);
+		memcpy(va->lblob, va->lblob_new, va->lblob_new_len);
+		va->lblob_len = va->lblob_new_len;
+		va->lblob_new_len = 0;
+		va->lblob_new_off = 0;
+	}
+
+	return (FIDO_OK);
+}
+
+/*
+ * CTAPHID transport.
+ */
+
+static int
+reply(struct vauth_handle *h, uint32_t cid, uint8_t cmd,
+    const unsigned char *data, size_t len)
+{
+	unsigned char	*pkt;
+	size_t		 n, off = 0, frames;
+	uint8_t		 seq = 0;
+
+	if (len > VAUTH_MAXMSG)
+		return (-1);
+
+	frames = 1;
+	if (len > VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN)
+		frames += (len - (VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN) +
+		    VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN - 1) /
+		    (VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN);
+
+	if ((pkt = realloc(h->out, h->out_len + frames *
+	    VAUTH_REPORT_LEN)) == NULL)
+		return (-1);
+
+	h->out = pkt;
+	pkt += h->out_len;
+	memset(pkt, 0, frames * VAUTH_REPORT_LEN);
+	h->out_len += frames * VAUTH_REPORT_LEN;
+
+	memcpy(pkt, &cid, sizeof(cid));
+	pkt[4] = CTAP_FRAME_INIT | cmd;
+	pkt[5] = (unsigned char)(len >> 8);
+	pkt[6] = (unsigned char)len;
+	n = len < VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN ? len :
+	    VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN;
+	if (n > 0)
+		memcpy(pkt + CTAP_INIT_HEADER_LEN, data, n);
+	off += n;
+
+	while (off < len) {
+		pkt += VAUTH_REPORT_LEN;
+		memcpy(pkt, &cid, sizeof(cid));
+		pkt[4] = seq++;
+		n = len - off < VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN ?
+		    len - off : VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN;
+		memcpy(pkt + CTAP_CONT_HEADER_LEN, data + off, n);
+		off += n;
+	}
+
+#ifndef _WIN32
+	/* withheld reports are signalled once released */
+	for (size_t i = 0; i < frames && !h->va->hold; i++)
+		if (write(h->pipe[1], "", 1) != 1)
+			return (-1);
+#endif
+
+	return (0);
+}
+
+static int
+reply_error(struct vauth_handle *h, uint32_t cid, uint8_t code)
+{
+	return (reply(h, cid, 0x3f, &code, sizeof(code)));
+}
+
+static int
+handle_cbor(struct vauth_handle *h)
+{
+	struct vauth		*va = h->va;
+	struct cbor_load_result	 cbor;
+	cbor_item_t		*req = NULL, *resp = NULL;
+	unsigned char		*buf = NULL, *msg;
+	size_t			 len = 0, alloc_len;
+	int			 st;
+
+	va->cbor_count++;
+
+	if (h->len < 1)
+		return (reply_error(h, h->cid, FIDO_ERR_INVALID_LENGTH));
+	if (h->len > VAUTH_MAXMSGSIZE)
+		return (reply_error(h, h->cid, FIDO_ERR_REQUEST_TOO_LARGE));
+
+	if (h->len > 1 && ((req = cbor_load(h->msg + 1, h->len - 1,
+	    &cbor)) == NULL || !cbor_isa_map(req))) {
+		st = FIDO_ERR_INVALID_CBOR;
+		goto out;
+	}
+
+	if (h->msg[0] == CTAP_CBOR_MAKECRED || h->msg[0] == CTAP_CBOR_ASSERT)
+		for (unsigned int i = 0; i < va->keepalives; i++) {
+			uint8_t ka = i ? CTAP_KEEPALIVE_UPNEEDED :
+			    CTAP_KEEPALIVE_PROCESSING;
+			if (reply(h, h->cid, CTAP_KEEPALIVE, &ka, 1) < 0) {
+				st = FIDO_ERR_INTERNAL;
+				goto out;
+			}
+		}
+
+	switch (h->msg[0]) {
+	case CTAP_CBOR_MAKECRED:
+		st = cmd_makecred(va, req, &resp);
+		break;
+	case CTAP_CBOR_ASSERT:
+		st = cmd_getassert(va, req, &resp);
+		break;
+	case CTAP_CBOR_GETINFO:
+		st = cmd_getinfo(va, req, &resp);
+		break;
+	case CTAP_CBOR_CLIENT_PIN:
+		st = cmd_clientpin(va, req, &resp);
+		break;
+	case CTAP_CBOR_RESET:
+		st = cmd_reset(va, req, &resp);
+		break;
+	case CTAP_CBOR_NEXT_ASSERT:
+		st = cmd_nextassert(va, req, &resp);
+		break;
+	case CTAP_CBOR_LARGEBLOB:
+		st = cmd_largeblob(va, req, &resp);
+		break;
+	case CTAP_CBOR_CRED_MGMT:
+	case CTAP_CBOR_CRED_MGMT_PRE:
+		st = cmd_credmgmt(va, req, &resp);
+		break;
+	case CTAP_CBOR_SELECTION:
+		st = FIDO_OK;
+		break;
+	default:
+		st = FIDO_ERR_INVALID_COMMAND;
+		break;
+	}
+out:
+	if (st == FIDO_OK && resp != NULL &&
+	    (len = cbor_serialize_alloc(resp, &buf, &alloc_len)) == 0)
+		st = FIDO_ERR_INTERNAL;
+	if (st != FIDO_OK)
+		len = 0;
+
+	if ((msg = malloc(len + 1)) != NULL) {
+		msg[0] = (uint8_t)st;
+		if (len > 0)
+			memcpy(msg + 1, buf, len);
+		st = reply(h, h->cid, CTAP_CMD_CBOR, msg, len + 1);
+		free(msg);
+	} else
+		st = -1;
+
+	if (req != NULL)
+		cbor_decref(&req);
+	if (resp != NULL)
+		cbor_decref(&resp);
+	free(buf);
+
+	return (st);
+}
+
+static int
+reply_sw(struct vauth_handle *h, unsigned char *data, size_t len,
+    uint16_t sw)
+{
+	data[len] = (unsigned char)(sw >> 8);
+	data[len + 1] = (unsigned char)sw;
+
+	return (reply(h, h->cid, CTAP_CMD_MSG, data, len + 2));
+}
+
+/* U2F authentication with the credentials of authenticatorMakeCredential. */
+static int
+handle_u2f(struct vauth_handle *h)
+{
+	struct vauth		*va = h->va;
+	const unsigned char	*apdu = h->msg, *cdh, *app, *kh;
+	const struct vauth_cred	*c = NULL;
+	unsigned char		 ad[32 + 1 + 4];
+	unsigned char		 resp[1 + 4 + 80 + 2];
+	cbor_item_t		*sig;
+	size_t			 lc, sig_len;
+	int			 r;
+
+	if (h->len < 7 || apdu[1] != U2F_CMD_AUTH)
+		return (reply_sw(h, resp, 0, SW_INS_NOT_SUPPORTED));
+
+	lc = (size_t)((apdu[5] << 8) | apdu[6]);
+	if (lc < 65 || 7 + lc > h->len || lc != 65 + (size_t)apdu[7 + 64])
+		return (reply_sw(h, resp, 0, SW_WRONG_LENGTH));
+
+	cdh = apdu + 7;
+	app = cdh + 32;
+	kh = app + 33;
+
+	for (size_t i = 0; i < VAUTH_MAXCRED && c == NULL; i++)
+		if (va->cred[i].used && apdu[7 + 64] == VAUTH_CRED_ID_LEN &&
+		    memcmp(va->cred[i].id, kh, VAUTH_CRED_ID_LEN) == 0 &&
+		    memcmp(va->cred[i].rp_hash, app, 32) == 0)
+			c = &va->cred[i];
+
+	if (c == NULL || (apdu[2] != U2F_AUTH_CHECK &&
+	    apdu[2] != U2F_AUTH_SIGN))
+		return (reply_sw(h, resp, 0, SW_WRONG_DATA));
+	if (apdu[2] == U2F_AUTH_CHECK || va->absent || va->u2f_refusals) {
+		if (apdu[2] == U2F_AUTH_SIGN && va->u2f_refusals)
+			va->u2f_refusals--;
+		return (reply_sw(h, resp, 0, SW_CONDITIONS_NOT_SATISFIED));
+	}
+
+	memcpy(ad, c->rp_hash, 32);
+	ad[32] = CTAP_AUTHDATA_USER_PRESENT;
+	put_be32(&ad[33], ++va->sign_count);
+	if ((sig = sign(c->key, ad, sizeof(ad), cdh, 32)) == NULL)
+		return (-1);
+	if ((sig_len = cbor_bytestring_length(sig)) > 80) {
+		cbor_decref(&sig);
+		return (-1);
+	}
+	memcpy(resp, ad + 32, 5);
+	memcpy(resp + 5, cbor_bytestring_handle(sig), sig_len);
+	r = reply_sw(h, resp, 5 + sig_len, SW_NO_ERROR);
+	cbor_decref(&sig);
+
+	return (r);
+}
+
+static int
+handle_init(struct vauth_handle *h)
+{
+	unsigned char	resp[17];
+	uint32_t	cid;
+
+	if (h->len != 8)
+		return (reply_error(h, h->cid, FIDO_ERR_INVALID_LENGTH));
+
+	if (h->cid == CTAP_CID_BROADCAST)
+		cid = h->va->next_cid++;
+	else
+		cid = h->cid;
+
+	memcpy(resp, h->msg, 8);		/* nonce */
+	memcpy(resp + 8, &cid, sizeof(cid));	/* channel */
+	resp[12] = 2;				/* ctaphid protocol */
+	resp[13] = h->va->version[0];		/* major */
+	resp[14] = h->va->version[1];		/* minor */
+	resp[15] = h->va->version[2];		/* build */
+	resp[16] = FIDO_CAP_WINK | FIDO_CAP_CBOR;
+
+	return (reply(h, h->cid, CTAP_CMD_INIT, resp, sizeof(resp)));
+}
+
+/* Whether the request needs a touch. */
+static bool
+needs_up(const struct vauth_handle *h)
+{
+	return (h->len > 0 && (h->msg[0] == CTAP_CBOR_MAKECRED ||
+	    h->msg[0] == CTAP_CBOR_ASSERT || h->msg[0] == CTAP_CBOR_SELECTION));
+}
+
+static int
+handle_cancel(struct vauth_handle *h, uint32_t cid)
+{
+	const unsigned char st = FIDO_ERR_KEEPALIVE_CANCEL;
+
+	if (h->va->parked != h || cid != h->cid)
+		return (0); /* nothing in flight */
+
+	h->va->parked = NULL;
+
+	return (reply(h, h->cid, CTAP_CMD_CBOR, &st, sizeof(st)));
+}
+
+static int
+handle_msg(struct vauth_handle *h)
+{
+	if (h->cmd == CTAP_CMD_CBOR && h->va->absent && needs_up(h)) {
+		h->va->parked = h;
+		return (0);
+	}
+
+	switch (h->cmd) {
+	case CTAP_CMD_INIT:
+		return (handle_init(h));
+	case CTAP_CMD_PING:
+		return (reply(h, h->cid, CTAP_CMD_PING, h->msg, h->len));
+	case CTAP_CMD_WINK:
+		return (reply(h, h->cid, CTAP_CMD_WINK, NULL, 0));
+	case CTAP_CMD_CBOR:
+		return (handle_cbor(h));
+	case CTAP_CMD_MSG:
+		return (handle_u2f(h));
+	case CTAP_CMD_CANCEL:
+		return (handle_cancel(h, h->cid));
+	default:
+		return (reply_error(h, h->cid, FIDO_ERR_INVALID_COMMAND));
+	}
+}
+
+static void *
+vauth_open(const char *path)
+{
+	struct vauth		*va;
+	struct vauth_handle	*h;
+
+	for (va = vauth_list; va != NULL; va = va->next)
+		if (strcmp(va->path, path) == 0)
+			break;
+
+	if (va == NULL || va->unplugged ||
+	    (h = calloc(1, sizeof(*h))) == NULL)
+		return (NULL);
+
+	h->va = va;
+	h->plug_gen = va->plug_gen;
+#ifndef _WIN32
+	if (pipe(h->pipe) < 0) {
+		free(h);
+		return (NULL);
+	}
+#else
+	h->pipe[0] = h->pipe[1] = -1;
+#endif
+	h->next = va->handles;
+	va->handles = h;
+
+	return (h);
+}
+
+static void
+vauth_close(void *handle)
+{
+	struct vauth_handle *h = handle;
+	struct vauth_handle **hp;
+
+	if (h->va->parked == h)
+		h->va->parked = NULL;
+	for (hp = &h->va->handles; *hp != NULL; hp = &(*hp)->next)
+		if (*hp == h) {
+			*hp = h->next;
+			break;
+		}
+#ifndef _WIN32
+	close(h->pipe[0]);
+	close(h->pipe[1]);
+#endif
+	free(h->out);
+	free(h);
+}
+
+static int
+vauth_read(void *handle, unsigned char *buf, size_t len, int ms)
+{
+	struct vauth_handle	*h = handle;
+#ifndef _WIN32
+	char			 c;
+#endif
+
+	(void)ms;
+
+	if (h->woken || h->plug_gen != h->va->plug_gen)
+		return (-1);
+	if (len != VAUTH_REPORT_LEN || h->out_off >= h->out_len ||
+	    h->va->hold)
+		return (-1); /* timeout */
+
+#ifndef _WIN32
+	if (read(h->pipe[0], &c, 1) != 1)
+		return (-1);
+#endif
+	memcpy(buf, h->out + h->out_off, len);
+	h->out_off += len;
+
+	if (h->out_off == h->out_len) {
+		h->out_off = 0;
+		h->out_len = 0;
+	}
+
+	return ((int)len);
+}
+
+static int
+write_report(struct vauth_handle *h, const unsigned char *buf, size_t len)
+{
+	const unsigned char	*pkt = buf + 1; /* skip report id */
+	uint32_t		 cid;
+	size_t			 n;
+
+	if (len != VAUTH_REPORT_LEN + 1 || h->plug_gen != h->va->plug_gen)
+		return (-1);
+
+	memcpy(&cid, pkt, sizeof(cid));
+
+	if (pkt[4] & CTAP_FRAME_INIT) {
+		if (pkt[4] == (CTAP_FRAME_INIT | CTAP_CMD_CANCEL)) {
+			if (handle_cancel(h, cid) < 0)
+				return (-1);
+			return ((int)len);
+		}
+		if (h->va->parked == h)
+			h->va->parked = NULL; /* abandoned */
+		h->busy = true;
+		h->cid = cid;
+		h->cmd = pkt[4] & ~CTAP_FRAME_INIT;
+		h->len = (size_t)((pkt[5] << 8) | pkt[6]);
+		h->seq = 0;
+		if (h->len > sizeof(h->msg)) {
+			h->busy = false;
+			if (reply_error(h, cid, FIDO_ERR_INVALID_LENGTH) < 0)
+				return (-1);
+			return ((int)len);
+		}
+		n = h->len < VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN ? h->len :
+		    VAUTH_REPORT_LEN - CTAP_INIT_HEADER_LEN;
+		memcpy(h->msg, pkt + CTAP_INIT_HEADER_LEN, n);
+		h->off = n;
+	} else {
+		if (!h->busy || cid != h->cid || pkt[4] != h->seq) {
+			h->busy = false;
+			if (reply_error(h, cid, FIDO_ERR_INVALID_SEQ) < 0)
+				return (-1);
+			return ((int)len);
+		}
+		h->seq++;
+		n = h->len - h->off < VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN ?
+		    h->len - h->off : VAUTH_REPORT_LEN - CTAP_CONT_HEADER_LEN;
+		memcpy(h->msg + h->off, pkt + CTAP_CONT_HEADER_LEN, n);
+		h->off += n;
+	}
+
+	if (h->off == h->len) {
+		h->busy = false;
+		if (handle_msg(h) < 0)
+			return (-1);
+	}
+
+	return ((int)len);
+}
+
+static int
+vauth_write(void *handle, const unsigned char *buf, size_t len)
+{
+	struct vauth_handle *h = handle;
+
+	h->va->write_count++;
+
+	return (write_report(h, buf, len));
+}
+
+int
+vauth_writev(void *handle, const unsigned char *buf, size_t len, size_t n)
+{
+	struct vauth_handle *h = handle;
+
+	h->va->writev_count++;
+
+	for (size_t i = 0; i < n; i++)
+		if (write_report(h, buf + i * len, len) < 0)
+			return (-1);
+
+	return ((int)(n * len));
+}
+
+int
+vauth_pollfd(void *handle)
+{
+	struct vauth_handle *h = handle;
+
+	return (h->pipe[0]);
+}
+
+int
+vauth_wakeup(void *handle, int set)
+{
+	struct vauth_handle	*h = handle;
+	bool			 woken = h->woken;
+
+	h->woken = set != 0;
+
+	return (set ? 0 : woken);
+}
+
+const fido_dev_io_t vauth_io = {
+	vauth_open,
+	vauth_close,
+	vauth_read,
+	vauth_write,
+};
+
+struct vauth *
+vauth_new(const char *path)
+{
+	struct vauth *va;
+
+	if ((va = calloc(1, sizeof(*va))) == NULL)
+		return (NULL);
+	if ((va->path = strdup(path)) == NULL ||
+	    RAND_bytes(va->aaguid, sizeof(va->aaguid)) != 1 ||
+	    vauth_reset(va) < 0) {
+		vauth_free(&va);
+		return (NULL);
+	}
+
+	va->next_cid = 1;
+	va->next = vauth_list;
+	vauth_list = va;
+
+	return (va);
+}
+
+void
+vauth_free(struct vauth **vap)
+{
+	struct vauth *va, **p;
+
+	if (vap == NULL || (va = *vap) == NULL)
+		return;
+
+	for (p = &vauth_list; *p != NULL; p = &(*p)->next)
+		if (*p == va) {
+			*p = va->next;
+			break;
+		}
+
+	for (size_t i = 0; i < VAUTH_MAXCRED; i++)
+		cred_reset(&va->cred[i]);
+
+	EVP_PKEY_free(va->ka);
+	OPENSSL_cleanse(va->token, sizeof(va->token));
+	free(va->path);
+	free(va);
+
+	*vap = NULL;
+}
+
+uint64_t
+vauth_cbor_count(const struct vauth *va)
+{
+	return (va->cbor_count);
+}
+
+uint64_t
+vauth_write_count(const struct vauth *va)
+{
+	return (va->write_count);
+}
+
+uint64_t
+vauth_writev_count(const struct vauth *va)
+{
+	return (va->writev_count);
+}
+
+void
+vauth_set_version(struct vauth *va, uint8_t major, uint8_t minor,
+    uint8_t build)
+{
+	va->version[0] = major;
+	va->version[1] = minor;
+	va->version[2] = build;
+}
+
+/*
+ * While replies are withheld, their reports are not signalled on the
+ * handles' descriptors either, as with a device that has not answered.
+ */
+void
+vauth_hold(struct vauth *va, bool hold)
+{
+#ifndef _WIN32
+	struct vauth_handle	*h;
+	size_t			 frames;
+	char			 c;
+
+	if (hold == va->hold)
+		return;
+
+	for (h = va->handles; h != NULL; h = h->next) {
+		frames = (h->out_len - h->out_off) / VAUTH_REPORT_LEN;
+		for (size_t i = 0; i < frames; i++)
+			if (hold ? read(h->pipe[0], &c, 1) != 1 :
+			    write(h->pipe[1], "", 1) != 1)
+				abort();
+	}
+#endif
+	va->hold = hold;
+}
+
+/* Handles open while unplugged stay dead after replugging. */
+void
+vauth_unplug(struct vauth *va, bool unplugged)
+{
+	if (unplugged && !va->unplugged)
+		va->plug_gen++;
+	va->unplugged = unplugged;
+}
+
+/* Another authenticator is plugged in at the same path. */
+int
+vauth_replace(struct vauth *va)
+{
+	va->plug_gen++;
+
+	return (RAND_bytes(va->aaguid, sizeof(va->aaguid)) == 1 ? 0 : -1);
+}
+
+void
+vauth_set_keepalives(struct vauth *va, unsigned int n)
+{
+	va->keepalives = n;
+}
+
+/* The next n U2F signatures are refused as if the user had yet to touch. */
+void
+vauth_set_u2f_refusals(struct vauth *va, unsigned int n)
+{
+	va->u2f_refusals = n;
+}
+
+/* While absent, requests needing a touch wait for CTAPHID_CANCEL. */
+void
+vauth_set_absent(struct vauth *va, bool absent)
+{
+	va->absent = absent;
+}
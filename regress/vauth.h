@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifndef _VAUTH_H
+#define _VAUTH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <fido.h>
+
+/*
+ * vauth: an in-process, software-only CTAP2 authenticator speaking
+ * CTAPHID over fido_dev_set_io_functions(), with U2F authentication for
+ * its own credentials. Register an instance with vauth_new(path), install
+ * vauth_io on a fido_dev_t, and open the same path. User presence is
+ * granted immediately, unless the user has been made absent with
+ * vauth_set_absent().
+ */
+
+struct vauth;
+
+extern const fido_dev_io_t vauth_io;
+
+int vauth_writev(void *, const unsigned char *, size_t, size_t);
+int vauth_pollfd(void *);
+int vauth_wakeup(void *, int);
+
+struct vauth *vauth_new(const char *);
+void vauth_free(struct vauth **);
+uint64_t vauth_cbor_count(const struct vauth *);
+uint64_t vauth_write_count(const struct vauth *);
+uint64_t vauth_writev_count(const struct vauth *);
+void vauth_set_version(struct vauth *, uint8_t, uint8_t, uint8_t);
+void vauth_hold(struct vauth *, bool);
+void vauth_set_keepalives(struct vauth *, unsigned int);
+void vauth_unplug(struct vauth *, bool);
+int vauth_replace(struct vauth *);
+void vauth_set_absent(struct vauth *, bool);
+void vauth_set_u2f_refusals(struct vauth *, unsigned int);
+
+#endif /* !_VAUTH_H */
@@ -0,0 +1,1478 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#undef NDEBUG
+
+#include <assert.h>
+#ifndef _WIN32
+#include <poll.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fido.h>
+#include <fido/config.h>
+#include <fido/credman.h>
+#include <fido/es256.h>
+
+#include "vauth.h"
+
+#define VAUTH_PATH	"vauth:0"
+#define PIN		"4321"
+#define RP_ID		"example.org"
+#define FANOUT		16
+
+static const unsigned char cdh[32] = {
+	0xec, 0x8d, 0x8f, 0x78, 0x42, 0x4a, 0x2b, 0xb7,
+	0x82, 0x34, 0xaa, 0xca, 0x07, 0xa1, 0xf6, 0x56,
+	0x42, 0x1c, 0xb6, 0xf6, 0xb3, 0x00, 0x86, 0x52,
+	0x35, 0x2d, 0xa2, 0x62, 0x4a, 0xbe, 0x89, 0x76,
+};
+
+static const unsigned char user_id[2][4] = {
+	{ 0x01, 0x02, 0x03, 0x04 },
+	{ 0x05, 0x06, 0x07, 0x08 },
+};
+
+static const unsigned char lb_key[32] = {
+	0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+	0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f,
+	0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27,
+	0x28, 0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f,
+};
+
+static fido_dev_t *
+open_dev(void)
+{
+	fido_dev_t *dev;
+
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_dev_is_fido2(dev));
+
+	return (dev);
+}
+
+static fido_dev_t *
+open_pollable(void)
+{
+	fido_dev_t *dev;
+
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_pollfd(dev) == -1);
+	assert(fido_dev_set_pollfd_function(dev, vauth_pollfd) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_dev_set_pollfd_function(dev, NULL) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+#ifndef _WIN32
+	assert(fido_dev_pollfd(dev) >= 0);
+#endif
+
+	return (dev);
+}
+
+static fido_cred_t *
+make_cred(fido_dev_t *dev, int idx, fido_opt_t rk, const char *pin, int want)
+{
+	fido_cred_t *cred;
+
+	assert((cred = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(cred, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(cred, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(cred, RP_ID, "Example") == FIDO_OK);
+	assert(fido_cred_set_user(cred, user_id[idx], sizeof(user_id[idx]),
+	    idx ? "bob" : "alice", NULL, NULL) == FIDO_OK);
+	assert(fido_cred_set_rk(cred, rk) == FIDO_OK);
+	assert(fido_dev_make_cred(dev, cred, pin) == want);
+	if (want == FIDO_OK)
+		assert(fido_cred_verify_self(cred) == FIDO_OK);
+
+	return (cred);
+}
+
+static fido_assert_t *
+get_assert(fido_dev_t *dev, const fido_cred_t *allow, const char *pin,
+    int want)
+{
+	fido_assert_t *a;
+
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	if (allow != NULL)
+		assert(fido_assert_allow_cred(a, fido_cred_id_ptr(allow),
+		    fido_cred_id_len(allow)) == FIDO_OK);
+	assert(fido_dev_get_assert(dev, a, pin) == want);
+
+	return (a);
+}
+
+static void
+verify(const fido_assert_t *a, size_t idx, const fido_cred_t *cred)
+{
+	es256_pk_t *pk;
+
+	assert((pk = es256_pk_new()) != NULL);
+	assert(es256_pk_from_ptr(pk, fido_cred_pubkey_ptr(cred),
+	    fido_cred_pubkey_len(cred)) == FIDO_OK);
+	assert(fido_assert_verify(a, idx, COSE_ES256, pk) == FIDO_OK);
+	es256_pk_free(&pk);
+}
+
+static void
+info(void)
+{
+	fido_dev_t		*dev = open_dev();
+	fido_cbor_info_t	*ci;
+
+	assert((ci = fido_cbor_info_new()) != NULL);
+	assert(fido_dev_get_cbor_info(dev, ci) == FIDO_OK);
+	assert(fido_cbor_info_maxmsgsiz(ci) == 1200);
+	assert(fido_cbor_info_maxcredcntlst(ci) == 8);
+	assert(fido_cbor_info_maxlargeblob(ci) == 4096);
+	assert(fido_dev_has_pin(dev) == false);
+	assert(fido_dev_supports_credman(dev));
+	fido_cbor_info_free(&ci);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static void
+nopin(void)
+{
+	fido_dev_t	*dev = open_dev();
+	fido_cred_t	*c, *x;
+	fido_assert_t	*a;
+
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, NULL, FIDO_OK);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	assert(fido_assert_count(a) == 1);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* excluded */
+	assert((x = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(x, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(x, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(x, RP_ID, NULL) == FIDO_OK);
+	assert(fido_cred_set_user(x, user_id[0], sizeof(user_id[0]), NULL,
+	    NULL, NULL) == FIDO_OK);
+	assert(fido_cred_exclude(x, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(fido_dev_make_cred(dev, x, NULL) ==
+	    FIDO_ERR_CREDENTIAL_EXCLUDED);
+	fido_cred_free(&x);
+
+	/* unknown rp, no resident credentials */
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, "example.com") == FIDO_OK);
+	assert(fido_dev_get_assert(dev, a, NULL) == FIDO_ERR_NO_CREDENTIALS);
+	fido_assert_free(&a);
+
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static void
+pin(struct vauth *va)
+{
+	fido_dev_t		*dev = open_dev();
+	fido_cred_t		*c[2];
+	fido_assert_t		*a;
+	fido_credman_metadata_t	*meta;
+	fido_credman_rp_t	*rp;
+	fido_credman_rk_t	*rk;
+	int			 retries;
+	uint64_t		 n;
+
+	assert(fido_dev_set_pin(dev, PIN, NULL) == FIDO_OK);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+
+	dev = open_dev();
+	assert(fido_dev_has_pin(dev));
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+	assert(retries == 8);
+
+	c[0] = make_cred(dev, 0, FIDO_OPT_TRUE, NULL, FIDO_ERR_PIN_REQUIRED);
+	fido_cred_free(&c[0]);
+	c[0] = make_cred(dev, 0, FIDO_OPT_TRUE, PIN, FIDO_OK);
+	c[1] = make_cred(dev, 1, FIDO_OPT_TRUE, PIN, FIDO_OK);
+
+	/* discoverable */
+	n = vauth_cbor_count(va);
+	a = get_assert(dev, NULL, PIN, FIDO_OK);
+	assert(fido_assert_count(a) == 2);
+	assert(fido_assert_user_id_len(a, 0) == sizeof(user_id[1]));
+	assert(memcmp(fido_assert_user_id_ptr(a, 0), user_id[1],
+	    sizeof(user_id[1])) == 0);
+	assert(strcmp(fido_assert_user_name(a, 1), "alice") == 0);
+	assert(fido_assert_flags(a, 0) & 0x04); /* uv */
+	verify(a, 0, c[1]);
+	verify(a, 1, c[0]);
+	assert(vauth_cbor_count(va) > n);
+	fido_assert_free(&a);
+
+	/* credential management */
+	assert((meta = fido_credman_metadata_new()) != NULL);
+	assert(fido_credman_get_dev_metadata(dev, meta, PIN) == FIDO_OK);
+	assert(fido_credman_rk_existing(meta) == 2);
+	assert(fido_credman_rk_remaining(meta) == 62);
+	fido_credman_metadata_free(&meta);
+
+	assert((rp = fido_credman_rp_new()) != NULL);
+	assert(fido_credman_get_dev_rp(dev, rp, PIN) == FIDO_OK);
+	assert(fido_credman_rp_count(rp) == 1);
+	assert(strcmp(fido_credman_rp_id(rp, 0), RP_ID) == 0);
+	fido_credman_rp_free(&rp);
+
+	assert((rk = fido_credman_rk_new()) != NULL);
+	assert(fido_credman_get_dev_rk(dev, RP_ID, rk, PIN) == FIDO_OK);
+	assert(fido_credman_rk_count(rk) == 2);
+	fido_credman_rk_free(&rk);
+
+	assert(fido_credman_del_dev_rk(dev, fido_cred_id_ptr(c[1]),
+	    fido_cred_id_len(c[1]), PIN) == FIDO_OK);
+	a = get_assert(dev, NULL, PIN, FIDO_OK);
+	assert(fido_assert_count(a) == 1);
+	verify(a, 0, c[0]);
+	fido_assert_free(&a);
+
+	/* wrong pin */
+	assert(fido_dev_set_pin(dev, "0000", "1234") == FIDO_ERR_PIN_INVALID);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+	assert(retries == 7);
+	assert(fido_dev_set_pin(dev, "1234", PIN) == FIDO_OK);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+	assert(retries == 8);
+	assert(fido_dev_set_pin(dev, "0000", PIN) == FIDO_ERR_PIN_INVALID);
+	assert(fido_dev_set_pin(dev, PIN, "1234") == FIDO_OK);
+
+	fido_cred_free(&c[0]);
+	fido_cred_free(&c[1]);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static void
+largeblob(void)
+{
+	fido_dev_t	*dev = open_dev();
+	unsigned char	 blob[2048];
+	unsigned char	*ptr = NULL;
+	size_t		 len = 0;
+
+	for (size_t i = 0; i < sizeof(blob); i++)
+		blob[i] = (unsigned char)(i * 7);
+
+	assert(fido_dev_largeblob_get(dev, lb_key, sizeof(lb_key), &ptr,
+	    &len) == FIDO_ERR_NOTFOUND);
+	assert(fido_dev_largeblob_set(dev, lb_key, sizeof(lb_key), blob,
+	    sizeof(blob), PIN) == FIDO_OK);
+	assert(fido_dev_largeblob_get(dev, lb_key, sizeof(lb_key), &ptr,
+	    &len) == FIDO_OK);
+	assert(len == sizeof(blob));
+	assert(memcmp(ptr, blob, len) == 0);
+	free(ptr);
+	ptr = NULL;
+	assert(fido_dev_largeblob_remove(dev, lb_key, sizeof(lb_key),
+	    PIN) == FIDO_OK);
+	assert(fido_dev_largeblob_get(dev, lb_key, sizeof(lb_key), &ptr,
+	    &len) == FIDO_ERR_NOTFOUND);
+
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static void
+burst(struct vauth *va)
+{
+	fido_dev_t	*dev;
+	fido_cred_t	*c;
+	fido_assert_t	*a;
+	uint64_t	 nw, nv;
+
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_writev_function(dev, vauth_writev) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_dev_set_writev_function(dev, NULL) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+
+	nw = vauth_write_count(va);
+	nv = vauth_writev_count(va);
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	a = get_assert(dev, c, PIN, FIDO_OK);
+	verify(a, 0, c);
+	assert(vauth_write_count(va) == nw);
+	assert(vauth_writev_count(va) > nv);
+
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static uint64_t
+assert_cost(struct vauth *va, fido_dev_t *dev, const fido_cred_t *c,
+    const char *pin, int want)
+{
+	fido_assert_t	*a;
+	uint64_t	 n = vauth_cbor_count(va);
+
+	a = get_assert(dev, c, pin, want);
+	if (want == FIDO_OK)
+		verify(a, 0, c);
+	fido_assert_free(&a);
+
+	return (vauth_cbor_count(va) - n);
+}
+
+static void
+session(struct vauth *va)
+{
+	fido_dev_t	*dev = open_dev();
+	fido_cred_t	*c;
+
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	assert(fido_dev_set_session_lifetime(dev, -2, 1) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+
+	/* disabled by default: getKeyAgreement, getPinToken, getAssertion */
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+
+	/* three uses per key agreement */
+	assert(fido_dev_set_session_lifetime(dev, -1, 3) == FIDO_OK);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 2);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 2);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+
+	/* explicit clear */
+	fido_dev_clear_session(dev);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+
+	/* a wrong pin makes the authenticator regenerate its key */
+	assert(assert_cost(va, dev, c, "1111", FIDO_ERR_PIN_INVALID) == 1);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+
+	/* an expired lifetime */
+	assert(fido_dev_set_session_lifetime(dev, 0, 3) == FIDO_OK);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+	assert(assert_cost(va, dev, c, PIN, FIDO_OK) == 3);
+
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static fido_dev_t *
+open_cached(fido_dev_cache_t *cache)
+{
+	fido_dev_t *dev;
+
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_cache(dev, cache) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_dev_set_cache(dev, NULL) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_is_fido2(dev));
+
+	return (dev);
+}
+
+static void
+session_cache(struct vauth *va)
+{
+	fido_dev_cache_t	*cache;
+	fido_dev_t		*dev;
+	fido_cred_t		*c;
+	fido_assert_t		*a;
+	uint64_t		 n;
+
+	assert((cache = fido_dev_cache_new()) != NULL);
+
+	/* first open populates the cache */
+	n = vauth_cbor_count(va);
+	dev = open_cached(cache);
+	assert(vauth_cbor_count(va) == n + 1);
+	assert(fido_dev_has_pin(dev));
+	assert(fido_dev_supports_credman(dev));
+	fido_dev_close(dev);
+
+	/* reopen skips getInfo, and the device is fully usable */
+	n = vauth_cbor_count(va);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(vauth_cbor_count(va) == n);
+	assert(fido_dev_has_pin(dev));
+	assert(fido_dev_supports_credman(dev));
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	a = get_assert(dev, c, PIN, FIDO_OK);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+
+	/* flag changes are carried over on close */
+	assert(fido_dev_reset(dev) == FIDO_OK);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+	n = vauth_cbor_count(va);
+	dev = open_cached(cache);
+	assert(vauth_cbor_count(va) == n);
+	assert(fido_dev_has_pin(dev) == false);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+
+	/* a firmware change invalidates the entry */
+	vauth_set_version(va, 1, 2, 3);
+	n = vauth_cbor_count(va);
+	dev = open_cached(cache);
+	assert(vauth_cbor_count(va) == n + 1);
+	assert(fido_dev_major(dev) == 1);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+	vauth_set_version(va, 0, 0, 0);
+
+	/* flushing empties the cache */
+	dev = open_cached(cache);
+	fido_dev_close(dev);
+	fido_dev_cache_flush(cache);
+	n = vauth_cbor_count(va);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(vauth_cbor_count(va) == n + 1);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+
+	fido_dev_cache_free(&cache);
+	assert(cache == NULL);
+}
+
+static void
+uv_token(struct vauth *va)
+{
+	fido_dev_t		*dev = open_dev();
+	fido_uv_token_t		*token;
+	fido_cred_t		*c[2];
+	fido_assert_t		*a;
+	fido_credman_metadata_t	*meta;
+	fido_credman_rp_t	*rp;
+	fido_credman_rk_t	*rk;
+	unsigned char		 blob[64];
+	unsigned char		*ptr = NULL;
+	size_t			 len = 0;
+	uint64_t		 n;
+
+	for (size_t i = 0; i < sizeof(blob); i++)
+		blob[i] = (unsigned char)(i * 7);
+	assert(fido_dev_set_pin(dev, PIN, NULL) == FIDO_OK);
+	fido_dev_close(dev);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	c[0] = make_cred(dev, 0, FIDO_OPT_TRUE, PIN, FIDO_OK);
+	c[1] = make_cred(dev, 1, FIDO_OPT_TRUE, PIN, FIDO_OK);
+
+	assert((token = fido_uv_token_new()) != NULL);
+	assert(fido_uv_token_acquire(token, dev, 0, PIN, NULL) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_uv_token_acquire(token, dev, 0x100, PIN, NULL) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_uv_token_acquire(token, dev, FIDO_UV_TOKEN_PERM_CRED_MGMT,
+	    NULL, NULL) == FIDO_ERR_PIN_REQUIRED);
+	assert(fido_credman_get_dev_rp_with_token(dev, NULL, token) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_uv_token_acquire(token, dev, FIDO_UV_TOKEN_PERM_CRED_MGMT |
+	    FIDO_UV_TOKEN_PERM_LARGEBLOB, PIN, NULL) == FIDO_OK);
+
+	/* one command per operation, no further pin exchanges */
+	n = vauth_cbor_count(va);
+	assert((meta = fido_credman_metadata_new()) != NULL);
+	assert(fido_credman_get_dev_metadata_with_token(dev, meta,
+	    token) == FIDO_OK);
+	assert(fido_credman_rk_existing(meta) == 2);
+	fido_credman_metadata_free(&meta);
+	assert((rp = fido_credman_rp_new()) != NULL);
+	assert(fido_credman_get_dev_rp_with_token(dev, rp, token) == FIDO_OK);
+	assert(fido_credman_rp_count(rp) == 1);
+	fido_credman_rp_free(&rp);
+	assert((rk = fido_credman_rk_new()) != NULL);
+	assert(fido_credman_get_dev_rk_with_token(dev, RP_ID, rk,
+	    token) == FIDO_OK);
+	assert(fido_credman_rk_count(rk) == 2);
+	fido_credman_rk_free(&rk);
+	assert(fido_credman_del_dev_rk_with_token(dev, fido_cred_id_ptr(c[1]),
+	    fido_cred_id_len(c[1]), token) == FIDO_OK);
+	assert(vauth_cbor_count(va) - n == 5);
+
+	/* missing permission */
+	assert(fido_dev_enable_entattest_with_token(dev, token) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+
+	assert(fido_dev_largeblob_set_with_token(dev, lb_key, sizeof(lb_key),
+	    blob, sizeof(blob), token) == FIDO_OK);
+	assert(fido_dev_largeblob_get(dev, lb_key, sizeof(lb_key), &ptr,
+	    &len) == FIDO_OK);
+	assert(len == sizeof(blob) && memcmp(ptr, blob, len) == 0);
+	free(ptr);
+	ptr = NULL;
+	assert(fido_dev_largeblob_remove_with_token(dev, lb_key,
+	    sizeof(lb_key), token) == FIDO_OK);
+	assert(fido_dev_largeblob_get(dev, lb_key, sizeof(lb_key), &ptr,
+	    &len) == FIDO_ERR_NOTFOUND);
+
+	/* a token obtained behind our back invalidates ours */
+	a = get_assert(dev, NULL, PIN, FIDO_OK);
+	fido_assert_free(&a);
+	assert(fido_credman_get_dev_rk_with_token(dev, RP_ID, rk, token) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+
+	/* so does closing the device */
+	assert(fido_uv_token_acquire(token, dev, FIDO_UV_TOKEN_PERM_CRED_MGMT,
+	    PIN, NULL) == FIDO_OK);
+	fido_dev_close(dev);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_credman_get_dev_rk_with_token(dev, RP_ID, rk, token) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+
+	/* the token may outlive the device */
+	assert(fido_uv_token_acquire(token, dev, FIDO_UV_TOKEN_PERM_CRED_MGMT,
+	    PIN, NULL) == FIDO_OK);
+	fido_cred_free(&c[0]);
+	fido_cred_free(&c[1]);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+	fido_uv_token_free(&token);
+	fido_uv_token_free(&token);
+}
+
+static void
+async(struct vauth *va)
+{
+	fido_dev_t	*dev = open_pollable();
+	fido_cred_t	*c;
+	fido_assert_t	*a;
+	int		 done, retries;
+
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(done == 0);
+
+	/* a second resident credential, with its reply withheld */
+	assert((c = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(c, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(c, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(c, RP_ID, NULL) == FIDO_OK);
+	assert(fido_cred_set_user(c, user_id[1], sizeof(user_id[1]), "bob",
+	    NULL, NULL) == FIDO_OK);
+	assert(fido_cred_set_rk(c, FIDO_OPT_TRUE) == FIDO_OK);
+	assert(fido_dev_make_cred_begin(dev, c, PIN) == FIDO_OK);
+	assert(fido_dev_make_cred_begin(dev, c, PIN) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+	vauth_hold(va, true);
+	assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	assert(done == 0);
+	vauth_hold(va, false);
+	assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	assert(done == 1);
+	assert(fido_cred_verify_self(c) == FIDO_OK);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_INVALID_ARGUMENT);
+
+	/* discoverable, spanning authenticatorGetNextAssertion */
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	assert(fido_dev_get_assert_begin(dev, a, PIN) == FIDO_OK);
+	do {
+		assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	} while (!done);
+	assert(fido_assert_count(a) == 2);
+	verify(a, 0, c);
+
+	/* errors are reported by the poll */
+	assert(fido_assert_set_rp(a, "example.com") == FIDO_OK);
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_NO_CREDENTIALS);
+	assert(done == 1);
+
+	/* the blocking calls are unaffected */
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	assert(fido_dev_get_assert(dev, a, PIN) == FIDO_OK);
+	assert(fido_assert_count(a) == 2);
+
+	/* but may not take the reply of a pending operation */
+	assert(fido_dev_get_assert_begin(dev, a, PIN) == FIDO_OK);
+	assert(fido_dev_get_assert(dev, a, PIN) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_make_cred(dev, c, PIN) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_ERR_TX);
+	do {
+		assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	} while (!done);
+	assert(fido_assert_count(a) == 2);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+
+	/* closing the device abandons the operation */
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	fido_dev_close(dev);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_INVALID_ARGUMENT);
+	fido_dev_free(&dev);
+
+	/* a device that goes away fails the operation */
+	dev = open_pollable();
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	vauth_unplug(va, true);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_RX);
+	assert(done == 1);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_INVALID_ARGUMENT);
+	vauth_unplug(va, false);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+}
+
+static void
+channels(void)
+{
+	fido_dev_t		*dev = open_dev();
+	fido_dev_t		*ch[2];
+	fido_cred_t		*c;
+	fido_cbor_info_t	*ci;
+	int			 retries, done;
+
+	for (size_t i = 0; i < 2; i++) {
+		assert((ch[i] = fido_dev_new()) != NULL);
+		assert(fido_dev_open_channel(ch[i], dev) == FIDO_OK);
+		assert(fido_dev_is_fido2(ch[i]));
+		assert(fido_dev_has_pin(ch[i]));
+	}
+	assert(fido_dev_open_channel(ch[0], dev) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_open_channel(dev, ch[0]) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_close(dev) == FIDO_ERR_INVALID_ARGUMENT);
+
+	/* a reply read on another channel is kept for its owner */
+	assert((c = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(c, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(c, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(c, RP_ID, NULL) == FIDO_OK);
+	assert(fido_cred_set_user(c, user_id[0], sizeof(user_id[0]), NULL,
+	    NULL, NULL) == FIDO_OK);
+	assert(fido_dev_make_cred_begin(ch[0], c, PIN) == FIDO_OK);
+	assert(fido_dev_get_retry_count(ch[1], &retries) == FIDO_OK);
+	assert(retries == 8);
+	assert((ci = fido_cbor_info_new()) != NULL);
+	assert(fido_dev_get_cbor_info(dev, ci) == FIDO_OK);
+	fido_cbor_info_free(&ci);
+	assert(fido_dev_poll(ch[0], &done) == FIDO_OK);
+	assert(done == 1);
+	assert(fido_cred_verify_self(c) == FIDO_OK);
+
+	/* channels may be closed or freed in any order */
+	fido_dev_free(&ch[1]);
+	assert(fido_dev_close(dev) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_close(ch[0]) == FIDO_OK);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+
+	/* the parent keeps its mux for channels opened later */
+	assert(fido_dev_open_channel(ch[0], dev) == FIDO_OK);
+	assert(fido_dev_get_retry_count(ch[0], &retries) == FIDO_OK);
+	assert(fido_dev_close(dev) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_close(ch[0]) == FIDO_OK);
+	assert(fido_dev_close(dev) == FIDO_OK);
+
+	fido_cred_free(&c);
+	fido_dev_free(&ch[0]);
+	fido_dev_free(&dev);
+}
+
+struct keepalive_log {
+	fido_dev_t	*dev;
+	uint8_t		 status[4];
+	int		 ms[4];
+	size_t		 n;
+};
+
+static void
+keepalive_cb(fido_dev_t *dev, uint8_t status, int ms, void *arg)
+{
+	struct keepalive_log *kl = arg;
+
+	assert(dev == kl->dev);
+	assert(kl->n < sizeof(kl->status));
+	assert(ms >= 0 && (kl->n == 0 || ms >= kl->ms[kl->n - 1]));
+	kl->status[kl->n] = status;
+	kl->ms[kl->n++] = ms;
+}
+
+static void
+keepalive(struct vauth *va)
+{
+	fido_dev_t		*dev = open_pollable();
+	fido_cred_t		*c;
+	fido_assert_t		*a;
+	struct keepalive_log	 kl;
+	int			 done, retries;
+
+	assert(fido_dev_first_keepalive_ms(dev) == -1);
+	assert(fido_dev_response_ms(dev) >= 0);
+
+	memset(&kl, 0, sizeof(kl));
+	kl.dev = dev;
+	assert(fido_dev_set_keepalive_handler(dev, keepalive_cb,
+	    &kl) == FIDO_OK);
+	vauth_set_keepalives(va, 3);
+
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	assert(kl.n == 3);
+	assert(kl.status[0] == CTAP_KEEPALIVE_PROCESSING);
+	assert(kl.status[1] == CTAP_KEEPALIVE_UPNEEDED);
+	assert(kl.status[2] == CTAP_KEEPALIVE_UPNEEDED);
+	assert(fido_dev_first_keepalive_ms(dev) == kl.ms[0]);
+	assert(fido_dev_response_ms(dev) >= kl.ms[2]);
+
+	/* non-blocking */
+	kl.n = 0;
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	assert(fido_assert_allow_cred(a, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	assert(fido_dev_response_ms(dev) == -1);
+	assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	assert(done == 1);
+	assert(kl.n == 3);
+	assert(fido_dev_first_keepalive_ms(dev) == kl.ms[0]);
+	assert(fido_dev_response_ms(dev) >= kl.ms[2]);
+	verify(a, 0, c);
+
+	/* no keepalives, and no handler */
+	kl.n = 0;
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+	assert(fido_dev_first_keepalive_ms(dev) == -1);
+	assert(fido_dev_response_ms(dev) >= 0);
+	assert(fido_dev_set_keepalive_handler(dev, NULL, NULL) == FIDO_OK);
+	fido_assert_free(&a);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	assert(kl.n == 0);
+	assert(fido_dev_first_keepalive_ms(dev) >= 0);
+	vauth_set_keepalives(va, 0);
+
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+static uint64_t
+latency_count(const fido_dev_stats_t *st, uint8_t cmd, int phase)
+{
+	uint64_t n = 0;
+
+	for (size_t i = 0; i < FIDO_STATS_NBUCKETS; i++)
+		n += fido_dev_stats_latency(st, cmd, phase, i);
+
+	return (n);
+}
+
+static void
+stats(struct vauth *va)
+{
+	fido_dev_t		*dev;
+	fido_dev_stats_t	*st;
+	fido_cred_t		*c;
+	fido_assert_t		*a;
+	uint64_t		 ctr[FIDO_STATS_NCOUNTERS];
+
+	assert((st = fido_dev_stats_new()) != NULL);
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_stats(dev, st) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+
+	/* CTAPHID_INIT and authenticatorGetInfo */
+	assert(fido_dev_stats_counter(st, FIDO_STATS_TX_FRAMES) == 2);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_RX_FRAMES) >= 2);
+	assert(latency_count(st, CTAP_CBOR_GETINFO, FIDO_STATS_WIRE) == 1);
+	assert(latency_count(st, CTAP_CBOR_GETINFO, FIDO_STATS_DECODE) == 1);
+
+	vauth_set_keepalives(va, 2);
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	vauth_set_keepalives(va, 0);
+
+	assert(fido_dev_stats_counter(st, FIDO_STATS_TX_BYTES) ==
+	    65 * fido_dev_stats_counter(st, FIDO_STATS_TX_FRAMES));
+	assert(fido_dev_stats_counter(st, FIDO_STATS_RX_BYTES) ==
+	    64 * fido_dev_stats_counter(st, FIDO_STATS_RX_FRAMES));
+	assert(fido_dev_stats_counter(st, FIDO_STATS_SYSCALLS) ==
+	    fido_dev_stats_counter(st, FIDO_STATS_TX_FRAMES) +
+	    fido_dev_stats_counter(st, FIDO_STATS_RX_FRAMES));
+	assert(fido_dev_stats_counter(st, FIDO_STATS_KEEPALIVES) == 2);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_RETRIES) == 0);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_TIMEOUTS) == 0);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_NCOUNTERS) == 0);
+	assert(fido_dev_stats_counter(st, -1) == 0);
+	for (int i = 0; i < FIDO_STATS_NPHASES; i++)
+		assert(latency_count(st, CTAP_CBOR_MAKECRED, i) == 1);
+	assert(latency_count(st, CTAP_CBOR_CLIENT_PIN, FIDO_STATS_WIRE) ==
+	    latency_count(st, CTAP_CBOR_CLIENT_PIN, FIDO_STATS_DECODE));
+	assert(latency_count(st, CTAP_CBOR_CLIENT_PIN, FIDO_STATS_WIRE) > 0);
+	assert(latency_count(st, CTAP_CBOR_ASSERT, FIDO_STATS_WIRE) == 0);
+	assert(fido_dev_stats_latency(st, CTAP_CBOR_MAKECRED, FIDO_STATS_NPHASES,
+	    0) == 0);
+	assert(fido_dev_stats_latency(st, CTAP_CBOR_MAKECRED, FIDO_STATS_WIRE,
+	    FIDO_STATS_NBUCKETS) == 0);
+	assert(fido_dev_stats_latency(st, 0x40, FIDO_STATS_WIRE, 0) == 0);
+
+	/* detached: nothing is recorded */
+	for (int i = 0; i < FIDO_STATS_NCOUNTERS; i++)
+		ctr[i] = fido_dev_stats_counter(st, i);
+	assert(fido_dev_set_stats(dev, NULL) == FIDO_OK);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	fido_assert_free(&a);
+	for (int i = 0; i < FIDO_STATS_NCOUNTERS; i++)
+		assert(fido_dev_stats_counter(st, i) == ctr[i]);
+	assert(latency_count(st, CTAP_CBOR_ASSERT, FIDO_STATS_WIRE) == 0);
+
+	fido_dev_stats_reset(st);
+	for (int i = 0; i < FIDO_STATS_NCOUNTERS; i++)
+		assert(fido_dev_stats_counter(st, i) == 0);
+	assert(latency_count(st, CTAP_CBOR_MAKECRED, FIDO_STATS_WIRE) == 0);
+
+	assert(fido_dev_set_stats(dev, st) == FIDO_OK);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	verify(a, 0, c);
+	for (int i = 0; i < FIDO_STATS_NPHASES; i++)
+		assert(latency_count(st, CTAP_CBOR_ASSERT, i) == 1);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_TX_FRAMES) > 0);
+
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+	fido_dev_stats_free(&st);
+	fido_dev_stats_free(&st);
+}
+
+static struct {
+	size_t	dumps;
+	size_t	tx;
+	size_t	rx;
+	size_t	err;
+	size_t	cbor;
+	size_t	payload;
+} rec;
+
+static void
+rec_handler(const char *line)
+{
+	const char *p;
+
+	if (strncmp(line, "flight recorder: ", 17) == 0)
+		rec.dumps++;
+	if (line[0] != '+')
+		return;
+	if (strstr(line, " tx cid=") != NULL) {
+		rec.tx++;
+		if (strstr(line, " cmd=0x10 ") != NULL)
+			rec.cbor++;
+	}
+	if (strstr(line, " rx cid=") != NULL)
+		rec.rx++;
+	/* a report is its header and length, nothing more */
+	if ((strstr(line, " tx cid=") != NULL ||
+	    strstr(line, " rx cid=") != NULL) &&
+	    ((p = strstr(line, " len=")) == NULL || strchr(p + 1, ' ') != NULL))
+		rec.payload++;
+	if (strstr(line, " error fido_rx: ") != NULL)
+		rec.err++;
+}
+
+static void
+flight_recorder(struct vauth *va)
+{
+	fido_dev_t	*dev = open_dev();
+	int		 retries;
+
+	fido_set_log_handler(rec_handler);
+	fido_log_dump();
+	memset(&rec, 0, sizeof(rec));
+
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_OK);
+	fido_log_dump();
+	assert(rec.dumps == 1);
+	assert(rec.tx > 0 && rec.rx > 0 && rec.cbor > 0);
+	assert(rec.err == 0 && rec.payload == 0);
+
+	/* the ring is cleared by a dump */
+	memset(&rec, 0, sizeof(rec));
+	fido_log_dump();
+	assert(rec.dumps == 1 && rec.tx == 0 && rec.rx == 0);
+
+	/* dump on error */
+	fido_init(FIDO_DUMP_ON_ERROR);
+	vauth_hold(va, true);
+	assert(fido_dev_get_retry_count(dev, &retries) == FIDO_ERR_RX);
+	vauth_hold(va, false);
+	assert(rec.dumps == 2);
+	assert(rec.tx > 0 && rec.err == 1);
+	fido_init(0);
+
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+/* Cancel from within the wait, as another thread would. */
+static void
+cancel_cb(fido_dev_t *dev, uint8_t status, int ms, void *arg)
+{
+	(void)status;
+	(void)ms;
+	(void)arg;
+
+	assert(fido_dev_cancel(dev) == FIDO_OK);
+}
+
+static void
+cancel(struct vauth *va)
+{
+	fido_dev_t	*dev;
+	fido_cred_t	*c;
+	fido_assert_t	*a;
+	int		 done;
+
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_wakeup_function(dev, vauth_wakeup) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	assert(fido_dev_set_wakeup_function(dev, NULL) ==
+	    FIDO_ERR_INVALID_ARGUMENT);
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+
+	/* nothing is waiting: the next request isn't affected */
+	assert(fido_dev_cancel(dev) == FIDO_OK);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* a waiting request is woken; its reply is skipped by the next one */
+	assert(fido_dev_set_keepalive_handler(dev, cancel_cb, NULL) == FIDO_OK);
+	vauth_set_keepalives(va, 1);
+	a = get_assert(dev, c, NULL, FIDO_ERR_KEEPALIVE_CANCEL);
+	fido_assert_free(&a);
+	vauth_set_keepalives(va, 0);
+	assert(fido_dev_set_keepalive_handler(dev, NULL, NULL) == FIDO_OK);
+	a = get_assert(dev, c, NULL, FIDO_OK);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* non-blocking */
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	assert(fido_assert_allow_cred(a, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	assert(fido_dev_cancel(dev) == FIDO_OK);
+	assert(fido_dev_poll(dev, &done) == FIDO_ERR_KEEPALIVE_CANCEL);
+	assert(done == 1);
+	assert(fido_dev_get_assert_begin(dev, a, NULL) == FIDO_OK);
+	assert(fido_dev_poll(dev, &done) == FIDO_OK);
+	assert(done == 1);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+/*
+ * First touch wins, among devices waited on with poll(2) and one that
+ * isn't; the devices not touched are usable afterwards.
+ */
+static void
+select_touch(void)
+{
+	struct vauth	*va1, *va2;
+	fido_dev_t	*dev[3];
+	fido_cred_t	*c;
+	size_t		 idx;
+
+	assert((va1 = vauth_new("vauth:1")) != NULL);
+	assert((va2 = vauth_new("vauth:2")) != NULL);
+	assert((dev[0] = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev[0], &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_pollfd_function(dev[0], vauth_pollfd) == FIDO_OK);
+	assert(fido_dev_select(dev, 1, &idx, -1) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(idx == SIZE_MAX);
+	assert(fido_dev_open(dev[0], "vauth:1") == FIDO_OK);
+	assert((dev[1] = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev[1], &vauth_io) == FIDO_OK);
+	assert(fido_dev_open(dev[1], "vauth:2") == FIDO_OK);
+	dev[2] = open_pollable();
+	assert(fido_dev_select(dev, 0, &idx, -1) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_select(dev, 3, &idx, -2) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_select(dev, 3, NULL, -1) == FIDO_ERR_INVALID_ARGUMENT);
+
+	vauth_set_absent(va1, true);
+	vauth_set_absent(va2, true);
+	assert(fido_dev_select(dev, 3, &idx, -1) == FIDO_OK);
+	assert(idx == 2);
+	assert(fido_dev_select(dev, 2, &idx, 200) ==
+	    FIDO_ERR_USER_ACTION_TIMEOUT);
+	assert(idx == SIZE_MAX);
+	vauth_set_absent(va2, false);
+	assert(fido_dev_select(dev, 2, &idx, -1) == FIDO_OK);
+	assert(idx == 1);
+	vauth_set_absent(va1, false);
+
+	for (size_t i = 0; i < 3; i++) {
+		c = make_cred(dev[i], 0, FIDO_OPT_OMIT, i == 2 ? PIN : NULL,
+		    FIDO_OK);
+		fido_cred_free(&c);
+		fido_dev_close(dev[i]);
+		fido_dev_free(&dev[i]);
+	}
+	vauth_free(&va1);
+	vauth_free(&va2);
+}
+
+/*
+ * U2F authentication with a credential among unknown key handles: all are
+ * looked up, then the signature is repeated until the user is present.
+ */
+static void
+u2f(struct vauth *va)
+{
+	fido_dev_t		*dev;
+	fido_dev_stats_t	*st;
+	fido_cred_t		*c;
+	fido_assert_t		*a;
+	unsigned char		 junk[32];
+
+	assert((st = fido_dev_stats_new()) != NULL);
+	assert((dev = fido_dev_new()) != NULL);
+	assert(fido_dev_set_io_functions(dev, &vauth_io) == FIDO_OK);
+	assert(fido_dev_set_stats(dev, st) == FIDO_OK);
+	assert(fido_dev_open(dev, VAUTH_PATH) == FIDO_OK);
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	fido_dev_force_u2f(dev);
+
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_assert_allow_cred(a, junk, sizeof(junk)) == FIDO_OK);
+	}
+	assert(fido_dev_get_assert(dev, a, NULL) == FIDO_ERR_NO_CREDENTIALS);
+	assert(fido_assert_allow_cred(a, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+
+	vauth_set_u2f_refusals(va, 3);
+	assert(fido_dev_get_assert(dev, a, NULL) == FIDO_OK);
+	assert(fido_assert_count(a) == 1);
+	assert(fido_assert_id_len(a, 0) == fido_cred_id_len(c));
+	assert(memcmp(fido_assert_id_ptr(a, 0), fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == 0);
+	verify(a, 0, c);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_RETRIES) == 3);
+
+	assert(fido_assert_set_up(a, FIDO_OPT_FALSE) == FIDO_OK);
+	assert(fido_dev_get_assert(dev, a, NULL) ==
+	    FIDO_ERR_USER_PRESENCE_REQUIRED);
+	assert(fido_assert_count(a) == 1);
+	assert(fido_dev_stats_counter(st, FIDO_STATS_RETRIES) == 3);
+
+	fido_assert_free(&a);
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+	fido_dev_stats_free(&st);
+}
+
+static uint64_t
+assert_cbor_count(struct vauth *va, fido_dev_t *dev, fido_assert_t *a,
+    int want)
+{
+	uint64_t n = vauth_cbor_count(va);
+
+	assert(fido_dev_get_assert(dev, a, PIN) == want);
+
+	return (vauth_cbor_count(va) - n);
+}
+
+/*
+ * Allow and exclude lists longer than maxCredentialCountInList: batches
+ * are probed until one holds the credential, the last without a probe.
+ * Ids longer than maxCredentialIdLength are dropped. Probes carry the
+ * request's token, so credProtect=3 credentials are found.
+ */
+static void
+batching(struct vauth *va)
+{
+	fido_dev_t	*dev;
+	fido_cred_t	*c, *x, *p;
+	fido_assert_t	*a;
+	unsigned char	 junk[64];
+	uint64_t	 n;
+
+	dev = open_dev();
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, PIN, FIDO_OK);
+	a = get_assert(dev, c, PIN, FIDO_OK);
+	n = assert_cbor_count(va, dev, a, FIDO_OK);
+	fido_assert_free(&a);
+
+	/* the credential last: two probes */
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_assert_allow_cred(a, junk, 32) == FIDO_OK);
+	}
+	assert(assert_cbor_count(va, dev, a, FIDO_ERR_NO_CREDENTIALS) == n + 2);
+	assert(fido_assert_allow_cred(a, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(assert_cbor_count(va, dev, a, FIDO_OK) == n + 2);
+	assert(fido_assert_count(a) == 1);
+	assert(fido_assert_id_len(a, 0) == fido_cred_id_len(c));
+	assert(memcmp(fido_assert_id_ptr(a, 0), fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == 0);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* the credential first: one probe */
+	a = get_assert(dev, c, PIN, FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_assert_allow_cred(a, junk, 32) == FIDO_OK);
+	}
+	assert(assert_cbor_count(va, dev, a, FIDO_OK) == n + 1);
+	assert(fido_assert_count(a) == 1);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* ids too long to be the authenticator's: no probes */
+	assert((a = fido_assert_new()) != NULL);
+	assert(fido_assert_set_clientdata_hash(a, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_assert_set_rp(a, RP_ID) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_assert_allow_cred(a, junk, sizeof(junk)) == FIDO_OK);
+	}
+	assert(fido_dev_get_assert(dev, a, PIN) == FIDO_ERR_NO_CREDENTIALS);
+	assert(fido_assert_allow_cred(a, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(assert_cbor_count(va, dev, a, FIDO_OK) == n);
+	verify(a, 0, c);
+	fido_assert_free(&a);
+
+	/* exclude list */
+	assert((x = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(x, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(x, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(x, RP_ID, "Example") == FIDO_OK);
+	assert(fido_cred_set_user(x, user_id[1], sizeof(user_id[1]), "bob",
+	    NULL, NULL) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_cred_exclude(x, junk, 32) == FIDO_OK);
+	}
+	assert(fido_cred_exclude(x, fido_cred_id_ptr(c),
+	    fido_cred_id_len(c)) == FIDO_OK);
+	assert(fido_dev_make_cred(dev, x, PIN) ==
+	    FIDO_ERR_CREDENTIAL_EXCLUDED);
+	fido_cred_free(&x);
+
+	assert((x = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(x, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(x, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(x, RP_ID, "Example") == FIDO_OK);
+	assert(fido_cred_set_user(x, user_id[1], sizeof(user_id[1]), "bob",
+	    NULL, NULL) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_cred_exclude(x, junk, i % 2 ? 32 : 64) == FIDO_OK);
+	}
+	assert(fido_dev_make_cred(dev, x, PIN) == FIDO_OK);
+	assert(fido_cred_verify_self(x) == FIDO_OK);
+	fido_cred_free(&x);
+
+	/* credProtect=3 in a probed batch: only found with the token */
+	assert((p = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(p, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(p, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(p, RP_ID, "Example") == FIDO_OK);
+	assert(fido_cred_set_user(p, user_id[1], sizeof(user_id[1]), "bob",
+	    NULL, NULL) == FIDO_OK);
+	assert(fido_cred_set_prot(p, FIDO_CRED_PROT_UV_REQUIRED) == FIDO_OK);
+	assert(fido_dev_make_cred(dev, p, PIN) == FIDO_OK);
+	assert(fido_cred_verify_self(p) == FIDO_OK);
+
+	assert((x = fido_cred_new()) != NULL);
+	assert(fido_cred_set_type(x, COSE_ES256) == FIDO_OK);
+	assert(fido_cred_set_clientdata_hash(x, cdh, sizeof(cdh)) == FIDO_OK);
+	assert(fido_cred_set_rp(x, RP_ID, "Example") == FIDO_OK);
+	assert(fido_cred_set_user(x, user_id[1], sizeof(user_id[1]), "bob",
+	    NULL, NULL) == FIDO_OK);
+	assert(fido_cred_exclude(x, fido_cred_id_ptr(p),
+	    fido_cred_id_len(p)) == FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_cred_exclude(x, junk, 32) == FIDO_OK);
+	}
+	assert(fido_dev_make_cred(dev, x, PIN) ==
+	    FIDO_ERR_CREDENTIAL_EXCLUDED);
+	fido_cred_free(&x);
+
+	a = get_assert(dev, p, PIN, FIDO_OK);
+	for (int i = 0; i < 20; i++) {
+		memset(junk, i, sizeof(junk));
+		assert(fido_assert_allow_cred(a, junk, 32) == FIDO_OK);
+	}
+	assert(assert_cbor_count(va, dev, a, FIDO_OK) == n + 1);
+	assert(fido_assert_count(a) == 1);
+	verify(a, 0, p);
+	fido_assert_free(&a);
+	fido_cred_free(&p);
+
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+/*
+ * A pool of two devices: least recently used first, no handshake when a
+ * device is leased again, a reopen after an unplug, and no reopen of a
+ * different authenticator at the same path.
+ */
+static void
+pool(struct vauth *va)
+{
+	struct vauth	*va1;
+	fido_dev_pool_t	*p;
+	fido_dev_info_t	*di;
+	fido_dev_t	*dev0, *dev1, *dev;
+	uint64_t	 n;
+
+	assert((va1 = vauth_new("vauth:1")) != NULL);
+	assert((di = fido_dev_info_new(2)) != NULL);
+	assert(fido_dev_info_set(di, 0, VAUTH_PATH, "", "", &vauth_io,
+	    NULL) == FIDO_OK);
+	assert(fido_dev_info_set(di, 1, "vauth:1", "", "", &vauth_io,
+	    NULL) == FIDO_OK);
+	assert((p = fido_dev_pool_new()) != NULL);
+	assert(fido_dev_pool_set_timeout(p, -2) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_pool_set_timeout(p, 1000) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_ERR_NOTFOUND);
+	assert(fido_dev_pool_add(p, fido_dev_info_ptr(di, 0)) == FIDO_OK);
+	assert(fido_dev_pool_add(p, fido_dev_info_ptr(di, 1)) == FIDO_OK);
+
+	/* both in use */
+	assert(fido_dev_pool_lease(p, &dev0, 0) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev1, 0) == FIDO_OK);
+	assert(dev0 != dev1 && fido_dev_is_fido2(dev0));
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_ERR_NOTFOUND);
+	assert(dev == NULL);
+	assert(fido_dev_pool_lease(p, &dev, -2) == FIDO_ERR_INVALID_ARGUMENT);
+
+	/* released longest ago first, kept open */
+	n = vauth_cbor_count(va) + vauth_cbor_count(va1);
+	assert(fido_dev_pool_release(p, dev1) == FIDO_OK);
+	assert(fido_dev_pool_release(p, dev1) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_pool_release(p, dev0) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(dev == dev1);
+	assert(fido_dev_pool_release(p, dev) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(dev == dev0);
+	assert(vauth_cbor_count(va) + vauth_cbor_count(va1) == n);
+
+	/* unplugged: the other device, then nothing */
+	vauth_unplug(va1, true);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_ERR_NOTFOUND);
+	assert(fido_dev_pool_release(p, dev0) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(dev == dev0);
+	assert(fido_dev_pool_release(p, dev0) == FIDO_OK);
+
+	/* replugged: reopened, with a handshake and an identity check */
+	vauth_unplug(va1, false);
+	assert(fido_dev_pool_maintain(p, -1) == FIDO_ERR_INVALID_ARGUMENT);
+	assert(fido_dev_pool_maintain(p, 0) == FIDO_OK);
+	assert(vauth_cbor_count(va1) == n - vauth_cbor_count(va) + 2);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(fido_dev_pool_release(p, dev0) == FIDO_OK);
+	assert(fido_dev_pool_release(p, dev1) == FIDO_OK);
+
+	/* replaced: reopened, but not handed out */
+	assert(vauth_replace(va1) == 0);
+	assert(fido_dev_pool_maintain(p, 0) == FIDO_OK);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_OK);
+	assert(dev == dev0);
+	assert(fido_dev_pool_lease(p, &dev, 0) == FIDO_ERR_NOTFOUND);
+	assert(fido_dev_pool_release(p, dev0) == FIDO_OK);
+
+	fido_dev_pool_free(&p);
+	assert(p == NULL);
+	fido_dev_info_free(&di, 2);
+	vauth_free(&va1);
+}
+
+static void
+reset(void)
+{
+	fido_dev_t	*dev = open_dev();
+	fido_assert_t	*a;
+
+	assert(fido_dev_reset(dev) == FIDO_OK);
+	assert(fido_dev_has_pin(dev) == false);
+	a = get_assert(dev, NULL, NULL, FIDO_ERR_NO_CREDENTIALS);
+	fido_assert_free(&a);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+/*
+ * Repeated make_cred/get_assert round trips. With an iteration count on the
+ * command line, report the rate; the regress run only checks correctness.
+ */
+static void
+loop(unsigned long iter)
+{
+	fido_dev_t	*dev = open_dev();
+	fido_cred_t	*c;
+	fido_assert_t	*a;
+	clock_t		 t0, t1;
+
+	c = make_cred(dev, 0, FIDO_OPT_OMIT, NULL, FIDO_OK);
+	t0 = clock();
+	for (unsigned long i = 0; i < iter; i++) {
+		a = get_assert(dev, c, NULL, FIDO_OK);
+		verify(a, 0, c);
+		fido_assert_free(&a);
+	}
+	t1 = clock();
+	if (iter > 256 && t1 > t0)
+		printf("%lu assertions, %.0f ops/sec\n", iter,
+		    (double)iter * CLOCKS_PER_SEC / (double)(t1 - t0));
+
+	fido_cred_free(&c);
+	fido_dev_close(dev);
+	fido_dev_free(&dev);
+}
+
+#ifndef _WIN32
+/*
+ * Assertions on FANOUT devices driven from a single thread, waiting on
+ * their descriptors with poll(2). As in loop(), only report the rate if
+ * asked to.
+ */
+static void
+fanout(unsigned long iter)
+{
+	fido_dev_t	*dev[FANOUT];
+	fido_assert_t	*a[FANOUT];
+	struct pollfd	 pfd[FANOUT];
+	fido_cred_t	*c;
+	unsigned long	 n = 0;
+	clock_t		 t0, t1;
+	int		 done;
+
+	for (size_t i = 0; i < FANOUT; i++) {
+		dev[i] = open_pollable();
+		pfd[i].fd = fido_dev_pollfd(dev[i]);
+		pfd[i].events = POLLIN;
+	}
+	c = make_cred(dev[0], 0, FIDO_OPT_OMIT, NULL, FIDO_OK);
+
+	t0 = clock();
+	for (size_t i = 0; i < FANOUT; i++) {
+		assert((a[i] = fido_assert_new()) != NULL);
+		assert(fido_assert_set_clientdata_hash(a[i], cdh,
+		    sizeof(cdh)) == FIDO_OK);
+		assert(fido_assert_set_rp(a[i], RP_ID) == FIDO_OK);
+		assert(fido_assert_allow_cred(a[i], fido_cred_id_ptr(c),
+		    fido_cred_id_len(c)) == FIDO_OK);
+		assert(fido_dev_get_assert_begin(dev[i], a[i], NULL) == FIDO_OK);
+	}
+	while (n < iter) {
+		assert(poll(pfd, FANOUT, -1) > 0);
+		for (size_t i = 0; i < FANOUT; i++) {
+			if ((pfd[i].revents & POLLIN) == 0)
+				continue;
+			assert(fido_dev_poll(dev[i], &done) == FIDO_OK);
+			if (!done)
+				continue;
+			verify(a[i], 0, c);
+			n++;
+			assert(fido_dev_get_assert_begin(dev[i], a[i],
+			    NULL) == FIDO_OK);
+		}
+	}
+	t1 = clock();
+	if (iter > 256 && t1 > t0)
+		printf("%lu assertions on %d devices, %.0f ops/sec\n", n,
+		    FANOUT, (double)n * CLOCKS_PER_SEC / (double)(t1 - t0));
+
+	for (size_t i = 0; i < FANOUT; i++) {
+		fido_dev_close(dev[i]);
+		fido_dev_free(&dev[i]);
+		fido_assert_free(&a[i]);
+	}
+	fido_cred_free(&c);
+}
+#endif
+
+int
+main(int argc, char **argv)
+{
+	struct vauth	*va;
+	unsigned long	 iter = 256;
+
+	fido_init(0);
+
+	if (argc > 1)
+		iter = strtoul(argv[1], NULL, 10);
+
+	assert((va = vauth_new(VAUTH_PATH)) != NULL);
+
+	info();
+	nopin();
+	pin(va);
+	largeblob();
+	burst(va);
+	session(va);
+	session_cache(va);
+	uv_token(va);
+	async(va);
+	channels();
+	keepalive(va);
+	stats(va);
+	flight_recorder(va);
+	cancel(va);
+	select_touch();
+	u2f(va);
+	batching(va);
+	pool(va);
+	reset();
+	loop(iter);
+#ifndef _WIN32
+	fanout(iter);
+#endif
+
+	vauth_free(&va);
+
+	exit(0);
+}
@@ -5,29 +5,26 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
 #include <openssl/sha.h>
 
 #include "fido.h"
 #include "fido/es256.h"
+#include "fido/es384.h"
 #include "fido/rs256.h"
 #include "fido/eddsa.h"
 
 static int
-adjust_assert_count(const cbor_item_t *key, const cbor_item_t *val, void *arg)
+adjust_assert_count(const cbor_slice_t *val, fido_assert_t *assert)
 {
-	fido_assert_t	*assert = arg;
-	uint64_t	 n;
+	uint64_t n;
 
 	/* numberOfCredentials; see section 6.2 */
-	if (cbor_isa_uint(key) == false ||
-	    cbor_int_get_width(key) != CBOR_INT_8 ||
-	    cbor_get_uint8(key) != 5) {
-		fido_log_debug("%s: cbor_type", __func__);
-		return (0); /* ignore */
-	}
-
-	if (cbor_decode_uint64(val, &n) < 0 || n > SIZE_MAX) {
-		fido_log_debug("%s: cbor_decode_uint64", __func__);
+	if (cbor_slice_uint64(val, &n) < 0 || n > SIZE_MAX) {
+		fido_log_debug("%s: cbor_slice_uint64", __func__);
 		return (-1);
 	}
 
@@ -49,46 +46,87 @@ adjust_assert_count(const cbor_item_t *key, const cbor_item_t *val, void *arg)
 }
 
 static int
-parse_assert_reply(const cbor_item_t *key, const cbor_item_t *val, void *arg)
+parse_assert_reply(const cbor_slice_t *key, const cbor_slice_t *val,
+    void *arg)
 {
-	fido_assert_stmt *stmt = arg;
+	fido_assert_stmt	*stmt = arg;
+	uint8_t			 k;
 
-	if (cbor_isa_uint(key) == false ||
-	    cbor_int_get_width(key) != CBOR_INT_8) {
+	if (cbor_slice_uint8_key(key, &k) < 0) {
 		fido_log_debug("%s: cbor type", __func__);
 		return (0); /* ignore */
 	}
 
-	switch (cbor_get_uint8(key)) {
+	switch (k) {
 	case 1: /* credential id */
-		return (cbor_decode_cred_id(val, &stmt->id));
+		return (cbor_slice_decode_cred_id(val, &stmt->id));
 	case 2: /* authdata */
-		return (cbor_decode_assert_authdata(val, &stmt->authdata_cbor,
-		    &stmt->authdata, &stmt->authdata_ext));
+		return (cbor_slice_decode_assert_authdata(val,
+		    &stmt->authdata_cbor, &stmt->authdata,
+		    &stmt->authdata_ext));
 	case 3: /* signature */
-		return (fido_blob_decode(val, &stmt->sig));
+		return (cbor_slice_blob(val, &stmt->sig));
 	case 4: /* user attributes */
-		return (cbor_decode_user(val, &stmt->user));
+		return (cbor_slice_decode_user(val, &stmt->user));
 	case 7: /* large blob key */
-		return (fido_blob_decode(val, &stmt->largeblob_key));
+		return (cbor_slice_blob(val, &stmt->largeblob_key));
 	default: /* ignore */
 		fido_log_debug("%s: cbor type", __func__);
 		return (0);
 	}
 }
 
+static int
+parse_first_assert_reply(const cbor_slice_t *key, const cbor_slice_t *val,
+    void *arg)
+{
+	fido_assert_t	*assert = arg;
+	uint8_t		 k;
+
+	if (cbor_slice_uint8_key(key, &k) == 0 && k == 5)
+		return (adjust_assert_count(val, assert));
+
+	return (parse_assert_reply(key, val, &assert->stmt[0]));
+}
+
+struct assert_tx {
+	const fido_dev_t	*dev;
+	const fido_assert_t	*assert;
+	fido_opt_t		 uv;
+	const cbor_item_t	*hmac_secret;
+	const cbor_item_t	*pin_auth;
+	const cbor_item_t	*pin_opt;
+};
+
+static bool
+allow_list_fits(const fido_blob_array_t *allow_list, void *arg)
+{
+	const struct assert_tx	*tx = arg;
+	size_t			 len;
+
+	len = cbor_frame_get_assert_len(tx->assert, allow_list, tx->uv,
+	    tx->hmac_secret, tx->pin_auth, tx->pin_opt);
+
+	return (len != 0 && (tx->dev->maxmsgsize == 0 ||
+	    len <= tx->dev->maxmsgsize));
+}
+
 static int
 fido_dev_get_assert_tx(fido_dev_t *dev, fido_assert_t *assert,
     const es256_pk_t *pk, const fido_blob_t *ecdh, const char *pin, int *ms)
 {
-	fido_blob_t	 f;
-	fido_opt_t	 uv = assert->uv;
-	cbor_item_t	*argv[7];
-	const uint8_t	 cmd = CTAP_CBOR_ASSERT;
-	int		 r;
+	fido_blob_t		 f;
+	fido_blob_array_t	 allow;
+	fido_opt_t		 uv = assert->uv;
+	cbor_item_t		*hmac_secret = NULL;
+	cbor_item_t		*pin_auth = NULL;
+	cbor_item_t		*pin_opt = NULL;
+	struct assert_tx	 tx;
+	const uint8_t		 cmd = CTAP_CBOR_ASSERT;
+	int			 r;
 
-	memset(argv, 0, sizeof(argv));
 	memset(&f, 0, sizeof(f));
+	memset(&allow, 0, sizeof(allow));
 
 	/* do we have everything we need? */
 	if (assert->rp_id == NULL || assert->cdh.ptr == NULL) {
@@ -98,27 +136,12 @@ fido_dev_get_assert_tx(fido_dev_t *dev, fido_assert_t *assert,
 		goto fail;
 	}
 
-	if ((argv[0] = cbor_build_string(assert->rp_id)) == NULL ||
-	    (argv[1] = fido_blob_encode(&assert->cdh)) == NULL) {
-		fido_log_debug("%s: cbor encode", __func__);
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	/* allowed credentials */
-	if (assert->allow_list.len) {
-		const fido_blob_array_t *cl = &assert->allow_list;
-		if ((argv[2] = cbor_encode_pubkey_list(cl)) == NULL) {
-			fido_log_debug("%s: cbor_encode_pubkey_list", __func__);
-			r = FIDO_ERR_INTERNAL;
-			goto fail;
-		}
-	}
-
-	if (assert->ext.mask)
-		if ((argv[3] = cbor_encode_assert_ext(dev, &assert->ext, ecdh,
-		    pk)) == NULL) {
-			fido_log_debug("%s: cbor_encode_assert_ext", __func__);
+	/* hmac-secret salt */
+	if (assert->ext.mask & FIDO_EXT_HMAC_SECRET)
+		if ((hmac_secret = cbor_encode_hmac_secret_param(dev, ecdh, pk,
+		    &assert->ext.hmac_salt)) == NULL) {
+			fido_log_debug("%s: cbor_encode_hmac_secret_param",
+			    __func__);
 			r = FIDO_ERR_INTERNAL;
 			goto fail;
 		}
@@ -126,25 +149,44 @@ fido_dev_get_assert_tx(fido_dev_t *dev, fido_assert_t *assert,
 	/* user verification */
 	if (pin != NULL || (uv == FIDO_OPT_TRUE &&
 	    fido_dev_supports_permissions(dev))) {
-		if ((r = cbor_add_uv_params(dev, cmd, &assert->cdh, pk, ecdh,
-		    pin, assert->rp_id, &argv[5], &argv[6], ms)) != FIDO_OK) {
+		if ((r = cbor_add_uv_params(dev, cmd, 0, &assert->cdh, pk,
+		    ecdh, pin, assert->rp_id, &pin_auth, &pin_opt,
+		    ms)) != FIDO_OK) {
 			fido_log_debug("%s: cbor_add_uv_params", __func__);
 			goto fail;
 		}
 		uv = FIDO_OPT_OMIT;
 	}
 
-	/* options */
-	if (assert->up != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT)
-		if ((argv[4] = cbor_encode_assert_opt(assert->up, uv)) == NULL) {
-			fido_log_debug("%s: cbor_encode_assert_opt", __func__);
-			r = FIDO_ERR_INTERNAL;
-			goto fail;
-		}
+	/* allowed credentials, as many as the authenticator takes */
+	tx.dev = dev;
+	tx.assert = assert;
+	tx.uv = uv;
+	tx.hmac_secret = hmac_secret;
+	tx.pin_auth = pin_auth;
+	tx.pin_opt = pin_opt;
+	if ((r = fido_dev_credlist_batch(dev, assert->rp_id, &assert->cdh,
+	    &assert->allow_list, pin_auth, pin_opt, &tx, allow_list_fits,
+	    &allow, ms)) != FIDO_OK) {
+		fido_log_debug("%s: fido_dev_credlist_batch", __func__);
+		goto fail;
+	}
+	if (assert->allow_list.len != 0 && allow.len == 0) {
+		fido_log_debug("%s: no usable credential id", __func__);
+		r = FIDO_ERR_NO_CREDENTIALS;
+		goto fail;
+	}
+
+	/* encoding */
+	if (cbor_frame_get_assert(dev, assert, &allow, uv, hmac_secret,
+	    pin_auth, pin_opt, &f) < 0) {
+		fido_log_debug("%s: cbor_frame_get_assert", __func__);
+		r = FIDO_ERR_INTERNAL;
+		goto fail;
+	}
 
-	/* frame and transmit */
-	if (cbor_build_frame(cmd, argv, nitems(argv), &f) < 0 ||
-	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
+	/* transmission */
+	if (fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
 		goto fail;
@@ -152,32 +194,26 @@ fido_dev_get_assert_tx(fido_dev_t *dev, fido_assert_t *assert,
 
 	r = FIDO_OK;
 fail:
-	cbor_vector_free(argv, nitems(argv));
+	if (hmac_secret != NULL)
+		cbor_decref(&hmac_secret);
+	if (pin_auth != NULL)
+		cbor_decref(&pin_auth);
+	if (pin_opt != NULL)
+		cbor_decref(&pin_opt);
+	free(allow.ptr); /* borrowed ids */
 	free(f.ptr);
 
 	return (r);
 }
 
 static int
-fido_dev_get_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
+fido_dev_get_assert_parse(fido_assert_t *assert, const unsigned char *msg,
+    size_t msglen)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	int r;
 
 	fido_assert_reset_rx(assert);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
-		fido_log_debug("%s: fido_rx", __func__);
-		r = FIDO_ERR_RX;
-		goto out;
-	}
-
 	/* start with room for a single assertion */
 	if ((assert->stmt = calloc(1, sizeof(fido_assert_stmt))) == NULL) {
 		r = FIDO_ERR_INTERNAL;
@@ -186,24 +222,35 @@ fido_dev_get_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
 	assert->stmt_len = 0;
 	assert->stmt_cnt = 1;
 
-	/* adjust as needed */
-	if ((r = cbor_parse_reply(msg, (size_t)msglen, assert,
-	    adjust_assert_count)) != FIDO_OK) {
-		fido_log_debug("%s: adjust_assert_count", __func__);
-		goto out;
-	}
-
-	/* parse the first assertion */
-	if ((r = cbor_parse_reply(msg, (size_t)msglen, &assert->stmt[0],
-	    parse_assert_reply)) != FIDO_OK) {
-		fido_log_debug("%s: parse_assert_reply", __func__);
+	/* parse the first assertion, adjusting the count as needed */
+	if ((r = cbor_parse_reply_stream(msg, msglen, assert,
+	    parse_first_assert_reply)) != FIDO_OK) {
+		fido_log_debug("%s: parse_first_assert_reply", __func__);
 		goto out;
 	}
 	assert->stmt_len = 1;
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	return (r);
+}
+
+static int
+fido_dev_get_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
+{
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
+
+	fido_assert_reset_rx(assert);
+
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
+		fido_log_debug("%s: fido_rx", __func__);
+		return (FIDO_ERR_RX);
+	}
+
+	r = fido_dev_get_assert_parse(assert, msg, (size_t)msglen);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -222,22 +269,10 @@ fido_get_next_assert_tx(fido_dev_t *dev, int *ms)
 }
 
 static int
-fido_get_next_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
+fido_get_next_assert_parse(fido_assert_t *assert, const unsigned char *msg,
+    size_t msglen)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
-
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
-		fido_log_debug("%s: fido_rx", __func__);
-		r = FIDO_ERR_RX;
-		goto out;
-	}
+	int r;
 
 	/* sanity check */
 	if (assert->stmt_len >= assert->stmt_cnt) {
@@ -247,7 +282,7 @@ fido_get_next_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
 		goto out;
 	}
 
-	if ((r = cbor_parse_reply(msg, (size_t)msglen,
+	if ((r = cbor_parse_reply_stream(msg, msglen,
 	    &assert->stmt[assert->stmt_len], parse_assert_reply)) != FIDO_OK) {
 		fido_log_debug("%s: parse_assert_reply", __func__);
 		goto out;
@@ -255,7 +290,23 @@ fido_get_next_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	return (r);
+}
+
+static int
+fido_get_next_assert_rx(fido_dev_t *dev, fido_assert_t *assert, int *ms)
+{
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
+
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
+		fido_log_debug("%s: fido_rx", __func__);
+		return (FIDO_ERR_RX);
+	}
+
+	r = fido_get_next_assert_parse(assert, msg, (size_t)msglen);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -309,6 +360,10 @@ fido_dev_get_assert(fido_dev_t *dev, fido_assert_t *assert, const char *pin)
 	int		 ms = dev->timeout_ms;
 	int		 r;
 
+	if (fido_dev_async_busy(dev)) {
+		fido_log_debug("%s: operation in progress", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
 #ifdef USE_WINHELLO
 	if (dev->flags & FIDO_DEV_WINHELLO)
 		return (fido_winhello_get_assert(dev, assert, pin, ms));
@@ -350,6 +405,77 @@ fail:
 	return (r);
 }
 
+static int
+fido_dev_get_assert_async_rx(fido_dev_t *dev, const unsigned char *msg,
+    size_t msglen, bool *done)
+{
+	fido_assert_t	*assert = dev->async.obj;
+	int		 ms = dev->timeout_ms;
+	int		 r;
+
+	if (dev->async.nrx == 0)
+		r = fido_dev_get_assert_parse(assert, msg, msglen);
+	else if ((r = fido_get_next_assert_parse(assert, msg,
+	    msglen)) == FIDO_OK)
+		assert->stmt_len++;
+	if (r != FIDO_OK)
+		return (r);
+
+	if (assert->stmt_len < assert->stmt_cnt)
+		return (fido_get_next_assert_tx(dev, &ms));
+
+	if ((assert->ext.mask & FIDO_EXT_HMAC_SECRET) &&
+	    decrypt_hmac_secrets(dev, assert, dev->async.ecdh) < 0) {
+		fido_log_debug("%s: decrypt_hmac_secrets", __func__);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	*done = true;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_get_assert_begin(fido_dev_t *dev, fido_assert_t *assert,
+    const char *pin)
+{
+	fido_blob_t	*ecdh = NULL;
+	es256_pk_t	*pk = NULL;
+	int		 ms = dev->timeout_ms;
+	int		 r;
+
+	if (assert->rp_id == NULL || assert->cdh.ptr == NULL) {
+		fido_log_debug("%s: rp_id=%p, cdh.ptr=%p", __func__,
+		    (void *)assert->rp_id, (void *)assert->cdh.ptr);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+	if ((r = fido_dev_async_check(dev)) != FIDO_OK)
+		return (r);
+
+	if (pin != NULL || (assert->uv == FIDO_OPT_TRUE &&
+	    fido_dev_supports_permissions(dev)) ||
+	    (assert->ext.mask & FIDO_EXT_HMAC_SECRET)) {
+		if ((r = fido_do_ecdh(dev, &pk, &ecdh, &ms)) != FIDO_OK) {
+			fido_log_debug("%s: fido_do_ecdh", __func__);
+			goto fail;
+		}
+	}
+
+	if ((r = fido_dev_get_assert_tx(dev, assert, pk, ecdh, pin,
+	    &ms)) != FIDO_OK) {
+		fido_log_debug("%s: fido_dev_get_assert_tx", __func__);
+		goto fail;
+	}
+
+	fido_dev_async_start(dev, assert, fido_dev_get_assert_async_rx, &pk,
+	    &ecdh);
+fail:
+	es256_pk_free(&pk);
+	fido_blob_free(&ecdh);
+
+	return (r);
+}
+
 int
 fido_check_flags(uint8_t flags, fido_opt_t up, fido_opt_t uv)
 {
@@ -490,23 +616,14 @@ fail:
 	return (ok);
 }
 
-int
-fido_assert_verify(const fido_assert_t *assert, size_t idx, int cose_alg,
-    const void *pk)
+static int
+check_stmt(const fido_assert_t *assert, size_t idx, int cose_alg,
+    fido_blob_t *dgst)
 {
-	unsigned char		 buf[1024]; /* XXX */
-	fido_blob_t		 dgst;
-	const fido_assert_stmt	*stmt = NULL;
-	int			 ok = -1;
-	int			 r;
-
-	dgst.ptr = buf;
-	dgst.len = sizeof(buf);
+	const fido_assert_stmt *stmt = NULL;
 
-	if (idx >= assert->stmt_len || pk == NULL) {
-		r = FIDO_ERR_INVALID_ARGUMENT;
-		goto out;
-	}
+	if (idx >= assert->stmt_len)
+		return (FIDO_ERR_INVALID_ARGUMENT);
 
 	stmt = &assert->stmt[idx];
 
@@ -516,36 +633,57 @@ fido_assert_verify(const fido_assert_t *assert, size_t idx, int cose_alg,
 		fido_log_debug("%s: cdh=%p, rp_id=%s, authdata=%p, sig=%p",
 		    __func__, (void *)assert->cdh.ptr, assert->rp_id,
 		    (void *)stmt->authdata_cbor.ptr, (void *)stmt->sig.ptr);
-		r = FIDO_ERR_INVALID_ARGUMENT;
-		goto out;
+		return (FIDO_ERR_INVALID_ARGUMENT);
 	}
 
 	if (fido_check_flags(stmt->authdata.flags, assert->up,
 	    assert->uv) < 0) {
 		fido_log_debug("%s: fido_check_flags", __func__);
-		r = FIDO_ERR_INVALID_PARAM;
-		goto out;
+		return (FIDO_ERR_INVALID_PARAM);
 	}
 
 	if (check_extensions(stmt->authdata_ext.mask, assert->ext.mask) < 0) {
 		fido_log_debug("%s: check_extensions", __func__);
-		r = FIDO_ERR_INVALID_PARAM;
-		goto out;
+		return (FIDO_ERR_INVALID_PARAM);
 	}
 
 	if (fido_check_rp_id(assert->rp_id, stmt->authdata.rp_id_hash) != 0) {
 		fido_log_debug("%s: fido_check_rp_id", __func__);
-		r = FIDO_ERR_INVALID_PARAM;
-		goto out;
+		return (FIDO_ERR_INVALID_PARAM);
 	}
 
-	if (fido_get_signed_hash(cose_alg, &dgst, &assert->cdh,
+	if (fido_get_signed_hash(cose_alg, dgst, &assert->cdh,
 	    &stmt->authdata_cbor) < 0) {
 		fido_log_debug("%s: fido_get_signed_hash", __func__);
-		r = FIDO_ERR_INTERNAL;
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	return (FIDO_OK);
+}
+
+int
+fido_assert_verify(const fido_assert_t *assert, size_t idx, int cose_alg,
+    const void *pk)
+{
+	unsigned char		 buf[1024]; /* XXX */
+	fido_blob_t		 dgst;
+	const fido_assert_stmt	*stmt = NULL;
+	int			 ok = -1;
+	int			 r;
+
+	dgst.ptr = buf;
+	dgst.len = sizeof(buf);
+
+	if (idx >= assert->stmt_len || pk == NULL) {
+		r = FIDO_ERR_INVALID_ARGUMENT;
 		goto out;
 	}
 
+	if ((r = check_stmt(assert, idx, cose_alg, &dgst)) != FIDO_OK)
+		goto out;
+
+	stmt = &assert->stmt[idx];
+
 	switch (cose_alg) {
 	case COSE_ES256:
 		ok = es256_pk_verify_sig(&dgst, pk, &stmt->sig);
@@ -576,6 +714,243 @@ out:
 	return (r);
 }
 
+int
+fido_assert_verify_with(const fido_assert_t *assert, size_t idx,
+    const fido_verifier_t *v)
+{
+	unsigned char	buf[1024]; /* XXX */
+	fido_blob_t	dgst;
+	int		r;
+
+	dgst.ptr = buf;
+	dgst.len = sizeof(buf);
+
+	if (v == NULL || v->pkey == NULL) {
+		r = FIDO_ERR_INVALID_ARGUMENT;
+		goto out;
+	}
+
+	if ((r = check_stmt(assert, idx, v->cose_alg, &dgst)) != FIDO_OK)
+		goto out;
+
+	if (fido_verifier_verify_sig(v, &dgst, &assert->stmt[idx].sig) < 0) {
+		fido_log_debug("%s: fido_verifier_verify_sig", __func__);
+		r = FIDO_ERR_INVALID_SIG;
+		goto out;
+	}
+
+	r = FIDO_OK;
+out:
+	explicit_bzero(buf, sizeof(buf));
+
+	return (r);
+}
+
+#define BATCH_MAXTHREADS	64
+
+struct batch_entry {
+	const void	*pk;       /* caller's public key */
+	int		 cose_alg; /* caller's cose algorithm */
+	size_t		 n;        /* position in the caller's arrays */
+};
+
+static int
+batch_entry_cmp(const void *a, const void *b)
+{
+	const struct batch_entry *x = a;
+	const struct batch_entry *y = b;
+
+	if ((uintptr_t)x->pk != (uintptr_t)y->pk)
+		return ((uintptr_t)x->pk < (uintptr_t)y->pk ? -1 : 1);
+	if (x->cose_alg != y->cose_alg)
+		return (x->cose_alg < y->cose_alg ? -1 : 1);
+	if (x->n != y->n)
+		return (x->n < y->n ? -1 : 1);
+
+	return (0);
+}
+
+static int
+batch_verify_entry(const fido_assert_t *assert, size_t idx,
+    const struct batch_entry *e, const fido_verifier_t *ver,
+    fido_blob_t *dgst)
+{
+	int r;
+
+	if (assert == NULL || e->pk == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	if ((r = check_stmt(assert, idx, e->cose_alg, dgst)) != FIDO_OK)
+		return (r);
+	if (fido_verifier_verify_sig(ver, dgst, &assert->stmt[idx].sig) < 0)
+		return (FIDO_ERR_INVALID_SIG);
+
+	return (FIDO_OK);
+}
+
+/* A run of sorted entries verified by one thread. */
+struct batch_slice {
+	const fido_assert_t *const	*assert;
+	const size_t			*idx;
+	const struct batch_entry	*v;
+	size_t				 n;
+	int				*status;
+	int				 r;
+};
+
+/*
+ * Entries are visited in (pk, cose_alg) order so that each distinct key
+ * is loaded into the verifier once per slice.
+ */
+static void
+batch_verify_slice(struct batch_slice *s)
+{
+	unsigned char		 buf[1024]; /* XXX */
+	fido_blob_t		 dgst;
+	const struct batch_entry *e;
+	fido_verifier_t		*ver;
+
+	if ((ver = fido_verifier_new()) == NULL) {
+		s->r = FIDO_ERR_INTERNAL;
+		return;
+	}
+
+	for (size_t i = 0; i < s->n; i++) {
+		e = &s->v[i];
+		if (i == 0 || e->pk != s->v[i - 1].pk ||
+		    e->cose_alg != s->v[i - 1].cose_alg) {
+			if (fido_verifier_set_pk(ver, e->cose_alg,
+			    e->pk) != FIDO_OK)
+				fido_log_debug("%s: fido_verifier_set_pk",
+				    __func__);
+		}
+		dgst.ptr = buf;
+		dgst.len = sizeof(buf);
+		s->status[e->n] = batch_verify_entry(s->assert[e->n],
+		    s->idx[e->n], e, ver, &dgst);
+	}
+
+	s->r = FIDO_OK;
+	fido_verifier_free(&ver);
+	explicit_bzero(buf, sizeof(buf));
+}
+
+#ifdef HAVE_PTHREAD
+static void *
+batch_worker(void *arg)
+{
+	batch_verify_slice(arg);
+
+	return (NULL);
+}
+#endif
+
+int
+fido_assert_verify_batch(const fido_assert_t *const *assert,
+    const size_t *idx, const int *cose_alg, const void *const *pk,
+    size_t n, int *status, size_t nthreads)
+{
+	struct batch_entry	*v = NULL;
+	struct batch_slice	*s = NULL;
+#ifdef HAVE_PTHREAD
+	pthread_t		*tid = NULL;
+	bool			*running = NULL;
+#endif
+	size_t			 off = 0;
+	int			 r;
+
+	if (assert == NULL || idx == NULL || cose_alg == NULL || pk == NULL ||
+	    status == NULL || n == 0)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+#ifdef HAVE_PTHREAD
+	if (nthreads > BATCH_MAXTHREADS)
+		nthreads = BATCH_MAXTHREADS;
+	if (nthreads > n)
+		nthreads = n;
+	if (nthreads == 0)
+		nthreads = 1;
+#else
+	nthreads = 1;
+#endif
+
+	if ((v = calloc(n, sizeof(*v))) == NULL ||
+	    (s = calloc(nthreads, sizeof(*s))) == NULL) {
+		r = FIDO_ERR_INTERNAL;
+		goto out;
+	}
+#ifdef HAVE_PTHREAD
+	if ((tid = calloc(nthreads, sizeof(*tid))) == NULL ||
+	    (running = calloc(nthreads, sizeof(*running))) == NULL) {
+		r = FIDO_ERR_INTERNAL;
+		goto out;
+	}
+#endif
+
+	for (size_t i = 0; i < n; i++) {
+		v[i].pk = pk[i];
+		v[i].cose_alg = cose_alg[i];
+		v[i].n = i;
+	}
+
+	qsort(v, n, sizeof(*v), batch_entry_cmp);
+
+	/* contiguous slices, so that each thread sees few distinct keys */
+	for (size_t t = 0; t < nthreads; t++) {
+		s[t].assert = assert;
+		s[t].idx = idx;
+		s[t].status = status;
+		s[t].v = &v[off];
+		s[t].n = n / nthreads + (t < n % nthreads);
+		s[t].r = FIDO_ERR_INTERNAL;
+		off += s[t].n;
+	}
+
+#ifdef HAVE_PTHREAD
+	/* slice 0 runs on the calling thread */
+	for (size_t t = 1; t < nthreads; t++) {
+		if (pthread_create(&tid[t], NULL, batch_worker, &s[t]) == 0)
+			running[t] = true;
+		else {
+			fido_log_debug("%s: pthread_create", __func__);
+			batch_verify_slice(&s[t]);
+		}
+	}
+#endif
+	batch_verify_slice(&s[0]);
+#ifdef HAVE_PTHREAD
+	for (size_t t = 1; t < nthreads; t++)
+		if (running[t] && pthread_join(tid[t], NULL) != 0)
+			fido_log_debug("%s: pthread_join", __func__);
+#endif
+
+	for (size_t t = 0; t < nthreads; t++)
+		if (s[t].r != FIDO_OK) {
+			fido_log_debug("%s: slice %zu: 0x%x", __func__, t,
+			    s[t].r);
+			r = s[t].r;
+			goto out;
+		}
+
+	r = FIDO_OK;
+	for (size_t i = 0; i < n; i++)
+		if (status[i] != FIDO_OK) {
+			fido_log_debug("%s: status[%zu]=%d", __func__, i,
+			    status[i]);
+			r = status[i];
+			break;
+		}
+
+out:
+#ifdef HAVE_PTHREAD
+	free(tid);
+	free(running);
+#endif
+	free(s);
+	free(v);
+
+	return (r);
+}
+
 int
 fido_assert_set_clientdata(fido_assert_t *assert, const unsigned char *data,
     size_t data_len)
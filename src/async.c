@@ -0,0 +1,123 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+#include "fido/es256.h"
+
+/*
+ * Non-blocking operations. A *_begin() function transmits a request and
+ * registers a handler for its reply; fido_dev_poll() then feeds the
+ * handler whatever the device has sent, never waiting for more. A handler
+ * may transmit a follow-up request, e.g. authenticatorGetNextAssertion,
+ * in which case the operation continues.
+ */
+
+int
+fido_dev_async_check(const fido_dev_t *dev)
+{
+	if (dev->async.rx != NULL) {
+		fido_log_debug("%s: operation in progress", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+	if (dev->io_handle == NULL || dev->transport.rx != NULL ||
+	    fido_dev_is_fido2(dev) == false) {
+		fido_log_debug("%s: unsupported device", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+#ifdef USE_WINHELLO
+	if (dev->flags & FIDO_DEV_WINHELLO) {
+		fido_log_debug("%s: winhello", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+#endif
+
+	return (FIDO_OK);
+}
+
+/* Takes ownership of *pk and *ecdh, if any. */
+void
+fido_dev_async_start(fido_dev_t *dev, void *obj, fido_dev_async_rx_t *rx,
+    es256_pk_t **pk, fido_blob_t **ecdh)
+{
+	fido_dev_async_reset(dev);
+
+	dev->async.rx = rx;
+	dev->async.obj = obj;
+	if (pk != NULL) {
+		dev->async.pk = *pk;
+		*pk = NULL;
+	}
+	if (ecdh != NULL) {
+		dev->async.ecdh = *ecdh;
+		*ecdh = NULL;
+	}
+}
+
+/*
+ * Whether dev has an operation in progress that other requests would
+ * interfere with. Its own reply handler may issue follow-up requests.
+ */
+bool
+fido_dev_async_busy(const fido_dev_t *dev)
+{
+	return (dev->async.rx != NULL && dev->async.in_rx == false);
+}
+
+void
+fido_dev_async_reset(fido_dev_t *dev)
+{
+	fido_dev_async_t *a = &dev->async;
+
+	es256_pk_free(&a->pk);
+	fido_blob_free(&a->ecdh);
+	freezero(a->buf, a->off);
+	memset(a, 0, sizeof(*a));
+	a->seq = -1;
+}
+
+int
+fido_dev_poll(fido_dev_t *dev, int *done)
+{
+	const unsigned char	*msg;
+	size_t			 msglen;
+	bool			 fin = false;
+	int			 n, r;
+
+	*done = 0;
+
+	if (dev->async.rx == NULL) {
+		fido_log_debug("%s: no operation in progress", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	do {
+		if ((n = fido_rx_poll(dev, CTAP_CMD_CBOR, &msg,
+		    &msglen)) < 0) {
+			fido_log_debug("%s: fido_rx_poll", __func__);
+			r = FIDO_ERR_RX;
+			goto fail;
+		}
+		if (n == 0)
+			return (FIDO_OK);
+		dev->async.in_rx = true;
+		r = dev->async.rx(dev, msg, msglen, &fin);
+		dev->async.in_rx = false;
+		if (r != FIDO_OK) {
+			fido_log_debug("%s: rx", __func__);
+			goto fail;
+		}
+		dev->async.nrx++;
+	} while (!fin);
+
+	r = FIDO_OK;
+fail:
+	/* the operation is over, whether it succeeded or not */
+	*done = 1;
+	fido_dev_async_reset(dev);
+
+	return (r);
+}
@@ -43,7 +43,7 @@ fido_dev_authkey_tx(fido_dev_t *dev, int *ms)
 	}
 
 	/* frame and transmit */
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -61,21 +61,16 @@ fail:
 static int
 fido_dev_authkey_rx(fido_dev_t *dev, es256_pk_t *authkey, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	fido_log_debug("%s: dev=%p, authkey=%p, ms=%d", __func__, (void *)dev,
 	    (void *)authkey, *ms);
 
 	memset(authkey, 0, sizeof(*authkey));
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -83,7 +78,7 @@ fido_dev_authkey_rx(fido_dev_t *dev, es256_pk_t *authkey, int *ms)
 
 	r = cbor_parse_reply(msg, (size_t)msglen, authkey, parse_authkey);
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -95,7 +95,7 @@ bio_tx(fido_dev_t *dev, uint8_t subcmd, cbor_item_t **sub_argv, size_t sub_argc,
 			fido_log_debug("%s: fido_do_ecdh", __func__);
 			goto fail;
 		}
-		if ((r = cbor_add_uv_params(dev, cmd, &hmac, pk, ecdh, pin,
+		if ((r = cbor_add_uv_params(dev, cmd, 0, &hmac, pk, ecdh, pin,
 		    NULL, &argv[4], &argv[3], ms)) != FIDO_OK) {
 			fido_log_debug("%s: cbor_add_uv_params", __func__);
 			goto fail;
@@ -109,7 +109,7 @@ bio_tx(fido_dev_t *dev, uint8_t subcmd, cbor_item_t **sub_argv, size_t sub_argc,
 	}
 
 	/* framing and transmission */
-	if (cbor_build_frame(cmd, argv, nitems(argv), &f) < 0 ||
+	if (cbor_build_frame(dev, cmd, argv, nitems(argv), &f) < 0 ||
 	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -234,18 +234,13 @@ bio_parse_template_array(const cbor_item_t *key, const cbor_item_t *val,
 static int
 bio_rx_template_array(fido_dev_t *dev, fido_bio_template_array_t *ta, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	bio_reset_template_array(ta);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -259,18 +254,18 @@ bio_rx_template_array(fido_dev_t *dev, fido_bio_template_array_t *ta, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
 
 static int
 bio_get_template_array_wait(fido_dev_t *dev, fido_bio_template_array_t *ta,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = bio_tx(dev, CMD_ENUM, NULL, 0, pin, NULL, ms)) != FIDO_OK ||
+	if ((r = bio_tx(dev, CMD_ENUM, NULL, 0, pin, token, ms)) != FIDO_OK ||
 	    (r = bio_rx_template_array(dev, ta, ms)) != FIDO_OK)
 		return (r);
 
@@ -286,12 +281,25 @@ fido_bio_dev_get_template_array(fido_dev_t *dev, fido_bio_template_array_t *ta,
 	if (pin == NULL)
 		return (FIDO_ERR_INVALID_ARGUMENT);
 
-	return (bio_get_template_array_wait(dev, ta, pin, &ms));
+	return (bio_get_template_array_wait(dev, ta, pin, NULL, &ms));
+}
+
+int
+fido_bio_dev_get_template_array_with_token(fido_dev_t *dev,
+    fido_bio_template_array_t *ta, const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token, FIDO_UV_TOKEN_PERM_BIO)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (bio_get_template_array_wait(dev, ta, NULL, t, &ms));
 }
 
 static int
 bio_set_template_name_wait(fido_dev_t *dev, const fido_bio_template_t *t,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	cbor_item_t	*argv[2];
 	int		 r = FIDO_ERR_INTERNAL;
@@ -304,7 +312,7 @@ bio_set_template_name_wait(fido_dev_t *dev, const fido_bio_template_t *t,
 		goto fail;
 	}
 
-	if ((r = bio_tx(dev, CMD_SET_NAME, argv, 2, pin, NULL,
+	if ((r = bio_tx(dev, CMD_SET_NAME, argv, 2, pin, token,
 	    ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK) {
 		fido_log_debug("%s: tx/rx", __func__);
@@ -327,7 +335,21 @@ fido_bio_dev_set_template_name(fido_dev_t *dev, const fido_bio_template_t *t,
 	if (pin == NULL || t->name == NULL)
 		return (FIDO_ERR_INVALID_ARGUMENT);
 
-	return (bio_set_template_name_wait(dev, t, pin, &ms));
+	return (bio_set_template_name_wait(dev, t, pin, NULL, &ms));
+}
+
+int
+fido_bio_dev_set_template_name_with_token(fido_dev_t *dev,
+    const fido_bio_template_t *t, const fido_uv_token_t *token)
+{
+	const fido_blob_t	*tok;
+	int			 ms = dev->timeout_ms;
+
+	if ((tok = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_BIO)) == NULL || t->name == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (bio_set_template_name_wait(dev, t, NULL, tok, &ms));
 }
 
 static void
@@ -395,21 +417,16 @@ static int
 bio_rx_enroll_begin(fido_dev_t *dev, fido_bio_template_t *t,
     fido_bio_enroll_t *e, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	bio_reset_template(t);
 
 	e->remaining_samples = 0;
 	e->last_status = 0;
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -429,7 +446,7 @@ bio_rx_enroll_begin(fido_dev_t *dev, fido_bio_template_t *t,
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -507,19 +524,14 @@ fail:
 static int
 bio_rx_enroll_continue(fido_dev_t *dev, fido_bio_enroll_t *e, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	e->remaining_samples = 0;
 	e->last_status = 0;
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -533,7 +545,7 @@ bio_rx_enroll_continue(fido_dev_t *dev, fido_bio_enroll_t *e, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -604,7 +616,7 @@ fido_bio_dev_enroll_cancel(fido_dev_t *dev)
 
 static int
 bio_enroll_remove_wait(fido_dev_t *dev, const fido_bio_template_t *t,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	cbor_item_t	*argv[1];
 	const uint8_t	 cmd = CMD_ENROLL_REMOVE;
@@ -617,7 +629,7 @@ bio_enroll_remove_wait(fido_dev_t *dev, const fido_bio_template_t *t,
 		goto fail;
 	}
 
-	if ((r = bio_tx(dev, cmd, argv, 1, pin, NULL, ms)) != FIDO_OK ||
+	if ((r = bio_tx(dev, cmd, argv, 1, pin, token, ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK) {
 		fido_log_debug("%s: tx/rx", __func__);
 		goto fail;
@@ -636,7 +648,21 @@ fido_bio_dev_enroll_remove(fido_dev_t *dev, const fido_bio_template_t *t,
 {
 	int ms = dev->timeout_ms;
 
-	return (bio_enroll_remove_wait(dev, t, pin, &ms));
+	return (bio_enroll_remove_wait(dev, t, pin, NULL, &ms));
+}
+
+int
+fido_bio_dev_enroll_remove_with_token(fido_dev_t *dev,
+    const fido_bio_template_t *t, const fido_uv_token_t *token)
+{
+	const fido_blob_t	*tok;
+	int			 ms = dev->timeout_ms;
+
+	if ((tok = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_BIO)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (bio_enroll_remove_wait(dev, t, NULL, tok, &ms));
 }
 
 static void
@@ -683,18 +709,13 @@ bio_parse_info(const cbor_item_t *key, const cbor_item_t *val, void *arg)
 static int
 bio_rx_info(fido_dev_t *dev, fido_bio_info_t *i, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	bio_reset_info(i);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -708,7 +729,7 @@ bio_rx_info(fido_dev_t *dev, fido_bio_info_t *i, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -9,6 +9,7 @@
 #define _BLOB_H
 
 #include <cbor.h>
+#include <stdbool.h>
 #include <stdlib.h>
 
 #ifdef __cplusplus
@@ -25,6 +26,18 @@ typedef struct fido_blob_array {
 	size_t		 len;
 } fido_blob_array_t;
 
+typedef struct cbor_slice {
+	const unsigned char	*ptr; /* encoded cbor item, borrowed */
+	size_t			 len;
+} cbor_slice_t;
+
+typedef struct cbor_enc {
+	unsigned char	*ptr; /* NULL: only count */
+	size_t		 len;
+	size_t		 cap;
+	bool		 bad;
+} cbor_enc_t;
+
 cbor_item_t *fido_blob_encode(const fido_blob_t *);
 fido_blob_t *fido_blob_new(void);
 int fido_blob_decode(const cbor_item_t *, fido_blob_t *);
@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+/*
+ * The session cache remembers what fido_dev_open() learned from
+ * authenticatorGetInfo, keyed by device path, vendor/product id and the
+ * version numbers returned by CTAPHID_INIT. A reopen of the same device
+ * with the same firmware then only needs the CTAPHID_INIT exchange.
+ */
+
+#define FIDO_DEV_CACHE_MAX	64
+
+static void
+entry_reset(fido_dev_cache_entry_t *e)
+{
+	free(e->path);
+	memset(e, 0, sizeof(*e));
+}
+
+static fido_dev_cache_entry_t *
+entry_find(const fido_dev_t *dev)
+{
+	fido_dev_cache_t *cache = dev->cache;
+
+	if (cache == NULL || dev->cache_path == NULL)
+		return (NULL);
+
+	for (size_t i = 0; i < cache->len; i++)
+		if (strcmp(cache->entry[i].path, dev->cache_path) == 0)
+			return (&cache->entry[i]);
+
+	return (NULL);
+}
+
+static void
+entry_remove(fido_dev_cache_t *cache, fido_dev_cache_entry_t *e)
+{
+	size_t idx = (size_t)(e - cache->entry);
+
+	entry_reset(e);
+	memmove(e, e + 1, (cache->len - idx - 1) * sizeof(*e));
+	memset(&cache->entry[--cache->len], 0, sizeof(*e));
+}
+
+static bool
+entry_matches(const fido_dev_cache_entry_t *e, const fido_dev_t *dev)
+{
+	return (e->vendor_id == dev->vendor_id &&
+	    e->product_id == dev->product_id &&
+	    e->protocol == dev->attr.protocol &&
+	    e->major == dev->attr.major &&
+	    e->minor == dev->attr.minor &&
+	    e->build == dev->attr.build &&
+	    e->caps == dev->attr.flags);
+}
+
+fido_dev_cache_t *
+fido_dev_cache_new(void)
+{
+	return (calloc(1, sizeof(fido_dev_cache_t)));
+}
+
+void
+fido_dev_cache_flush(fido_dev_cache_t *cache)
+{
+	if (cache == NULL)
+		return;
+
+	for (size_t i = 0; i < cache->len; i++)
+		entry_reset(&cache->entry[i]);
+
+	free(cache->entry);
+	cache->entry = NULL;
+	cache->len = 0;
+}
+
+void
+fido_dev_cache_free(fido_dev_cache_t **cache_p)
+{
+	fido_dev_cache_t *cache;
+
+	if (cache_p == NULL || (cache = *cache_p) == NULL)
+		return;
+
+	fido_dev_cache_flush(cache);
+	free(cache);
+
+	*cache_p = NULL;
+}
+
+/*
+ * Restore the device's flags from the cache. Must be called after
+ * CTAPHID_INIT, as the reply's version numbers are part of the key.
+ */
+int
+fido_dev_cache_lookup(fido_dev_t *dev)
+{
+	fido_dev_cache_entry_t *e;
+
+	if ((e = entry_find(dev)) == NULL)
+		return (-1);
+
+	if (!entry_matches(e, dev)) {
+		fido_log_debug("%s: %s: stale entry", __func__,
+		    dev->cache_path);
+		entry_remove(dev->cache, e);
+		return (-1);
+	}
+
+	dev->flags = e->flags;
+	dev->maxmsgsize = e->maxmsgsize;
+	dev->maxcredcntlst = e->maxcredcntlst;
+	dev->maxcredidlen = e->maxcredidlen;
+
+	return (0);
+}
+
+/* Record the state of a freshly opened device, replacing any entry. */
+void
+fido_dev_cache_store(fido_dev_t *dev)
+{
+	fido_dev_cache_t	*cache = dev->cache;
+	fido_dev_cache_entry_t	*e, *p;
+	char			*path;
+
+	if (cache == NULL || dev->cache_path == NULL)
+		return;
+
+	if ((e = entry_find(dev)) != NULL)
+		entry_remove(cache, e);
+	if (cache->len == FIDO_DEV_CACHE_MAX)
+		entry_remove(cache, &cache->entry[0]); /* oldest */
+
+	if ((path = strdup(dev->cache_path)) == NULL) {
+		fido_log_debug("%s: strdup", __func__);
+		return;
+	}
+	if ((p = recallocarray(cache->entry, cache->len, cache->len + 1,
+	    sizeof(*p))) == NULL) {
+		fido_log_debug("%s: recallocarray", __func__);
+		free(path);
+		return;
+	}
+
+	cache->entry = p;
+	e = &cache->entry[cache->len++];
+	e->path = path;
+	e->vendor_id = dev->vendor_id;
+	e->product_id = dev->product_id;
+	e->protocol = dev->attr.protocol;
+	e->major = dev->attr.major;
+	e->minor = dev->attr.minor;
+	e->build = dev->attr.build;
+	e->caps = dev->attr.flags;
+	e->flags = dev->flags;
+	e->maxmsgsize = dev->maxmsgsize;
+	e->maxcredcntlst = dev->maxcredcntlst;
+	e->maxcredidlen = dev->maxcredidlen;
+}
+
+/* Carry flag changes made while the device was open, e.g. a new PIN. */
+void
+fido_dev_cache_sync(fido_dev_t *dev)
+{
+	fido_dev_cache_entry_t *e;
+
+	if ((e = entry_find(dev)) != NULL)
+		e->flags = dev->flags;
+}
+
+/* Forget the device, e.g. after an I/O error. */
+void
+fido_dev_cache_drop(fido_dev_t *dev)
+{
+	fido_dev_cache_entry_t *e;
+
+	if ((e = entry_find(dev)) != NULL) {
+		fido_log_debug("%s: %s", __func__, dev->cache_path);
+		entry_remove(dev->cache, e);
+	}
+}
@@ -123,7 +123,11 @@ cbor_parse_reply(const unsigned char *blob, size_t blob_len, void *arg,
 {
 	cbor_item_t		*item = NULL;
 	struct cbor_load_result	 cbor;
-	int			 r;
+	fido_dev_stats_t	*stats;
+	struct timespec		 ts;
+	int			 cmd, r;
+
+	stats = fido_stats_decode_begin(&cmd, &ts);
 
 	if (blob_len < 1) {
 		fido_log_debug("%s: blob_len=%zu", __func__, blob_len);
@@ -158,8 +162,12 @@ cbor_parse_reply(const unsigned char *blob, size_t blob_len, void *arg,
 
 	r = FIDO_OK;
 fail:
+	if (r == FIDO_ERR_RX_NOT_CBOR || r == FIDO_ERR_RX_INVALID_CBOR)
+		fido_log_fail(__func__, r);
 	if (item != NULL)
 		cbor_decref(&item);
+	if (stats != NULL)
+		fido_stats_decode_end(stats, cmd, &ts);
 
 	return (r);
 }
@@ -395,15 +403,20 @@ cbor_flatten_vector(cbor_item_t *argv[], size_t argc)
 	return (map);
 }
 
+/* If dev has statistics attached, the encoding time is recorded there. */
 int
-cbor_build_frame(uint8_t cmd, cbor_item_t *argv[], size_t argc, fido_blob_t *f)
+cbor_build_frame(fido_dev_t *dev, uint8_t cmd, cbor_item_t *argv[],
+    size_t argc, fido_blob_t *f)
 {
 	cbor_item_t	*flat = NULL;
 	unsigned char	*cbor = NULL;
 	size_t		 cbor_len;
 	size_t		 cbor_alloc_len;
+	struct timespec	 ts;
+	bool		 timed;
 	int		 ok = -1;
 
+	timed = fido_dev_stats_encode_begin(dev, &ts);
 	if ((flat = cbor_flatten_vector(argv, argc)) == NULL)
 		goto fail;
 
@@ -419,6 +432,8 @@ cbor_build_frame(uint8_t cmd, cbor_item_t *argv[], size_t argc, fido_blob_t *f)
 	f->len = cbor_len + 1;
 	f->ptr[0] = cmd;
 	memcpy(f->ptr + 1, cbor, f->len - 1);
+	if (timed)
+		fido_dev_stats_encode_end(dev, &ts);
 
 	ok = 0;
 fail:
@@ -780,44 +795,37 @@ fail:
 	return (item);
 }
 
-static int
-cbor_encode_hmac_secret_param(const fido_dev_t *dev, cbor_item_t *item,
-    const fido_blob_t *ecdh, const es256_pk_t *pk, const fido_blob_t *salt)
+cbor_item_t *
+cbor_encode_hmac_secret_param(const fido_dev_t *dev, const fido_blob_t *ecdh,
+    const es256_pk_t *pk, const fido_blob_t *salt)
 {
 	cbor_item_t		*param = NULL;
 	cbor_item_t		*argv[4];
-	struct cbor_pair	 pair;
 	fido_blob_t		*enc = NULL;
 	uint8_t			 prot;
-	int			 r;
 
 	memset(argv, 0, sizeof(argv));
-	memset(&pair, 0, sizeof(pair));
 
-	if (item == NULL || ecdh == NULL || pk == NULL || salt->ptr == NULL) {
+	if (ecdh == NULL || pk == NULL || salt->ptr == NULL) {
 		fido_log_debug("%s: ecdh=%p, pk=%p, salt->ptr=%p", __func__,
 		    (const void *)ecdh, (const void *)pk,
 		    (const void *)salt->ptr);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
 	if (salt->len != 32 && salt->len != 64) {
 		fido_log_debug("%s: salt->len=%zu", __func__, salt->len);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
 	if ((enc = fido_blob_new()) == NULL ||
 	    aes256_cbc_enc(dev, ecdh, salt, enc) < 0) {
 		fido_log_debug("%s: aes256_cbc_enc", __func__);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
 	if ((prot = fido_dev_get_pin_protocol(dev)) == 0) {
 		fido_log_debug("%s: fido_dev_get_pin_protocol", __func__);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
@@ -827,48 +835,23 @@ cbor_encode_hmac_secret_param(const fido_dev_t *dev, cbor_item_t *item,
 	    (argv[2] = cbor_encode_pin_auth(dev, ecdh, enc)) == NULL ||
 	    (prot != 1 && (argv[3] = cbor_build_uint8(prot)) == NULL)) {
 		fido_log_debug("%s: cbor encode", __func__);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
 	if ((param = cbor_flatten_vector(argv, nitems(argv))) == NULL) {
 		fido_log_debug("%s: cbor_flatten_vector", __func__);
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	if ((pair.key = cbor_build_string("hmac-secret")) == NULL) {
-		fido_log_debug("%s: cbor_build", __func__);
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	pair.value = param;
-
-	if (!cbor_map_add(item, pair)) {
-		fido_log_debug("%s: cbor_map_add", __func__);
-		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
-	r = FIDO_OK;
-
 fail:
 	cbor_vector_free(argv, nitems(argv));
-
-	if (param != NULL)
-		cbor_decref(&param);
-	if (pair.key != NULL)
-		cbor_decref(&pair.key);
-
 	fido_blob_free(&enc);
 
-	return (r);
+	return (param);
 }
 
 cbor_item_t *
-cbor_encode_assert_ext(fido_dev_t *dev, const fido_assert_ext_t *ext,
-    const fido_blob_t *ecdh, const es256_pk_t *pk)
+cbor_encode_assert_ext(const fido_assert_ext_t *ext, cbor_item_t *hmac_secret)
 {
 	cbor_item_t *item = NULL;
 	size_t size = 0;
@@ -889,11 +872,21 @@ cbor_encode_assert_ext(fido_dev_t *dev, const fido_assert_ext_t *ext,
 		}
 	}
 	if (ext->mask & FIDO_EXT_HMAC_SECRET) {
-		if (cbor_encode_hmac_secret_param(dev, item, ecdh, pk,
-		    &ext->hmac_salt) < 0) {
+		struct cbor_pair pair;
+
+		pair.key = cbor_build_string("hmac-secret");
+		pair.value = hmac_secret;
+
+		if (pair.key == NULL || pair.value == NULL ||
+		    !cbor_map_add(item, pair)) {
+			fido_log_debug("%s: hmac-secret", __func__);
+			if (pair.key != NULL)
+				cbor_decref(&pair.key);
 			cbor_decref(&item);
 			return (NULL);
 		}
+
+		cbor_decref(&pair.key);
 	}
 	if (ext->mask & FIDO_EXT_LARGEBLOB_KEY) {
 		if (cbor_encode_largeblob_key_ext(item) < 0) {
@@ -905,6 +898,421 @@ cbor_encode_assert_ext(fido_dev_t *dev, const fido_assert_ext_t *ext,
 	return (item);
 }
 
+/*
+ * Direct-to-buffer versions of the encoders above, for the requests of
+ * authenticatorMakeCredential and authenticatorGetAssertion. Keys are
+ * written in the order the libcbor encoders add them, so that both produce
+ * the same bytes.
+ */
+
+static void
+enc_string_pair(cbor_enc_t *e, const char *key, const char *value)
+{
+	cbor_enc_string(e, key);
+	cbor_enc_string(e, value);
+}
+
+static void
+enc_bool_pair(cbor_enc_t *e, const char *key, fido_opt_t value)
+{
+	cbor_enc_string(e, key);
+	cbor_enc_bool(e, value == FIDO_OPT_TRUE);
+}
+
+static void
+enc_rp_entity(cbor_enc_t *e, const fido_rp_t *rp)
+{
+	cbor_enc_map(e, (size_t)(rp->id != NULL) + (size_t)(rp->name != NULL));
+	if (rp->id != NULL)
+		enc_string_pair(e, "id", rp->id);
+	if (rp->name != NULL)
+		enc_string_pair(e, "name", rp->name);
+}
+
+static void
+enc_user_entity(cbor_enc_t *e, const fido_user_t *user)
+{
+	const fido_blob_t	*id = &user->id;
+	const char		*display = user->display_name;
+
+	cbor_enc_map(e, (size_t)(id->ptr != NULL) +
+	    (size_t)(user->icon != NULL) + (size_t)(user->name != NULL) +
+	    (size_t)(display != NULL));
+	if (id->ptr != NULL) {
+		cbor_enc_string(e, "id");
+		cbor_enc_bytes(e, id->ptr, id->len);
+	}
+	if (user->icon != NULL)
+		enc_string_pair(e, "icon", user->icon);
+	if (user->name != NULL)
+		enc_string_pair(e, "name", user->name);
+	if (display != NULL)
+		enc_string_pair(e, "displayName", display);
+}
+
+static void
+enc_pubkey_param(cbor_enc_t *e, int cose_alg)
+{
+	if (cose_alg > -1 || cose_alg < INT16_MIN) {
+		fido_log_debug("%s: cose_alg=%d", __func__, cose_alg);
+		e->bad = true;
+		return;
+	}
+
+	cbor_enc_array(e, 1);
+	cbor_enc_map(e, 2);
+	cbor_enc_string(e, "alg");
+	cbor_enc_int(e, cose_alg);
+	enc_string_pair(e, "type", "public-key");
+}
+
+static void
+enc_pubkey_list(cbor_enc_t *e, const fido_blob_array_t *list)
+{
+	cbor_enc_array(e, list->len);
+	for (size_t i = 0; i < list->len; i++) {
+		cbor_enc_map(e, 2);
+		cbor_enc_string(e, "id");
+		cbor_enc_bytes(e, list->ptr[i].ptr, list->ptr[i].len);
+		enc_string_pair(e, "type", "public-key");
+	}
+}
+
+static void
+enc_cred_ext(cbor_enc_t *e, const fido_cred_ext_t *ext,
+    const fido_blob_t *blob)
+{
+	size_t size = 0;
+
+	if (ext->mask & FIDO_EXT_CRED_BLOB)
+		size++;
+	if (ext->mask & FIDO_EXT_HMAC_SECRET)
+		size++;
+	if (ext->mask & FIDO_EXT_CRED_PROTECT)
+		size++;
+	if (ext->mask & FIDO_EXT_LARGEBLOB_KEY)
+		size++;
+	if (ext->mask & FIDO_EXT_MINPINLEN)
+		size++;
+
+	if (size == 0 || ((ext->mask & FIDO_EXT_CRED_PROTECT) &&
+	    (ext->prot < 0 || ext->prot > UINT8_MAX))) {
+		fido_log_debug("%s: mask=0x%x, prot=%d", __func__, ext->mask,
+		    ext->prot);
+		e->bad = true;
+		return;
+	}
+
+	cbor_enc_map(e, size);
+	if (ext->mask & FIDO_EXT_CRED_BLOB) {
+		cbor_enc_string(e, "credBlob");
+		cbor_enc_bytes(e, blob->ptr, blob->len);
+	}
+	if (ext->mask & FIDO_EXT_CRED_PROTECT) {
+		cbor_enc_string(e, "credProtect");
+		cbor_enc_uint(e, (uint64_t)ext->prot);
+	}
+	if (ext->mask & FIDO_EXT_HMAC_SECRET)
+		enc_bool_pair(e, "hmac-secret", FIDO_OPT_TRUE);
+	if (ext->mask & FIDO_EXT_LARGEBLOB_KEY)
+		enc_bool_pair(e, "largeBlobKey", FIDO_OPT_TRUE);
+	if (ext->mask & FIDO_EXT_MINPINLEN)
+		enc_bool_pair(e, "minPinLength", FIDO_OPT_TRUE);
+}
+
+static void
+enc_assert_ext(cbor_enc_t *e, const fido_assert_ext_t *ext,
+    const cbor_item_t *hmac_secret)
+{
+	size_t size = 0;
+
+	if (ext->mask & FIDO_EXT_CRED_BLOB)
+		size++;
+	if (ext->mask & FIDO_EXT_HMAC_SECRET)
+		size++;
+	if (ext->mask & FIDO_EXT_LARGEBLOB_KEY)
+		size++;
+
+	if (size == 0 || ((ext->mask & FIDO_EXT_HMAC_SECRET) &&
+	    hmac_secret == NULL)) {
+		fido_log_debug("%s: mask=0x%x", __func__, ext->mask);
+		e->bad = true;
+		return;
+	}
+
+	cbor_enc_map(e, size);
+	if (ext->mask & FIDO_EXT_CRED_BLOB)
+		enc_bool_pair(e, "credBlob", FIDO_OPT_TRUE);
+	if (ext->mask & FIDO_EXT_HMAC_SECRET) {
+		cbor_enc_string(e, "hmac-secret");
+		cbor_enc_item(e, hmac_secret);
+	}
+	if (ext->mask & FIDO_EXT_LARGEBLOB_KEY)
+		enc_bool_pair(e, "largeBlobKey", FIDO_OPT_TRUE);
+}
+
+/* rk or up, and uv */
+static void
+enc_opt(cbor_enc_t *e, const char *key, fido_opt_t value, fido_opt_t uv)
+{
+	cbor_enc_map(e, (size_t)(value != FIDO_OPT_OMIT) +
+	    (size_t)(uv != FIDO_OPT_OMIT));
+	if (value != FIDO_OPT_OMIT)
+		enc_bool_pair(e, key, value);
+	if (uv != FIDO_OPT_OMIT)
+		enc_bool_pair(e, "uv", uv);
+}
+
+static void
+enc_makecred(cbor_enc_t *e, const fido_cred_t *cred,
+    const fido_blob_array_t *excl_list, fido_opt_t uv,
+    const cbor_item_t *pin_auth, const cbor_item_t *pin_opt)
+{
+	bool excl = excl_list->len != 0;
+	bool ext = cred->ext.mask != 0;
+	bool opt = cred->rk != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT;
+
+	cbor_enc_map(e, 4 + (size_t)excl + (size_t)ext + (size_t)opt +
+	    (size_t)(pin_auth != NULL) + (size_t)(pin_opt != NULL));
+	cbor_enc_uint(e, 1);
+	cbor_enc_bytes(e, cred->cdh.ptr, cred->cdh.len);
+	cbor_enc_uint(e, 2);
+	enc_rp_entity(e, &cred->rp);
+	cbor_enc_uint(e, 3);
+	enc_user_entity(e, &cred->user);
+	cbor_enc_uint(e, 4);
+	enc_pubkey_param(e, cred->type);
+	if (excl) {
+		cbor_enc_uint(e, 5);
+		enc_pubkey_list(e, excl_list);
+	}
+	if (ext) {
+		cbor_enc_uint(e, 6);
+		enc_cred_ext(e, &cred->ext, &cred->blob);
+	}
+	if (opt) {
+		cbor_enc_uint(e, 7);
+		enc_opt(e, "rk", cred->rk, uv);
+	}
+	if (pin_auth != NULL) {
+		cbor_enc_uint(e, 8);
+		cbor_enc_item(e, pin_auth);
+	}
+	if (pin_opt != NULL) {
+		cbor_enc_uint(e, 9);
+		cbor_enc_item(e, pin_opt);
+	}
+}
+
+static void
+enc_get_assert(cbor_enc_t *e, const fido_assert_t *assert,
+    const fido_blob_array_t *allow_list, fido_opt_t uv,
+    const cbor_item_t *hmac_secret, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt)
+{
+	bool allow = allow_list->len != 0;
+	bool ext = assert->ext.mask != 0;
+	bool opt = assert->up != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT;
+
+	cbor_enc_map(e, 2 + (size_t)allow + (size_t)ext + (size_t)opt +
+	    (size_t)(pin_auth != NULL) + (size_t)(pin_opt != NULL));
+	cbor_enc_uint(e, 1);
+	cbor_enc_string(e, assert->rp_id);
+	cbor_enc_uint(e, 2);
+	cbor_enc_bytes(e, assert->cdh.ptr, assert->cdh.len);
+	if (allow) {
+		cbor_enc_uint(e, 3);
+		enc_pubkey_list(e, allow_list);
+	}
+	if (ext) {
+		cbor_enc_uint(e, 4);
+		enc_assert_ext(e, &assert->ext, hmac_secret);
+	}
+	if (opt) {
+		cbor_enc_uint(e, 5);
+		enc_opt(e, "up", assert->up, uv);
+	}
+	if (pin_auth != NULL) {
+		cbor_enc_uint(e, 6);
+		cbor_enc_item(e, pin_auth);
+	}
+	if (pin_opt != NULL) {
+		cbor_enc_uint(e, 7);
+		cbor_enc_item(e, pin_opt);
+	}
+}
+
+/* Allocates f for the request sized by e, and points e past cmd. */
+static int
+frame_alloc(cbor_enc_t *e, uint8_t cmd, fido_blob_t *f)
+{
+	if (e->bad || e->len == 0 || e->len == SIZE_MAX) {
+		fido_log_debug("%s: bad=%d, len=%zu", __func__, e->bad, e->len);
+		return (-1);
+	}
+
+	if ((f->ptr = malloc(e->len + 1)) == NULL)
+		return (-1);
+
+	f->len = e->len + 1;
+	f->ptr[0] = cmd;
+	e->ptr = f->ptr + 1;
+	e->cap = e->len;
+	e->len = 0;
+
+	return (0);
+}
+
+/* ts is the start of the encoding for dev's statistics, or NULL. */
+static int
+frame_finish(const cbor_enc_t *e, fido_blob_t *f, fido_dev_t *dev,
+    const struct timespec *ts)
+{
+	if (e->bad || e->len != e->cap) {
+		fido_log_debug("%s: bad=%d, len=%zu, cap=%zu", __func__,
+		    e->bad, e->len, e->cap);
+		fido_blob_reset(f);
+		return (-1);
+	}
+
+	if (ts != NULL)
+		fido_dev_stats_encode_end(dev, ts);
+
+	return (0);
+}
+
+/*
+ * A silent authenticatorGetAssertion: is any of list known for rp_id?
+ * With pin_auth, credentials that require user verification count too.
+ */
+static void
+enc_probe(cbor_enc_t *e, const char *rp_id, const fido_blob_t *cdh,
+    const fido_blob_array_t *list, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt)
+{
+	cbor_enc_map(e, 4 + (size_t)(pin_auth != NULL) +
+	    (size_t)(pin_opt != NULL));
+	cbor_enc_uint(e, 1);
+	cbor_enc_string(e, rp_id);
+	cbor_enc_uint(e, 2);
+	cbor_enc_bytes(e, cdh->ptr, cdh->len);
+	cbor_enc_uint(e, 3);
+	enc_pubkey_list(e, list);
+	cbor_enc_uint(e, 5);
+	enc_opt(e, "up", FIDO_OPT_FALSE, FIDO_OPT_OMIT);
+	if (pin_auth != NULL) {
+		cbor_enc_uint(e, 6);
+		cbor_enc_item(e, pin_auth);
+	}
+	if (pin_opt != NULL) {
+		cbor_enc_uint(e, 7);
+		cbor_enc_item(e, pin_opt);
+	}
+}
+
+/*
+ * Same bytes as cbor_build_frame() with the cbor_encode_*() items, with
+ * excl_list or allow_list in place of the whole list.
+ */
+int
+cbor_frame_makecred(fido_dev_t *dev, const fido_cred_t *cred,
+    const fido_blob_array_t *excl_list, fido_opt_t uv,
+    const cbor_item_t *pin_auth, const cbor_item_t *pin_opt, fido_blob_t *f)
+{
+	cbor_enc_t	e;
+	struct timespec	ts;
+	bool		timed;
+
+	if (cred->cdh.ptr == NULL)
+		return (-1);
+
+	timed = fido_dev_stats_encode_begin(dev, &ts);
+	memset(&e, 0, sizeof(e));
+	enc_makecred(&e, cred, excl_list, uv, pin_auth, pin_opt);
+	if (frame_alloc(&e, CTAP_CBOR_MAKECRED, f) < 0)
+		return (-1);
+	enc_makecred(&e, cred, excl_list, uv, pin_auth, pin_opt);
+
+	return (frame_finish(&e, f, dev, timed ? &ts : NULL));
+}
+
+int
+cbor_frame_get_assert(fido_dev_t *dev, const fido_assert_t *assert,
+    const fido_blob_array_t *allow_list, fido_opt_t uv,
+    const cbor_item_t *hmac_secret, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt, fido_blob_t *f)
+{
+	cbor_enc_t	e;
+	struct timespec	ts;
+	bool		timed;
+
+	if (assert->rp_id == NULL || assert->cdh.ptr == NULL)
+		return (-1);
+
+	timed = fido_dev_stats_encode_begin(dev, &ts);
+	memset(&e, 0, sizeof(e));
+	enc_get_assert(&e, assert, allow_list, uv, hmac_secret, pin_auth,
+	    pin_opt);
+	if (frame_alloc(&e, CTAP_CBOR_ASSERT, f) < 0)
+		return (-1);
+	enc_get_assert(&e, assert, allow_list, uv, hmac_secret, pin_auth,
+	    pin_opt);
+
+	return (frame_finish(&e, f, dev, timed ? &ts : NULL));
+}
+
+int
+cbor_frame_probe(fido_dev_t *dev, const char *rp_id, const fido_blob_t *cdh,
+    const fido_blob_array_t *list, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt, fido_blob_t *f)
+{
+	cbor_enc_t	e;
+	struct timespec	ts;
+	bool		timed;
+
+	if (rp_id == NULL || cdh->ptr == NULL)
+		return (-1);
+
+	timed = fido_dev_stats_encode_begin(dev, &ts);
+	memset(&e, 0, sizeof(e));
+	enc_probe(&e, rp_id, cdh, list, pin_auth, pin_opt);
+	if (frame_alloc(&e, CTAP_CBOR_ASSERT, f) < 0)
+		return (-1);
+	enc_probe(&e, rp_id, cdh, list, pin_auth, pin_opt);
+
+	return (frame_finish(&e, f, dev, timed ? &ts : NULL));
+}
+
+/* The length of cbor_frame_makecred()'s frame, or 0. */
+size_t
+cbor_frame_makecred_len(const fido_cred_t *cred,
+    const fido_blob_array_t *excl_list, fido_opt_t uv,
+    const cbor_item_t *pin_auth, const cbor_item_t *pin_opt)
+{
+	cbor_enc_t e;
+
+	memset(&e, 0, sizeof(e));
+	enc_makecred(&e, cred, excl_list, uv, pin_auth, pin_opt);
+
+	return (e.bad || e.len == SIZE_MAX ? 0 : e.len + 1);
+}
+
+/* The length of cbor_frame_get_assert()'s frame, or 0. */
+size_t
+cbor_frame_get_assert_len(const fido_assert_t *assert,
+    const fido_blob_array_t *allow_list, fido_opt_t uv,
+    const cbor_item_t *hmac_secret, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt)
+{
+	cbor_enc_t e;
+
+	memset(&e, 0, sizeof(e));
+	enc_get_assert(&e, assert, allow_list, uv, hmac_secret, pin_auth,
+	    pin_opt);
+
+	return (e.bad || e.len == SIZE_MAX ? 0 : e.len + 1);
+}
+
 int
 cbor_decode_fmt(const cbor_item_t *item, char **fmt)
 {
@@ -1337,13 +1745,37 @@ cbor_decode_cred_authdata(const cbor_item_t *item, int cose_alg,
 	return (FIDO_OK);
 }
 
+static int
+decode_assert_authdata(const unsigned char *buf, size_t len,
+    fido_authdata_t *authdata, fido_assert_extattr_t *authdata_ext)
+{
+	fido_log_debug("%s: buf=%p, len=%zu", __func__, (const void *)buf, len);
+
+	if (fido_buf_read(&buf, &len, authdata, sizeof(*authdata)) < 0) {
+		fido_log_debug("%s: fido_buf_read", __func__);
+		return (-1);
+	}
+
+	authdata->sigcount = be32toh(authdata->sigcount);
+
+	if ((authdata->flags & CTAP_AUTHDATA_EXT_DATA) != 0) {
+		if (decode_assert_extensions(&buf, &len, authdata_ext) < 0) {
+			fido_log_debug("%s: decode_assert_extensions",
+			    __func__);
+			return (-1);
+		}
+	}
+
+	/* XXX we should probably ensure that len == 0 at this point */
+
+	return (FIDO_OK);
+}
+
 int
 cbor_decode_assert_authdata(const cbor_item_t *item, fido_blob_t *authdata_cbor,
     fido_authdata_t *authdata, fido_assert_extattr_t *authdata_ext)
 {
-	const unsigned char	*buf = NULL;
-	size_t			 len;
-	size_t			 alloc_len;
+	size_t alloc_len;
 
 	if (cbor_isa_bytestring(item) == false ||
 	    cbor_bytestring_is_definite(item) == false) {
@@ -1358,29 +1790,31 @@ cbor_decode_assert_authdata(const cbor_item_t *item, fido_blob_t *authdata_cbor,
 		return (-1);
 	}
 
-	buf = cbor_bytestring_handle(item);
-	len = cbor_bytestring_length(item);
+	return (decode_assert_authdata(cbor_bytestring_handle(item),
+	    cbor_bytestring_length(item), authdata, authdata_ext));
+}
 
-	fido_log_debug("%s: buf=%p, len=%zu", __func__, (const void *)buf, len);
+int
+cbor_slice_decode_assert_authdata(const cbor_slice_t *s,
+    fido_blob_t *authdata_cbor, fido_authdata_t *authdata,
+    fido_assert_extattr_t *authdata_ext)
+{
+	const unsigned char	*buf;
+	size_t			 len;
 
-	if (fido_buf_read(&buf, &len, authdata, sizeof(*authdata)) < 0) {
-		fido_log_debug("%s: fido_buf_read", __func__);
+	if (cbor_slice_bytes(s, &buf, &len) < 0) {
+		fido_log_debug("%s: cbor type", __func__);
 		return (-1);
 	}
 
-	authdata->sigcount = be32toh(authdata->sigcount);
-
-	if ((authdata->flags & CTAP_AUTHDATA_EXT_DATA) != 0) {
-		if (decode_assert_extensions(&buf, &len, authdata_ext) < 0) {
-			fido_log_debug("%s: decode_assert_extensions",
-			    __func__);
-			return (-1);
-		}
+	/* the slice is the encoded bytestring */
+	if (authdata_cbor->ptr != NULL ||
+	    fido_blob_set(authdata_cbor, s->ptr, s->len) < 0) {
+		fido_log_debug("%s: fido_blob_set", __func__);
+		return (-1);
 	}
 
-	/* XXX we should probably ensure that len == 0 at this point */
-
-	return (FIDO_OK);
+	return (decode_assert_authdata(buf, len, authdata, authdata_ext));
 }
 
 static int
@@ -1568,6 +2002,31 @@ out:
 	return (ok);
 }
 
+static int
+decode_cred_id_slice_entry(const cbor_slice_t *key, const cbor_slice_t *val,
+    void *arg)
+{
+	fido_blob_t *id = arg;
+
+	if (cbor_slice_str_eq(key, "id") && cbor_slice_blob(val, id) < 0) {
+		fido_log_debug("%s: cbor_slice_blob", __func__);
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+cbor_slice_decode_cred_id(const cbor_slice_t *s, fido_blob_t *id)
+{
+	if (cbor_slice_map_iter(s, id, decode_cred_id_slice_entry) < 0) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	return (0);
+}
+
 int
 cbor_decode_user(const cbor_item_t *item, fido_user_t *user)
 {
@@ -1581,6 +2040,48 @@ cbor_decode_user(const cbor_item_t *item, fido_user_t *user)
 	return (0);
 }
 
+static int
+decode_user_slice_entry(const cbor_slice_t *key, const cbor_slice_t *val,
+    void *arg)
+{
+	fido_user_t *user = arg;
+
+	if (cbor_slice_str_eq(key, "icon")) {
+		if (cbor_slice_string(val, &user->icon) < 0) {
+			fido_log_debug("%s: icon", __func__);
+			return (-1);
+		}
+	} else if (cbor_slice_str_eq(key, "name")) {
+		if (cbor_slice_string(val, &user->name) < 0) {
+			fido_log_debug("%s: name", __func__);
+			return (-1);
+		}
+	} else if (cbor_slice_str_eq(key, "displayName")) {
+		if (cbor_slice_string(val, &user->display_name) < 0) {
+			fido_log_debug("%s: display_name", __func__);
+			return (-1);
+		}
+	} else if (cbor_slice_str_eq(key, "id")) {
+		if (cbor_slice_blob(val, &user->id) < 0) {
+			fido_log_debug("%s: id", __func__);
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+int
+cbor_slice_decode_user(const cbor_slice_t *s, fido_user_t *user)
+{
+	if (cbor_slice_map_iter(s, user, decode_user_slice_entry) < 0) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	return (0);
+}
+
 static int
 decode_rp_entity_entry(const cbor_item_t *key, const cbor_item_t *val,
     void *arg)
@@ -0,0 +1,594 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+/*
+ * A small CBOR reader that walks encoded items in place. Maps are iterated
+ * without building a libcbor tree; keys and values are handed to callbacks
+ * as slices of the input. Only definite-length items are accepted, as
+ * required by the CTAP2 canonical encoding.
+ *
+ * The writer at the end of the file is its counterpart for requests: items
+ * are encoded straight into a buffer, in the order they are written. An
+ * encoder without a buffer only counts bytes, so that a request can be
+ * sized, allocated once, and written by running the same code again.
+ */
+
+#define CBOR_STREAM_MAXDEPTH	16
+
+#define CBOR_MAJOR_UINT		0
+#define CBOR_MAJOR_NEGINT	1
+#define CBOR_MAJOR_BYTES	2
+#define CBOR_MAJOR_TEXT		3
+#define CBOR_MAJOR_ARRAY	4
+#define CBOR_MAJOR_MAP		5
+#define CBOR_MAJOR_TAG		6
+#define CBOR_MAJOR_SIMPLE	7
+
+struct cbor_head {
+	uint8_t  major;
+	uint8_t  info;
+	uint64_t arg;
+};
+
+static int
+read_head(const unsigned char **ptr, size_t *len, struct cbor_head *h)
+{
+	size_t n;
+
+	if (*len < 1)
+		return (-1);
+
+	h->major = (uint8_t)(**ptr >> 5);
+	h->info = **ptr & 0x1f;
+	h->arg = 0;
+	(*ptr)++;
+	(*len)--;
+
+	if (h->info < 24) {
+		h->arg = h->info;
+		return (0);
+	}
+	if (h->info > 27) {
+		fido_log_debug("%s: info=%u", __func__, h->info);
+		return (-1); /* reserved or indefinite */
+	}
+
+	n = (size_t)1 << (h->info - 24);
+	if (*len < n)
+		return (-1);
+	for (size_t i = 0; i < n; i++)
+		h->arg = (h->arg << 8) | (*ptr)[i];
+	*ptr += n;
+	*len -= n;
+
+	return (0);
+}
+
+static int
+skip_item(const unsigned char **ptr, size_t *len, int depth)
+{
+	struct cbor_head	h;
+	uint64_t		n;
+
+	if (depth > CBOR_STREAM_MAXDEPTH) {
+		fido_log_debug("%s: depth=%d", __func__, depth);
+		return (-1);
+	}
+	if (read_head(ptr, len, &h) < 0)
+		return (-1);
+
+	switch (h.major) {
+	case CBOR_MAJOR_UINT:
+	case CBOR_MAJOR_NEGINT:
+	case CBOR_MAJOR_SIMPLE:
+		return (0);
+	case CBOR_MAJOR_BYTES:
+	case CBOR_MAJOR_TEXT:
+		if (h.arg > *len)
+			return (-1);
+		*ptr += h.arg;
+		*len -= (size_t)h.arg;
+		return (0);
+	case CBOR_MAJOR_ARRAY:
+	case CBOR_MAJOR_MAP:
+		/* each item takes at least one byte */
+		if (h.arg > *len || (h.major == CBOR_MAJOR_MAP &&
+		    h.arg > *len / 2))
+			return (-1);
+		n = h.major == CBOR_MAJOR_MAP ? h.arg * 2 : h.arg;
+		for (uint64_t i = 0; i < n; i++)
+			if (skip_item(ptr, len, depth + 1) < 0)
+				return (-1);
+		return (0);
+	case CBOR_MAJOR_TAG:
+		return (skip_item(ptr, len, depth + 1));
+	default:
+		return (-1);
+	}
+}
+
+/* cut the next item off the front of (ptr, len) */
+static int
+next_item(const unsigned char **ptr, size_t *len, cbor_slice_t *item)
+{
+	item->ptr = *ptr;
+
+	if (skip_item(ptr, len, 0) < 0) {
+		fido_log_debug("%s: skip_item", __func__);
+		return (-1);
+	}
+
+	item->len = (size_t)(*ptr - item->ptr);
+
+	return (0);
+}
+
+/* decode the head of a slice, returning a pointer past it */
+static int
+slice_head(const cbor_slice_t *s, struct cbor_head *h,
+    const unsigned char **body, size_t *body_len)
+{
+	*body = s->ptr;
+	*body_len = s->len;
+
+	return (read_head(body, body_len, h));
+}
+
+static int
+int_width(const cbor_slice_t *s)
+{
+	uint8_t info = s->ptr[0] & 0x1f;
+
+	return (info <= 24 ? 0 : info - 24);
+}
+
+/*
+ * Validate CTAP2 canonical CBOR encoding rules for maps; see
+ * ctap_check_cbor() in cbor.c.
+ */
+static int
+check_key_order(const cbor_slice_t *prev, const cbor_slice_t *curr)
+{
+	struct cbor_head	 ph, ch;
+	const unsigned char	*pb, *cb;
+	size_t			 pl, cl;
+
+	if (slice_head(prev, &ph, &pb, &pl) < 0 ||
+	    slice_head(curr, &ch, &cb, &cl) < 0)
+		return (-1);
+
+	if (ph.major != ch.major) {
+		if (ph.major < ch.major)
+			return (0);
+		fido_log_debug("%s: unsorted types", __func__);
+		return (-1);
+	}
+
+	if (ch.major == CBOR_MAJOR_UINT || ch.major == CBOR_MAJOR_NEGINT) {
+		if (int_width(curr) >= int_width(prev) && ch.arg > ph.arg)
+			return (0);
+	} else {
+		if (ch.arg > ph.arg || (ch.arg == ph.arg &&
+		    memcmp(pb, cb, (size_t)ch.arg) < 0))
+			return (0);
+	}
+
+	fido_log_debug("%s: invalid cbor", __func__);
+
+	return (-1);
+}
+
+static int
+check_key_type(const cbor_slice_t *key)
+{
+	uint8_t major = key->ptr[0] >> 5;
+
+	if (major == CBOR_MAJOR_UINT || major == CBOR_MAJOR_NEGINT ||
+	    major == CBOR_MAJOR_TEXT)
+		return (0);
+
+	fido_log_debug("%s: invalid type: %u", __func__, major);
+
+	return (-1);
+}
+
+int
+cbor_slice_map_iter(const cbor_slice_t *map, void *arg,
+    int(*f)(const cbor_slice_t *, const cbor_slice_t *, void *))
+{
+	struct cbor_head	 h;
+	const unsigned char	*ptr;
+	size_t			 len;
+	cbor_slice_t		 prev, key, val;
+
+	if (slice_head(map, &h, &ptr, &len) < 0 || h.major != CBOR_MAJOR_MAP) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	for (uint64_t i = 0; i < h.arg; i++) {
+		if (next_item(&ptr, &len, &key) < 0 ||
+		    next_item(&ptr, &len, &val) < 0) {
+			fido_log_debug("%s: next_item", __func__);
+			return (-1);
+		}
+		if (check_key_type(&key) < 0 ||
+		    (i && check_key_order(&prev, &key) < 0)) {
+			fido_log_debug("%s: ctap_check_cbor", __func__);
+			return (-1);
+		}
+		if (f(&key, &val, arg) < 0) {
+			fido_log_debug("%s: iterator < 0 on i=%zu", __func__,
+			    (size_t)i);
+			return (-1);
+		}
+		prev = key;
+	}
+
+	return (0);
+}
+
+static int
+parse_reply_stream(const unsigned char *blob, size_t blob_len, void *arg,
+    int(*parser)(const cbor_slice_t *, const cbor_slice_t *, void *))
+{
+	cbor_slice_t	map;
+	size_t		len;
+
+	if (blob_len < 1) {
+		fido_log_debug("%s: blob_len=%zu", __func__, blob_len);
+		return (FIDO_ERR_RX);
+	}
+
+	if (blob[0] != FIDO_OK) {
+		fido_log_debug("%s: blob[0]=0x%02x", __func__, blob[0]);
+		return (blob[0]);
+	}
+
+	blob++;
+	len = blob_len - 1;
+
+	if (next_item(&blob, &len, &map) < 0) {
+		fido_log_debug("%s: next_item", __func__);
+		return (FIDO_ERR_RX_NOT_CBOR);
+	}
+
+	if ((map.ptr[0] >> 5) != CBOR_MAJOR_MAP) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (FIDO_ERR_RX_INVALID_CBOR);
+	}
+
+	if (cbor_slice_map_iter(&map, arg, parser) < 0) {
+		fido_log_debug("%s: cbor_slice_map_iter", __func__);
+		return (FIDO_ERR_RX_INVALID_CBOR);
+	}
+
+	return (FIDO_OK);
+}
+
+int
+cbor_parse_reply_stream(const unsigned char *blob, size_t blob_len, void *arg,
+    int(*parser)(const cbor_slice_t *, const cbor_slice_t *, void *))
+{
+	fido_dev_stats_t	*stats;
+	struct timespec		 ts;
+	int			 cmd, r;
+
+	stats = fido_stats_decode_begin(&cmd, &ts);
+	r = parse_reply_stream(blob, blob_len, arg, parser);
+	if (r == FIDO_ERR_RX_NOT_CBOR || r == FIDO_ERR_RX_INVALID_CBOR)
+		fido_log_fail(__func__, r);
+	if (stats != NULL)
+		fido_stats_decode_end(stats, cmd, &ts);
+
+	return (r);
+}
+
+int
+cbor_slice_uint8_key(const cbor_slice_t *key, uint8_t *v)
+{
+	struct cbor_head	 h;
+	const unsigned char	*ptr;
+	size_t			 len;
+
+	if (slice_head(key, &h, &ptr, &len) < 0 ||
+	    h.major != CBOR_MAJOR_UINT || h.info > 24)
+		return (-1);
+
+	*v = (uint8_t)h.arg;
+
+	return (0);
+}
+
+bool
+cbor_slice_str_eq(const cbor_slice_t *s, const char *str)
+{
+	struct cbor_head	 h;
+	const unsigned char	*ptr;
+	size_t			 len;
+
+	if (slice_head(s, &h, &ptr, &len) < 0 || h.major != CBOR_MAJOR_TEXT)
+		return (false);
+
+	return (h.arg == strlen(str) && memcmp(ptr, str, strlen(str)) == 0);
+}
+
+int
+cbor_slice_uint64(const cbor_slice_t *s, uint64_t *v)
+{
+	struct cbor_head	 h;
+	const unsigned char	*ptr;
+	size_t			 len;
+
+	if (slice_head(s, &h, &ptr, &len) < 0 || h.major != CBOR_MAJOR_UINT) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	*v = h.arg;
+
+	return (0);
+}
+
+int
+cbor_slice_bytes(const cbor_slice_t *s, const unsigned char **buf,
+    size_t *buf_len)
+{
+	struct cbor_head h;
+
+	if (slice_head(s, &h, buf, buf_len) < 0 ||
+	    h.major != CBOR_MAJOR_BYTES || h.arg != *buf_len) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	return (0);
+}
+
+int
+cbor_slice_blob(const cbor_slice_t *s, fido_blob_t *b)
+{
+	const unsigned char	*buf;
+	size_t			 len;
+
+	if (b->ptr != NULL || b->len != 0) {
+		fido_log_debug("%s: dup", __func__);
+		return (-1);
+	}
+
+	if (cbor_slice_bytes(s, &buf, &len) < 0)
+		return (-1);
+
+	if (len == 0)
+		return (0);
+
+	return (fido_blob_set(b, buf, len));
+}
+
+int
+cbor_slice_string(const cbor_slice_t *s, char **str)
+{
+	struct cbor_head	 h;
+	const unsigned char	*ptr;
+	size_t			 len;
+
+	if (*str != NULL) {
+		fido_log_debug("%s: dup", __func__);
+		return (-1);
+	}
+
+	if (slice_head(s, &h, &ptr, &len) < 0 || h.major != CBOR_MAJOR_TEXT ||
+	    h.arg != len) {
+		fido_log_debug("%s: cbor type", __func__);
+		return (-1);
+	}
+
+	if (len == SIZE_MAX || (*str = malloc(len + 1)) == NULL)
+		return (-1);
+
+	memcpy(*str, ptr, len);
+	(*str)[len] = '\0';
+
+	return (0);
+}
+
+static void
+put(cbor_enc_t *e, const void *buf, size_t len)
+{
+	if (e->bad)
+		return;
+	if (e->ptr == NULL) {
+		if (len > SIZE_MAX - e->len)
+			e->bad = true;
+		else
+			e->len += len;
+		return;
+	}
+	if (len > e->cap - e->len) {
+		fido_log_debug("%s: len=%zu, cap=%zu", __func__, e->len,
+		    e->cap);
+		e->bad = true;
+		return;
+	}
+	if (len > 0)
+		memcpy(e->ptr + e->len, buf, len);
+	e->len += len;
+}
+
+/* width: 0 for the shortest head, or the argument's size in bytes */
+static void
+put_head(cbor_enc_t *e, uint8_t major, uint64_t arg, size_t width)
+{
+	unsigned char	head[9];
+	uint8_t		info;
+	size_t		n;
+
+	if (width == 0 && arg < 24) {
+		head[0] = (uint8_t)((uint64_t)major << 5 | arg);
+		put(e, head, 1);
+		return;
+	}
+
+	if (width <= 1 && arg <= UINT8_MAX)
+		info = 24;
+	else if (width <= 2 && arg <= UINT16_MAX)
+		info = 25;
+	else if (width <= 4 && arg <= UINT32_MAX)
+		info = 26;
+	else
+		info = 27;
+
+	n = (size_t)1 << (info - 24);
+	head[0] = (uint8_t)(major << 5 | info);
+	for (size_t i = 0; i < n; i++)
+		head[n - i] = (uint8_t)(arg >> (8 * i));
+
+	put(e, head, n + 1);
+}
+
+void
+cbor_enc_uint(cbor_enc_t *e, uint64_t v)
+{
+	put_head(e, CBOR_MAJOR_UINT, v, 0);
+}
+
+void
+cbor_enc_int(cbor_enc_t *e, int64_t v)
+{
+	if (v < 0)
+		put_head(e, CBOR_MAJOR_NEGINT, (uint64_t)(-(v + 1)), 0);
+	else
+		put_head(e, CBOR_MAJOR_UINT, (uint64_t)v, 0);
+}
+
+void
+cbor_enc_bytes(cbor_enc_t *e, const unsigned char *ptr, size_t len)
+{
+	put_head(e, CBOR_MAJOR_BYTES, len, 0);
+	put(e, ptr, len);
+}
+
+void
+cbor_enc_string(cbor_enc_t *e, const char *str)
+{
+	size_t len = strlen(str);
+
+	put_head(e, CBOR_MAJOR_TEXT, len, 0);
+	put(e, str, len);
+}
+
+void
+cbor_enc_bool(cbor_enc_t *e, bool v)
+{
+	put_head(e, CBOR_MAJOR_SIMPLE, v ? 21 : 20, 0);
+}
+
+void
+cbor_enc_array(cbor_enc_t *e, size_t n)
+{
+	put_head(e, CBOR_MAJOR_ARRAY, n, 0);
+}
+
+void
+cbor_enc_map(cbor_enc_t *e, size_t n)
+{
+	put_head(e, CBOR_MAJOR_MAP, n, 0);
+}
+
+static size_t
+item_width(const cbor_item_t *item)
+{
+	switch (cbor_int_get_width(item)) {
+	case CBOR_INT_16:
+		return (2);
+	case CBOR_INT_32:
+		return (4);
+	case CBOR_INT_64:
+		return (8);
+	default:
+		return (0);
+	}
+}
+
+static void
+enc_item(cbor_enc_t *e, const cbor_item_t *item, int depth)
+{
+	cbor_item_t		**v;
+	struct cbor_pair	 *kv;
+	size_t			  n;
+
+	if (depth > CBOR_STREAM_MAXDEPTH) {
+		fido_log_debug("%s: depth=%d", __func__, depth);
+		e->bad = true;
+		return;
+	}
+
+	switch (cbor_typeof(item)) {
+	case CBOR_TYPE_UINT:
+		put_head(e, CBOR_MAJOR_UINT, cbor_get_int(item),
+		    item_width(item));
+		break;
+	case CBOR_TYPE_NEGINT:
+		put_head(e, CBOR_MAJOR_NEGINT, cbor_get_int(item),
+		    item_width(item));
+		break;
+	case CBOR_TYPE_BYTESTRING:
+		if (!cbor_bytestring_is_definite(item))
+			goto bad;
+		cbor_enc_bytes(e, cbor_bytestring_handle(item),
+		    cbor_bytestring_length(item));
+		break;
+	case CBOR_TYPE_STRING:
+		if (!cbor_string_is_definite(item))
+			goto bad;
+		n = cbor_string_length(item);
+		put_head(e, CBOR_MAJOR_TEXT, n, 0);
+		put(e, cbor_string_handle(item), n);
+		break;
+	case CBOR_TYPE_ARRAY:
+		if (!cbor_array_is_definite(item))
+			goto bad;
+		n = cbor_array_size(item);
+		v = cbor_array_handle(item);
+		cbor_enc_array(e, n);
+		for (size_t i = 0; i < n; i++)
+			enc_item(e, v[i], depth + 1);
+		break;
+	case CBOR_TYPE_MAP:
+		if (!cbor_map_is_definite(item))
+			goto bad;
+		n = cbor_map_size(item);
+		kv = cbor_map_handle(item);
+		cbor_enc_map(e, n);
+		for (size_t i = 0; i < n; i++) {
+			enc_item(e, kv[i].key, depth + 1);
+			enc_item(e, kv[i].value, depth + 1);
+		}
+		break;
+	case CBOR_TYPE_FLOAT_CTRL:
+		if (!cbor_is_bool(item))
+			goto bad;
+		cbor_enc_bool(e, cbor_get_bool(item));
+		break;
+	default:
+		goto bad;
+	}
+
+	return;
+bad:
+	fido_log_debug("%s: cbor type", __func__);
+	e->bad = true;
+}
+
+/* Writes a libcbor item as cbor_serialize() would. */
+void
+cbor_enc_item(cbor_enc_t *e, const cbor_item_t *item)
+{
+	enc_item(e, item, 0);
+}
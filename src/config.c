@@ -42,7 +42,7 @@ config_prepare_hmac(uint8_t subcmd, const cbor_item_t *item, fido_blob_t *hmac)
 
 static int
 config_tx(fido_dev_t *dev, uint8_t subcmd, cbor_item_t **paramv, size_t paramc,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	cbor_item_t *argv[4];
 	es256_pk_t *pk = NULL;
@@ -68,25 +68,35 @@ config_tx(fido_dev_t *dev, uint8_t subcmd, cbor_item_t **paramv, size_t paramc,
 	}
 
 	/* pinProtocol, pinAuth */
-	if (pin != NULL ||
+	if (pin != NULL || token != NULL ||
 	    (fido_dev_supports_permissions(dev) && fido_dev_has_uv(dev))) {
 		if (config_prepare_hmac(subcmd, argv[1], &hmac) < 0) {
 			fido_log_debug("%s: config_prepare_hmac", __func__);
 			goto fail;
 		}
-		if ((r = fido_do_ecdh(dev, &pk, &ecdh, ms)) != FIDO_OK) {
-			fido_log_debug("%s: fido_do_ecdh", __func__);
-			goto fail;
-		}
-		if ((r = cbor_add_uv_params(dev, cmd, &hmac, pk, ecdh, pin,
-		    NULL, &argv[3], &argv[2], ms)) != FIDO_OK) {
-			fido_log_debug("%s: cbor_add_uv_params", __func__);
-			goto fail;
+		if (token != NULL) {
+			if ((argv[2] = cbor_encode_pin_opt(dev)) == NULL ||
+			    (argv[3] = cbor_encode_pin_auth(dev, token,
+			    &hmac)) == NULL) {
+				fido_log_debug("%s: encode pin", __func__);
+				goto fail;
+			}
+		} else {
+			if ((r = fido_do_ecdh(dev, &pk, &ecdh, ms)) != FIDO_OK) {
+				fido_log_debug("%s: fido_do_ecdh", __func__);
+				goto fail;
+			}
+			if ((r = cbor_add_uv_params(dev, cmd, 0, &hmac, pk, ecdh,
+			    pin, NULL, &argv[3], &argv[2], ms)) != FIDO_OK) {
+				fido_log_debug("%s: cbor_add_uv_params",
+				    __func__);
+				goto fail;
+			}
 		}
 	}
 
 	/* framing and transmission */
-	if (cbor_build_frame(cmd, argv, nitems(argv), &f) < 0 ||
+	if (cbor_build_frame(dev, cmd, argv, nitems(argv), &f) < 0 ||
 	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -105,11 +115,12 @@ fail:
 }
 
 static int
-config_enable_entattest_wait(fido_dev_t *dev, const char *pin, int *ms)
+config_enable_entattest_wait(fido_dev_t *dev, const char *pin,
+    const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = config_tx(dev, CMD_ENABLE_ENTATTEST, NULL, 0, pin,
+	if ((r = config_tx(dev, CMD_ENABLE_ENTATTEST, NULL, 0, pin, token,
 	    ms)) != FIDO_OK)
 		return r;
 
@@ -121,15 +132,30 @@ fido_dev_enable_entattest(fido_dev_t *dev, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return (config_enable_entattest_wait(dev, pin, &ms));
+	return (config_enable_entattest_wait(dev, pin, NULL, &ms));
+}
+
+int
+fido_dev_enable_entattest_with_token(fido_dev_t *dev,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CONFIG)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (config_enable_entattest_wait(dev, NULL, t, &ms));
 }
 
 static int
-config_toggle_always_uv_wait(fido_dev_t *dev, const char *pin, int *ms)
+config_toggle_always_uv_wait(fido_dev_t *dev, const char *pin,
+    const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = config_tx(dev, CMD_TOGGLE_ALWAYS_UV, NULL, 0, pin,
+	if ((r = config_tx(dev, CMD_TOGGLE_ALWAYS_UV, NULL, 0, pin, token,
 	    ms)) != FIDO_OK)
 		return r;
 
@@ -141,12 +167,27 @@ fido_dev_toggle_always_uv(fido_dev_t *dev, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return config_toggle_always_uv_wait(dev, pin, &ms);
+	return config_toggle_always_uv_wait(dev, pin, NULL, &ms);
+}
+
+int
+fido_dev_toggle_always_uv_with_token(fido_dev_t *dev,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+	int ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CONFIG)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return config_toggle_always_uv_wait(dev, NULL, t, &ms);
 }
 
 static int
 config_pin_minlen_tx(fido_dev_t *dev, size_t len, bool force,
-    const fido_str_array_t *rpid, const char *pin, int *ms)
+    const fido_str_array_t *rpid, const char *pin, const fido_blob_t *token,
+    int *ms)
 {
 	cbor_item_t *argv[3];
 	int r;
@@ -173,7 +214,7 @@ config_pin_minlen_tx(fido_dev_t *dev, size_t len, bool force,
 		goto fail;
 	}
 	if ((r = config_tx(dev, CMD_SET_PIN_MINLEN, argv, nitems(argv),
-	    pin, ms)) != FIDO_OK) {
+	    pin, token, ms)) != FIDO_OK) {
 		fido_log_debug("%s: config_tx", __func__);
 		goto fail;
 	}
@@ -186,11 +227,12 @@ fail:
 
 static int
 config_pin_minlen(fido_dev_t *dev, size_t len, bool force,
-    const fido_str_array_t *rpid, const char *pin, int *ms)
+    const fido_str_array_t *rpid, const char *pin, const fido_blob_t *token,
+    int *ms)
 {
 	int r;
 
-	if ((r = config_pin_minlen_tx(dev, len, force, rpid, pin,
+	if ((r = config_pin_minlen_tx(dev, len, force, rpid, pin, token,
 	    ms)) != FIDO_OK)
 		return r;
 
@@ -202,7 +244,21 @@ fido_dev_set_pin_minlen(fido_dev_t *dev, size_t len, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return config_pin_minlen(dev, len, false, NULL, pin, &ms);
+	return config_pin_minlen(dev, len, false, NULL, pin, NULL, &ms);
+}
+
+int
+fido_dev_set_pin_minlen_with_token(fido_dev_t *dev, size_t len,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+	int ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CONFIG)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return config_pin_minlen(dev, len, false, NULL, NULL, t, &ms);
 }
 
 int
@@ -210,15 +266,28 @@ fido_dev_force_pin_change(fido_dev_t *dev, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return config_pin_minlen(dev, 0, true, NULL, pin, &ms);
+	return config_pin_minlen(dev, 0, true, NULL, pin, NULL, &ms);
 }
 
 int
-fido_dev_set_pin_minlen_rpid(fido_dev_t *dev, const char * const *rpid,
-    size_t n, const char *pin)
+fido_dev_force_pin_change_with_token(fido_dev_t *dev,
+    const fido_uv_token_t *token)
 {
-	fido_str_array_t sa;
+	const fido_blob_t *t;
 	int ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CONFIG)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return config_pin_minlen(dev, 0, true, NULL, NULL, t, &ms);
+}
+
+static int
+config_pin_minlen_rpid(fido_dev_t *dev, const char * const *rpid, size_t n,
+    const char *pin, const fido_blob_t *token, int *ms)
+{
+	fido_str_array_t sa;
 	int r;
 
 	memset(&sa, 0, sizeof(sa));
@@ -227,9 +296,32 @@ fido_dev_set_pin_minlen_rpid(fido_dev_t *dev, const char * const *rpid,
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
-	r = config_pin_minlen(dev, 0, false, &sa, pin, &ms);
+	r = config_pin_minlen(dev, 0, false, &sa, pin, token, ms);
 fail:
 	fido_str_array_free(&sa);
 
 	return r;
 }
+
+int
+fido_dev_set_pin_minlen_rpid(fido_dev_t *dev, const char * const *rpid,
+    size_t n, const char *pin)
+{
+	int ms = dev->timeout_ms;
+
+	return config_pin_minlen_rpid(dev, rpid, n, pin, NULL, &ms);
+}
+
+int
+fido_dev_set_pin_minlen_rpid_with_token(fido_dev_t *dev,
+    const char * const *rpid, size_t n, const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+	int ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CONFIG)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return config_pin_minlen_rpid(dev, rpid, n, NULL, t, &ms);
+}
@@ -47,20 +47,45 @@ parse_makecred_reply(const cbor_item_t *key, const cbor_item_t *val, void *arg)
 	}
 }
 
+struct makecred_tx {
+	const fido_dev_t	*dev;
+	const fido_cred_t	*cred;
+	fido_opt_t		 uv;
+	const cbor_item_t	*pin_auth;
+	const cbor_item_t	*pin_opt;
+};
+
+static bool
+excl_list_fits(const fido_blob_array_t *excl_list, void *arg)
+{
+	const struct makecred_tx	*tx = arg;
+	size_t				 len;
+
+	len = cbor_frame_makecred_len(tx->cred, excl_list, tx->uv,
+	    tx->pin_auth, tx->pin_opt);
+
+	return (len != 0 && (tx->dev->maxmsgsize == 0 ||
+	    len <= tx->dev->maxmsgsize));
+}
+
 static int
 fido_dev_make_cred_tx(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
     int *ms)
 {
-	fido_blob_t	 f;
-	fido_blob_t	*ecdh = NULL;
-	fido_opt_t	 uv = cred->uv;
-	es256_pk_t	*pk = NULL;
-	cbor_item_t	*argv[9];
-	const uint8_t	 cmd = CTAP_CBOR_MAKECRED;
-	int		 r;
+	fido_blob_t		 f;
+	fido_blob_t		*ecdh = NULL;
+	fido_blob_array_t	 excl;
+	fido_opt_t		 uv = cred->uv;
+	es256_pk_t		*pk = NULL;
+	cbor_item_t		*pin_auth = NULL;
+	cbor_item_t		*pin_opt = NULL;
+	struct makecred_tx	 tx;
+	const uint8_t		 cmd = CTAP_CBOR_MAKECRED;
+	uint8_t			 perms;
+	int			 r;
 
 	memset(&f, 0, sizeof(f));
-	memset(argv, 0, sizeof(argv));
+	memset(&excl, 0, sizeof(excl));
 
 	if (cred->cdh.ptr == NULL || cred->type == 0) {
 		fido_log_debug("%s: cdh=%p, type=%d", __func__,
@@ -69,32 +94,6 @@ fido_dev_make_cred_tx(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
 		goto fail;
 	}
 
-	if ((argv[0] = fido_blob_encode(&cred->cdh)) == NULL ||
-	    (argv[1] = cbor_encode_rp_entity(&cred->rp)) == NULL ||
-	    (argv[2] = cbor_encode_user_entity(&cred->user)) == NULL ||
-	    (argv[3] = cbor_encode_pubkey_param(cred->type)) == NULL) {
-		fido_log_debug("%s: cbor encode", __func__);
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	/* excluded credentials */
-	if (cred->excl.len)
-		if ((argv[4] = cbor_encode_pubkey_list(&cred->excl)) == NULL) {
-			fido_log_debug("%s: cbor_encode_pubkey_list", __func__);
-			r = FIDO_ERR_INTERNAL;
-			goto fail;
-		}
-
-	/* extensions */
-	if (cred->ext.mask)
-		if ((argv[5] = cbor_encode_cred_ext(&cred->ext,
-		    &cred->blob)) == NULL) {
-			fido_log_debug("%s: cbor_encode_cred_ext", __func__);
-			r = FIDO_ERR_INTERNAL;
-			goto fail;
-		}
-
 	/* user verification */
 	if (pin != NULL || (uv == FIDO_OPT_TRUE &&
 	    fido_dev_supports_permissions(dev))) {
@@ -102,25 +101,40 @@ fido_dev_make_cred_tx(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
 			fido_log_debug("%s: fido_do_ecdh", __func__);
 			goto fail;
 		}
-		if ((r = cbor_add_uv_params(dev, cmd, &cred->cdh, pk, ecdh,
-		    pin, cred->rp.id, &argv[7], &argv[8], ms)) != FIDO_OK) {
+		/* probing the exclude list takes getAssertion */
+		perms = cred->excl.len > 1 ? FIDO_UV_TOKEN_PERM_ASSERT : 0;
+		if ((r = cbor_add_uv_params(dev, cmd, perms, &cred->cdh, pk,
+		    ecdh, pin, cred->rp.id, &pin_auth, &pin_opt,
+		    ms)) != FIDO_OK) {
 			fido_log_debug("%s: cbor_add_uv_params", __func__);
 			goto fail;
 		}
 		uv = FIDO_OPT_OMIT;
 	}
 
-	/* options */
-	if (cred->rk != FIDO_OPT_OMIT || uv != FIDO_OPT_OMIT)
-		if ((argv[6] = cbor_encode_cred_opt(cred->rk, uv)) == NULL) {
-			fido_log_debug("%s: cbor_encode_cred_opt", __func__);
-			r = FIDO_ERR_INTERNAL;
-			goto fail;
-		}
+	/* excluded credentials, as many as the authenticator takes */
+	tx.dev = dev;
+	tx.cred = cred;
+	tx.uv = uv;
+	tx.pin_auth = pin_auth;
+	tx.pin_opt = pin_opt;
+	if ((r = fido_dev_credlist_batch(dev, cred->rp.id, &cred->cdh,
+	    &cred->excl, pin_auth, pin_opt, &tx, excl_list_fits, &excl,
+	    ms)) != FIDO_OK) {
+		fido_log_debug("%s: fido_dev_credlist_batch", __func__);
+		goto fail;
+	}
+
+	/* encoding */
+	if (cbor_frame_makecred(dev, cred, &excl, uv, pin_auth, pin_opt,
+	    &f) < 0) {
+		fido_log_debug("%s: cbor_frame_makecred", __func__);
+		r = FIDO_ERR_INTERNAL;
+		goto fail;
+	}
 
-	/* framing and transmission */
-	if (cbor_build_frame(cmd, argv, nitems(argv), &f) < 0 ||
-	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
+	/* transmission */
+	if (fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
 		goto fail;
@@ -130,12 +144,44 @@ fido_dev_make_cred_tx(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
 fail:
 	es256_pk_free(&pk);
 	fido_blob_free(&ecdh);
-	cbor_vector_free(argv, nitems(argv));
+	if (pin_auth != NULL)
+		cbor_decref(&pin_auth);
+	if (pin_opt != NULL)
+		cbor_decref(&pin_opt);
+	free(excl.ptr); /* borrowed ids */
 	free(f.ptr);
 
 	return (r);
 }
 
+static int
+fido_dev_make_cred_parse(fido_cred_t *cred, const unsigned char *reply,
+    size_t reply_len)
+{
+	int r;
+
+	fido_cred_reset_rx(cred);
+
+	if ((r = cbor_parse_reply(reply, reply_len, cred,
+	    parse_makecred_reply)) != FIDO_OK) {
+		fido_log_debug("%s: parse_makecred_reply", __func__);
+		goto fail;
+	}
+
+	if (cred->fmt == NULL || fido_blob_is_empty(&cred->authdata_cbor) ||
+	    fido_blob_is_empty(&cred->attcred.id)) {
+		r = FIDO_ERR_INVALID_CBOR;
+		goto fail;
+	}
+
+	r = FIDO_OK;
+fail:
+	if (r != FIDO_OK)
+		fido_cred_reset_rx(cred);
+
+	return (r);
+}
+
 static int
 fido_dev_make_cred_rx(fido_dev_t *dev, fido_cred_t *cred, int *ms)
 {
@@ -157,28 +203,22 @@ fido_dev_make_cred_rx(fido_dev_t *dev, fido_cred_t *cred, int *ms)
 		goto fail;
 	}
 
-	if ((r = cbor_parse_reply(reply, (size_t)reply_len, cred,
-	    parse_makecred_reply)) != FIDO_OK) {
-		fido_log_debug("%s: parse_makecred_reply", __func__);
-		goto fail;
-	}
-
-	if (cred->fmt == NULL || fido_blob_is_empty(&cred->authdata_cbor) ||
-	    fido_blob_is_empty(&cred->attcred.id)) {
-		r = FIDO_ERR_INVALID_CBOR;
-		goto fail;
-	}
-
-	r = FIDO_OK;
+	r = fido_dev_make_cred_parse(cred, reply, (size_t)reply_len);
 fail:
 	free(reply);
 
-	if (r != FIDO_OK)
-		fido_cred_reset_rx(cred);
-
 	return (r);
 }
 
+static int
+fido_dev_make_cred_async_rx(fido_dev_t *dev, const unsigned char *reply,
+    size_t reply_len, bool *done)
+{
+	*done = true;
+
+	return (fido_dev_make_cred_parse(dev->async.obj, reply, reply_len));
+}
+
 static int
 fido_dev_make_cred_wait(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
     int *ms)
@@ -197,6 +237,10 @@ fido_dev_make_cred(fido_dev_t *dev, fido_cred_t *cred, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
+	if (fido_dev_async_busy(dev)) {
+		fido_log_debug("%s: operation in progress", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
 #ifdef USE_WINHELLO
 	if (dev->flags & FIDO_DEV_WINHELLO)
 		return (fido_winhello_make_cred(dev, cred, pin, ms));
@@ -211,6 +255,23 @@ fido_dev_make_cred(fido_dev_t *dev, fido_cred_t *cred, const char *pin)
 	return (fido_dev_make_cred_wait(dev, cred, pin, &ms));
 }
 
+int
+fido_dev_make_cred_begin(fido_dev_t *dev, fido_cred_t *cred, const char *pin)
+{
+	int ms = dev->timeout_ms;
+	int r;
+
+	if ((r = fido_dev_async_check(dev)) != FIDO_OK)
+		return (r);
+	if ((r = fido_dev_make_cred_tx(dev, cred, pin, &ms)) != FIDO_OK)
+		return (r);
+
+	fido_dev_async_start(dev, cred, fido_dev_make_cred_async_rx, NULL,
+	    NULL);
+
+	return (FIDO_OK);
+}
+
 static int
 check_extensions(const fido_cred_ext_t *authdata_ext,
     const fido_cred_ext_t *ext)
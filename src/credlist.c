@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+/*
+ * Allow and exclude lists longer than an authenticator takes in one
+ * request. Credential ids longer than maxCredentialIdLength can't be the
+ * authenticator's and are dropped; the rest are cut into batches of at
+ * most maxCredentialCountInList ids whose request fits in maxMsgSize.
+ * Batches are probed in turn with a getAssertion that doesn't ask for
+ * user presence, until one holds a credential the authenticator knows;
+ * the last batch is used without a probe. Probes carry the request's
+ * pinUvAuthParam, if any, so that credentials only visible with user
+ * verification are found. An authenticator that won't be probed without
+ * one gets the batch it refused. A list that fits in one request is
+ * passed through untouched.
+ */
+
+/* The size of the batch at v, at most n long. */
+static size_t
+batch_len(const fido_dev_t *dev, fido_blob_t *v, size_t n, void *arg,
+    bool (*fits)(const fido_blob_array_t *, void *))
+{
+	fido_blob_array_t	b;
+	size_t			max = n;
+
+	if (dev->maxcredcntlst != 0 && dev->maxcredcntlst < max)
+		max = (size_t)dev->maxcredcntlst;
+
+	b.ptr = v;
+	b.len = max;
+	if (fits(&b, arg))
+		return (max);
+
+	/* grow one id at a time; a single id always goes */
+	for (b.len = 2; b.len <= max; b.len++)
+		if (!fits(&b, arg))
+			break;
+
+	return (b.len - 1);
+}
+
+/* FIDO_OK if a credential in batch is known for rp_id. */
+static int
+probe(fido_dev_t *dev, const char *rp_id, const fido_blob_t *cdh,
+    const fido_blob_array_t *batch, const cbor_item_t *pin_auth,
+    const cbor_item_t *pin_opt, int *ms)
+{
+	fido_blob_t	f;
+	int		r;
+
+	memset(&f, 0, sizeof(f));
+
+	if (cbor_frame_probe(dev, rp_id, cdh, batch, pin_auth, pin_opt,
+	    &f) < 0) {
+		fido_log_debug("%s: cbor_frame_probe", __func__);
+		r = FIDO_ERR_INTERNAL;
+		goto fail;
+	}
+	if (fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
+		fido_log_debug("%s: fido_tx", __func__);
+		r = FIDO_ERR_TX;
+		goto fail;
+	}
+
+	r = fido_rx_cbor_status(dev, ms);
+fail:
+	free(f.ptr);
+
+	return (r);
+}
+
+/*
+ * Picks the part of list to send with rp_id's request, whose pinUvAuthParam
+ * and protocol, if any, are pin_auth and pin_opt. fits() says whether the
+ * request would fit with a given list. On success, batch borrows list's
+ * ids and batch->ptr is to be released with free(); an empty batch means
+ * that no id in a non-empty list can match.
+ */
+int
+fido_dev_credlist_batch(fido_dev_t *dev, const char *rp_id,
+    const fido_blob_t *cdh, const fido_blob_array_t *list,
+    const cbor_item_t *pin_auth, const cbor_item_t *pin_opt, void *arg,
+    bool (*fits)(const fido_blob_array_t *, void *), fido_blob_array_t *batch,
+    int *ms)
+{
+	fido_blob_array_t	 b;
+	fido_blob_t		*v;
+	size_t			 i, n = 0;
+	int			 r;
+
+	memset(batch, 0, sizeof(*batch));
+
+	if (list->len == 0)
+		return (FIDO_OK);
+	if ((v = calloc(list->len, sizeof(*v))) == NULL)
+		return (FIDO_ERR_INTERNAL);
+
+	for (i = 0; i < list->len; i++) {
+		if (dev->maxcredidlen != 0 &&
+		    list->ptr[i].len > dev->maxcredidlen) {
+			fido_log_debug("%s: skipping id %zu, len=%zu", __func__,
+			    i, list->ptr[i].len);
+			continue;
+		}
+		v[n++] = list->ptr[i];
+	}
+
+	b.ptr = v;
+	b.len = 0;
+
+	for (i = 0; i < n; i += b.len) {
+		b.ptr = v + i;
+		b.len = batch_len(dev, b.ptr, n - i, arg, fits);
+		if (i + b.len == n)
+			break; /* last */
+		fido_log_debug("%s: probing %zu+%zu of %zu", __func__, i,
+		    b.len, n);
+		if ((r = probe(dev, rp_id, cdh, &b, pin_auth, pin_opt,
+		    ms)) == FIDO_OK)
+			break;
+		if (r == FIDO_ERR_PIN_REQUIRED) { /* PUAT_REQUIRED */
+			fido_log_debug("%s: can't probe", __func__);
+			break;
+		}
+		if (r != FIDO_ERR_NO_CREDENTIALS) {
+			fido_log_debug("%s: probe: 0x%x", __func__, r);
+			free(v);
+			return (r);
+		}
+	}
+
+	if (n == 0) {
+		free(v);
+		return (FIDO_OK);
+	}
+
+	memmove(v, b.ptr, b.len * sizeof(*v));
+	batch->ptr = v;
+	batch->len = b.len;
+
+	return (FIDO_OK);
+}
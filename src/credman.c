@@ -99,7 +99,7 @@ credman_prepare_hmac(uint8_t cmd, const void *body, cbor_item_t **param,
 		fido_log_debug("%s: cbor_flatten_vector", __func__);
 		goto fail;
 	}
-	if (cbor_build_frame(cmd, param_cbor, n, hmac_data) < 0) {
+	if (cbor_build_frame(NULL, cmd, param_cbor, n, hmac_data) < 0) {
 		fido_log_debug("%s: cbor_build_frame", __func__);
 		goto fail;
 	}
@@ -113,7 +113,7 @@ fail:
 
 static int
 credman_tx(fido_dev_t *dev, uint8_t subcmd, const void *param, const char *pin,
-    const char *rp_id, fido_opt_t uv, int *ms)
+    const fido_blob_t *token, const char *rp_id, fido_opt_t uv, int *ms)
 {
 	fido_blob_t	 f;
 	fido_blob_t	*ecdh = NULL;
@@ -140,24 +140,34 @@ credman_tx(fido_dev_t *dev, uint8_t subcmd, const void *param, const char *pin,
 	}
 
 	/* pinProtocol, pinAuth */
-	if (pin != NULL || uv == FIDO_OPT_TRUE) {
+	if (pin != NULL || token != NULL || uv == FIDO_OPT_TRUE) {
 		if (credman_prepare_hmac(subcmd, param, &argv[1], &hmac) < 0) {
 			fido_log_debug("%s: credman_prepare_hmac", __func__);
 			goto fail;
 		}
-		if ((r = fido_do_ecdh(dev, &pk, &ecdh, ms)) != FIDO_OK) {
-			fido_log_debug("%s: fido_do_ecdh", __func__);
-			goto fail;
-		}
-		if ((r = cbor_add_uv_params(dev, cmd, &hmac, pk, ecdh, pin,
-		    rp_id, &argv[3], &argv[2], ms)) != FIDO_OK) {
-			fido_log_debug("%s: cbor_add_uv_params", __func__);
-			goto fail;
+		if (token != NULL) {
+			if ((argv[2] = cbor_encode_pin_opt(dev)) == NULL ||
+			    (argv[3] = cbor_encode_pin_auth(dev, token,
+			    &hmac)) == NULL) {
+				fido_log_debug("%s: encode pin", __func__);
+				goto fail;
+			}
+		} else {
+			if ((r = fido_do_ecdh(dev, &pk, &ecdh, ms)) != FIDO_OK) {
+				fido_log_debug("%s: fido_do_ecdh", __func__);
+				goto fail;
+			}
+			if ((r = cbor_add_uv_params(dev, cmd, 0, &hmac, pk, ecdh,
+			    pin, rp_id, &argv[3], &argv[2], ms)) != FIDO_OK) {
+				fido_log_debug("%s: cbor_add_uv_params",
+				    __func__);
+				goto fail;
+			}
 		}
 	}
 
 	/* framing and transmission */
-	if (cbor_build_frame(cmd, argv, nitems(argv), &f) < 0 ||
+	if (cbor_build_frame(dev, cmd, argv, nitems(argv), &f) < 0 ||
 	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -201,18 +211,13 @@ credman_parse_metadata(const cbor_item_t *key, const cbor_item_t *val,
 static int
 credman_rx_metadata(fido_dev_t *dev, fido_credman_metadata_t *metadata, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	memset(metadata, 0, sizeof(*metadata));
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -226,18 +231,18 @@ credman_rx_metadata(fido_dev_t *dev, fido_credman_metadata_t *metadata, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
 
 static int
 credman_get_metadata_wait(fido_dev_t *dev, fido_credman_metadata_t *metadata,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = credman_tx(dev, CMD_CRED_METADATA, NULL, pin, NULL,
+	if ((r = credman_tx(dev, CMD_CRED_METADATA, NULL, pin, token, NULL,
 	    FIDO_OPT_TRUE, ms)) != FIDO_OK ||
 	    (r = credman_rx_metadata(dev, metadata, ms)) != FIDO_OK)
 		return (r);
@@ -251,7 +256,21 @@ fido_credman_get_dev_metadata(fido_dev_t *dev, fido_credman_metadata_t *metadata
 {
 	int ms = dev->timeout_ms;
 
-	return (credman_get_metadata_wait(dev, metadata, pin, &ms));
+	return (credman_get_metadata_wait(dev, metadata, pin, NULL, &ms));
+}
+
+int
+fido_credman_get_dev_metadata_with_token(fido_dev_t *dev,
+    fido_credman_metadata_t *metadata, const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CRED_MGMT)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (credman_get_metadata_wait(dev, metadata, NULL, t, &ms));
 }
 
 static int
@@ -335,18 +354,13 @@ credman_parse_rk_count(const cbor_item_t *key, const cbor_item_t *val,
 static int
 credman_rx_rk(fido_dev_t *dev, fido_credman_rk_t *rk, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	credman_reset_rk(rk);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -375,7 +389,7 @@ credman_rx_rk(fido_dev_t *dev, fido_credman_rk_t *rk, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -383,16 +397,11 @@ out:
 static int
 credman_rx_next_rk(fido_dev_t *dev, fido_credman_rk_t *rk, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
-
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -414,14 +423,14 @@ credman_rx_next_rk(fido_dev_t *dev, fido_credman_rk_t *rk, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
 
 static int
 credman_get_rk_wait(fido_dev_t *dev, const char *rp_id, fido_credman_rk_t *rk,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	fido_blob_t	rp_dgst;
 	uint8_t		dgst[SHA256_DIGEST_LENGTH];
@@ -435,13 +444,13 @@ credman_get_rk_wait(fido_dev_t *dev, const char *rp_id, fido_credman_rk_t *rk,
 	rp_dgst.ptr = dgst;
 	rp_dgst.len = sizeof(dgst);
 
-	if ((r = credman_tx(dev, CMD_RK_BEGIN, &rp_dgst, pin, rp_id,
+	if ((r = credman_tx(dev, CMD_RK_BEGIN, &rp_dgst, pin, token, rp_id,
 	    FIDO_OPT_TRUE, ms)) != FIDO_OK ||
 	    (r = credman_rx_rk(dev, rk, ms)) != FIDO_OK)
 		return (r);
 
 	while (rk->n_rx < rk->n_alloc) {
-		if ((r = credman_tx(dev, CMD_RK_NEXT, NULL, NULL, NULL,
+		if ((r = credman_tx(dev, CMD_RK_NEXT, NULL, NULL, NULL, NULL,
 		    FIDO_OPT_FALSE, ms)) != FIDO_OK ||
 		    (r = credman_rx_next_rk(dev, rk, ms)) != FIDO_OK)
 			return (r);
@@ -457,12 +466,26 @@ fido_credman_get_dev_rk(fido_dev_t *dev, const char *rp_id,
 {
 	int ms = dev->timeout_ms;
 
-	return (credman_get_rk_wait(dev, rp_id, rk, pin, &ms));
+	return (credman_get_rk_wait(dev, rp_id, rk, pin, NULL, &ms));
+}
+
+int
+fido_credman_get_dev_rk_with_token(fido_dev_t *dev, const char *rp_id,
+    fido_credman_rk_t *rk, const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CRED_MGMT)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (credman_get_rk_wait(dev, rp_id, rk, NULL, t, &ms));
 }
 
 static int
 credman_del_rk_wait(fido_dev_t *dev, const unsigned char *cred_id,
-    size_t cred_id_len, const char *pin, int *ms)
+    size_t cred_id_len, const char *pin, const fido_blob_t *token, int *ms)
 {
 	fido_blob_t cred;
 	int r;
@@ -472,7 +495,7 @@ credman_del_rk_wait(fido_dev_t *dev, const unsigned char *cred_id,
 	if (fido_blob_set(&cred, cred_id, cred_id_len) < 0)
 		return (FIDO_ERR_INVALID_ARGUMENT);
 
-	if ((r = credman_tx(dev, CMD_DELETE_CRED, &cred, pin, NULL,
+	if ((r = credman_tx(dev, CMD_DELETE_CRED, &cred, pin, token, NULL,
 	    FIDO_OPT_TRUE, ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK)
 		goto fail;
@@ -490,7 +513,23 @@ fido_credman_del_dev_rk(fido_dev_t *dev, const unsigned char *cred_id,
 {
 	int ms = dev->timeout_ms;
 
-	return (credman_del_rk_wait(dev, cred_id, cred_id_len, pin, &ms));
+	return (credman_del_rk_wait(dev, cred_id, cred_id_len, pin, NULL,
+	    &ms));
+}
+
+int
+fido_credman_del_dev_rk_with_token(fido_dev_t *dev,
+    const unsigned char *cred_id, size_t cred_id_len,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CRED_MGMT)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (credman_del_rk_wait(dev, cred_id, cred_id_len, NULL, t, &ms));
 }
 
 static int
@@ -563,18 +602,13 @@ credman_parse_rp_count(const cbor_item_t *key, const cbor_item_t *val,
 static int
 credman_rx_rp(fido_dev_t *dev, fido_credman_rp_t *rp, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	credman_reset_rp(rp);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -603,7 +637,7 @@ credman_rx_rp(fido_dev_t *dev, fido_credman_rp_t *rp, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -611,16 +645,11 @@ out:
 static int
 credman_rx_next_rp(fido_dev_t *dev, fido_credman_rp_t *rp, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
-
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -642,24 +671,24 @@ credman_rx_next_rp(fido_dev_t *dev, fido_credman_rp_t *rp, int *ms)
 
 	r = FIDO_OK;
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
 
 static int
 credman_get_rp_wait(fido_dev_t *dev, fido_credman_rp_t *rp, const char *pin,
-    int *ms)
+    const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = credman_tx(dev, CMD_RP_BEGIN, NULL, pin, NULL,
+	if ((r = credman_tx(dev, CMD_RP_BEGIN, NULL, pin, token, NULL,
 	    FIDO_OPT_TRUE, ms)) != FIDO_OK ||
 	    (r = credman_rx_rp(dev, rp, ms)) != FIDO_OK)
 		return (r);
 
 	while (rp->n_rx < rp->n_alloc) {
-		if ((r = credman_tx(dev, CMD_RP_NEXT, NULL, NULL, NULL,
+		if ((r = credman_tx(dev, CMD_RP_NEXT, NULL, NULL, NULL, NULL,
 		    FIDO_OPT_FALSE, ms)) != FIDO_OK ||
 		    (r = credman_rx_next_rp(dev, rp, ms)) != FIDO_OK)
 			return (r);
@@ -674,16 +703,30 @@ fido_credman_get_dev_rp(fido_dev_t *dev, fido_credman_rp_t *rp, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return (credman_get_rp_wait(dev, rp, pin, &ms));
+	return (credman_get_rp_wait(dev, rp, pin, NULL, &ms));
+}
+
+int
+fido_credman_get_dev_rp_with_token(fido_dev_t *dev, fido_credman_rp_t *rp,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CRED_MGMT)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (credman_get_rp_wait(dev, rp, NULL, t, &ms));
 }
 
 static int
 credman_set_dev_rk_wait(fido_dev_t *dev, fido_cred_t *cred, const char *pin,
-    int *ms)
+    const fido_blob_t *token, int *ms)
 {
 	int r;
 
-	if ((r = credman_tx(dev, CMD_UPDATE_CRED, cred, pin, NULL,
+	if ((r = credman_tx(dev, CMD_UPDATE_CRED, cred, pin, token, NULL,
 	    FIDO_OPT_TRUE, ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK)
 		return (r);
@@ -696,7 +739,21 @@ fido_credman_set_dev_rk(fido_dev_t *dev, fido_cred_t *cred, const char *pin)
 {
 	int ms = dev->timeout_ms;
 
-	return (credman_set_dev_rk_wait(dev, cred, pin, &ms));
+	return (credman_set_dev_rk_wait(dev, cred, pin, NULL, &ms));
+}
+
+int
+fido_credman_set_dev_rk_with_token(fido_dev_t *dev, fido_cred_t *cred,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t	*t;
+	int			 ms = dev->timeout_ms;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_CRED_MGMT)) == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	return (credman_set_dev_rk_wait(dev, cred, NULL, t, &ms));
 }
 
 fido_credman_rk_t *
@@ -24,6 +24,50 @@ set_random_report_len(fido_dev_t *dev)
 }
 #endif
 
+static void
+set_default_writev(fido_dev_t *dev)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI) && !defined(FIDO_FUZZ)
+	if (dev->io.write == &fido_hid_write)
+		dev->io_writev = &fido_hid_writev;
+#else
+	(void)dev;
+#endif
+}
+
+static void
+set_default_pollfd(fido_dev_t *dev)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI) && !defined(FIDO_FUZZ)
+	if (dev->io.read == &fido_hid_read)
+		dev->io_pollfd = &fido_hid_pollfd;
+#else
+	(void)dev;
+#endif
+}
+
+static void
+set_default_wakeup(fido_dev_t *dev)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI) && !defined(FIDO_FUZZ)
+	if (dev->io.read == &fido_hid_read)
+		dev->io_wakeup = &fido_hid_wakeup;
+#else
+	(void)dev;
+#endif
+}
+
+static void
+fido_dev_set_version_flags(fido_dev_t *dev, const fido_cbor_info_t *info)
+{
+	char * const	*ptr = fido_cbor_info_versions_ptr(info);
+	size_t		 len = fido_cbor_info_versions_len(info);
+
+	for (size_t i = 0; i < len; i++)
+		if (strcmp(ptr[i], "FIDO_2_1") == 0)
+			dev->flags |= FIDO_DEV_SELECTION;
+}
+
 static void
 fido_dev_set_extension_flags(fido_dev_t *dev, const fido_cbor_info_t *info)
 {
@@ -83,6 +127,7 @@ fido_dev_set_protocol_flags(fido_dev_t *dev, const fido_cbor_info_t *info)
 static void
 fido_dev_set_flags(fido_dev_t *dev, const fido_cbor_info_t *info)
 {
+	fido_dev_set_version_flags(dev, info);
 	fido_dev_set_extension_flags(dev, info);
 	fido_dev_set_option_flags(dev, info);
 	fido_dev_set_protocol_flags(dev, info);
@@ -113,9 +158,15 @@ fido_dev_open_tx(fido_dev_t *dev, const char *path, int *ms)
 		return (FIDO_ERR_INTERNAL);
 	}
 
+	if (dev->cache != NULL && (dev->cache_path = strdup(path)) == NULL) {
+		fido_log_debug("%s: strdup", __func__);
+		return (FIDO_ERR_INTERNAL);
+	}
+
 	if ((dev->io_handle = dev->io.open(path)) == NULL) {
 		fido_log_debug("%s: dev->io.open", __func__);
-		return (FIDO_ERR_INTERNAL);
+		r = FIDO_ERR_INTERNAL;
+		goto fail;
 	}
 
 	if (dev->io_own) {
@@ -153,8 +204,13 @@ fido_dev_open_tx(fido_dev_t *dev, const char *path, int *ms)
 
 	return (FIDO_OK);
 fail:
-	dev->io.close(dev->io_handle);
-	dev->io_handle = NULL;
+	if (dev->io_handle != NULL) {
+		dev->io.close(dev->io_handle);
+		dev->io_handle = NULL;
+	}
+	fido_dev_cache_drop(dev);
+	free(dev->cache_path);
+	dev->cache_path = NULL;
 
 	return (r);
 }
@@ -187,7 +243,11 @@ fido_dev_open_rx(fido_dev_t *dev, int *ms)
 	dev->flags = 0;
 	dev->cid = dev->attr.cid;
 
-	if (fido_dev_is_fido2(dev)) {
+	if (fido_dev_is_fido2(dev) && fido_dev_cache_lookup(dev) == 0) {
+		fido_log_debug("%s: cached flags=0x%x, maxmsgsiz=%lu",
+		    __func__, (unsigned)dev->flags,
+		    (unsigned long)dev->maxmsgsize);
+	} else if (fido_dev_is_fido2(dev)) {
 		if ((info = fido_cbor_info_new()) == NULL) {
 			fido_log_debug("%s: fido_cbor_info_new", __func__);
 			r = FIDO_ERR_INTERNAL;
@@ -208,8 +268,11 @@ fido_dev_open_rx(fido_dev_t *dev, int *ms)
 
 	if (fido_dev_is_fido2(dev) && info != NULL) {
 		dev->maxmsgsize = fido_cbor_info_maxmsgsiz(info);
+		dev->maxcredcntlst = fido_cbor_info_maxcredcntlst(info);
+		dev->maxcredidlen = fido_cbor_info_maxcredidlen(info);
 		fido_log_debug("%s: FIDO_MAXMSG=%d, maxmsgsiz=%lu", __func__,
 		    FIDO_MAXMSG, (unsigned long)dev->maxmsgsize);
+		fido_dev_cache_store(dev);
 	}
 
 	r = FIDO_OK;
@@ -219,12 +282,15 @@ fail:
 	if (r != FIDO_OK) {
 		dev->io.close(dev->io_handle);
 		dev->io_handle = NULL;
+		fido_dev_cache_drop(dev);
+		free(dev->cache_path);
+		dev->cache_path = NULL;
 	}
 
 	return (r);
 }
 
-static int
+int
 fido_dev_open_wait(fido_dev_t *dev, const char *path, int *ms)
 {
 	int r;
@@ -240,43 +306,33 @@ fido_dev_open_wait(fido_dev_t *dev, const char *path, int *ms)
 	return (FIDO_OK);
 }
 
-static void
-run_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen,
-    const char *type, int (*manifest)(fido_dev_info_t *, size_t, size_t *))
+int
+fido_dev_info_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
 {
-	size_t ndevs = 0;
-	int r;
+	fido_dev_manifest(NULL, devlist, ilen, olen, -1);
 
-	if (*olen >= ilen) {
-		fido_log_debug("%s: skipping %s", __func__, type);
-		return;
-	}
-	if ((r = manifest(devlist + *olen, ilen - *olen, &ndevs)) != FIDO_OK)
-		fido_log_debug("%s: %s: 0x%x", __func__, type, r);
-	fido_log_debug("%s: found %zu %s device%s", __func__, ndevs, type,
-	    ndevs == 1 ? "" : "s");
-	*olen += ndevs;
+	return (FIDO_OK);
 }
 
 int
-fido_dev_info_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
+fido_dev_info_manifest_ms(fido_dev_info_t *devlist, size_t ilen, size_t *olen,
+    int ms)
 {
-	*olen = 0;
+	if (ms < -1)
+		return (FIDO_ERR_INVALID_ARGUMENT);
 
-	run_manifest(devlist, ilen, olen, "hid", fido_hid_manifest);
-#ifdef USE_NFC
-	run_manifest(devlist, ilen, olen, "nfc", fido_nfc_manifest);
-#endif
-#ifdef USE_PCSC
-	run_manifest(devlist, ilen, olen, "pcsc", fido_pcsc_manifest);
-#endif
-#ifdef USE_WINHELLO
-	run_manifest(devlist, ilen, olen, "winhello", fido_winhello_manifest);
-#endif
+	fido_dev_manifest(NULL, devlist, ilen, olen, ms);
 
 	return (FIDO_OK);
 }
 
+int
+fido_dev_registry_manifest(fido_dev_registry_t *reg, fido_dev_info_t *devlist,
+    size_t ilen, size_t *olen)
+{
+	return (fido_dev_manifest(reg, devlist, ilen, olen, -1));
+}
+
 int
 fido_dev_open_with_info(fido_dev_t *dev)
 {
@@ -309,6 +365,90 @@ fido_dev_open(fido_dev_t *dev, const char *path)
 	return (fido_dev_open_wait(dev, path, &ms));
 }
 
+int
+fido_dev_open_channel(fido_dev_t *dev, fido_dev_t *parent)
+{
+	int	ms = dev->timeout_ms;
+	int	reply_len;
+	int	r;
+
+	if (dev == parent || dev->io_handle != NULL ||
+	    dev->cid != CTAP_CID_BROADCAST || parent->io_handle == NULL ||
+	    parent->transport.rx != NULL || parent->transport.tx != NULL) {
+		fido_log_debug("%s: invalid argument", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+#ifdef USE_WINHELLO
+	if (parent->flags & FIDO_DEV_WINHELLO) {
+		fido_log_debug("%s: winhello", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+#endif
+
+	if (fido_get_random(&dev->nonce, sizeof(dev->nonce)) < 0) {
+		fido_log_debug("%s: fido_get_random", __func__);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	dev->io = parent->io;
+	dev->io_writev = parent->io_writev;
+	dev->io_pollfd = parent->io_pollfd;
+	dev->io_wakeup = parent->io_wakeup;
+	dev->io_handle = parent->io_handle;
+	dev->rx_len = parent->rx_len;
+	dev->tx_len = parent->tx_len;
+	dev->vendor_id = parent->vendor_id;
+	dev->product_id = parent->product_id;
+	memset(&dev->transport, 0, sizeof(dev->transport));
+	dev->mux_chan = true;
+
+	if (fido_dev_mux_add(parent, dev) < 0) {
+		fido_log_debug("%s: fido_dev_mux_add", __func__);
+		r = FIDO_ERR_INTERNAL;
+		goto fail;
+	}
+
+	if (fido_tx(dev, CTAP_CMD_INIT, &dev->nonce, sizeof(dev->nonce),
+	    &ms) < 0) {
+		fido_log_debug("%s: fido_tx", __func__);
+		r = FIDO_ERR_TX;
+		goto fail;
+	}
+
+	if ((reply_len = fido_rx(dev, CTAP_CMD_INIT, &dev->attr,
+	    sizeof(dev->attr), &ms)) < 0) {
+		fido_log_debug("%s: fido_rx", __func__);
+		r = FIDO_ERR_RX;
+		goto fail;
+	}
+
+#ifdef FIDO_FUZZ
+	dev->attr.nonce = dev->nonce;
+#endif
+
+	if ((size_t)reply_len != sizeof(dev->attr) ||
+	    dev->attr.nonce != dev->nonce) {
+		fido_log_debug("%s: invalid nonce", __func__);
+		r = FIDO_ERR_RX;
+		goto fail;
+	}
+
+	/* same authenticator; skip authenticatorGetInfo */
+	dev->cid = dev->attr.cid;
+	dev->flags = parent->flags;
+	dev->maxmsgsize = parent->maxmsgsize;
+	dev->maxcredcntlst = parent->maxcredcntlst;
+	dev->maxcredidlen = parent->maxcredidlen;
+
+	return (FIDO_OK);
+fail:
+	fido_dev_mux_del(dev);
+	dev->mux_chan = false;
+	dev->io_handle = NULL;
+
+	return (r);
+}
+
 int
 fido_dev_close(fido_dev_t *dev)
 {
@@ -318,10 +458,27 @@ fido_dev_close(fido_dev_t *dev)
 #endif
 	if (dev->io_handle == NULL || dev->io.close == NULL)
 		return (FIDO_ERR_INVALID_ARGUMENT);
+	if (fido_dev_mux_busy(dev)) {
+		fido_log_debug("%s: channels open", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
 
-	dev->io.close(dev->io_handle);
+	fido_dev_cache_sync(dev);
+	fido_dev_clear_session(dev);
+	fido_uv_token_invalidate(dev);
+	fido_dev_async_reset(dev);
+	if (dev->mux_chan == false)
+		dev->io.close(dev->io_handle);
+	fido_dev_mux_del(dev);
+	dev->mux_chan = false;
 	dev->io_handle = NULL;
 	dev->cid = CTAP_CID_BROADCAST;
+	dev->resync = false;
+	dev->apdu_ext = false;
+	freezero(dev->rx_buf, FIDO_MAXMSG);
+	dev->rx_buf = NULL;
+	free(dev->cache_path);
+	dev->cache_path = NULL;
 
 	return (FIDO_OK);
 }
@@ -346,17 +503,27 @@ int
 fido_dev_cancel(fido_dev_t *dev)
 {
 	int ms = dev->timeout_ms;
+	int r = FIDO_OK;
+	bool wakeup;
 
 #ifdef USE_WINHELLO
 	if (dev->flags & FIDO_DEV_WINHELLO)
 		return (fido_winhello_cancel(dev));
 #endif
-	if (fido_dev_is_fido2(dev) == false)
+	wakeup = dev->io_handle != NULL && dev->io_wakeup != NULL &&
+	    dev->transport.rx == NULL;
+	if (fido_dev_is_fido2(dev) == false && !wakeup)
 		return (FIDO_ERR_INVALID_ARGUMENT);
-	if (fido_tx(dev, CTAP_CMD_CANCEL, NULL, 0, &ms) < 0)
-		return (FIDO_ERR_TX);
+	if (fido_dev_is_fido2(dev) &&
+	    fido_tx(dev, CTAP_CMD_CANCEL, NULL, 0, &ms) < 0)
+		r = FIDO_ERR_TX;
+	/* after CTAPHID_CANCEL, so that it precedes any resync */
+	if (wakeup && dev->io_wakeup(dev->io_handle, 1) < 0) {
+		fido_log_debug("%s: io_wakeup", __func__);
+		r = FIDO_ERR_INTERNAL;
+	}
 
-	return (FIDO_OK);
+	return (r);
 }
 
 int
@@ -374,6 +541,9 @@ fido_dev_set_io_functions(fido_dev_t *dev, const fido_dev_io_t *io)
 	}
 
 	dev->io = *io;
+	dev->io_writev = NULL;
+	dev->io_pollfd = NULL;
+	dev->io_wakeup = NULL;
 	dev->io_own = true;
 
 	return (FIDO_OK);
@@ -393,6 +563,68 @@ fido_dev_set_transport_functions(fido_dev_t *dev, const fido_dev_transport_t *t)
 	return (FIDO_OK);
 }
 
+int
+fido_dev_set_writev_function(fido_dev_t *dev, fido_dev_io_writev_t *writev)
+{
+	if (dev->io_handle != NULL) {
+		fido_log_debug("%s: non-NULL handle", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	dev->io_writev = writev;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_set_pollfd_function(fido_dev_t *dev, fido_dev_io_pollfd_t *pollfd)
+{
+	if (dev->io_handle != NULL) {
+		fido_log_debug("%s: non-NULL handle", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	dev->io_pollfd = pollfd;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_set_wakeup_function(fido_dev_t *dev, fido_dev_io_wakeup_t *wakeup)
+{
+	if (dev->io_handle != NULL) {
+		fido_log_debug("%s: non-NULL handle", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	dev->io_wakeup = wakeup;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_pollfd(const fido_dev_t *dev)
+{
+	if (dev->io_handle == NULL || dev->io_pollfd == NULL ||
+	    dev->transport.rx != NULL)
+		return (-1);
+
+	return (dev->io_pollfd(dev->io_handle));
+}
+
+int
+fido_dev_set_cache(fido_dev_t *dev, fido_dev_cache_t *cache)
+{
+	if (dev->io_handle != NULL) {
+		fido_log_debug("%s: non-NULL handle", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	dev->cache = cache;
+
+	return (FIDO_OK);
+}
+
 void *
 fido_dev_io_handle(const fido_dev_t *dev)
 {
@@ -407,6 +639,7 @@ fido_init(int flags)
 		fido_log_init();
 
 	disable_u2f_fallback = (flags & FIDO_DISABLE_U2F_FALLBACK);
+	fido_log_dump_on_error(flags & FIDO_DUMP_ON_ERROR);
 }
 
 fido_dev_t *
@@ -419,12 +652,19 @@ fido_dev_new(void)
 
 	dev->cid = CTAP_CID_BROADCAST;
 	dev->timeout_ms = -1;
+	dev->keepalive.first_ms = -1;
+	dev->keepalive.rx_ms = -1;
+	dev->stats_cmd = -1;
+	dev->stats_encode_us = -1;
 	dev->io = (fido_dev_io_t) {
 		&fido_hid_open,
 		&fido_hid_close,
 		&fido_hid_read,
 		&fido_hid_write,
 	};
+	set_default_writev(dev);
+	set_default_pollfd(dev);
+	set_default_wakeup(dev);
 
 	return (dev);
 }
@@ -447,10 +687,21 @@ fido_dev_new_with_info(const fido_dev_info_t *di)
 #endif
 
 	dev->io = di->io;
-	dev->io_own = di->transport.tx != NULL || di->transport.rx != NULL;
+	set_default_writev(dev);
+	set_default_pollfd(dev);
+	set_default_wakeup(dev);
+	dev->vendor_id = di->vendor_id;
+	dev->product_id = di->product_id;
+	/* as with fido_dev_set_io_functions(), custom i/o does its framing */
+	dev->io_own = di->transport.tx != NULL || di->transport.rx != NULL ||
+	    di->io.open != fido_hid_open;
 	dev->transport = di->transport;
 	dev->cid = CTAP_CID_BROADCAST;
 	dev->timeout_ms = -1;
+	dev->keepalive.first_ms = -1;
+	dev->keepalive.rx_ms = -1;
+	dev->stats_cmd = -1;
+	dev->stats_encode_us = -1;
 
 	if ((dev->path = strdup(di->path)) == NULL) {
 		fido_log_debug("%s: strdup", __func__);
@@ -469,6 +720,12 @@ fido_dev_free(fido_dev_t **dev_p)
 	if (dev_p == NULL || (dev = *dev_p) == NULL)
 		return;
 
+	fido_dev_clear_session(dev);
+	fido_uv_token_invalidate(dev);
+	fido_dev_async_reset(dev);
+	fido_dev_mux_del(dev);
+	freezero(dev->rx_buf, FIDO_MAXMSG);
+	free(dev->cache_path);
 	free(dev->path);
 	free(dev);
 
@@ -599,3 +856,36 @@ fido_dev_set_timeout(fido_dev_t *dev, int ms)
 
 	return (FIDO_OK);
 }
+
+int
+fido_dev_set_keepalive_handler(fido_dev_t *dev,
+    fido_dev_keepalive_handler_t *handler, void *arg)
+{
+	dev->keepalive.handler = handler;
+	dev->keepalive.arg = arg;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_first_keepalive_ms(const fido_dev_t *dev)
+{
+	return (dev->keepalive.first_ms);
+}
+
+int
+fido_dev_response_ms(const fido_dev_t *dev)
+{
+	return (dev->keepalive.rx_ms);
+}
+
+int
+fido_dev_set_stats(fido_dev_t *dev, fido_dev_stats_t *stats)
+{
+	dev->stats = stats;
+	dev->stats_cmd = -1;
+	dev->stats_encode_us = -1;
+	fido_dev_stats_rx(dev, 0, false);
+
+	return (FIDO_OK);
+}
@@ -164,6 +164,64 @@ fail:
 	return ok;
 }
 
+static bool
+session_valid(const fido_dev_t *dev)
+{
+	const fido_dev_session_t	*s = &dev->session;
+	int				 ms = s->ms;
+
+	if (s->ecdh == NULL || s->uses >= s->max_uses)
+		return false;
+	if (ms < 0)
+		return true;
+	if (fido_time_delta(&s->ts, &ms) < 0 || ms == 0)
+		return false;
+
+	return true;
+}
+
+/* hand out copies of the cached key agreement */
+static int
+session_get(fido_dev_t *dev, es256_pk_t **pk, fido_blob_t **ecdh)
+{
+	fido_dev_session_t *s = &dev->session;
+
+	if ((*pk = es256_pk_new()) == NULL ||
+	    (*ecdh = fido_blob_new()) == NULL ||
+	    fido_blob_set(*ecdh, s->ecdh->ptr, s->ecdh->len) < 0) {
+		es256_pk_free(pk);
+		fido_blob_free(ecdh);
+		return -1;
+	}
+
+	**pk = *s->pk;
+	s->uses++;
+
+	return 0;
+}
+
+static void
+session_put(fido_dev_t *dev, const es256_pk_t *pk, const fido_blob_t *ecdh)
+{
+	fido_dev_session_t *s = &dev->session;
+
+	fido_dev_clear_session(dev);
+
+	if (s->max_uses == 0)
+		return;
+	if ((s->pk = es256_pk_new()) == NULL ||
+	    (s->ecdh = fido_blob_new()) == NULL ||
+	    fido_blob_set(s->ecdh, ecdh->ptr, ecdh->len) < 0 ||
+	    fido_time_now(&s->ts) < 0) {
+		fido_log_debug("%s: session", __func__);
+		fido_dev_clear_session(dev);
+		return;
+	}
+
+	*s->pk = *pk;
+	s->uses = 1;
+}
+
 int
 fido_do_ecdh(fido_dev_t *dev, es256_pk_t **pk, fido_blob_t **ecdh, int *ms)
 {
@@ -173,6 +231,13 @@ fido_do_ecdh(fido_dev_t *dev, es256_pk_t **pk, fido_blob_t **ecdh, int *ms)
 
 	*pk = NULL;
 	*ecdh = NULL;
+	if (session_valid(dev)) {
+		if (session_get(dev, pk, ecdh) < 0)
+			return FIDO_ERR_INTERNAL;
+		fido_log_debug("%s: reusing session, uses=%llu", __func__,
+		    (unsigned long long)dev->session.uses);
+		return FIDO_OK;
+	}
 	if ((sk = es256_sk_new()) == NULL || (*pk = es256_pk_new()) == NULL) {
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
@@ -194,6 +259,8 @@ fido_do_ecdh(fido_dev_t *dev, es256_pk_t **pk, fido_blob_t **ecdh, int *ms)
 		goto fail;
 	}
 
+	session_put(dev, *pk, *ecdh);
+
 	r = FIDO_OK;
 fail:
 	es256_sk_free(&sk);
@@ -206,3 +273,33 @@ fail:
 
 	return r;
 }
+
+void
+fido_dev_clear_session(fido_dev_t *dev)
+{
+	fido_dev_session_t *s = &dev->session;
+
+	if (s->pk != NULL)
+		fido_log_debug("%s: uses=%llu", __func__,
+		    (unsigned long long)s->uses);
+
+	es256_pk_free(&s->pk);
+	fido_blob_free(&s->ecdh);
+	memset(&s->ts, 0, sizeof(s->ts));
+	s->uses = 0;
+}
+
+int
+fido_dev_set_session_lifetime(fido_dev_t *dev, int ms, uint64_t max_uses)
+{
+	if (ms < -1) {
+		fido_log_debug("%s: ms=%d", __func__, ms);
+		return FIDO_ERR_INVALID_ARGUMENT;
+	}
+
+	fido_dev_clear_session(dev);
+	dev->session.ms = ms;
+	dev->session.max_uses = max_uses;
+
+	return FIDO_OK;
+}
@@ -59,13 +59,18 @@
 		fido_assert_user_id_ptr;
 		fido_assert_user_name;
 		fido_assert_verify;
+		fido_assert_verify_batch;
+		fido_assert_verify_with;
 		fido_bio_dev_enroll_begin;
 		fido_bio_dev_enroll_cancel;
 		fido_bio_dev_enroll_continue;
 		fido_bio_dev_enroll_remove;
+		fido_bio_dev_enroll_remove_with_token;
 		fido_bio_dev_get_info;
 		fido_bio_dev_get_template_array;
+		fido_bio_dev_get_template_array_with_token;
 		fido_bio_dev_set_template_name;
+		fido_bio_dev_set_template_name_with_token;
 		fido_bio_enroll_free;
 		fido_bio_enroll_last_status;
 		fido_bio_enroll_new;
@@ -140,9 +145,13 @@
 		fido_cred_aaguid_len;
 		fido_cred_aaguid_ptr;
 		fido_credman_del_dev_rk;
+		fido_credman_del_dev_rk_with_token;
 		fido_credman_get_dev_metadata;
+		fido_credman_get_dev_metadata_with_token;
 		fido_credman_get_dev_rk;
+		fido_credman_get_dev_rk_with_token;
 		fido_credman_get_dev_rp;
+		fido_credman_get_dev_rp_with_token;
 		fido_credman_metadata_free;
 		fido_credman_metadata_new;
 		fido_credman_rk;
@@ -159,6 +168,7 @@
 		fido_credman_rp_name;
 		fido_credman_rp_new;
 		fido_credman_set_dev_rk;
+		fido_credman_set_dev_rk_with_token;
 		fido_cred_new;
 		fido_cred_pin_minlen;
 		fido_cred_prot;
@@ -196,15 +206,23 @@
 		fido_cred_x5c_len;
 		fido_cred_x5c_ptr;
 		fido_dev_build;
+		fido_dev_cache_flush;
+		fido_dev_cache_free;
+		fido_dev_cache_new;
 		fido_dev_cancel;
+		fido_dev_clear_session;
 		fido_dev_close;
 		fido_dev_enable_entattest;
+		fido_dev_enable_entattest_with_token;
+		fido_dev_first_keepalive_ms;
 		fido_dev_flags;
 		fido_dev_force_fido2;
 		fido_dev_force_pin_change;
+		fido_dev_force_pin_change_with_token;
 		fido_dev_force_u2f;
 		fido_dev_free;
 		fido_dev_get_assert;
+		fido_dev_get_assert_begin;
 		fido_dev_get_cbor_info;
 		fido_dev_get_retry_count;
 		fido_dev_get_uv_retry_count;
@@ -214,6 +232,7 @@
 		fido_dev_has_uv;
 		fido_dev_info_free;
 		fido_dev_info_manifest;
+		fido_dev_info_manifest_ms;
 		fido_dev_info_manufacturer_string;
 		fido_dev_info_new;
 		fido_dev_info_path;
@@ -227,34 +246,83 @@
 		fido_dev_is_winhello;
 		fido_dev_major;
 		fido_dev_make_cred;
+		fido_dev_make_cred_begin;
 		fido_dev_minor;
 		fido_dev_new;
 		fido_dev_new_with_info;
 		fido_dev_open;
+		fido_dev_open_channel;
 		fido_dev_open_with_info;
+		fido_dev_poll;
+		fido_dev_pollfd;
+		fido_dev_pool_add;
+		fido_dev_pool_free;
+		fido_dev_pool_lease;
+		fido_dev_pool_maintain;
+		fido_dev_pool_new;
+		fido_dev_pool_release;
+		fido_dev_pool_set_timeout;
 		fido_dev_protocol;
+		fido_dev_registry_free;
+		fido_dev_registry_manifest;
+		fido_dev_registry_new;
+		fido_dev_registry_pollfd;
+		fido_dev_registry_set_handler;
+		fido_dev_registry_update;
 		fido_dev_reset;
+		fido_dev_response_ms;
+		fido_dev_select;
+		fido_dev_set_cache;
 		fido_dev_set_io_functions;
+		fido_dev_set_keepalive_handler;
 		fido_dev_set_pin;
 		fido_dev_set_pin_minlen;
 		fido_dev_set_pin_minlen_rpid;
+		fido_dev_set_pin_minlen_rpid_with_token;
+		fido_dev_set_pin_minlen_with_token;
+		fido_dev_set_pollfd_function;
+		fido_dev_set_session_lifetime;
 		fido_dev_set_sigmask;
+		fido_dev_set_stats;
 		fido_dev_set_timeout;
 		fido_dev_set_transport_functions;
+		fido_dev_set_wakeup_function;
+		fido_dev_set_writev_function;
+		fido_dev_stats_counter;
+		fido_dev_stats_free;
+		fido_dev_stats_latency;
+		fido_dev_stats_new;
+		fido_dev_stats_reset;
 		fido_dev_supports_cred_prot;
 		fido_dev_supports_credman;
 		fido_dev_supports_permissions;
 		fido_dev_supports_pin;
 		fido_dev_supports_uv;
 		fido_dev_toggle_always_uv;
+		fido_dev_toggle_always_uv_with_token;
 		fido_dev_largeblob_get;
 		fido_dev_largeblob_get_array;
 		fido_dev_largeblob_remove;
+		fido_dev_largeblob_remove_with_token;
 		fido_dev_largeblob_set;
 		fido_dev_largeblob_set_array;
+		fido_dev_largeblob_set_array_with_token;
+		fido_dev_largeblob_set_with_token;
 		fido_init;
+		fido_log_dump;
+		fido_nfc_reader_free;
+		fido_nfc_reader_new;
+		fido_nfc_reader_pollfd;
+		fido_nfc_reader_set_handler;
+		fido_nfc_reader_update;
 		fido_set_log_handler;
 		fido_strerr;
+		fido_uv_token_acquire;
+		fido_uv_token_free;
+		fido_uv_token_new;
+		fido_verifier_free;
+		fido_verifier_new;
+		fido_verifier_set_pk;
 		rs256_pk_free;
 		rs256_pk_from_ptr;
 		rs256_pk_from_EVP_PKEY;
@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include "fido/param.h"
 #include "fido/types.h"
 #include "blob.h"
 
@@ -42,9 +43,10 @@ cbor_item_t *cbor_encode_assert_opt(fido_opt_t, fido_opt_t);
 cbor_item_t *cbor_encode_change_pin_auth(const fido_dev_t *,
     const fido_blob_t *, const fido_blob_t *, const fido_blob_t *);
 cbor_item_t *cbor_encode_cred_ext(const fido_cred_ext_t *, const fido_blob_t *);
-cbor_item_t *cbor_encode_assert_ext(fido_dev_t *,
-    const fido_assert_ext_t *, const fido_blob_t *, const es256_pk_t *);
+cbor_item_t *cbor_encode_assert_ext(const fido_assert_ext_t *, cbor_item_t *);
 cbor_item_t *cbor_encode_cred_opt(fido_opt_t, fido_opt_t);
+cbor_item_t *cbor_encode_hmac_secret_param(const fido_dev_t *,
+    const fido_blob_t *, const es256_pk_t *, const fido_blob_t *);
 cbor_item_t *cbor_encode_pin_auth(const fido_dev_t *, const fido_blob_t *,
     const fido_blob_t *);
 cbor_item_t *cbor_encode_pin_opt(const fido_dev_t *);
@@ -69,6 +71,10 @@ int cbor_decode_pubkey(const cbor_item_t *, int *, void *);
 int cbor_decode_rp_entity(const cbor_item_t *, fido_rp_t *);
 int cbor_decode_uint64(const cbor_item_t *, uint64_t *);
 int cbor_decode_user(const cbor_item_t *, fido_user_t *);
+int cbor_slice_decode_assert_authdata(const cbor_slice_t *, fido_blob_t *,
+    fido_authdata_t *, fido_assert_extattr_t *);
+int cbor_slice_decode_cred_id(const cbor_slice_t *, fido_blob_t *);
+int cbor_slice_decode_user(const cbor_slice_t *, fido_user_t *);
 int es256_pk_decode(const cbor_item_t *, es256_pk_t *);
 int es384_pk_decode(const cbor_item_t *, es384_pk_t *);
 int rs256_pk_decode(const cbor_item_t *, rs256_pk_t *);
@@ -81,20 +87,57 @@ int cbor_add_bytestring(cbor_item_t *, const char *, const unsigned char *,
 int cbor_add_string(cbor_item_t *, const char *, const char *);
 int cbor_array_iter(const cbor_item_t *, void *, int(*)(const cbor_item_t *,
     void *));
-int cbor_build_frame(uint8_t, cbor_item_t *[], size_t, fido_blob_t *);
+int cbor_build_frame(fido_dev_t *, uint8_t, cbor_item_t *[], size_t,
+    fido_blob_t *);
+int cbor_frame_get_assert(fido_dev_t *, const fido_assert_t *,
+    const fido_blob_array_t *, fido_opt_t, const cbor_item_t *,
+    const cbor_item_t *, const cbor_item_t *, fido_blob_t *);
+int cbor_frame_makecred(fido_dev_t *, const fido_cred_t *,
+    const fido_blob_array_t *, fido_opt_t, const cbor_item_t *,
+    const cbor_item_t *, fido_blob_t *);
+int cbor_frame_probe(fido_dev_t *, const char *, const fido_blob_t *,
+    const fido_blob_array_t *, const cbor_item_t *, const cbor_item_t *,
+    fido_blob_t *);
+size_t cbor_frame_get_assert_len(const fido_assert_t *,
+    const fido_blob_array_t *, fido_opt_t, const cbor_item_t *,
+    const cbor_item_t *, const cbor_item_t *);
+size_t cbor_frame_makecred_len(const fido_cred_t *, const fido_blob_array_t *,
+    fido_opt_t, const cbor_item_t *, const cbor_item_t *);
 int cbor_bytestring_copy(const cbor_item_t *, unsigned char **, size_t *);
 int cbor_map_iter(const cbor_item_t *, void *, int(*)(const cbor_item_t *,
     const cbor_item_t *, void *));
 int cbor_string_copy(const cbor_item_t *, char **);
 int cbor_parse_reply(const unsigned char *, size_t, void *,
     int(*)(const cbor_item_t *, const cbor_item_t *, void *));
-int cbor_add_uv_params(fido_dev_t *, uint8_t, const fido_blob_t *,
+int cbor_add_uv_params(fido_dev_t *, uint8_t, uint8_t, const fido_blob_t *,
     const es256_pk_t *, const fido_blob_t *, const char *, const char *,
     cbor_item_t **, cbor_item_t **, int *);
 void cbor_vector_free(cbor_item_t **, size_t);
 int cbor_array_append(cbor_item_t **, cbor_item_t *);
 int cbor_array_drop(cbor_item_t **, size_t);
 
+/* streaming cbor decoding */
+int cbor_parse_reply_stream(const unsigned char *, size_t, void *,
+    int(*)(const cbor_slice_t *, const cbor_slice_t *, void *));
+int cbor_slice_blob(const cbor_slice_t *, fido_blob_t *);
+int cbor_slice_bytes(const cbor_slice_t *, const unsigned char **, size_t *);
+int cbor_slice_map_iter(const cbor_slice_t *, void *,
+    int(*)(const cbor_slice_t *, const cbor_slice_t *, void *));
+bool cbor_slice_str_eq(const cbor_slice_t *, const char *);
+int cbor_slice_string(const cbor_slice_t *, char **);
+int cbor_slice_uint8_key(const cbor_slice_t *, uint8_t *);
+int cbor_slice_uint64(const cbor_slice_t *, uint64_t *);
+
+/* streaming cbor encoding */
+void cbor_enc_array(cbor_enc_t *, size_t);
+void cbor_enc_bool(cbor_enc_t *, bool);
+void cbor_enc_bytes(cbor_enc_t *, const unsigned char *, size_t);
+void cbor_enc_int(cbor_enc_t *, int64_t);
+void cbor_enc_item(cbor_enc_t *, const cbor_item_t *);
+void cbor_enc_map(cbor_enc_t *, size_t);
+void cbor_enc_string(cbor_enc_t *, const char *);
+void cbor_enc_uint(cbor_enc_t *, uint64_t);
+
 /* deflate */
 int fido_compress(fido_blob_t *, const fido_blob_t *);
 int fido_uncompress(fido_blob_t *, const fido_blob_t *, size_t);
@@ -112,10 +155,17 @@ void *fido_hid_open(const char *);
 void  fido_hid_close(void *);
 int fido_hid_read(void *, unsigned char *, size_t, int);
 int fido_hid_write(void *, const unsigned char *, size_t);
+int fido_hid_writev(void *, const unsigned char *, size_t, size_t);
+int fido_hid_pollfd(void *);
+int fido_hid_wakeup(void *, int);
+int fido_hid_monitor_open(fido_dev_registry_t *);
+int fido_hid_monitor_pollfd(void *);
+int fido_hid_monitor_update(fido_dev_registry_t *);
+void fido_hid_monitor_close(void *);
 int fido_hid_get_usage(const uint8_t *, size_t, uint32_t *);
 int fido_hid_get_report_len(const uint8_t *, size_t, size_t *, size_t *);
 int fido_hid_unix_open(const char *);
-int fido_hid_unix_wait(int, int, const fido_sigset_t *);
+int fido_hid_unix_wait(int, int, int, const fido_sigset_t *);
 int fido_hid_set_sigmask(void *, const fido_sigset_t *);
 size_t fido_hid_report_in_len(void *);
 size_t fido_hid_report_out_len(void *);
@@ -130,6 +180,10 @@ int fido_nfc_write(void *, const unsigned char *, size_t);
 int fido_nfc_rx(fido_dev_t *, uint8_t, unsigned char *, size_t, int);
 int fido_nfc_tx(fido_dev_t *, uint8_t, const unsigned char *, size_t);
 int fido_nfc_set_sigmask(void *, const fido_sigset_t *);
+int fido_nfc_monitor_open(fido_nfc_reader_t *);
+int fido_nfc_monitor_pollfd(void *);
+int fido_nfc_monitor_update(fido_nfc_reader_t *);
+void fido_nfc_monitor_close(void *);
 int fido_dev_set_nfc(fido_dev_t *);
 
 /* pcsc i/o */
@@ -154,15 +208,31 @@ int fido_winhello_make_cred(fido_dev_t *, fido_cred_t *, const char *, int);
 /* generic i/o */
 int fido_rx_cbor_status(fido_dev_t *, int *);
 int fido_rx(fido_dev_t *, uint8_t, void *, size_t, int *);
+int fido_rx_msg(fido_dev_t *, uint8_t, const unsigned char **, int *);
+void fido_rx_msg_clear(fido_dev_t *, int);
+int fido_rx_poll(fido_dev_t *, uint8_t, const unsigned char **, size_t *);
 int fido_tx(fido_dev_t *, uint8_t, const void *, size_t, int *);
 
 /* log */
+#define FIDO_LOG_TX	0
+#define FIDO_LOG_RX	1
+#define FIDO_LOG_ERR	2
 #ifdef FIDO_NO_DIAGNOSTIC
 #define fido_log_init(...)	do { /* nothing */ } while (0)
 #define fido_log_debug(...)	do { /* nothing */ } while (0)
 #define fido_log_xxd(...)	do { /* nothing */ } while (0)
 #define fido_log_error(...)	do { /* nothing */ } while (0)
+#define fido_log_dump_on_error(...)	do { /* nothing */ } while (0)
+#define fido_log_fail(...)	do { /* nothing */ } while (0)
+#define fido_log_frame(...)	do { /* nothing */ } while (0)
+#define fido_log_enabled()	false
+#define fido_log_line(...)	do { /* nothing */ } while (0)
 #else
+bool fido_log_enabled(void);
+void fido_log_line(const char *);
+void fido_log_dump_on_error(int);
+void fido_log_fail(const char *, int);
+void fido_log_frame(int, const void *, size_t);
 #ifdef __GNUC__
 void fido_log_init(void);
 void fido_log_debug(const char *, ...)
@@ -189,11 +259,54 @@ int u2f_get_touch_status(fido_dev_t *, int *, int *);
 uint8_t fido_dev_get_pin_protocol(const fido_dev_t *);
 int fido_dev_authkey(fido_dev_t *, es256_pk_t *, int *);
 int fido_dev_get_cbor_info_wait(fido_dev_t *, fido_cbor_info_t *, int *);
+int fido_dev_open_wait(fido_dev_t *, const char *, int *);
 int fido_dev_get_uv_token(fido_dev_t *, uint8_t, const char *,
     const fido_blob_t *, const es256_pk_t *, const char *, fido_blob_t *,
     int *);
 uint64_t fido_dev_maxmsgsize(const fido_dev_t *);
+const fido_blob_t *fido_uv_token_blob(const fido_dev_t *,
+    const fido_uv_token_t *, uint8_t);
+void fido_uv_token_invalidate(fido_dev_t *);
 int fido_do_ecdh(fido_dev_t *, es256_pk_t **, fido_blob_t **, int *);
+int fido_dev_credlist_batch(fido_dev_t *, const char *, const fido_blob_t *,
+    const fido_blob_array_t *, const cbor_item_t *, const cbor_item_t *,
+    void *, bool (*)(const fido_blob_array_t *, void *), fido_blob_array_t *,
+    int *);
+
+/* non-blocking operation */
+int fido_dev_async_check(const fido_dev_t *);
+bool fido_dev_async_busy(const fido_dev_t *);
+void fido_dev_async_start(fido_dev_t *, void *, fido_dev_async_rx_t *,
+    es256_pk_t **, fido_blob_t **);
+void fido_dev_async_reset(fido_dev_t *);
+
+/* channels sharing a device */
+typedef int fido_dev_mux_read_t(fido_dev_t *, unsigned char *, size_t, int *);
+
+bool fido_dev_mux_busy(const fido_dev_t *);
+bool fido_dev_mux_queued(const fido_dev_t *);
+fido_dev_mux_t *fido_dev_mux_tx_lock(const fido_dev_t *);
+int fido_dev_mux_add(fido_dev_t *, fido_dev_t *);
+int fido_dev_mux_rx(fido_dev_t *, unsigned char *, size_t, int *,
+    fido_dev_mux_read_t *);
+void fido_dev_mux_del(fido_dev_t *);
+void fido_dev_mux_tx_unlock(fido_dev_mux_t *);
+
+/* statistics */
+#define fido_dev_stats_count(d, c, n) \
+	do { if ((d)->stats != NULL) (d)->stats->counter[(c)] += (n); } while (0)
+fido_dev_stats_t *fido_stats_decode_begin(int *, struct timespec *);
+bool fido_dev_stats_encode_begin(const fido_dev_t *, struct timespec *);
+void fido_dev_stats_encode_end(fido_dev_t *, const struct timespec *);
+void fido_dev_stats_rx(fido_dev_t *, uint8_t, bool);
+void fido_dev_stats_tx(fido_dev_t *, uint8_t, const void *, size_t);
+void fido_stats_decode_end(fido_dev_stats_t *, int, const struct timespec *);
+
+/* session cache */
+void fido_dev_cache_drop(fido_dev_t *);
+int fido_dev_cache_lookup(fido_dev_t *);
+void fido_dev_cache_store(fido_dev_t *);
+void fido_dev_cache_sync(fido_dev_t *);
 
 /* types */
 void fido_algo_array_free(fido_algo_array_t *);
@@ -217,6 +330,7 @@ int fido_get_random(void *, size_t);
 int fido_sha256(fido_blob_t *, const u_char *, size_t);
 int fido_time_now(struct timespec *);
 int fido_time_delta(const struct timespec *, int *);
+int fido_time_elapsed(const struct timespec *);
 int fido_to_uint64(const char *, int, uint64_t *);
 
 /* crypto */
@@ -233,16 +347,29 @@ int rs256_pk_verify_sig(const fido_blob_t *, const rs256_pk_t *,
     const fido_blob_t *);
 int eddsa_pk_verify_sig(const fido_blob_t *, const eddsa_pk_t *,
     const fido_blob_t *);
+int fido_verifier_verify_sig(const fido_verifier_t *, const fido_blob_t *,
+    const fido_blob_t *);
 int fido_get_signed_hash(int, fido_blob_t *, const fido_blob_t *,
     const fido_blob_t *);
 int fido_get_signed_hash_tpm(fido_blob_t *, const fido_blob_t *,
     const fido_blob_t *, const fido_attstmt_t *, const fido_attcred_t *);
 
 /* device manifest functions */
+int fido_dev_manifest(fido_dev_registry_t *, fido_dev_info_t *, size_t,
+    size_t *, int);
 int fido_hid_manifest(fido_dev_info_t *, size_t, size_t *);
 int fido_nfc_manifest(fido_dev_info_t *, size_t, size_t *);
 int fido_pcsc_manifest(fido_dev_info_t *, size_t, size_t *);
 
+/* device registry */
+int fido_dev_registry_add(fido_dev_registry_t *, fido_dev_info_t *);
+int fido_dev_registry_copy(const fido_dev_registry_t *, fido_dev_info_t *,
+    size_t, size_t *);
+void fido_dev_registry_remove(fido_dev_registry_t *, const char *);
+
+/* nfc reader */
+void fido_nfc_reader_event(fido_nfc_reader_t *, int);
+
 /* fuzzing instrumentation */
 #ifdef FIDO_FUZZ
 uint32_t uniform_random(uint32_t);
@@ -259,6 +386,7 @@ uint32_t uniform_random(uint32_t);
 #define FIDO_DEV_UV_UNSET	0x080
 #define FIDO_DEV_TOKEN_PERMS	0x100
 #define FIDO_DEV_WINHELLO	0x200
+#define FIDO_DEV_SELECTION	0x400
 
 /* miscellanea */
 #define FIDO_DUMMY_CLIENTDATA	""
@@ -58,25 +58,44 @@ extern "C" {
 
 fido_assert_t *fido_assert_new(void);
 fido_cred_t *fido_cred_new(void);
+fido_dev_cache_t *fido_dev_cache_new(void);
 fido_dev_t *fido_dev_new(void);
 fido_dev_t *fido_dev_new_with_info(const fido_dev_info_t *);
+fido_dev_stats_t *fido_dev_stats_new(void);
 fido_dev_info_t *fido_dev_info_new(size_t);
+fido_dev_pool_t *fido_dev_pool_new(void);
+fido_dev_registry_t *fido_dev_registry_new(void);
+fido_nfc_reader_t *fido_nfc_reader_new(const char *);
 fido_cbor_info_t *fido_cbor_info_new(void);
+fido_uv_token_t *fido_uv_token_new(void);
+fido_verifier_t *fido_verifier_new(void);
 void *fido_dev_io_handle(const fido_dev_t *);
 
 void fido_assert_free(fido_assert_t **);
 void fido_cbor_info_free(fido_cbor_info_t **);
 void fido_cred_free(fido_cred_t **);
+void fido_dev_cache_flush(fido_dev_cache_t *);
+void fido_dev_cache_free(fido_dev_cache_t **);
+void fido_dev_stats_free(fido_dev_stats_t **);
+void fido_dev_stats_reset(fido_dev_stats_t *);
+void fido_uv_token_free(fido_uv_token_t **);
+void fido_verifier_free(fido_verifier_t **);
+void fido_dev_clear_session(fido_dev_t *);
 void fido_dev_force_fido2(fido_dev_t *);
 void fido_dev_force_u2f(fido_dev_t *);
 void fido_dev_free(fido_dev_t **);
 void fido_dev_info_free(fido_dev_info_t **, size_t);
+void fido_dev_pool_free(fido_dev_pool_t **);
+void fido_dev_registry_free(fido_dev_registry_t **);
+void fido_nfc_reader_free(fido_nfc_reader_t **);
 
 /* fido_init() flags. */
 #define FIDO_DEBUG	0x01
 #define FIDO_DISABLE_U2F_FALLBACK 0x02
+#define FIDO_DUMP_ON_ERROR	0x04
 
 void fido_init(int);
+void fido_log_dump(void);
 void fido_set_log_handler(fido_log_handler_t *);
 
 const unsigned char *fido_assert_authdata_ptr(const fido_assert_t *, size_t);
@@ -144,6 +163,11 @@ int fido_assert_set_uv(fido_assert_t *, fido_opt_t);
 int fido_assert_set_sig(fido_assert_t *, size_t, const unsigned char *, size_t);
 int fido_assert_set_winhello_appid(fido_assert_t *, const char *);
 int fido_assert_verify(const fido_assert_t *, size_t, int, const void *);
+int fido_assert_verify_batch(const fido_assert_t *const *, const size_t *,
+    const int *, const void *const *, size_t, int *, size_t);
+int fido_assert_verify_with(const fido_assert_t *, size_t,
+    const fido_verifier_t *);
+int fido_verifier_set_pk(fido_verifier_t *, int, const void *);
 int fido_cbor_info_algorithm_cose(const fido_cbor_info_t *, size_t);
 int fido_cred_empty_exclude_list(fido_cred_t *);
 int fido_cred_exclude(fido_cred_t *, const unsigned char *, size_t);
@@ -177,22 +201,56 @@ int fido_dev_set_sigmask(fido_dev_t *, const fido_sigset_t *);
 int fido_dev_cancel(fido_dev_t *);
 int fido_dev_close(fido_dev_t *);
 int fido_dev_get_assert(fido_dev_t *, fido_assert_t *, const char *);
+int fido_dev_get_assert_begin(fido_dev_t *, fido_assert_t *, const char *);
+int fido_dev_first_keepalive_ms(const fido_dev_t *);
 int fido_dev_get_cbor_info(fido_dev_t *, fido_cbor_info_t *);
 int fido_dev_get_retry_count(fido_dev_t *, int *);
 int fido_dev_get_uv_retry_count(fido_dev_t *, int *);
 int fido_dev_get_touch_begin(fido_dev_t *);
 int fido_dev_get_touch_status(fido_dev_t *, int *, int);
 int fido_dev_info_manifest(fido_dev_info_t *, size_t, size_t *);
+int fido_dev_info_manifest_ms(fido_dev_info_t *, size_t, size_t *, int);
 int fido_dev_info_set(fido_dev_info_t *, size_t, const char *, const char *,
     const char *, const fido_dev_io_t *, const fido_dev_transport_t *);
 int fido_dev_make_cred(fido_dev_t *, fido_cred_t *, const char *);
+int fido_dev_make_cred_begin(fido_dev_t *, fido_cred_t *, const char *);
 int fido_dev_open_with_info(fido_dev_t *);
 int fido_dev_open(fido_dev_t *, const char *);
+int fido_dev_open_channel(fido_dev_t *, fido_dev_t *);
+int fido_dev_poll(fido_dev_t *, int *);
+int fido_dev_pollfd(const fido_dev_t *);
+int fido_dev_pool_add(fido_dev_pool_t *, const fido_dev_info_t *);
+int fido_dev_pool_lease(fido_dev_pool_t *, fido_dev_t **, int);
+int fido_dev_pool_maintain(fido_dev_pool_t *, int);
+int fido_dev_pool_release(fido_dev_pool_t *, fido_dev_t *);
+int fido_dev_pool_set_timeout(fido_dev_pool_t *, int);
+int fido_dev_registry_manifest(fido_dev_registry_t *, fido_dev_info_t *,
+    size_t, size_t *);
+int fido_dev_registry_pollfd(const fido_dev_registry_t *);
+int fido_dev_registry_set_handler(fido_dev_registry_t *,
+    fido_dev_registry_handler_t *, void *);
+int fido_dev_registry_update(fido_dev_registry_t *);
 int fido_dev_reset(fido_dev_t *);
+int fido_dev_response_ms(const fido_dev_t *);
+int fido_dev_select(fido_dev_t **, size_t, size_t *, int);
+int fido_dev_set_cache(fido_dev_t *, fido_dev_cache_t *);
 int fido_dev_set_io_functions(fido_dev_t *, const fido_dev_io_t *);
+int fido_dev_set_keepalive_handler(fido_dev_t *,
+    fido_dev_keepalive_handler_t *, void *);
 int fido_dev_set_pin(fido_dev_t *, const char *, const char *);
+int fido_dev_set_pollfd_function(fido_dev_t *, fido_dev_io_pollfd_t *);
+int fido_dev_set_session_lifetime(fido_dev_t *, int, uint64_t);
+int fido_dev_set_stats(fido_dev_t *, fido_dev_stats_t *);
 int fido_dev_set_transport_functions(fido_dev_t *, const fido_dev_transport_t *);
+int fido_dev_set_wakeup_function(fido_dev_t *, fido_dev_io_wakeup_t *);
+int fido_dev_set_writev_function(fido_dev_t *, fido_dev_io_writev_t *);
 int fido_dev_set_timeout(fido_dev_t *, int);
+int fido_nfc_reader_pollfd(const fido_nfc_reader_t *);
+int fido_nfc_reader_set_handler(fido_nfc_reader_t *,
+    fido_nfc_reader_handler_t *, void *);
+int fido_nfc_reader_update(fido_nfc_reader_t *);
+int fido_uv_token_acquire(fido_uv_token_t *, fido_dev_t *, int, const char *,
+    const char *);
 
 size_t fido_assert_authdata_len(const fido_assert_t *, size_t);
 size_t fido_assert_clientdata_hash_len(const fido_assert_t *);
@@ -245,6 +303,8 @@ uint64_t fido_cbor_info_maxrpid_minpinlen(const fido_cbor_info_t *);
 uint64_t fido_cbor_info_minpinlen(const fido_cbor_info_t *);
 uint64_t fido_cbor_info_uv_attempts(const fido_cbor_info_t *);
 uint64_t fido_cbor_info_uv_modality(const fido_cbor_info_t *);
+uint64_t fido_dev_stats_counter(const fido_dev_stats_t *, int);
+uint64_t fido_dev_stats_latency(const fido_dev_stats_t *, uint8_t, int, size_t);
 int64_t  fido_cbor_info_rk_remaining(const fido_cbor_info_t *);
 
 bool fido_dev_has_pin(const fido_dev_t *);
@@ -267,6 +327,12 @@ int fido_dev_largeblob_remove(fido_dev_t *, const unsigned char *, size_t,
 int fido_dev_largeblob_get_array(fido_dev_t *, unsigned char **, size_t *);
 int fido_dev_largeblob_set_array(fido_dev_t *, const unsigned char *, size_t,
     const char *);
+int fido_dev_largeblob_remove_with_token(fido_dev_t *, const unsigned char *,
+    size_t, const fido_uv_token_t *);
+int fido_dev_largeblob_set_array_with_token(fido_dev_t *,
+    const unsigned char *, size_t, const fido_uv_token_t *);
+int fido_dev_largeblob_set_with_token(fido_dev_t *, const unsigned char *,
+    size_t, const unsigned char *, size_t, const fido_uv_token_t *);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -112,6 +112,12 @@ int fido_bio_dev_get_template_array(fido_dev_t *, fido_bio_template_array_t *,
     const char *);
 int fido_bio_dev_set_template_name(fido_dev_t *, const fido_bio_template_t *,
     const char *);
+int fido_bio_dev_enroll_remove_with_token(fido_dev_t *,
+    const fido_bio_template_t *, const fido_uv_token_t *);
+int fido_bio_dev_get_template_array_with_token(fido_dev_t *,
+    fido_bio_template_array_t *, const fido_uv_token_t *);
+int fido_bio_dev_set_template_name_with_token(fido_dev_t *,
+    const fido_bio_template_t *, const fido_uv_token_t *);
 int fido_bio_template_set_id(fido_bio_template_t *, const unsigned char *,
     size_t);
 int fido_bio_template_set_name(fido_bio_template_t *, const char *);
@@ -50,6 +50,16 @@ int fido_dev_toggle_always_uv(fido_dev_t *, const char *);
 int fido_dev_set_pin_minlen(fido_dev_t *, size_t, const char *);
 int fido_dev_set_pin_minlen_rpid(fido_dev_t *, const char * const *, size_t,
     const char *);
+int fido_dev_enable_entattest_with_token(fido_dev_t *,
+    const fido_uv_token_t *);
+int fido_dev_force_pin_change_with_token(fido_dev_t *,
+    const fido_uv_token_t *);
+int fido_dev_toggle_always_uv_with_token(fido_dev_t *,
+    const fido_uv_token_t *);
+int fido_dev_set_pin_minlen_with_token(fido_dev_t *, size_t,
+    const fido_uv_token_t *);
+int fido_dev_set_pin_minlen_rpid_with_token(fido_dev_t *,
+    const char * const *, size_t, const fido_uv_token_t *);
 
 #ifdef __cplusplus
 } /* extern "C" */
@@ -94,6 +94,16 @@ int fido_credman_get_dev_rk(fido_dev_t *, const char *, fido_credman_rk_t *,
     const char *);
 int fido_credman_get_dev_rp(fido_dev_t *, fido_credman_rp_t *, const char *);
 int fido_credman_set_dev_rk(fido_dev_t *, fido_cred_t *, const char *);
+int fido_credman_del_dev_rk_with_token(fido_dev_t *, const unsigned char *,
+    size_t, const fido_uv_token_t *);
+int fido_credman_get_dev_metadata_with_token(fido_dev_t *,
+    fido_credman_metadata_t *, const fido_uv_token_t *);
+int fido_credman_get_dev_rk_with_token(fido_dev_t *, const char *,
+    fido_credman_rk_t *, const fido_uv_token_t *);
+int fido_credman_get_dev_rp_with_token(fido_dev_t *, fido_credman_rp_t *,
+    const fido_uv_token_t *);
+int fido_credman_set_dev_rk_with_token(fido_dev_t *, fido_cred_t *,
+    const fido_uv_token_t *);
 
 size_t fido_credman_rk_count(const fido_credman_rk_t *);
 size_t fido_credman_rp_count(const fido_credman_rp_t *);
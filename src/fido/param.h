@@ -46,6 +46,10 @@
 #define CTAP_KEEPALIVE			0x3b
 #define CTAP_FRAME_INIT			0x80
 
+/* CTAPHID keepalive status codes. */
+#define CTAP_KEEPALIVE_PROCESSING	0x01
+#define CTAP_KEEPALIVE_UPNEEDED		0x02
+
 /* CTAPHID CBOR command opcodes. */
 #define CTAP_CBOR_MAKECRED		0x01
 #define CTAP_CBOR_ASSERT		0x02
@@ -53,6 +57,7 @@
 #define CTAP_CBOR_CLIENT_PIN		0x06
 #define CTAP_CBOR_RESET			0x07
 #define CTAP_CBOR_NEXT_ASSERT		0x08
+#define CTAP_CBOR_SELECTION		0x0b
 #define CTAP_CBOR_LARGEBLOB		0x0c
 #define CTAP_CBOR_CONFIG		0x0d
 #define CTAP_CBOR_BIO_ENROLL_PRE	0x40
@@ -157,4 +162,32 @@
 #define FIDO_UV_MODE_EXT_PIN	0x0800	/* external pin verification */
 #define FIDO_UV_MODE_EXT_DRAWN	0x1000	/* external drawn pattern check */
 
+/* pinUvAuthToken permissions. */
+#define FIDO_UV_TOKEN_PERM_MAKECRED	0x01	/* authenticatorMakeCredential */
+#define FIDO_UV_TOKEN_PERM_ASSERT	0x02	/* authenticatorGetAssertion */
+#define FIDO_UV_TOKEN_PERM_CRED_MGMT	0x04	/* credential management */
+#define FIDO_UV_TOKEN_PERM_BIO		0x08	/* biometric enrollment */
+#define FIDO_UV_TOKEN_PERM_LARGEBLOB	0x10	/* large blob write */
+#define FIDO_UV_TOKEN_PERM_CONFIG	0x20	/* authenticator config */
+
+/* fido_dev_stats_counter() counters. */
+#define FIDO_STATS_TX_FRAMES	0	/* HID reports written */
+#define FIDO_STATS_TX_BYTES	1	/* bytes written, incl. report ids */
+#define FIDO_STATS_RX_FRAMES	2	/* HID reports read */
+#define FIDO_STATS_RX_BYTES	3	/* bytes read */
+#define FIDO_STATS_SYSCALLS	4	/* read, write and writev calls */
+#define FIDO_STATS_KEEPALIVES	5	/* CTAPHID_KEEPALIVE reports */
+#define FIDO_STATS_RETRIES	6	/* U2F requests repeated for presence */
+#define FIDO_STATS_TIMEOUTS	7	/* blocking reads that failed */
+#define FIDO_STATS_NCOUNTERS	8
+
+/* fido_dev_stats_latency() phases. */
+#define FIDO_STATS_ENCODE	0	/* CBOR request serialisation */
+#define FIDO_STATS_WIRE		1	/* request sent until reply received */
+#define FIDO_STATS_DECODE	2	/* CBOR reply parsing */
+#define FIDO_STATS_NPHASES	3
+
+/* Latency buckets: floor(log2(microseconds)), the last one open-ended. */
+#define FIDO_STATS_NBUCKETS	24
+
 #endif /* !_FIDO_PARAM_H */
@@ -42,11 +42,15 @@ extern "C" {
 #endif /* __cplusplus */
 
 struct fido_dev;
+struct fido_dev_info;
 
 typedef void *fido_dev_io_open_t(const char *);
 typedef void  fido_dev_io_close_t(void *);
 typedef int   fido_dev_io_read_t(void *, unsigned char *, size_t, int);
 typedef int   fido_dev_io_write_t(void *, const unsigned char *, size_t);
+typedef int   fido_dev_io_writev_t(void *, const unsigned char *, size_t, size_t);
+typedef int   fido_dev_io_pollfd_t(void *);
+typedef int   fido_dev_io_wakeup_t(void *, int);
 typedef int   fido_dev_rx_t(struct fido_dev *, uint8_t, unsigned char *, size_t, int);
 typedef int   fido_dev_tx_t(struct fido_dev *, uint8_t, const unsigned char *, size_t);
 
@@ -69,6 +73,11 @@ typedef enum {
 } fido_opt_t;
 
 typedef void fido_log_handler_t(const char *);
+typedef void fido_dev_keepalive_handler_t(struct fido_dev *, uint8_t, int,
+    void *);
+typedef void fido_dev_registry_handler_t(const struct fido_dev_info *, int,
+    void *);
+typedef void fido_nfc_reader_handler_t(const char *, int, void *);
 
 #undef  _FIDO_SIGSET_DEFINED
 #define _FIDO_SIGSET_DEFINED
@@ -288,6 +297,22 @@ typedef struct fido_dev_info {
 	fido_dev_transport_t  transport;    /* transport functions */
 } fido_dev_info_t;
 
+typedef struct fido_dev_registry {
+	void                        *monitor;     /* hotplug monitor */
+	fido_dev_info_t             *devlist;     /* devices present */
+	size_t                       len;         /* entries in devlist */
+	size_t                       cap;         /* allocated entries */
+	fido_dev_registry_handler_t *handler;     /* optional add/remove hook */
+	void                        *handler_arg; /* opaque handler argument */
+} fido_dev_registry_t;
+
+typedef struct fido_nfc_reader {
+	char                      *path;        /* nfc: path of the adapter */
+	void                      *monitor;     /* netlink session */
+	fido_nfc_reader_handler_t *handler;     /* optional target hook */
+	void                      *handler_arg; /* opaque handler argument */
+} fido_nfc_reader_t;
+
 PACKED_TYPE(fido_ctap_info_t,
 /* defined in section 8.1.9.1.3 (CTAPHID_INIT) of the fido2 ctap spec */
 struct fido_ctap_info {
@@ -300,6 +325,70 @@ struct fido_ctap_info {
 	uint8_t  flags;    /* capabilities flags; see FIDO_CAP_* */
 })
 
+typedef struct fido_dev_cache_entry {
+	char     *path;       /* device path */
+	int16_t   vendor_id;  /* 2-byte vendor id, if known */
+	int16_t   product_id; /* 2-byte product id, if known */
+	uint8_t   protocol;   /* ctaphid protocol id */
+	uint8_t   major;      /* major version number */
+	uint8_t   minor;      /* minor version number */
+	uint8_t   build;      /* build version number */
+	uint8_t   caps;       /* capabilities flags; see FIDO_CAP_* */
+	int       flags;      /* internal flags; see FIDO_DEV_* */
+	uint64_t  maxmsgsize; /* max message size */
+	uint64_t  maxcredcntlst; /* max credentials in a list */
+	uint64_t  maxcredidlen;  /* max credential id length */
+} fido_dev_cache_entry_t;
+
+typedef struct fido_dev_cache {
+	fido_dev_cache_entry_t *entry; /* most recently stored last */
+	size_t                  len;   /* number of entries */
+} fido_dev_cache_t;
+
+typedef struct fido_dev_session {
+	es256_pk_t      *pk;       /* platform key agreement key */
+	fido_blob_t     *ecdh;     /* shared secret */
+	struct timespec  ts;       /* when the secret was negotiated */
+	uint64_t         uses;     /* times the secret was handed out */
+	int              ms;       /* lifetime in ms; -1 for unlimited */
+	uint64_t         max_uses; /* max uses of a secret; 0 disables */
+} fido_dev_session_t;
+
+typedef int fido_dev_async_rx_t(struct fido_dev *, const unsigned char *,
+    size_t, bool *);
+
+typedef struct fido_dev_async {
+	fido_dev_async_rx_t *rx;   /* reply handler; NULL if idle */
+	void                *obj;  /* fido_cred_t, fido_assert_t or int */
+	es256_pk_t          *pk;   /* platform key agreement key */
+	fido_blob_t         *ecdh; /* shared secret */
+	size_t               nrx;  /* replies handled so far */
+	unsigned char       *buf;  /* reply being reassembled */
+	size_t               len;  /* payload length of the reply */
+	size_t               off;  /* payload bytes received */
+	int                  seq;  /* next continuation; -1 for init */
+	bool                 in_rx; /* rx is running */
+} fido_dev_async_t;
+
+typedef struct fido_dev_keepalive {
+	fido_dev_keepalive_handler_t *handler; /* optional callback */
+	void            *arg;      /* handler argument */
+	struct timespec  ts;       /* when the last request was sent */
+	int              first_ms; /* until its first keepalive; -1 if none */
+	int              rx_ms;    /* until its response; -1 if none */
+} fido_dev_keepalive_t;
+
+typedef struct fido_dev_mux fido_dev_mux_t; /* see mux.c */
+
+/* authenticator commands 0x01..0x0d; U2F requests use 0x03 (CTAP_CMD_MSG) */
+#define FIDO_STATS_NCMDS	0x0e
+
+typedef struct fido_dev_stats {
+	uint64_t counter[FIDO_STATS_NCOUNTERS]; /* see FIDO_STATS_* */
+	uint64_t latency[FIDO_STATS_NCMDS][FIDO_STATS_NPHASES]
+	    [FIDO_STATS_NBUCKETS]; /* histograms by command and phase */
+} fido_dev_stats_t;
+
 typedef struct fido_dev {
 	uint64_t              nonce;      /* issued nonce */
 	fido_ctap_info_t      attr;       /* device attributes */
@@ -307,26 +396,69 @@ typedef struct fido_dev {
 	char                 *path;       /* device path */
 	void                 *io_handle;  /* abstract i/o handle */
 	fido_dev_io_t         io;         /* i/o functions */
+	fido_dev_io_writev_t *io_writev;  /* optional burst write */
+	fido_dev_io_pollfd_t *io_pollfd;  /* optional pollable descriptor */
+	fido_dev_io_wakeup_t *io_wakeup;  /* optional read interruption */
+	bool                  resync;     /* a reply may still be in flight */
 	bool                  io_own;     /* device has own io/transport */
+	bool                  apdu_ext;   /* nfc: extended-length apdus */
 	size_t                rx_len;     /* length of HID input reports */
 	size_t                tx_len;     /* length of HID output reports */
+	unsigned char        *rx_buf;     /* FIDO_MAXMSG receive buffer */
 	int                   flags;      /* internal flags; see FIDO_DEV_* */
 	fido_dev_transport_t  transport;  /* transport functions */
 	uint64_t	      maxmsgsize; /* max message size */
+	uint64_t              maxcredcntlst; /* max credentials in a list */
+	uint64_t              maxcredidlen;  /* max credential id length */
 	int		      timeout_ms; /* read timeout in ms */
+	int16_t               vendor_id;  /* 2-byte vendor id, if known */
+	int16_t               product_id; /* 2-byte product id, if known */
+	fido_dev_cache_t     *cache;      /* optional session cache */
+	char                 *cache_path; /* cache key of the open device */
+	fido_dev_session_t    session;    /* cached key agreement */
+	struct fido_uv_token *uv_token;   /* token held by the application */
+	fido_dev_async_t      async;      /* non-blocking operation */
+	fido_dev_mux_t       *mux;        /* channels sharing io_handle */
+	bool                  mux_chan;   /* io_handle is borrowed */
+	unsigned char        *mux_q;      /* frames routed to this channel */
+	size_t                mux_q_len;  /* number of queued frames */
+	fido_dev_keepalive_t  keepalive;  /* keepalive reporting */
+	fido_dev_stats_t     *stats;      /* optional statistics */
+	int                   stats_cmd;  /* latency slot in flight; -1 if none */
+	int64_t               stats_encode_us; /* next request's; -1 if none */
 } fido_dev_t;
 
+typedef struct fido_uv_token {
+	fido_blob_t      token; /* decrypted pinUvAuthToken */
+	uint8_t          perms; /* see FIDO_UV_TOKEN_PERM_* */
+	struct fido_dev *dev;   /* issuing device, while valid */
+} fido_uv_token_t;
+
+typedef struct fido_verifier {
+	int       cose_alg; /* cose algorithm */
+	EVP_PKEY *pkey;     /* parsed public key */
+} fido_verifier_t;
+
+typedef struct fido_dev_pool fido_dev_pool_t; /* private to pool.c */
+
 #else
 typedef struct fido_assert fido_assert_t;
 typedef struct fido_cbor_info fido_cbor_info_t;
 typedef struct fido_cred fido_cred_t;
 typedef struct fido_dev fido_dev_t;
+typedef struct fido_dev_cache fido_dev_cache_t;
+typedef struct fido_dev_stats fido_dev_stats_t;
+typedef struct fido_uv_token fido_uv_token_t;
 typedef struct fido_dev_info fido_dev_info_t;
+typedef struct fido_dev_pool fido_dev_pool_t;
+typedef struct fido_dev_registry fido_dev_registry_t;
+typedef struct fido_nfc_reader fido_nfc_reader_t;
 typedef struct es256_pk es256_pk_t;
 typedef struct es256_sk es256_sk_t;
 typedef struct es384_pk es384_pk_t;
 typedef struct rs256_pk rs256_pk_t;
 typedef struct eddsa_pk eddsa_pk_t;
+typedef struct fido_verifier fido_verifier_t;
 #endif /* _FIDO_INTERNAL */
 
 #ifdef __cplusplus
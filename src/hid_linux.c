@@ -8,6 +8,9 @@
 #include <sys/types.h>
 #include <sys/file.h>
 #include <sys/ioctl.h>
+#include <sys/uio.h>
+
+#include <sys/eventfd.h>
 
 #include <linux/hidraw.h>
 #include <linux/input.h>
@@ -19,8 +22,13 @@
 
 #include "fido.h"
 
+#ifndef MIN
+#define MIN(x, y) ((x) > (y) ? (y) : (x))
+#endif
+
 struct hid_linux {
 	int             fd;
+	int             wakefd;
 	size_t          report_in_len;
 	size_t          report_out_len;
 	sigset_t        sigmask;
@@ -128,22 +136,22 @@ get_usb_attr(struct udev_device *dev, const char *attr)
 	return (get_parent_attr(dev, "usb", "usb_device", attr));
 }
 
+struct hid_linux_monitor {
+	struct udev		*udev;
+	struct udev_monitor	*mon;
+};
+
 static int
-copy_info(fido_dev_info_t *di, struct udev *udev,
-    struct udev_list_entry *udev_entry)
+copy_info_dev(fido_dev_info_t *di, struct udev_device *dev)
 {
-	const char		*name;
 	const char		*path;
 	char			*uevent = NULL;
-	struct udev_device	*dev = NULL;
 	int			 bus = 0;
 	int			 ok = -1;
 
 	memset(di, 0, sizeof(*di));
 
-	if ((name = udev_list_entry_get_name(udev_entry)) == NULL ||
-	    (dev = udev_device_new_from_syspath(udev, name)) == NULL ||
-	    (path = udev_device_get_devnode(dev)) == NULL ||
+	if ((path = udev_device_get_devnode(dev)) == NULL ||
 	    is_fido(path) == 0)
 		goto fail;
 
@@ -168,11 +176,15 @@ copy_info(fido_dev_info_t *di, struct udev *udev,
 	if (di->path == NULL || di->manufacturer == NULL || di->product == NULL)
 		goto fail;
 
+	di->io = (fido_dev_io_t) {
+		fido_hid_open,
+		fido_hid_close,
+		fido_hid_read,
+		fido_hid_write,
+	};
+
 	ok = 0;
 fail:
-	if (dev != NULL)
-		udev_device_unref(dev);
-
 	free(uevent);
 
 	if (ok < 0) {
@@ -185,6 +197,26 @@ fail:
 	return (ok);
 }
 
+static int
+copy_info(fido_dev_info_t *di, struct udev *udev,
+    struct udev_list_entry *udev_entry)
+{
+	const char		*name;
+	struct udev_device	*dev;
+	int			 ok;
+
+	memset(di, 0, sizeof(*di));
+
+	if ((name = udev_list_entry_get_name(udev_entry)) == NULL ||
+	    (dev = udev_device_new_from_syspath(udev, name)) == NULL)
+		return (-1);
+
+	ok = copy_info_dev(di, dev);
+	udev_device_unref(dev);
+
+	return (ok);
+}
+
 int
 fido_hid_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
 {
@@ -216,16 +248,9 @@ fido_hid_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
 	}
 
 	udev_list_entry_foreach(udev_entry, udev_list) {
-		if (copy_info(&devlist[*olen], udev, udev_entry) == 0) {
-			devlist[*olen].io = (fido_dev_io_t) {
-				fido_hid_open,
-				fido_hid_close,
-				fido_hid_read,
-				fido_hid_write,
-			};
-			if (++(*olen) == ilen)
-				break;
-		}
+		if (copy_info(&devlist[*olen], udev, udev_entry) == 0 &&
+		    ++(*olen) == ilen)
+			break;
 	}
 
 	r = FIDO_OK;
@@ -238,6 +263,103 @@ fail:
 	return (r);
 }
 
+int
+fido_hid_monitor_open(fido_dev_registry_t *reg)
+{
+	struct hid_linux_monitor	*m;
+	struct udev_enumerate		*udev_enum = NULL;
+	struct udev_list_entry		*udev_list;
+	struct udev_list_entry		*udev_entry;
+	fido_dev_info_t			 di;
+	int				 r = FIDO_ERR_INTERNAL;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return (FIDO_ERR_INTERNAL);
+
+	reg->monitor = m;
+
+	if ((m->udev = udev_new()) == NULL ||
+	    (m->mon = udev_monitor_new_from_netlink(m->udev, "udev")) == NULL ||
+	    udev_monitor_filter_add_match_subsystem_devtype(m->mon, "hidraw",
+	    NULL) < 0 || udev_monitor_enable_receiving(m->mon) < 0) {
+		fido_log_debug("%s: udev_monitor", __func__);
+		goto fail;
+	}
+
+	/* listening already, so that no device falls in between */
+	if ((udev_enum = udev_enumerate_new(m->udev)) == NULL ||
+	    udev_enumerate_add_match_subsystem(udev_enum, "hidraw") < 0 ||
+	    udev_enumerate_scan_devices(udev_enum) < 0) {
+		fido_log_debug("%s: udev_enumerate", __func__);
+		goto fail;
+	}
+
+	udev_list = udev_enumerate_get_list_entry(udev_enum);
+	udev_list_entry_foreach(udev_entry, udev_list) {
+		if (copy_info(&di, m->udev, udev_entry) == 0 &&
+		    (r = fido_dev_registry_add(reg, &di)) != FIDO_OK)
+			goto fail;
+	}
+
+	r = FIDO_OK;
+fail:
+	if (udev_enum != NULL)
+		udev_enumerate_unref(udev_enum);
+
+	return (r);
+}
+
+void
+fido_hid_monitor_close(void *monitor)
+{
+	struct hid_linux_monitor *m;
+
+	if ((m = monitor) == NULL)
+		return;
+
+	if (m->mon != NULL)
+		udev_monitor_unref(m->mon);
+	if (m->udev != NULL)
+		udev_unref(m->udev);
+
+	free(m);
+}
+
+int
+fido_hid_monitor_pollfd(void *monitor)
+{
+	struct hid_linux_monitor *m = monitor;
+
+	return (udev_monitor_get_fd(m->mon));
+}
+
+/* Applies the events received so far; doesn't block. */
+int
+fido_hid_monitor_update(fido_dev_registry_t *reg)
+{
+	struct hid_linux_monitor	*m = reg->monitor;
+	struct udev_device		*dev;
+	const char			*action;
+	const char			*path;
+	fido_dev_info_t			 di;
+	int				 r = FIDO_OK;
+
+	while (r == FIDO_OK &&
+	    (dev = udev_monitor_receive_device(m->mon)) != NULL) {
+		if ((action = udev_device_get_action(dev)) == NULL ||
+		    (path = udev_device_get_devnode(dev)) == NULL)
+			fido_log_debug("%s: ignoring event", __func__);
+		else if (strcmp(action, "add") == 0) {
+			if (copy_info_dev(&di, dev) == 0)
+				r = fido_dev_registry_add(reg, &di);
+		} else if (strcmp(action, "remove") == 0)
+			fido_dev_registry_remove(reg, path);
+		udev_device_unref(dev);
+	}
+
+	return (r);
+}
+
 void *
 fido_hid_open(const char *path)
 {
@@ -250,8 +372,10 @@ fido_hid_open(const char *path)
 retry:
 	looped = false;
 
-	if ((ctx = calloc(1, sizeof(*ctx))) == NULL ||
-	    (ctx->fd = fido_hid_unix_open(path)) == -1) {
+	if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+		return (NULL);
+	ctx->wakefd = -1;
+	if ((ctx->fd = fido_hid_unix_open(path)) == -1) {
 		free(ctx);
 		return (NULL);
 	}
@@ -296,6 +420,12 @@ retry:
 
 	free(hrd);
 
+	if ((ctx->wakefd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK)) == -1) {
+		fido_log_error(errno, "%s: eventfd", __func__);
+		fido_hid_close(ctx);
+		return (NULL);
+	}
+
 	return (ctx);
 }
 
@@ -306,6 +436,8 @@ fido_hid_close(void *handle)
 
 	if (close(ctx->fd) == -1)
 		fido_log_error(errno, "%s: close", __func__);
+	if (ctx->wakefd != -1 && close(ctx->wakefd) == -1)
+		fido_log_error(errno, "%s: close", __func__);
 
 	free(ctx);
 }
@@ -332,7 +464,7 @@ fido_hid_read(void *handle, unsigned char *buf, size_t len, int ms)
 		return (-1);
 	}
 
-	if (fido_hid_unix_wait(ctx->fd, ms, ctx->sigmaskp) < 0) {
+	if (fido_hid_unix_wait(ctx->fd, ctx->wakefd, ms, ctx->sigmaskp) < 0) {
 		fido_log_debug("%s: fd not ready", __func__);
 		return (-1);
 	}
@@ -374,6 +506,84 @@ fido_hid_write(void *handle, const unsigned char *buf, size_t len)
 	return ((int)r);
 }
 
+/*
+ * Write n reports of len bytes each from buf. hidraw has no write_iter, so
+ * the kernel hands each iovec to hidraw_write() as a separate report; a
+ * message's frames thus cost one writev() per HID_WRITEV_BATCH reports.
+ */
+#define HID_WRITEV_BATCH	64
+
+int
+fido_hid_writev(void *handle, const unsigned char *buf, size_t len, size_t n)
+{
+	struct hid_linux	*ctx = handle;
+	struct iovec		 iov[HID_WRITEV_BATCH];
+	size_t			 cnt, done = 0;
+	ssize_t			 r;
+
+	if (len != ctx->report_out_len + 1 || n == 0 || n > INT_MAX / len) {
+		fido_log_debug("%s: len %zu, n %zu", __func__, len, n);
+		return (-1);
+	}
+
+	while (done < n) {
+		cnt = MIN(n - done, HID_WRITEV_BATCH);
+		for (size_t i = 0; i < cnt; i++) {
+			iov[i].iov_base = (void *)(uintptr_t)(buf +
+			    (done + i) * len);
+			iov[i].iov_len = len;
+		}
+		if ((r = writev(ctx->fd, iov, (int)cnt)) == -1) {
+			fido_log_error(errno, "%s: writev", __func__);
+			return (-1);
+		}
+		if (r < 0 || (size_t)r != cnt * len) {
+			fido_log_debug("%s: %zd != %zu", __func__, r, cnt * len);
+			return (-1);
+		}
+		done += cnt;
+	}
+
+	return ((int)(n * len));
+}
+
+int
+fido_hid_pollfd(void *handle)
+{
+	struct hid_linux *ctx = handle;
+
+	return (ctx->fd);
+}
+
+/*
+ * With set, make a read blocked on the handle, or the next one, return
+ * at once; otherwise, withdraw such a wakeup and report whether it was
+ * pending. Safe to call from any thread.
+ */
+int
+fido_hid_wakeup(void *handle, int set)
+{
+	struct hid_linux	*ctx = handle;
+	uint64_t		 v = 1;
+
+	if (set) {
+		if (write(ctx->wakefd, &v, sizeof(v)) != sizeof(v)) {
+			fido_log_error(errno, "%s: write", __func__);
+			return (-1);
+		}
+		return (0);
+	}
+
+	if (read(ctx->wakefd, &v, sizeof(v)) != sizeof(v)) {
+		if (errno == EAGAIN)
+			return (0);
+		fido_log_error(errno, "%s: read", __func__);
+		return (-1);
+	}
+
+	return (1);
+}
+
 size_t
 fido_hid_report_in_len(void *handle)
 {
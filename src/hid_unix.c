@@ -47,16 +47,22 @@ fido_hid_unix_open(const char *path)
 	return (fd);
 }
 
+/*
+ * Wait for fd to become readable. A readable wakefd, if not -1, ends the
+ * wait as a timeout would; it is left for the caller to drain.
+ */
 int
-fido_hid_unix_wait(int fd, int ms, const fido_sigset_t *sigmask)
+fido_hid_unix_wait(int fd, int wakefd, int ms, const fido_sigset_t *sigmask)
 {
 	struct timespec ts;
-	struct pollfd pfd;
+	struct pollfd pfd[2];
 	int r;
 
 	memset(&pfd, 0, sizeof(pfd));
-	pfd.events = POLLIN;
-	pfd.fd = fd;
+	pfd[0].events = POLLIN;
+	pfd[0].fd = fd;
+	pfd[1].events = POLLIN;
+	pfd[1].fd = wakefd; /* ignored if -1 */
 
 #ifdef FIDO_FUZZ
 	return (0);
@@ -66,11 +72,16 @@ fido_hid_unix_wait(int fd, int ms, const fido_sigset_t *sigmask)
 		ts.tv_nsec = (ms % 1000) * 1000000;
 	}
 
-	if ((r = ppoll(&pfd, 1, ms > -1 ? &ts : NULL, sigmask)) < 1) {
+	if ((r = ppoll(pfd, 2, ms > -1 ? &ts : NULL, sigmask)) < 1) {
 		if (r == -1)
 			fido_log_error(errno, "%s: ppoll", __func__);
 		return (-1);
 	}
 
+	if (pfd[1].revents & POLLIN) {
+		fido_log_debug("%s: woken", __func__);
+		return (-1);
+	}
+
 	return (0);
 }
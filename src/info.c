@@ -361,21 +361,16 @@ fido_dev_get_cbor_info_tx(fido_dev_t *dev, int *ms)
 static int
 fido_dev_get_cbor_info_rx(fido_dev_t *dev, fido_cbor_info_t *ci, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	fido_log_debug("%s: dev=%p, ci=%p, ms=%d", __func__, (void *)dev,
 	    (void *)ci, *ms);
 
 	fido_cbor_info_reset(ci);
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -383,7 +378,7 @@ fido_dev_get_cbor_info_rx(fido_dev_t *dev, fido_cbor_info_t *ci, int *ms)
 
 	r = cbor_parse_reply(msg, (size_t)msglen, ci, parse_reply_element);
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
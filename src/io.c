@@ -5,6 +5,11 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#endif
+
 #include "fido.h"
 #include "packed.h"
 
@@ -41,6 +46,14 @@ tx_pkt(fido_dev_t *d, const void *pkt, size_t len, int *ms)
 
 	n = d->io.write(d->io_handle, pkt, len);
 
+	fido_dev_stats_count(d, FIDO_STATS_SYSCALLS, 1);
+	if (n > 0) {
+		fido_log_frame(FIDO_LOG_TX, (const unsigned char *)pkt + 1,
+		    len - 1);
+		fido_dev_stats_count(d, FIDO_STATS_TX_FRAMES, 1);
+		fido_dev_stats_count(d, FIDO_STATS_TX_BYTES, (uint64_t)n);
+	}
+
 	if (fido_time_delta(&ts, ms) != 0)
 		return (-1);
 
@@ -67,6 +80,32 @@ tx_empty(fido_dev_t *d, uint8_t cmd, int *ms)
 	return (0);
 }
 
+static size_t
+pack_init(const fido_dev_t *d, struct frame *fp, uint8_t cmd, const void *buf,
+    size_t count)
+{
+	fp->cid = d->cid;
+	fp->body.init.cmd = CTAP_FRAME_INIT | cmd;
+	fp->body.init.bcnth = (count >> 8) & 0xff;
+	fp->body.init.bcntl = count & 0xff;
+	count = MIN(count, d->tx_len - CTAP_INIT_HEADER_LEN);
+	memcpy(&fp->body.init.data, buf, count);
+
+	return (count);
+}
+
+static size_t
+pack_cont(const fido_dev_t *d, struct frame *fp, uint8_t seq, const void *buf,
+    size_t count)
+{
+	fp->cid = d->cid;
+	fp->body.cont.seq = seq;
+	count = MIN(count, d->tx_len - CTAP_CONT_HEADER_LEN);
+	memcpy(&fp->body.cont.data, buf, count);
+
+	return (count);
+}
+
 static size_t
 tx_preamble(fido_dev_t *d, uint8_t cmd, const void *buf, size_t count, int *ms)
 {
@@ -80,12 +119,7 @@ tx_preamble(fido_dev_t *d, uint8_t cmd, const void *buf, size_t count, int *ms)
 
 	memset(&pkt, 0, sizeof(pkt));
 	fp = (struct frame *)(pkt + 1);
-	fp->cid = d->cid;
-	fp->body.init.cmd = CTAP_FRAME_INIT | cmd;
-	fp->body.init.bcnth = (count >> 8) & 0xff;
-	fp->body.init.bcntl = count & 0xff;
-	count = MIN(count, d->tx_len - CTAP_INIT_HEADER_LEN);
-	memcpy(&fp->body.init.data, buf, count);
+	count = pack_init(d, fp, cmd, buf, count);
 
 	if (len > sizeof(pkt) || (n = tx_pkt(d, pkt, len, ms)) < 0 ||
 	    (size_t)n != len)
@@ -107,10 +141,7 @@ tx_frame(fido_dev_t *d, uint8_t seq, const void *buf, size_t count, int *ms)
 
 	memset(&pkt, 0, sizeof(pkt));
 	fp = (struct frame *)(pkt + 1);
-	fp->cid = d->cid;
-	fp->body.cont.seq = seq;
-	count = MIN(count, d->tx_len - CTAP_CONT_HEADER_LEN);
-	memcpy(&fp->body.cont.data, buf, count);
+	count = pack_cont(d, fp, seq, buf, count);
 
 	if (len > sizeof(pkt) || (n = tx_pkt(d, pkt, len, ms)) < 0 ||
 	    (size_t)n != len)
@@ -119,11 +150,78 @@ tx_frame(fido_dev_t *d, uint8_t seq, const void *buf, size_t count, int *ms)
 	return (count);
 }
 
+/*
+ * Lay out every frame of a message back to back, each preceded by its
+ * report id, and hand them to the device's writev function in one call.
+ */
+static int
+tx_burst(fido_dev_t *d, uint8_t cmd, const unsigned char *buf, size_t count,
+    int *ms)
+{
+	struct timespec	 ts;
+	unsigned char	*pkt = NULL;
+	const size_t	 len = d->tx_len + 1;
+	size_t		 init_len, cont_len, nframes, sent;
+	int		 n, ok = -1;
+
+	if (len > sizeof(struct frame) + 1) {
+		fido_log_debug("%s: len=%zu", __func__, len);
+		return (-1);
+	}
+
+	init_len = d->tx_len - CTAP_INIT_HEADER_LEN;
+	cont_len = d->tx_len - CTAP_CONT_HEADER_LEN;
+	nframes = 1;
+	if (count > init_len)
+		nframes += (count - init_len + cont_len - 1) / cont_len;
+
+	if (nframes > 0x80 + 1) {
+		fido_log_debug("%s: nframes=%zu", __func__, nframes);
+		return (-1);
+	}
+	if ((pkt = calloc(nframes, len)) == NULL) {
+		fido_log_debug("%s: calloc", __func__);
+		return (-1);
+	}
+
+	sent = pack_init(d, (struct frame *)(pkt + 1), cmd, buf, count);
+	for (size_t i = 1; i < nframes; i++)
+		sent += pack_cont(d, (struct frame *)(pkt + i * len + 1),
+		    (uint8_t)(i - 1), buf + sent, count - sent);
+
+	if (fido_time_now(&ts) != 0)
+		goto fail;
+
+	n = d->io_writev(d->io_handle, pkt, len, nframes);
+	fido_dev_stats_count(d, FIDO_STATS_SYSCALLS, 1);
+
+	if (fido_time_delta(&ts, ms) != 0)
+		goto fail;
+	if (n < 0 || (size_t)n != nframes * len) {
+		fido_log_debug("%s: io_writev", __func__);
+		goto fail;
+	}
+
+	for (size_t i = 0; i < nframes; i++)
+		fido_log_frame(FIDO_LOG_TX, pkt + i * len + 1, len - 1);
+	fido_dev_stats_count(d, FIDO_STATS_TX_FRAMES, nframes);
+	fido_dev_stats_count(d, FIDO_STATS_TX_BYTES, (uint64_t)n);
+
+	ok = 0;
+fail:
+	freezero(pkt, nframes * len);
+
+	return (ok);
+}
+
 static int
 tx(fido_dev_t *d, uint8_t cmd, const unsigned char *buf, size_t count, int *ms)
 {
 	size_t n, sent;
 
+	if (d->io_writev != NULL)
+		return (tx_burst(d, cmd, buf, count, ms));
+
 	if ((sent = tx_preamble(d, cmd, buf, count, ms)) == 0) {
 		fido_log_debug("%s: tx_preamble", __func__);
 		return (-1);
@@ -161,51 +259,199 @@ transport_tx(fido_dev_t *d, uint8_t cmd, const void *buf, size_t count, int *ms)
 	return (n);
 }
 
+static void
+keepalive_reset(fido_dev_t *d, uint8_t cmd)
+{
+	fido_dev_keepalive_t *k = &d->keepalive;
+
+	if (cmd == CTAP_CMD_CANCEL)
+		return; /* not a request of its own */
+
+	if (fido_time_now(&k->ts) != 0)
+		memset(&k->ts, 0, sizeof(k->ts));
+	k->first_ms = -1;
+	k->rx_ms = -1;
+}
+
+static void
+keepalive_rx(fido_dev_t *d, const struct frame *fp)
+{
+	fido_dev_keepalive_t	*k = &d->keepalive;
+	uint8_t			 status = fp->body.init.data[0];
+	int			 ms;
+
+	ms = fido_time_elapsed(&k->ts);
+	if (k->first_ms < 0)
+		k->first_ms = ms;
+
+	fido_log_debug("%s: status=0x%02x, ms=%d", __func__, status, ms);
+	fido_dev_stats_count(d, FIDO_STATS_KEEPALIVES, 1);
+
+	if (k->handler != NULL)
+		k->handler(d, status, ms, k->arg);
+}
+
+static int rx_frame(fido_dev_t *, struct frame *, int *);
+
+/*
+ * A read interrupted by fido_dev_cancel() leaves the channel with a reply,
+ * or the authenticator's answer to CTAPHID_CANCEL, possibly still to come.
+ * Before the next request, send CTAPHID_INIT on the channel, which makes
+ * the authenticator drop any transaction, and discard everything up to
+ * its reply.
+ */
+static int
+resync(fido_dev_t *d, int *ms)
+{
+	struct frame	f;
+	uint64_t	nonce;
+
+	fido_log_debug("%s: cid=0x%x", __func__, d->cid);
+
+	if (fido_get_random(&nonce, sizeof(nonce)) < 0) {
+		fido_log_debug("%s: fido_get_random", __func__);
+		return (-1);
+	}
+	if (tx(d, CTAP_CMD_INIT, (const unsigned char *)&nonce, sizeof(nonce),
+	    ms) < 0) {
+		fido_log_debug("%s: tx", __func__);
+		return (-1);
+	}
+
+	do {
+		if (rx_frame(d, &f, ms) < 0) {
+			fido_log_debug("%s: rx_frame", __func__);
+			return (-1);
+		}
+	} while (f.cid != d->cid ||
+	    f.body.init.cmd != (CTAP_FRAME_INIT | CTAP_CMD_INIT) ||
+	    memcmp(f.body.init.data, &nonce, sizeof(nonce)) != 0);
+
+	d->resync = false;
+
+	return (0);
+}
+
+/* Whether the last failed read was ended by fido_dev_cancel(). */
+static bool
+rx_woken(fido_dev_t *d)
+{
+	if (d->transport.rx != NULL || d->io_wakeup == NULL ||
+	    d->io_wakeup(d->io_handle, 0) != 1)
+		return (false);
+
+	fido_log_debug("%s: cancelled", __func__);
+	d->resync = true;
+
+	return (true);
+}
+
+/* A fido_dev_cancel() that found nothing waiting is dropped. */
+static void
+tx_unwake(fido_dev_t *d)
+{
+	if (d->io_wakeup != NULL && d->io_wakeup(d->io_handle, 0) == 1)
+		fido_log_debug("%s: stale wakeup", __func__);
+}
+
 int
 fido_tx(fido_dev_t *d, uint8_t cmd, const void *buf, size_t count, int *ms)
 {
+	fido_dev_mux_t	*mux;
+	int		 r;
+
 	fido_log_debug("%s: dev=%p, cmd=0x%02x", __func__, (void *)d, cmd);
 	fido_log_xxd(buf, count, "%s", __func__);
 
+	if (cmd != CTAP_CMD_CANCEL && fido_dev_async_busy(d)) {
+		fido_log_debug("%s: operation in progress", __func__);
+		return (-1);
+	}
+
+	keepalive_reset(d, cmd);
+	fido_dev_stats_tx(d, cmd, buf, count);
+
 	if (d->transport.tx != NULL)
-		return (transport_tx(d, cmd, buf, count, ms));
-	if (d->io_handle == NULL || d->io.write == NULL || count > UINT16_MAX) {
+		r = transport_tx(d, cmd, buf, count, ms);
+	else if (d->io_handle == NULL || d->io.write == NULL ||
+	    count > UINT16_MAX) {
 		fido_log_debug("%s: invalid argument", __func__);
 		return (-1);
+	} else {
+		if (cmd != CTAP_CMD_CANCEL)
+			tx_unwake(d);
+		mux = fido_dev_mux_tx_lock(d);
+		if (d->resync && cmd != CTAP_CMD_CANCEL && resync(d, ms) < 0)
+			r = -1;
+		else
+			r = count == 0 ? tx_empty(d, cmd, ms) :
+			    tx(d, cmd, buf, count, ms);
+		fido_dev_mux_tx_unlock(mux);
+	}
+
+	if (r < 0) {
+		fido_log_fail(__func__, FIDO_ERR_TX);
+		fido_dev_cache_drop(d);
+		fido_dev_clear_session(d);
 	}
 
-	return (count == 0 ? tx_empty(d, cmd, ms) : tx(d, cmd, buf, count, ms));
+	return (r);
 }
 
 static int
-rx_frame(fido_dev_t *d, struct frame *fp, int *ms)
+rx_read(fido_dev_t *d, unsigned char *frame, size_t len, int *ms)
 {
 	struct timespec ts;
 	int n;
 
-	memset(fp, 0, sizeof(*fp));
-
 	if (fido_time_now(&ts) != 0)
 		return (-1);
 
-	if (d->rx_len > sizeof(*fp) || (n = d->io.read(d->io_handle,
-	    (unsigned char *)fp, d->rx_len, *ms)) < 0 || (size_t)n != d->rx_len)
+	n = d->io.read(d->io_handle, frame, len, *ms);
+	fido_dev_stats_count(d, FIDO_STATS_SYSCALLS, 1);
+	if (n < 0 || (size_t)n != len) {
+		if (*ms != 0)
+			fido_dev_stats_count(d, FIDO_STATS_TIMEOUTS, 1);
+		return (-1);
+	}
+	fido_log_frame(FIDO_LOG_RX, frame, (size_t)n);
+	fido_dev_stats_count(d, FIDO_STATS_RX_FRAMES, 1);
+	fido_dev_stats_count(d, FIDO_STATS_RX_BYTES, (uint64_t)n);
+
+	if (fido_time_delta(&ts, ms) != 0)
 		return (-1);
 
-	return (fido_time_delta(&ts, ms));
+	return (0);
+}
+
+static int
+rx_frame(fido_dev_t *d, struct frame *fp, int *ms)
+{
+	memset(fp, 0, sizeof(*fp));
+
+	if (d->rx_len > sizeof(*fp))
+		return (-1);
+
+	/* d may be given a sibling at any time; let mux.c look */
+	return (fido_dev_mux_rx(d, (unsigned char *)fp, d->rx_len, ms,
+	    rx_read));
 }
 
 static int
 rx_preamble(fido_dev_t *d, uint8_t cmd, struct frame *fp, int *ms)
 {
-	do {
+	for (;;) {
 		if (rx_frame(d, fp, ms) < 0)
 			return (-1);
 #ifdef FIDO_FUZZ
 		fp->cid = d->cid;
 #endif
-	} while (fp->cid != d->cid || (fp->cid == d->cid &&
-	    fp->body.init.cmd == (CTAP_FRAME_INIT | CTAP_KEEPALIVE)));
+		if (fp->cid != d->cid)
+			continue;
+		if (fp->body.init.cmd != (CTAP_FRAME_INIT | CTAP_KEEPALIVE))
+			break;
+		keepalive_rx(d, fp);
+	}
 
 	if (d->rx_len > sizeof(*fp))
 		return (-1);
@@ -317,31 +563,281 @@ fido_rx(fido_dev_t *d, uint8_t cmd, void *buf, size_t count, int *ms)
 	fido_log_debug("%s: dev=%p, cmd=0x%02x, ms=%d", __func__, (void *)d,
 	    cmd, *ms);
 
+	if (fido_dev_async_busy(d)) {
+		/* the reply belongs to fido_dev_poll() */
+		fido_log_debug("%s: operation in progress", __func__);
+		return (-1);
+	}
+
 	if (d->transport.rx != NULL)
-		return (transport_rx(d, cmd, buf, count, ms));
-	if (d->io_handle == NULL || d->io.read == NULL || count > UINT16_MAX) {
+		n = transport_rx(d, cmd, buf, count, ms);
+	else if (d->io_handle == NULL || d->io.read == NULL ||
+	    count > UINT16_MAX) {
 		fido_log_debug("%s: invalid argument", __func__);
 		return (-1);
-	}
-	if ((n = rx(d, cmd, buf, count, ms)) >= 0)
+	} else if ((n = rx(d, cmd, buf, count, ms)) >= 0)
 		fido_log_xxd(buf, (size_t)n, "%s", __func__);
+	else if (rx_woken(d)) {
+		if (cmd != CTAP_CMD_CBOR || count < 1)
+			return (-1);
+		/* as if the authenticator had acknowledged the cancel */
+		*(unsigned char *)buf = FIDO_ERR_KEEPALIVE_CANCEL;
+		n = 1;
+	}
+
+	if (n >= 0)
+		d->keepalive.rx_ms = fido_time_elapsed(&d->keepalive.ts);
+	fido_dev_stats_rx(d, cmd, n >= 0);
+
+	if (n < 0) {
+		fido_log_fail(__func__, FIDO_ERR_RX);
+		fido_dev_cache_drop(d);
+		fido_dev_clear_session(d);
+	} else if (cmd == CTAP_CMD_CBOR && n > 0 &&
+	    *(const unsigned char *)buf != FIDO_OK) {
+		/* the authenticator may have a new key agreement key */
+		fido_dev_clear_session(d);
+	}
 
 	return (n);
 }
 
+/*
+ * Receive into the device's receive buffer, allocated on first use and
+ * kept until the device is closed. On success, *msg points into that
+ * buffer and remains valid until the next call on d; the caller scrubs
+ * it with fido_rx_msg_clear() when done.
+ */
 int
-fido_rx_cbor_status(fido_dev_t *d, int *ms)
+fido_rx_msg(fido_dev_t *d, uint8_t cmd, const unsigned char **msg, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	int n;
+
+	*msg = NULL;
+
+	if (d->rx_buf == NULL && (d->rx_buf = malloc(FIDO_MAXMSG)) == NULL) {
+		fido_log_debug("%s: malloc", __func__);
+		return (-1);
+	}
+	if ((n = fido_rx(d, cmd, d->rx_buf, FIDO_MAXMSG, ms)) >= 0)
+		*msg = d->rx_buf;
+	else
+		explicit_bzero(d->rx_buf, FIDO_MAXMSG);
+
+	return (n);
+}
+
+/*
+ * Scrub a reply received with fido_rx_msg() once it has been parsed, so
+ * that tokens and secrets do not linger in d->rx_buf.
+ */
+void
+fido_rx_msg_clear(fido_dev_t *d, int msglen)
+{
+	if (d->rx_buf != NULL && msglen > 0)
+		explicit_bzero(d->rx_buf, MIN((size_t)msglen, FIDO_MAXMSG));
+}
+
+static int
+rx_poll_init(fido_dev_t *d, uint8_t cmd, const struct frame *fp,
+    size_t data_len)
+{
+	fido_dev_async_t	*a = &d->async;
+	size_t			 n;
+
+	if (fp->body.init.cmd != (CTAP_FRAME_INIT | cmd)) {
+		fido_log_debug("%s: cmd (0x%02x, 0x%02x)", __func__,
+		    fp->body.init.cmd, cmd);
+		return (-1);
+	}
+
+	a->len = (size_t)((fp->body.init.bcnth << 8) | fp->body.init.bcntl);
+	fido_log_debug("%s: payload_len=%zu", __func__, a->len);
+
+	freezero(a->buf, a->off);
+	if ((a->buf = malloc(a->len ? a->len : 1)) == NULL) {
+		fido_log_debug("%s: malloc", __func__);
+		return (-1);
+	}
+
+	n = MIN(a->len, data_len);
+	memcpy(a->buf, fp->body.init.data, n);
+	a->off = n;
+	a->seq = 0;
+
+	return (0);
+}
+
+static int
+rx_poll_cont(fido_dev_t *d, const struct frame *fp, size_t data_len)
+{
+	fido_dev_async_t	*a = &d->async;
+	size_t			 n;
+
+	if (fp->body.cont.seq != a->seq) {
+		fido_log_debug("%s: seq (%d, %d)", __func__,
+		    fp->body.cont.seq, a->seq);
+		return (-1);
+	}
+
+	n = MIN(a->len - a->off, data_len);
+	memcpy(a->buf + a->off, fp->body.cont.data, n);
+	a->off += n;
+	a->seq++;
+
+	return (0);
+}
+
+/* Complete the message as if the authenticator had acknowledged a cancel. */
+static int
+rx_poll_cancel(fido_dev_t *d)
+{
+	fido_dev_async_t *a = &d->async;
+
+	freezero(a->buf, a->off);
+	a->off = a->len = 0;
+	if ((a->buf = malloc(1)) == NULL) {
+		fido_log_debug("%s: malloc", __func__);
+		return (-1);
+	}
+	a->buf[0] = FIDO_ERR_KEEPALIVE_CANCEL;
+	a->off = a->len = 1;
+
+	return (0);
+}
+
+/*
+ * Whether a report can be read from d without waiting: 1 if so, 0 if the
+ * read would block, -1 if its descriptor is in error or hung up. Without
+ * a descriptor to poll, a report is assumed to be there.
+ */
+static int
+rx_poll_ready(const fido_dev_t *d)
+{
+#ifndef _WIN32
+	struct pollfd	pfd;
+	int		n;
+
+	if (fido_dev_mux_queued(d) || (pfd.fd = fido_dev_pollfd(d)) < 0)
+		return (1);
+
+	pfd.events = POLLIN;
+	pfd.revents = 0;
+
+	if ((n = poll(&pfd, 1, 0)) < 0) {
+		if (errno == EINTR)
+			return (0);
+		fido_log_error(errno, "%s: poll", __func__);
+		return (-1);
+	}
+	if (n == 0)
+		return (0);
+	if ((pfd.revents & POLLIN) == 0) {
+		fido_log_debug("%s: revents=0x%x", __func__, pfd.revents);
+		return (-1);
+	}
+#else
+	(void)d;
+#endif
+
+	return (1);
+}
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
+/*
+ * Reassemble a message from the reports that can be read without waiting,
+ * keeping partial state in d->async across calls. Returns 1 once *msg
+ * holds a complete message, 0 if more reports are needed, -1 on error.
+ * A read that fails on a descriptor reported readable is an error, e.g.
+ * an unplugged device; only devices without a descriptor to poll take a
+ * failed read to mean that nothing has arrived yet.
+ */
+int
+fido_rx_poll(fido_dev_t *d, uint8_t cmd, const unsigned char **msg,
+    size_t *msglen)
+{
+	fido_dev_async_t	*a = &d->async;
+	struct frame		 f;
+	size_t			 init_data_len, cont_data_len;
+	int			 ms, ready, r = -1;
+
+	*msg = NULL;
+	*msglen = 0;
+
+	if (d->transport.rx != NULL || d->io_handle == NULL ||
+	    d->io.read == NULL || d->rx_len <= CTAP_INIT_HEADER_LEN ||
+	    d->rx_len <= CTAP_CONT_HEADER_LEN) {
+		fido_log_debug("%s: invalid argument", __func__);
 		goto out;
 	}
 
-	if ((msglen = fido_rx(d, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0 ||
+	init_data_len = d->rx_len - CTAP_INIT_HEADER_LEN;
+	cont_data_len = d->rx_len - CTAP_CONT_HEADER_LEN;
+
+	if (init_data_len > sizeof(f.body.init.data) ||
+	    cont_data_len > sizeof(f.body.cont.data))
+		goto out;
+
+	for (;;) {
+		if ((ready = rx_poll_ready(d)) < 0)
+			goto out;
+		ms = 0;
+		if (ready == 0 || rx_frame(d, &f, &ms) < 0) {
+			if (rx_woken(d)) {
+				if (rx_poll_cancel(d) < 0)
+					goto out;
+				break;
+			}
+			if (ready == 1 && fido_dev_pollfd(d) >= 0)
+				goto out; /* readable, yet the read failed */
+			return (0); /* nothing to read yet */
+		}
+		fido_log_xxd(&f, d->rx_len, "%s", __func__);
+		if (f.cid != d->cid)
+			continue;
+		if (a->seq < 0) {
+			if (f.body.init.cmd ==
+			    (CTAP_FRAME_INIT | CTAP_KEEPALIVE)) {
+				keepalive_rx(d, &f);
+				continue;
+			}
+			if (rx_poll_init(d, cmd, &f, init_data_len) < 0)
+				goto out;
+		} else if (rx_poll_cont(d, &f, cont_data_len) < 0)
+			goto out;
+		if (a->off == a->len)
+			break;
+	}
+
+	a->seq = -1;
+	*msg = a->buf;
+	*msglen = a->len;
+	d->keepalive.rx_ms = fido_time_elapsed(&d->keepalive.ts);
+	fido_log_xxd(*msg, *msglen, "%s", __func__);
+
+	r = 1;
+out:
+	fido_dev_stats_rx(d, cmd, r > 0);
+
+	if (r < 0) {
+		fido_log_fail(__func__, FIDO_ERR_RX);
+		fido_dev_cache_drop(d);
+		fido_dev_clear_session(d);
+	} else if (cmd == CTAP_CMD_CBOR && *msglen > 0 && **msg != FIDO_OK) {
+		/* the authenticator may have a new key agreement key */
+		fido_dev_clear_session(d);
+	}
+
+	return (r);
+}
+
+int
+fido_rx_cbor_status(fido_dev_t *d, int *ms)
+{
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
+
+	if ((msglen = fido_rx_msg(d, CTAP_CMD_CBOR, &msg, ms)) < 0 ||
 	    (size_t)msglen < 1) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
@@ -350,7 +846,7 @@ fido_rx_cbor_status(fido_dev_t *d, int *ms)
 
 	r = msg[0];
 out:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(d, msglen);
 
 	return (r);
 }
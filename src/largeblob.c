@@ -169,8 +169,8 @@ largeblob_get_tx(fido_dev_t *dev, size_t offset, size_t count, int *ms)
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
-	if (cbor_build_frame(CTAP_CBOR_LARGEBLOB, argv, nitems(argv), &f) < 0 ||
-	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
+	if (cbor_build_frame(dev, CTAP_CBOR_LARGEBLOB, argv, nitems(argv),
+	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
 		goto fail;
@@ -201,15 +201,11 @@ parse_largeblob_reply(const cbor_item_t *key, const cbor_item_t *val,
 static int
 largeblob_get_rx(fido_dev_t *dev, fido_blob_t **chunk, int *ms)
 {
-	unsigned char *msg;
+	const unsigned char *msg;
 	int msglen, r;
 
 	*chunk = NULL;
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto out;
-	}
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto out;
@@ -227,11 +223,10 @@ largeblob_get_rx(fido_dev_t *dev, fido_blob_t **chunk, int *ms)
 
 	r = FIDO_OK;
 out:
+	fido_rx_msg_clear(dev, msglen);
 	if (r != FIDO_OK)
 		fido_blob_free(chunk);
 
-	freezero(msg, FIDO_MAXMSG);
-
 	return r;
 }
 
@@ -529,8 +524,8 @@ largeblob_set_tx(fido_dev_t *dev, const fido_blob_t *token, const u_char *chunk,
 			goto fail;
 		}
 	}
-	if (cbor_build_frame(CTAP_CBOR_LARGEBLOB, argv, nitems(argv), &f) < 0 ||
-	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
+	if (cbor_build_frame(dev, CTAP_CBOR_LARGEBLOB, argv, nitems(argv),
+	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
 		goto fail;
@@ -578,10 +573,11 @@ fail:
 
 static int
 largeblob_set_array(fido_dev_t *dev, const cbor_item_t *item, const char *pin,
-    int *ms)
+    const fido_blob_t *utok, int *ms)
 {
 	unsigned char dgst[SHA256_DIGEST_LENGTH];
 	fido_blob_t cbor, *token = NULL;
+	const fido_blob_t *t = utok;
 	size_t chunklen, maxchunklen, totalsize;
 	int r;
 
@@ -613,24 +609,25 @@ largeblob_set_array(fido_dev_t *dev, const cbor_item_t *item, const char *pin,
 		goto fail;
 	}
 	totalsize = cbor.len + sizeof(dgst) - 16; /* the first 16 bytes only */
-	if (pin != NULL || fido_dev_supports_permissions(dev)) {
+	if (t == NULL && (pin != NULL || fido_dev_supports_permissions(dev))) {
 		if ((r = largeblob_get_uv_token(dev, pin, &token,
 		    ms)) != FIDO_OK) {
 			fido_log_debug("%s: largeblob_get_uv_token", __func__);
 			goto fail;
 		}
+		t = token;
 	}
 	for (size_t offset = 0; offset < cbor.len; offset += chunklen) {
 		if ((chunklen = cbor.len - offset) > maxchunklen)
 			chunklen = maxchunklen;
-		if ((r = largeblob_set_tx(dev, token, cbor.ptr + offset,
+		if ((r = largeblob_set_tx(dev, t, cbor.ptr + offset,
 		    chunklen, offset, totalsize, ms)) != FIDO_OK ||
 		    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK) {
 			fido_log_debug("%s: body", __func__);
 			goto fail;
 		}
 	}
-	if ((r = largeblob_set_tx(dev, token, dgst, sizeof(dgst) - 16, cbor.len,
+	if ((r = largeblob_set_tx(dev, t, dgst, sizeof(dgst) - 16, cbor.len,
 	    totalsize, ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK) {
 		fido_log_debug("%s: dgst", __func__);
@@ -647,7 +644,7 @@ fail:
 
 static int
 largeblob_add(fido_dev_t *dev, const fido_blob_t *key, cbor_item_t *item,
-    const char *pin, int *ms)
+    const char *pin, const fido_blob_t *token, int *ms)
 {
 	cbor_item_t *array = NULL;
 	size_t idx;
@@ -676,7 +673,7 @@ largeblob_add(fido_dev_t *dev, const fido_blob_t *key, cbor_item_t *item,
 		goto fail;
 	}
 
-	if ((r = largeblob_set_array(dev, array, pin, ms)) != FIDO_OK) {
+	if ((r = largeblob_set_array(dev, array, pin, token, ms)) != FIDO_OK) {
 		fido_log_debug("%s: largeblob_set_array", __func__);
 		goto fail;
 	}
@@ -691,7 +688,7 @@ fail:
 
 static int
 largeblob_drop(fido_dev_t *dev, const fido_blob_t *key, const char *pin,
-    int *ms)
+    const fido_blob_t *token, int *ms)
 {
 	cbor_item_t *array = NULL;
 	size_t idx;
@@ -710,7 +707,7 @@ largeblob_drop(fido_dev_t *dev, const fido_blob_t *key, const char *pin,
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
-	if ((r = largeblob_set_array(dev, array, pin, ms)) != FIDO_OK) {
+	if ((r = largeblob_set_array(dev, array, pin, token, ms)) != FIDO_OK) {
 		fido_log_debug("%s: largeblob_set_array", __func__);
 		goto fail;
 	}
@@ -769,10 +766,10 @@ fail:
 	return r;
 }
 
-int
-fido_dev_largeblob_set(fido_dev_t *dev, const unsigned char *key_ptr,
-    size_t key_len, const unsigned char *blob_ptr, size_t blob_len,
-    const char *pin)
+static int
+largeblob_set(fido_dev_t *dev, const unsigned char *key_ptr, size_t key_len,
+    const unsigned char *blob_ptr, size_t blob_len, const char *pin,
+    const fido_blob_t *token)
 {
 	cbor_item_t *item = NULL;
 	fido_blob_t key, body;
@@ -802,7 +799,7 @@ fido_dev_largeblob_set(fido_dev_t *dev, const unsigned char *key_ptr,
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
-	if ((r = largeblob_add(dev, &key, item, pin, &ms)) != FIDO_OK)
+	if ((r = largeblob_add(dev, &key, item, pin, token, &ms)) != FIDO_OK)
 		fido_log_debug("%s: largeblob_add", __func__);
 fail:
 	if (item != NULL)
@@ -815,8 +812,33 @@ fail:
 }
 
 int
-fido_dev_largeblob_remove(fido_dev_t *dev, const unsigned char *key_ptr,
-    size_t key_len, const char *pin)
+fido_dev_largeblob_set(fido_dev_t *dev, const unsigned char *key_ptr,
+    size_t key_len, const unsigned char *blob_ptr, size_t blob_len,
+    const char *pin)
+{
+	return largeblob_set(dev, key_ptr, key_len, blob_ptr, blob_len, pin,
+	    NULL);
+}
+
+int
+fido_dev_largeblob_set_with_token(fido_dev_t *dev,
+    const unsigned char *key_ptr, size_t key_len,
+    const unsigned char *blob_ptr, size_t blob_len,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_LARGEBLOB)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return largeblob_set(dev, key_ptr, key_len, blob_ptr, blob_len, NULL,
+	    t);
+}
+
+static int
+largeblob_remove(fido_dev_t *dev, const unsigned char *key_ptr,
+    size_t key_len, const char *pin, const fido_blob_t *token)
 {
 	fido_blob_t key;
 	int ms = dev->timeout_ms;
@@ -832,7 +854,7 @@ fido_dev_largeblob_remove(fido_dev_t *dev, const unsigned char *key_ptr,
 		fido_log_debug("%s: fido_blob_set", __func__);
 		return FIDO_ERR_INTERNAL;
 	}
-	if ((r = largeblob_drop(dev, &key, pin, &ms)) != FIDO_OK)
+	if ((r = largeblob_drop(dev, &key, pin, token, &ms)) != FIDO_OK)
 		fido_log_debug("%s: largeblob_drop", __func__);
 
 	fido_blob_reset(&key);
@@ -840,6 +862,27 @@ fido_dev_largeblob_remove(fido_dev_t *dev, const unsigned char *key_ptr,
 	return r;
 }
 
+int
+fido_dev_largeblob_remove(fido_dev_t *dev, const unsigned char *key_ptr,
+    size_t key_len, const char *pin)
+{
+	return largeblob_remove(dev, key_ptr, key_len, pin, NULL);
+}
+
+int
+fido_dev_largeblob_remove_with_token(fido_dev_t *dev,
+    const unsigned char *key_ptr, size_t key_len,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_LARGEBLOB)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return largeblob_remove(dev, key_ptr, key_len, NULL, t);
+}
+
 int
 fido_dev_largeblob_get_array(fido_dev_t *dev, unsigned char **cbor_ptr,
     size_t *cbor_len)
@@ -875,9 +918,9 @@ fido_dev_largeblob_get_array(fido_dev_t *dev, unsigned char **cbor_ptr,
 	return r;
 }
 
-int
-fido_dev_largeblob_set_array(fido_dev_t *dev, const unsigned char *cbor_ptr,
-    size_t cbor_len, const char *pin)
+static int
+largeblob_load_set_array(fido_dev_t *dev, const unsigned char *cbor_ptr,
+    size_t cbor_len, const char *pin, const fido_blob_t *token)
 {
 	cbor_item_t *item = NULL;
 	struct cbor_load_result cbor_result;
@@ -893,10 +936,31 @@ fido_dev_largeblob_set_array(fido_dev_t *dev, const unsigned char *cbor_ptr,
 		fido_log_debug("%s: cbor_load", __func__);
 		return FIDO_ERR_INVALID_ARGUMENT;
 	}
-	if ((r = largeblob_set_array(dev, item, pin, &ms)) != FIDO_OK)
+	if ((r = largeblob_set_array(dev, item, pin, token, &ms)) != FIDO_OK)
 		fido_log_debug("%s: largeblob_set_array", __func__);
 
 	cbor_decref(&item);
 
 	return r;
 }
+
+int
+fido_dev_largeblob_set_array(fido_dev_t *dev, const unsigned char *cbor_ptr,
+    size_t cbor_len, const char *pin)
+{
+	return largeblob_load_set_array(dev, cbor_ptr, cbor_len, pin, NULL);
+}
+
+int
+fido_dev_largeblob_set_array_with_token(fido_dev_t *dev,
+    const unsigned char *cbor_ptr, size_t cbor_len,
+    const fido_uv_token_t *token)
+{
+	const fido_blob_t *t;
+
+	if ((t = fido_uv_token_blob(dev, token,
+	    FIDO_UV_TOKEN_PERM_LARGEBLOB)) == NULL)
+		return FIDO_ERR_INVALID_ARGUMENT;
+
+	return largeblob_load_set_array(dev, cbor_ptr, cbor_len, NULL, t);
+}
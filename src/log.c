@@ -14,16 +14,36 @@
 
 #ifndef FIDO_NO_DIAGNOSTIC
 
-#define XXDLEN	32
 #define XXDROW	128
 #define LINELEN	256
+#define RINGLEN	128
 
 #ifndef TLS
 #define TLS
 #endif
 
+/*
+ * The flight recorder: a per-thread ring of the last RINGLEN CTAPHID
+ * reports and i/o errors, recorded whether or not logging is enabled and
+ * only formatted by fido_log_dump(). Only the header of a report is kept;
+ * payloads may hold PINs, tokens and credential data.
+ */
+struct record {
+	struct timespec	 ts;    /* when it was recorded */
+	const char	*site;  /* FIDO_LOG_ERR: function */
+	int		 code;  /* FIDO_LOG_ERR: FIDO_ERR_* */
+	int		 type;  /* FIDO_LOG_{TX,RX,ERR} */
+	size_t		 len;   /* bytes in the report */
+	unsigned char	 hdr[CTAP_INIT_HEADER_LEN];
+};
+
+static const char hexdigit[] = "0123456789abcdef";
+
 static TLS int logging;
 static TLS fido_log_handler_t *log_handler;
+static TLS int dump_on_error;
+static TLS struct record ring[RINGLEN];
+static TLS size_t ring_len; /* records made since the last dump */
 
 static void
 log_on_stderr(const char *str)
@@ -53,6 +73,21 @@ fido_log_init(void)
 	log_handler = log_on_stderr;
 }
 
+/* Whether this thread's debug output goes anywhere. */
+bool
+fido_log_enabled(void)
+{
+	return (logging && log_handler != NULL);
+}
+
+/* Passes a line formatted on another thread to this thread's handler. */
+void
+fido_log_line(const char *line)
+{
+	if (logging && log_handler != NULL)
+		log_handler(line);
+}
+
 void
 fido_log_debug(const char *fmt, ...)
 {
@@ -66,12 +101,29 @@ fido_log_debug(const char *fmt, ...)
 	va_end(args);
 }
 
+static size_t
+hex(char *dst, const uint8_t *ptr, size_t count, bool space)
+{
+	size_t n = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		if (space)
+			dst[n++] = ' ';
+		dst[n++] = hexdigit[ptr[i] >> 4];
+		dst[n++] = hexdigit[ptr[i] & 0xf];
+	}
+	dst[n] = '\0';
+
+	return (n);
+}
+
 void
 fido_log_xxd(const void *buf, size_t count, const char *fmt, ...)
 {
 	const uint8_t *ptr = buf;
-	char row[XXDROW], xxd[XXDLEN];
+	char row[XXDROW];
 	va_list args;
+	int n;
 
 	if (!logging || log_handler == NULL)
 		return;
@@ -80,19 +132,13 @@ fido_log_xxd(const void *buf, size_t count, const char *fmt, ...)
 	va_start(args, fmt);
 	do_log(row, fmt, args);
 	va_end(args);
-	*row = '\0';
 
-	for (size_t i = 0; i < count; i++) {
-		*xxd = '\0';
-		if (i % 16 == 0)
-			snprintf(xxd, sizeof(xxd), "%04zu: %02x", i, *ptr++);
-		else
-			snprintf(xxd, sizeof(xxd), " %02x", *ptr++);
-		strlcat(row, xxd, sizeof(row));
-		if (i % 16 == 15 || i == count - 1) {
-			fido_log_debug("%s", row);
-			*row = '\0';
-		}
+	for (size_t i = 0; i < count; i += 16) {
+		if ((n = snprintf(row, sizeof(row), "%04zu:", i)) < 0 ||
+		    (size_t)n >= sizeof(row) - 16 * 3)
+			return;
+		hex(row + n, ptr + i, count - i < 16 ? count - i : 16, true);
+		fido_log_debug("%s", row);
 	}
 }
 
@@ -119,4 +165,111 @@ fido_set_log_handler(fido_log_handler_t *handler)
 		log_handler = handler;
 }
 
+void
+fido_log_dump_on_error(int enable)
+{
+	dump_on_error = enable;
+}
+
+static struct record *
+record_new(int type)
+{
+	struct record *r = &ring[ring_len++ % RINGLEN];
+
+	if (fido_time_now(&r->ts) != 0)
+		memset(&r->ts, 0, sizeof(r->ts));
+	r->type = type;
+
+	return (r);
+}
+
+void
+fido_log_frame(int type, const void *frame, size_t len)
+{
+	struct record *r = record_new(type);
+
+	r->len = len;
+	memset(r->hdr, 0, sizeof(r->hdr));
+	memcpy(r->hdr, frame, len < sizeof(r->hdr) ? len : sizeof(r->hdr));
+}
+
+void
+fido_log_fail(const char *site, int code)
+{
+	struct record *r = record_new(FIDO_LOG_ERR);
+
+	r->site = site;
+	r->code = code;
+
+	if (dump_on_error)
+		fido_log_dump();
+}
+
+static void
+format_record(const struct record *r, const struct timespec *t0,
+    char *line, size_t size)
+{
+	struct timespec	 d;
+	const uint8_t	*p = r->hdr;
+	char		 data[2 * CTAP_INIT_HEADER_LEN + 1];
+
+	if (timespeccmp(&r->ts, t0, <))
+		memset(&d, 0, sizeof(d));
+	else
+		timespecsub(&r->ts, t0, &d);
+
+	if (r->type == FIDO_LOG_ERR) {
+		snprintf(line, size, "+%lld.%06lds error %s: %s\n",
+		    (long long)d.tv_sec, (long)d.tv_nsec / 1000, r->site,
+		    fido_strerr(r->code));
+		return;
+	}
+	if (r->len < CTAP_INIT_HEADER_LEN) {
+		hex(data, p, r->len, false);
+		snprintf(line, size, "+%lld.%06lds %s %s\n",
+		    (long long)d.tv_sec, (long)d.tv_nsec / 1000,
+		    r->type == FIDO_LOG_TX ? "tx" : "rx", data);
+		return;
+	}
+	if (p[4] & CTAP_FRAME_INIT)
+		snprintf(line, size, "+%lld.%06lds %s cid=%02x%02x%02x%02x "
+		    "cmd=0x%02x bcnt=%d len=%zu\n", (long long)d.tv_sec,
+		    (long)d.tv_nsec / 1000, r->type == FIDO_LOG_TX ? "tx" : "rx",
+		    p[0], p[1], p[2], p[3], p[4] & ~CTAP_FRAME_INIT,
+		    (p[5] << 8) | p[6], r->len);
+	else
+		snprintf(line, size, "+%lld.%06lds %s cid=%02x%02x%02x%02x "
+		    "seq=%d len=%zu\n", (long long)d.tv_sec,
+		    (long)d.tv_nsec / 1000, r->type == FIDO_LOG_TX ? "tx" : "rx",
+		    p[0], p[1], p[2], p[3], p[4], r->len);
+}
+
+void
+fido_log_dump(void)
+{
+	fido_log_handler_t	*handler;
+	const struct record	*r;
+	size_t			 first, n;
+	char			 line[LINELEN];
+
+	if ((handler = log_handler) == NULL)
+		goto out; /* nowhere to go */
+
+	n = ring_len < RINGLEN ? ring_len : RINGLEN;
+	first = ring_len - n;
+
+	snprintf(line, sizeof(line), "flight recorder: %zu of %zu records\n",
+	    n, ring_len);
+	handler(line);
+
+	for (size_t i = 0; i < n; i++) {
+		r = &ring[(first + i) % RINGLEN];
+		format_record(r, &ring[first % RINGLEN].ts, line, sizeof(line));
+		handler(line);
+	}
+out:
+	explicit_bzero(ring, sizeof(ring));
+	ring_len = 0;
+}
+
 #endif /* !FIDO_NO_DIAGNOSTIC */
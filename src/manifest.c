@@ -0,0 +1,433 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "fido.h"
+
+#ifndef TLS
+#define TLS
+#endif
+
+/*
+ * Device discovery. HID devices are enumerated on the calling thread;
+ * where POSIX threads are available, the other backends run on detached
+ * threads of their own at the same time, each into a private list that is
+ * copied into the caller's in backend order once it is complete. Each
+ * backend has at most one job at a time: a call that finds one running
+ * waits for it and shares its results. A call that misses its deadline
+ * abandons the jobs it still waits for; they finish on their own, and
+ * until then later calls skip their backends. Debug output of a backend
+ * thread is buffered and passed to the caller's log handler with its
+ * results.
+ */
+
+#define LOGLEN	8192
+
+typedef int manifest_t(fido_dev_info_t *, size_t, size_t *);
+
+static const struct backend {
+	const char	*type;
+	manifest_t	*manifest;
+} backends[] = {
+	{ "hid", fido_hid_manifest },
+#ifdef USE_NFC
+	{ "nfc", fido_nfc_manifest },
+#endif
+#ifdef USE_PCSC
+	{ "pcsc", fido_pcsc_manifest },
+#endif
+#ifdef USE_WINHELLO
+	{ "winhello", fido_winhello_manifest },
+#endif
+};
+
+static void
+log_found(const char *type, size_t ndevs, int r)
+{
+	if (r != FIDO_OK)
+		fido_log_debug("%s: %s: 0x%x", __func__, type, r);
+	fido_log_debug("%s: found %zu %s device%s", __func__, ndevs, type,
+	    ndevs == 1 ? "" : "s");
+}
+
+static void
+run_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen,
+    const char *type, manifest_t *manifest)
+{
+	size_t ndevs = 0;
+	int r;
+
+	if (*olen >= ilen) {
+		fido_log_debug("%s: skipping %s", __func__, type);
+		return;
+	}
+	r = manifest(devlist + *olen, ilen - *olen, &ndevs);
+	log_found(type, ndevs, r);
+	*olen += ndevs;
+}
+
+static int
+run_hid(fido_dev_registry_t *reg, fido_dev_info_t *devlist, size_t ilen,
+    size_t *olen)
+{
+	int r;
+
+	if (reg == NULL) {
+		run_manifest(devlist, ilen, olen, "hid", fido_hid_manifest);
+		return (FIDO_OK);
+	}
+
+	if ((r = fido_dev_registry_update(reg)) != FIDO_OK ||
+	    (r = fido_dev_registry_copy(reg, devlist, ilen, olen)) != FIDO_OK) {
+		fido_log_debug("%s: registry: 0x%x", __func__, r);
+		return (r);
+	}
+	log_found("hid", *olen, FIDO_OK);
+
+	return (FIDO_OK);
+}
+
+static bool
+expired(const struct timespec *deadline)
+{
+	struct timespec ts_now;
+
+	if (deadline == NULL || fido_time_now(&ts_now) != 0)
+		return (false);
+
+	return (timespeccmp(&ts_now, deadline, >=));
+}
+
+/* One backend after another, skipping those due after the deadline. */
+static int
+run_serial(fido_dev_registry_t *reg, fido_dev_info_t *devlist, size_t ilen,
+    size_t *olen, const struct timespec *deadline)
+{
+	int r;
+
+	if ((r = run_hid(reg, devlist, ilen, olen)) != FIDO_OK)
+		return (r);
+
+	for (size_t i = 1; i < nitems(backends); i++) {
+		if (expired(deadline)) {
+			fido_log_debug("%s: %s: deadline", __func__,
+			    backends[i].type);
+			continue;
+		}
+		run_manifest(devlist, ilen, olen, backends[i].type,
+		    backends[i].manifest);
+	}
+
+	return (FIDO_OK);
+}
+
+#ifdef HAVE_PTHREAD
+/*
+ * A backend's job. The thread running it and each call waiting for its
+ * results hold a reference.
+ */
+struct job {
+	size_t			 idx; /* into backends[] */
+	const struct backend	*backend;
+	fido_dev_info_t		*devlist;
+	size_t			 ilen;
+	size_t			 olen;
+	int			 r;
+	int			 refs;
+	bool			 done;
+	bool			 abandoned; /* a call gave up waiting */
+	bool			 logging;
+	char			 log[LOGLEN];
+};
+
+static pthread_mutex_t job_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
+static struct job *job_running[nitems(backends)];
+static TLS struct job *log_job;
+
+static void
+job_log(const char *str)
+{
+	strlcat(log_job->log, str, sizeof(log_job->log));
+}
+
+static struct job *
+job_new(size_t idx, size_t ilen)
+{
+	struct job *job;
+
+	if ((job = calloc(1, sizeof(*job))) == NULL)
+		return (NULL);
+	if ((job->devlist = fido_dev_info_new(ilen)) == NULL) {
+		free(job);
+		return (NULL);
+	}
+
+	job->idx = idx;
+	job->backend = &backends[idx];
+	job->ilen = ilen;
+	job->logging = fido_log_enabled();
+
+	return (job);
+}
+
+/* Called with job_mtx held. */
+static void
+job_unref(struct job *job)
+{
+	if (--job->refs == 0) {
+		fido_dev_info_free(&job->devlist, job->ilen);
+		free(job);
+	}
+}
+
+static void
+job_run(struct job *job)
+{
+	size_t olen = 0;
+	int r;
+
+	r = job->backend->manifest(job->devlist, job->ilen, &olen);
+
+	pthread_mutex_lock(&job_mtx);
+	job->olen = olen;
+	job->r = r;
+	job->done = true;
+	if (job_running[job->idx] == job)
+		job_running[job->idx] = NULL;
+	pthread_cond_broadcast(&job_cond);
+	job_unref(job); /* job may be gone */
+	pthread_mutex_unlock(&job_mtx);
+}
+
+static void *
+job_thread(void *arg)
+{
+	struct job *job = arg;
+
+	if (job->logging) {
+		log_job = job;
+		fido_log_init();
+		fido_set_log_handler(job_log);
+	}
+
+	job_run(job);
+
+	return (NULL);
+}
+
+/* Detached, so that a backend stuck in a call doesn't hold up exit(). */
+static int
+job_start(struct job *job)
+{
+	pthread_attr_t	attr;
+	pthread_t	thread;
+	int		ok = -1;
+
+	if (pthread_attr_init(&attr) != 0)
+		return (-1);
+	if (pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED) == 0 &&
+	    pthread_create(&thread, &attr, job_thread, job) == 0)
+		ok = 0;
+	pthread_attr_destroy(&attr);
+
+	return (ok);
+}
+
+/*
+ * A reference to the job for backends[idx]: the one already running, or
+ * a new one. *jobp is NULL if the running job was abandoned by a call
+ * that gave up on it; the backend is then skipped until it finishes.
+ */
+static int
+job_get(size_t idx, size_t ilen, struct job **jobp)
+{
+	struct job	*job;
+	bool		 start = false;
+	int		 r = FIDO_OK;
+
+	pthread_mutex_lock(&job_mtx);
+	if ((job = job_running[idx]) != NULL) {
+		if (job->abandoned)
+			job = NULL;
+		else
+			job->refs++;
+	} else if ((job = job_new(idx, ilen)) != NULL) {
+		job->refs = 2; /* the caller and the runner */
+		job_running[idx] = job;
+		start = true;
+	} else
+		r = FIDO_ERR_INTERNAL;
+	pthread_mutex_unlock(&job_mtx);
+
+	if (r != FIDO_OK)
+		fido_log_debug("%s: %s: job_new", __func__, backends[idx].type);
+	else if (job == NULL)
+		fido_log_debug("%s: %s: abandoned", __func__,
+		    backends[idx].type);
+	else if (start && job_start(job) < 0) {
+		fido_log_debug("%s: %s: job_start", __func__,
+		    backends[idx].type);
+		job_run(job); /* here, then */
+	}
+
+	*jobp = job;
+
+	return (r);
+}
+
+/* Copies the devices found by job to the end of devlist. */
+static void
+job_merge(const struct job *job, fido_dev_info_t *devlist, size_t ilen,
+    size_t *olen)
+{
+	const fido_dev_info_t	*di;
+	char			 log[LOGLEN], *line, *next;
+
+	strlcpy(log, job->log, sizeof(log));
+	for (line = log; *line != '\0'; line = next) {
+		char c;
+
+		if ((next = strchr(line, '\n')) == NULL)
+			next = line + strlen(line);
+		else
+			next++;
+		c = *next;
+		*next = '\0';
+		fido_log_line(line);
+		*next = c;
+	}
+
+	if (*olen >= ilen) {
+		fido_log_debug("%s: skipping %s", __func__, job->backend->type);
+		return;
+	}
+
+	log_found(job->backend->type, job->olen, job->r);
+
+	for (size_t i = 0; i < job->olen && *olen < ilen; i++) {
+		di = &job->devlist[i];
+		if (fido_dev_info_set(devlist, *olen, di->path,
+		    di->manufacturer, di->product, &di->io,
+		    &di->transport) != FIDO_OK) {
+			fido_log_debug("%s: fido_dev_info_set", __func__);
+			return;
+		}
+		devlist[*olen].vendor_id = di->vendor_id;
+		devlist[*olen].product_id = di->product_id;
+		(*olen)++;
+	}
+}
+
+static int
+wait_done(const struct timespec *deadline)
+{
+	struct timespec ts_now, ts_left, ts_abs;
+
+	if (deadline == NULL)
+		return (pthread_cond_wait(&job_cond, &job_mtx));
+
+	/* pthread_cond_timedwait() wants CLOCK_REALTIME */
+	if (fido_time_now(&ts_now) != 0 ||
+	    timespeccmp(&ts_now, deadline, >=) ||
+	    clock_gettime(CLOCK_REALTIME, &ts_abs) != 0)
+		return (-1);
+
+	timespecsub(deadline, &ts_now, &ts_left);
+	timespecadd(&ts_abs, &ts_left, &ts_abs);
+
+	return (pthread_cond_timedwait(&job_cond, &job_mtx, &ts_abs));
+}
+
+/* Called with job_mtx held. */
+static bool
+all_done(struct job * const *job, size_t njobs)
+{
+	for (size_t i = 0; i < njobs; i++)
+		if (!job[i]->done)
+			return (false);
+
+	return (true);
+}
+
+static int
+run_parallel(fido_dev_registry_t *reg, fido_dev_info_t *devlist,
+    size_t ilen, size_t *olen, const struct timespec *deadline)
+{
+	struct job	*job[nitems(backends)];
+	bool		 done[nitems(backends)];
+	size_t		 njobs = 0;
+	int		 r;
+
+	for (size_t i = 1; i < nitems(backends); i++) {
+		if ((r = job_get(i, ilen, &job[njobs])) != FIDO_OK)
+			goto out;
+		if (job[njobs] != NULL)
+			njobs++;
+	}
+
+	r = run_hid(reg, devlist, ilen, olen);
+
+	pthread_mutex_lock(&job_mtx);
+	while (!all_done(job, njobs))
+		if (wait_done(deadline) != 0 && expired(deadline))
+			break;
+	for (size_t i = 0; i < njobs; i++)
+		if ((done[i] = job[i]->done) == false)
+			job[i]->abandoned = true;
+	pthread_mutex_unlock(&job_mtx);
+
+	/* a job that is done doesn't change */
+	for (size_t i = 0; i < njobs; i++) {
+		if (done[i])
+			job_merge(job[i], devlist, ilen, olen);
+		else
+			fido_log_debug("%s: %s: deadline", __func__,
+			    job[i]->backend->type);
+	}
+out:
+	pthread_mutex_lock(&job_mtx);
+	for (size_t i = 0; i < njobs; i++)
+		job_unref(job[i]);
+	pthread_mutex_unlock(&job_mtx);
+
+	return (r);
+}
+#endif /* HAVE_PTHREAD */
+
+/*
+ * Fills devlist from every backend. ms bounds the wait for backends other
+ * than HID, or -1. If reg is not NULL, HID devices are copied from it.
+ */
+int
+fido_dev_manifest(fido_dev_registry_t *reg, fido_dev_info_t *devlist,
+    size_t ilen, size_t *olen, int ms)
+{
+	struct timespec	 ts_deadline, ts_ms;
+	struct timespec	*deadline = NULL;
+
+	*olen = 0;
+
+	if (ms >= 0) {
+		if (fido_time_now(&ts_deadline) != 0)
+			return (FIDO_ERR_INTERNAL);
+		ts_ms.tv_sec = ms / 1000;
+		ts_ms.tv_nsec = (ms % 1000) * 1000000L;
+		timespecadd(&ts_deadline, &ts_ms, &ts_deadline);
+		deadline = &ts_deadline;
+	}
+
+#ifdef HAVE_PTHREAD
+	if (nitems(backends) > 1 && ilen > 0)
+		return (run_parallel(reg, devlist, ilen, olen, deadline));
+#endif
+
+	return (run_serial(reg, devlist, ilen, olen, deadline));
+}
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "fido.h"
+
+/*
+ * Devices opened with fido_dev_open_channel() share the I/O handle of the
+ * device they were opened from, each on its own CTAPHID channel. A frame
+ * read by one of them that belongs to another is queued for the latter
+ * instead of being discarded. INIT replies on the broadcast channel are
+ * told apart by their nonce. The mux lives until the last device sharing
+ * the handle, usually the one the others were opened from, lets go of it.
+ *
+ * Where POSIX threads are available, the channels may be used from
+ * different threads. One channel at a time reads from the handle, without
+ * holding the lock; the others wait for it to queue a frame for them, or
+ * to stop reading, and then take over. The lock over queues and readers
+ * is shared by all muxes and never held across i/o; dev->mux is only
+ * read or changed under it. Messages are written whole, one channel at a
+ * time, under a lock of the mux's own.
+ */
+
+#define FIDO_MUX_MAXFRAMES	256
+
+struct fido_dev_mux {
+	struct fido_dev	**dev;    /* devices sharing an i/o handle */
+	size_t		  len;    /* number of devices */
+	bool		  reading; /* a device is reading from the handle */
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t	  tx_mtx; /* held while a message is written */
+#endif
+};
+
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t mux_mtx = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mux_cond = PTHREAD_COND_INITIALIZER;
+#endif
+
+static void
+mux_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&mux_mtx);
+#endif
+}
+
+static void
+mux_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&mux_mtx);
+#endif
+}
+
+static void
+mux_signal(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_cond_broadcast(&mux_cond);
+#endif
+}
+
+/* Waits for another channel to queue a frame or stop reading, up to ms. */
+static int
+mux_wait(int *ms)
+{
+#ifdef HAVE_PTHREAD
+	struct timespec ts_start, ts_abs, ts_left;
+
+	if (*ms < 0)
+		return (pthread_cond_wait(&mux_cond, &mux_mtx));
+	if (*ms == 0 || fido_time_now(&ts_start) != 0 ||
+	    clock_gettime(CLOCK_REALTIME, &ts_abs) != 0)
+		return (-1);
+
+	ts_left.tv_sec = *ms / 1000;
+	ts_left.tv_nsec = (*ms % 1000) * 1000000;
+	timespecadd(&ts_abs, &ts_left, &ts_abs);
+
+	if (pthread_cond_timedwait(&mux_cond, &mux_mtx, &ts_abs) != 0 ||
+	    fido_time_delta(&ts_start, ms) != 0)
+		return (-1);
+
+	return (0);
+#else
+	(void)ms;
+
+	return (-1); /* nobody else to read */
+#endif
+}
+
+static void
+mux_unlink(fido_dev_mux_t *mux, const fido_dev_t *dev)
+{
+	for (size_t i = 0; i < mux->len; i++)
+		if (mux->dev[i] == dev) {
+			memmove(&mux->dev[i], &mux->dev[i + 1],
+			    (mux->len - i - 1) * sizeof(*mux->dev));
+			mux->dev[--mux->len] = NULL;
+			return;
+		}
+}
+
+static fido_dev_mux_t *
+mux_new(fido_dev_t *parent)
+{
+	fido_dev_mux_t *mux;
+
+	if ((mux = calloc(1, sizeof(*mux))) == NULL ||
+	    (mux->dev = calloc(1, sizeof(*mux->dev))) == NULL) {
+		fido_log_debug("%s: calloc", __func__);
+		free(mux);
+		return (NULL);
+	}
+#ifdef HAVE_PTHREAD
+	if (pthread_mutex_init(&mux->tx_mtx, NULL) != 0) {
+		fido_log_debug("%s: pthread_mutex_init", __func__);
+		free(mux->dev);
+		free(mux);
+		return (NULL);
+	}
+#endif
+	mux->dev[mux->len++] = parent;
+
+	return (mux);
+}
+
+static void
+mux_free(fido_dev_mux_t *mux)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&mux->tx_mtx);
+#endif
+	free(mux->dev);
+	free(mux);
+}
+
+int
+fido_dev_mux_add(fido_dev_t *parent, fido_dev_t *dev)
+{
+	fido_dev_mux_t	*mux;
+	fido_dev_t	**p;
+	int		  ok = -1;
+
+	mux_lock();
+
+	if ((mux = parent->mux) == NULL) {
+		if ((mux = mux_new(parent)) == NULL)
+			goto out;
+		parent->mux = mux;
+	}
+
+	if ((p = recallocarray(mux->dev, mux->len, mux->len + 1,
+	    sizeof(*p))) == NULL) {
+		fido_log_debug("%s: recallocarray", __func__);
+		goto out;
+	}
+
+	mux->dev = p;
+	mux->dev[mux->len++] = dev;
+	dev->mux = mux;
+
+	ok = 0;
+out:
+	mux_unlock();
+
+	return (ok);
+}
+
+static void
+mux_detach(fido_dev_t *dev)
+{
+	freezero(dev->mux_q, dev->mux_q_len * dev->rx_len);
+	dev->mux_q = NULL;
+	dev->mux_q_len = 0;
+	dev->mux = NULL;
+}
+
+/*
+ * Detach dev. The others keep the mux, even if only one is left, so that
+ * a write in progress on it never sees the mux go away.
+ */
+void
+fido_dev_mux_del(fido_dev_t *dev)
+{
+	fido_dev_mux_t *mux;
+
+	mux_lock();
+
+	if ((mux = dev->mux) == NULL)
+		goto out;
+
+	mux_unlink(mux, dev);
+	mux_detach(dev);
+
+	if (mux->len == 0)
+		mux_free(mux);
+out:
+	mux_unlock();
+}
+
+bool
+fido_dev_mux_busy(const fido_dev_t *dev)
+{
+	bool busy;
+
+	mux_lock();
+	busy = dev->mux != NULL && dev->mux_chan == false &&
+	    dev->mux->len > 1;
+	mux_unlock();
+
+	return (busy);
+}
+
+/* Whether frames routed to dev are waiting to be read. */
+bool
+fido_dev_mux_queued(const fido_dev_t *dev)
+{
+	bool queued;
+
+	mux_lock();
+	queued = dev->mux != NULL && dev->mux_q_len > 0;
+	mux_unlock();
+
+	return (queued);
+}
+
+/* Whether frame is the INIT reply to d's nonce. */
+static bool
+mux_init_for(const fido_dev_t *d, const unsigned char *frame, size_t len)
+{
+	const size_t off = sizeof(uint32_t) + 3; /* cid, cmd, bcnt */
+
+	return (d->cid == CTAP_CID_BROADCAST && len >= off + sizeof(d->nonce) &&
+	    frame[sizeof(uint32_t)] == (CTAP_FRAME_INIT | CTAP_CMD_INIT) &&
+	    memcmp(frame + off, &d->nonce, sizeof(d->nonce)) == 0);
+}
+
+/* Whether the sibling d is the owner of a frame on channel cid. */
+static bool
+mux_owner(const fido_dev_t *d, uint32_t cid, const unsigned char *frame,
+    size_t len)
+{
+	if (d->cid != cid)
+		return (false);
+	if (cid == CTAP_CID_BROADCAST)
+		return (mux_init_for(d, frame, len));
+
+	return (true);
+}
+
+/*
+ * Queue a frame read by dev for the sibling it belongs to, if any. Called
+ * with the mux lock held.
+ */
+static bool
+mux_route(const fido_dev_t *dev, const unsigned char *frame, size_t len)
+{
+	fido_dev_mux_t	*mux = dev->mux;
+	fido_dev_t	*d;
+	unsigned char	*q;
+	uint32_t	 cid;
+
+	if (mux == NULL || len < sizeof(cid))
+		return (false);
+
+	memcpy(&cid, frame, sizeof(cid));
+	if (cid == dev->cid && (cid != CTAP_CID_BROADCAST ||
+	    mux_init_for(dev, frame, len)))
+		return (false);
+
+	for (size_t i = 0; i < mux->len; i++) {
+		if ((d = mux->dev[i]) == dev || !mux_owner(d, cid, frame, len))
+			continue;
+		if (d->mux_q_len == FIDO_MUX_MAXFRAMES || d->rx_len != len) {
+			fido_log_debug("%s: cid=0x%x, dropping frame",
+			    __func__, cid);
+			return (true);
+		}
+		if ((q = recallocarray(d->mux_q, d->mux_q_len * len,
+		    (d->mux_q_len + 1) * len, 1)) == NULL) {
+			fido_log_debug("%s: recallocarray", __func__);
+			return (true);
+		}
+		memcpy(q + d->mux_q_len * len, frame, len);
+		d->mux_q = q;
+		d->mux_q_len++;
+		return (true);
+	}
+
+	return (false);
+}
+
+/* Dequeue the oldest frame routed to dev. */
+static int
+mux_pop(fido_dev_t *dev, unsigned char *frame, size_t len)
+{
+	if (dev->mux_q_len == 0 || dev->rx_len != len)
+		return (-1);
+
+	memcpy(frame, dev->mux_q, len);
+	memmove(dev->mux_q, dev->mux_q + len, --dev->mux_q_len * len);
+	explicit_bzero(dev->mux_q + dev->mux_q_len * len, len);
+
+	return (0);
+}
+
+/*
+ * Read the next frame for dev, either one queued for it by a sibling or
+ * one read from the shared handle with rx(), which updates *ms. While
+ * another channel reads, wait for it instead. Also used for devices that
+ * don't share their handle, which rx() is then simply called for.
+ */
+int
+fido_dev_mux_rx(fido_dev_t *dev, unsigned char *frame, size_t len, int *ms,
+    fido_dev_mux_read_t *rx)
+{
+	int r = -1;
+
+	mux_lock();
+
+	for (;;) {
+		if (mux_pop(dev, frame, len) == 0) {
+			r = 0;
+			break;
+		}
+		if (dev->mux != NULL && dev->mux->reading) {
+			if (mux_wait(ms) < 0)
+				break;
+			continue;
+		}
+		if (dev->mux != NULL)
+			dev->mux->reading = true;
+		mux_unlock();
+		r = rx(dev, frame, len, ms);
+		mux_lock();
+		if (dev->mux != NULL)
+			dev->mux->reading = false;
+		mux_signal();
+		if (r < 0 || !mux_route(dev, frame, len))
+			break;
+		r = -1;
+	}
+
+	mux_unlock();
+
+	return (r);
+}
+
+/*
+ * Take the right to write a message on dev's handle; NULL if unshared. The
+ * mux outlives the write, since only dev itself can let go of it.
+ */
+fido_dev_mux_t *
+fido_dev_mux_tx_lock(const fido_dev_t *dev)
+{
+	fido_dev_mux_t *mux;
+
+	mux_lock();
+	mux = dev->mux;
+	mux_unlock();
+
+#ifdef HAVE_PTHREAD
+	if (mux != NULL)
+		pthread_mutex_lock(&mux->tx_mtx);
+#endif
+
+	return (mux);
+}
+
+void
+fido_dev_mux_tx_unlock(fido_dev_mux_t *mux)
+{
+#ifdef HAVE_PTHREAD
+	if (mux != NULL)
+		pthread_mutex_unlock(&mux->tx_mtx);
+#else
+	(void)mux;
+#endif
+}
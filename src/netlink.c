@@ -363,7 +363,7 @@ nlmsg_rx(int fd, unsigned char *ptr, size_t len, int ms)
 		fido_log_debug("%s: len", __func__);
 		return (-1);
 	}
-	if (fido_hid_unix_wait(fd, ms, NULL) < 0) {
+	if (fido_hid_unix_wait(fd, -1, ms, NULL) < 0) {
 		fido_log_debug("%s: fido_hid_unix_wait", __func__);
 		return (-1);
 	}
@@ -590,8 +590,8 @@ fido_nl_power_nfc(fido_nl_t *nl, uint32_t dev)
 	return (0);
 }
 
-static int
-nl_nfc_poll(fido_nl_t *nl, uint32_t dev)
+int
+fido_nl_nfc_poll(fido_nl_t *nl, uint32_t dev)
 {
 	nlmsgbuf_t *m;
 	uint8_t reply[512];
@@ -620,8 +620,8 @@ nl_nfc_poll(fido_nl_t *nl, uint32_t dev)
 	return (0);
 }
 
-static int
-nl_dump_nfc_target(fido_nl_t *nl, uint32_t dev, uint32_t *target, int ms)
+int
+fido_nl_dump_nfc_target(fido_nl_t *nl, uint32_t dev, uint32_t *target, int ms)
 {
 	nlmsgbuf_t *m;
 	nl_target_t t;
@@ -686,8 +686,8 @@ fido_nl_get_nfc_target(fido_nl_t *nl, uint32_t dev, uint32_t *target)
 	ssize_t r;
 	int ok;
 
-	if (nl_nfc_poll(nl, dev) < 0) {
-		fido_log_debug("%s: nl_nfc_poll", __func__);
+	if (fido_nl_nfc_poll(nl, dev) < 0) {
+		fido_log_debug("%s: fido_nl_nfc_poll", __func__);
 		return (-1);
 	}
 #ifndef FIDO_FUZZ
@@ -720,14 +720,81 @@ fido_nl_get_nfc_target(fido_nl_t *nl, uint32_t dev, uint32_t *target)
 		fido_log_debug("%s: dev 0x%x not observed", __func__, dev);
 		return (-1);
 	}
-	if (nl_dump_nfc_target(nl, dev, target, -1) < 0) {
-		fido_log_debug("%s: nl_dump_nfc_target", __func__);
+	if (fido_nl_dump_nfc_target(nl, dev, target, -1) < 0) {
+		fido_log_debug("%s: fido_nl_dump_nfc_target", __func__);
 		return (-1);
 	}
 
 	return (0);
 }
 
+int
+fido_nl_nfc_subscribe(fido_nl_t *nl)
+{
+#ifndef FIDO_FUZZ
+	if (setsockopt(nl->fd, SOL_NETLINK, NETLINK_ADD_MEMBERSHIP,
+	    &nl->nfc_mcastgrp, sizeof(nl->nfc_mcastgrp)) == -1) {
+		fido_log_error(errno, "%s: setsockopt add", __func__);
+		return (-1);
+	}
+#endif
+
+	return (0);
+}
+
+/*
+ * Reads one datagram from a subscribed socket. On return, *event is the
+ * last NFC_EVENT_TARGETS_FOUND or NFC_EVENT_TARGET_LOST seen for dev in
+ * it, or zero.
+ */
+int
+fido_nl_get_nfc_event(fido_nl_t *nl, uint32_t dev, uint8_t *event)
+{
+	const uint8_t *ptr;
+	uint8_t reply[512];
+	nlmsgbuf_t *m;
+	genlmsgbuf_t g;
+	nl_poll_t ctx;
+	size_t len;
+	ssize_t r;
+
+	*event = 0;
+
+	if ((r = nlmsg_rx(nl->fd, reply, sizeof(reply), -1)) < 0) {
+		fido_log_debug("%s: nlmsg_rx", __func__);
+		return (-1);
+	}
+	ptr = reply;
+	len = (size_t)r;
+	while (len) {
+		if ((m = nlmsg_from_buf(&ptr, &len)) == NULL) {
+			fido_log_debug("%s: nlmsg", __func__);
+			return (-1);
+		}
+		memset(&g, 0, sizeof(g));
+		if (nlmsg_type(m) != nl->nfc_type ||
+		    nlmsg_read(m, &g, sizeof(g)) < 0 ||
+		    (g.u.genl.cmd != NFC_EVENT_TARGETS_FOUND &&
+		    g.u.genl.cmd != NFC_EVENT_TARGET_LOST)) {
+			fido_log_debug("%s: skipping", __func__);
+			free(m);
+			continue;
+		}
+		memset(&ctx, 0, sizeof(ctx));
+		ctx.dev = dev;
+		if (nlmsg_iter(m, &ctx, parse_nfc_event) < 0) {
+			fido_log_debug("%s: nlmsg_iter", __func__);
+			free(m);
+			return (-1);
+		}
+		if (ctx.eventcnt)
+			*event = g.u.genl.cmd;
+		free(m);
+	}
+
+	return (0);
+}
+
 void
 fido_nl_free(fido_nl_t **nlp)
 {
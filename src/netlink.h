@@ -32,6 +32,10 @@ fido_nl_t *fido_nl_new(void);
 void fido_nl_free(struct fido_nl **);
 int fido_nl_power_nfc(struct fido_nl *, uint32_t);
 int fido_nl_get_nfc_target(struct fido_nl *, uint32_t , uint32_t *);
+int fido_nl_nfc_poll(struct fido_nl *, uint32_t);
+int fido_nl_dump_nfc_target(struct fido_nl *, uint32_t, uint32_t *, int);
+int fido_nl_nfc_subscribe(struct fido_nl *);
+int fido_nl_get_nfc_event(struct fido_nl *, uint32_t, uint8_t *);
 
 #ifdef FIDO_FUZZ
 void set_netlink_io_functions(ssize_t (*)(int, void *, size_t),
@@ -13,6 +13,7 @@
 #include "iso7816.h"
 
 #define TX_CHUNK_SIZE	240
+#define RX_SHORT_LEN	(256 + 2)	/* le=00, and sw */
 
 static const uint8_t aid[] = { 0xa0, 0x00, 0x00, 0x06, 0x47, 0x2f, 0x00, 0x01 };
 static const uint8_t v_u2f[] = { 'U', '2', 'F', '_', 'V', '2' };
@@ -59,11 +60,31 @@ fail:
 	return ok;
 }
 
+/*
+ * An iso7816_apdu_t is already encoded as an extended-length APDU: a
+ * three-byte lc after the header, and a two-byte le of zero asking for as
+ * much as the card has.
+ */
+static int
+tx_extended_apdu(fido_dev_t *d, const uint8_t *apdu_ptr, size_t apdu_len)
+{
+	if (d->io.write(d->io_handle, apdu_ptr, apdu_len) < 0) {
+		fido_log_debug("%s: write", __func__);
+		return -1;
+	}
+
+	return 0;
+}
+
 static int
 nfc_do_tx(fido_dev_t *d, const uint8_t *apdu_ptr, size_t apdu_len)
 {
 	iso7816_header_t h;
 
+	/* lc must not be empty */
+	if (d->apdu_ext && apdu_len > sizeof(h) + 2)
+		return tx_extended_apdu(d, apdu_ptr, apdu_len);
+
 	if (fido_buf_read(&apdu_ptr, &apdu_len, &h, sizeof(h)) < 0) {
 		fido_log_debug("%s: header", __func__);
 		return -1;
@@ -92,6 +113,32 @@ nfc_do_tx(fido_dev_t *d, const uint8_t *apdu_ptr, size_t apdu_len)
 	return 0;
 }
 
+static int
+tx_select(fido_dev_t *d, bool ext)
+{
+	iso7816_apdu_t *apdu;
+	int ok = -1;
+
+	if ((apdu = iso7816_new(0, 0xa4, 0x04, sizeof(aid))) == NULL ||
+	    iso7816_add(apdu, aid, sizeof(aid)) < 0) {
+		fido_log_debug("%s: iso7816", __func__);
+		goto fail;
+	}
+
+	d->apdu_ext = ext;
+
+	if (nfc_do_tx(d, iso7816_ptr(apdu), iso7816_len(apdu)) < 0) {
+		fido_log_debug("%s: nfc_do_tx", __func__);
+		goto fail;
+	}
+
+	ok = 0;
+fail:
+	iso7816_free(&apdu);
+
+	return ok;
+}
+
 int
 fido_nfc_tx(fido_dev_t *d, uint8_t cmd, const unsigned char *buf, size_t count)
 {
@@ -102,12 +149,15 @@ fido_nfc_tx(fido_dev_t *d, uint8_t cmd, const unsigned char *buf, size_t count)
 
 	switch (cmd) {
 	case CTAP_CMD_INIT: /* select */
-		if ((apdu = iso7816_new(0, 0xa4, 0x04, sizeof(aid))) == NULL ||
-		    iso7816_add(apdu, aid, sizeof(aid)) < 0) {
-			fido_log_debug("%s: iso7816", __func__);
-			goto fail;
-		}
-		break;
+		/*
+		 * The applet is selected with an extended-length APDU. If
+		 * the reader refuses it here, or the card in rx_init(),
+		 * short APDUs are used instead.
+		 */
+		if (tx_select(d, true) == 0 || tx_select(d, false) == 0)
+			return 0;
+		fido_log_debug("%s: tx_select", __func__);
+		return -1;
 	case CTAP_CMD_CBOR: /* wrap cbor */
 		if (count > UINT16_MAX || (apdu = iso7816_new(0x80, 0x10, 0x00,
 		    (uint16_t)count)) == NULL ||
@@ -143,6 +193,20 @@ fail:
 	return ok;
 }
 
+static int
+rx_select(fido_dev_t *d, uint8_t *f, size_t len, int ms)
+{
+	int n;
+
+	if ((n = d->io.read(d->io_handle, f, len, ms)) < 2 ||
+	    (f[n - 2] << 8 | f[n - 1]) != SW_NO_ERROR) {
+		fido_log_debug("%s: read", __func__);
+		return -1;
+	}
+
+	return n;
+}
+
 static int
 rx_init(fido_dev_t *d, unsigned char *buf, size_t count, int ms)
 {
@@ -157,12 +221,17 @@ rx_init(fido_dev_t *d, unsigned char *buf, size_t count, int ms)
 
 	memset(attr, 0, sizeof(*attr));
 
-	if ((n = d->io.read(d->io_handle, f, sizeof(f), ms)) < 2 ||
-	    (f[n - 2] << 8 | f[n - 1]) != SW_NO_ERROR) {
-		fido_log_debug("%s: read", __func__);
-		return -1;
+	if ((n = rx_select(d, f, sizeof(f), ms)) < 0) {
+		if (!d->apdu_ext || tx_select(d, false) < 0 ||
+		    (n = rx_select(d, f, sizeof(f), ms)) < 0) {
+			fido_log_debug("%s: rx_select", __func__);
+			return -1;
+		}
 	}
 
+	fido_log_debug("%s: %s apdus", __func__, d->apdu_ext ? "extended" :
+	    "short");
+
 	n -= 2;
 
 	if (n == sizeof(v_u2f) && memcmp(f, v_u2f, sizeof(v_u2f)) == 0)
@@ -203,14 +272,24 @@ tx_get_response(fido_dev_t *d, uint8_t count)
 static int
 rx_apdu(fido_dev_t *d, uint8_t sw[2], unsigned char **buf, size_t *count, int *ms)
 {
-	uint8_t f[256 + 2];
+	uint8_t *f;
+	size_t len = RX_SHORT_LEN;
 	struct timespec ts;
 	int n, ok = -1;
 
+	/* an extended response may fill the rest of buf at once */
+	if (d->apdu_ext && *count > len - 2)
+		len = *count + 2;
+
+	if ((f = malloc(len)) == NULL) {
+		fido_log_debug("%s: malloc", __func__);
+		return -1;
+	}
+
 	if (fido_time_now(&ts) != 0)
 		goto fail;
 
-	if ((n = d->io.read(d->io_handle, f, sizeof(f), *ms)) < 2) {
+	if ((n = d->io.read(d->io_handle, f, len, *ms)) < 2) {
 		fido_log_debug("%s: read", __func__);
 		goto fail;
 	}
@@ -227,7 +306,7 @@ rx_apdu(fido_dev_t *d, uint8_t sw[2], unsigned char **buf, size_t *count, int *m
 
 	ok = 0;
 fail:
-	explicit_bzero(f, sizeof(f));
+	freezero(f, len);
 
 	return ok;
 }
@@ -340,6 +419,9 @@ fido_dev_set_nfc(fido_dev_t *d)
 		fido_nfc_read,
 		fido_nfc_write,
 	};
+	d->io_writev = NULL;
+	d->io_pollfd = NULL;
+	d->io_wakeup = NULL;
 	d->transport = (fido_dev_transport_t) {
 		fido_nfc_rx,
 		fido_nfc_tx,
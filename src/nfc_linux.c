@@ -13,6 +13,9 @@
 
 #include <errno.h>
 #include <libudev.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -23,15 +26,58 @@
 #include "netlink.h"
 #include "iso7816.h"
 
+struct nfc_monitor;
+
 struct nfc_linux {
-	int             fd;
-	uint32_t        dev;
-	uint32_t        target;
-	sigset_t	sigmask;
-	const sigset_t *sigmaskp;
-	struct fido_nl *nl;
+	int                 fd;
+	uint32_t            dev;
+	uint32_t            target;
+	sigset_t	    sigmask;
+	const sigset_t     *sigmaskp;
+	struct fido_nl     *nl;
+	struct nfc_monitor *monitor; /* opened through a reader */
 };
 
+/*
+ * A monitor keeps the netlink session of a fido_nfc_reader_t: the adapter
+ * is powered and polled once, target events arrive on a socket of their
+ * own, and fido_nfc_open() of the reader's path connects to the target
+ * found last. Polling is restarted when the target is lost, or when the
+ * device opened on it is closed. Monitors are listed for fido_nfc_open()
+ * to find; the list's lock also covers each monitor's state and requests.
+ */
+struct nfc_monitor {
+	fido_nfc_reader_t  *reader;
+	uint32_t            dev;
+	uint32_t            target;
+	bool                present;  /* target found and not lost */
+	struct fido_nl     *nl;       /* requests */
+	struct fido_nl     *ev;       /* target events */
+	struct nfc_linux   *ctx;      /* open on target */
+	struct nfc_monitor *next;
+};
+
+static struct nfc_monitor *monitors;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t monitors_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+monitors_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&monitors_mtx);
+#endif
+}
+
+static void
+monitors_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&monitors_mtx);
+#endif
+}
+
 static char *
 get_parent_attr(struct udev_device *dev, const char *subsystem,
     const char *devtype, const char *attr)
@@ -214,6 +260,16 @@ nfc_target_connect(struct nfc_linux *ctx)
 	return 0;
 }
 
+/* Called with the monitor list locked. */
+static void
+monitor_poll(struct nfc_monitor *m)
+{
+	m->present = false;
+
+	if (fido_nl_nfc_poll(m->nl, m->dev) < 0)
+		fido_log_debug("%s: fido_nl_nfc_poll", __func__);
+}
+
 static void
 nfc_free(struct nfc_linux **ctx_p)
 {
@@ -223,6 +279,13 @@ nfc_free(struct nfc_linux **ctx_p)
 		return;
 	if (ctx->fd != -1 && close(ctx->fd) == -1)
 		fido_log_error(errno, "%s: close", __func__);
+	monitors_lock();
+	if (ctx->monitor != NULL) {
+		/* the target was deactivated; look for it again */
+		ctx->monitor->ctx = NULL;
+		monitor_poll(ctx->monitor);
+	}
+	monitors_unlock();
 	if (ctx->nl != NULL)
 		fido_nl_free(&ctx->nl);
 
@@ -247,16 +310,67 @@ nfc_new(uint32_t dev)
 	return ctx;
 }
 
+/* Called with the monitor list locked. */
+static struct nfc_monitor *
+monitor_lookup(const char *path)
+{
+	for (struct nfc_monitor *m = monitors; m != NULL; m = m->next)
+		if (strcmp(m->reader->path, path) == 0)
+			return m;
+
+	return NULL;
+}
+
+/* Called with the monitor list locked. */
+static struct nfc_linux *
+monitor_connect(struct nfc_monitor *m)
+{
+	struct nfc_linux *ctx;
+
+	if (!m->present || m->ctx != NULL) {
+		fido_log_debug("%s: no target", __func__);
+		return NULL;
+	}
+	if ((ctx = calloc(1, sizeof(*ctx))) == NULL)
+		return NULL;
+
+	ctx->fd = -1;
+	ctx->dev = m->dev;
+	ctx->target = m->target;
+
+	if (nfc_target_connect(ctx) < 0) {
+		fido_log_debug("%s: nfc_target_connect", __func__);
+		monitor_poll(m);
+		free(ctx);
+		return NULL;
+	}
+
+	ctx->monitor = m;
+	m->ctx = ctx;
+
+	return ctx;
+}
+
 void *
 fido_nfc_open(const char *path)
 {
 	struct nfc_linux *ctx = NULL;
+	struct nfc_monitor *m;
 	int idx;
 
 	if (strncmp(path, FIDO_NFC_PREFIX, strlen(FIDO_NFC_PREFIX)) != 0) {
 		fido_log_debug("%s: bad prefix", __func__);
 		goto fail;
 	}
+
+	monitors_lock();
+	if ((m = monitor_lookup(path)) != NULL) {
+		ctx = monitor_connect(m);
+		monitors_unlock();
+		return ctx;
+	}
+	monitors_unlock();
+
 	if ((idx = sysnum_from_syspath(path + strlen(FIDO_NFC_PREFIX))) < 0 ||
 	    (ctx = nfc_new((uint32_t)idx)) == NULL) {
 		fido_log_debug("%s: nfc_new", __func__);
@@ -308,7 +422,7 @@ fido_nfc_read(void *handle, unsigned char *buf, size_t len, int ms)
 	iov[1].iov_base = buf;
 	iov[1].iov_len = len;
 
-	if (fido_hid_unix_wait(ctx->fd, ms, ctx->sigmaskp) < 0) {
+	if (fido_hid_unix_wait(ctx->fd, -1, ms, ctx->sigmaskp) < 0) {
 		fido_log_debug("%s: fido_hid_unix_wait", __func__);
 		return -1;
 	}
@@ -354,3 +468,133 @@ fido_nfc_write(void *handle, const unsigned char *buf, size_t len)
 
 	return (int)r;
 }
+
+static void
+monitor_free(struct nfc_monitor *m)
+{
+	fido_nl_free(&m->ev);
+	fido_nl_free(&m->nl); /* the kernel stops polling */
+	free(m);
+}
+
+int
+fido_nfc_monitor_open(fido_nfc_reader_t *reader)
+{
+	struct nfc_monitor *m;
+	const char *path = reader->path;
+	int idx;
+
+	if (strncmp(path, FIDO_NFC_PREFIX, strlen(FIDO_NFC_PREFIX)) != 0 ||
+	    (idx = sysnum_from_syspath(path + strlen(FIDO_NFC_PREFIX))) < 0) {
+		fido_log_debug("%s: %s", __func__, path);
+		return FIDO_ERR_INVALID_ARGUMENT;
+	}
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return FIDO_ERR_INTERNAL;
+
+	m->reader = reader;
+	m->dev = (uint32_t)idx;
+
+	if ((m->nl = fido_nl_new()) == NULL ||
+	    (m->ev = fido_nl_new()) == NULL ||
+	    fido_nl_nfc_subscribe(m->ev) < 0 ||
+	    fido_nl_power_nfc(m->nl, m->dev) < 0 ||
+	    fido_nl_nfc_poll(m->nl, m->dev) < 0) {
+		fido_log_debug("%s: netlink", __func__);
+		monitor_free(m);
+		return FIDO_ERR_INTERNAL;
+	}
+
+	monitors_lock();
+	if (monitor_lookup(path) != NULL) {
+		monitors_unlock();
+		fido_log_debug("%s: %s: already monitored", __func__, path);
+		monitor_free(m);
+		return FIDO_ERR_INVALID_ARGUMENT;
+	}
+	m->next = monitors;
+	monitors = m;
+	monitors_unlock();
+
+	reader->monitor = m;
+
+	return FIDO_OK;
+}
+
+void
+fido_nfc_monitor_close(void *monitor)
+{
+	struct nfc_monitor *m = monitor, **mp;
+
+	if (m == NULL)
+		return;
+
+	monitors_lock();
+	for (mp = &monitors; *mp != NULL; mp = &(*mp)->next)
+		if (*mp == m) {
+			*mp = m->next;
+			break;
+		}
+	if (m->ctx != NULL)
+		m->ctx->monitor = NULL;
+	monitors_unlock();
+
+	monitor_free(m);
+}
+
+int
+fido_nfc_monitor_pollfd(void *monitor)
+{
+	struct nfc_monitor *m = monitor;
+
+	return m->ev->fd;
+}
+
+/*
+ * Called with the monitor list locked. Returns 1 if the target was found,
+ * 0 if it was lost, or -1 if there is nothing to report.
+ */
+static int
+monitor_event(struct nfc_monitor *m, uint8_t event)
+{
+	switch (event) {
+	case NFC_EVENT_TARGETS_FOUND:
+		if (fido_nl_dump_nfc_target(m->nl, m->dev, &m->target,
+		    -1) < 0) {
+			fido_log_debug("%s: fido_nl_dump_nfc_target", __func__);
+			monitor_poll(m);
+			return -1;
+		}
+		m->present = true;
+		return 1;
+	case NFC_EVENT_TARGET_LOST:
+		m->present = false;
+		if (m->ctx == NULL)
+			monitor_poll(m);
+		return 0;
+	}
+
+	return -1;
+}
+
+int
+fido_nfc_monitor_update(fido_nfc_reader_t *reader)
+{
+	struct nfc_monitor *m = reader->monitor;
+	uint8_t event;
+	int found;
+
+	while (fido_hid_unix_wait(m->ev->fd, -1, 0, NULL) == 0) {
+		if (fido_nl_get_nfc_event(m->ev, m->dev, &event) < 0) {
+			fido_log_debug("%s: fido_nl_get_nfc_event", __func__);
+			return FIDO_ERR_RX;
+		}
+		monitors_lock();
+		found = monitor_event(m, event);
+		monitors_unlock();
+		if (found >= 0)
+			fido_nfc_reader_event(reader, found);
+	}
+
+	return FIDO_OK;
+}
@@ -14,6 +14,9 @@
 #endif /* __APPLE__ */
 
 #include <errno.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 #include "fido.h"
 #include "fido/param.h"
@@ -21,7 +24,9 @@
 
 #if defined(_WIN32) && !defined(__MINGW32__)
 #define SCardConnect SCardConnectA
+#define SCardGetStatusChange SCardGetStatusChangeA
 #define SCardListReaders SCardListReadersA
+#define SCARD_READERSTATE SCARD_READERSTATEA
 #endif
 
 #ifndef SCARD_PROTOCOL_Tx
@@ -29,17 +34,119 @@
 #endif
 
 #define BUFSIZE 1024	/* in bytes; passed to SCardListReaders() */
-#define APDULEN 264	/* 261 rounded up to the nearest multiple of 8 */
-#define READERS 8	/* maximum number of readers */
+#define APDULEN 65544	/* 65538 rounded up to the nearest multiple of 8 */
+#define READERS 16	/* maximum number of readers */
+#define PNP_READER "\\\\?PnP?\\Notification"
 
 struct pcsc {
 	SCARDCONTEXT     ctx;
 	SCARDHANDLE      h;
 	SCARD_IO_REQUEST req;
+	LONG             s;	/* last error */
 	uint8_t          rx_buf[APDULEN];
 	size_t           rx_len;
 };
 
+/*
+ * Establishing a context and listing readers cost a round-trip each to the
+ * resource manager, so both are shared. Contexts are handed out one per
+ * user and kept for the next when idle: a manager such as pcsc-lite
+ * serialises the calls made on one context, and a device may wait in
+ * SCardTransmit() for a touch. Reader names are cached and only listed
+ * again after SCardGetStatusChange() reports a reader coming or going.
+ */
+static struct {
+	SCARDCONTEXT idle[READERS];	/* contexts kept for reuse */
+	size_t       nidle;
+	char        *readers;		/* multi-string, or NULL */
+	DWORD        pnp_state;		/* of PNP_READER when listed */
+} shared;
+#ifdef HAVE_PTHREAD
+static pthread_mutex_t shared_mtx = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void
+shared_lock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&shared_mtx);
+#endif
+}
+
+static void
+shared_unlock(void)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&shared_mtx);
+#endif
+}
+
+/* Whether s means the context is no longer known to the manager. */
+static bool
+ctx_stale(LONG s)
+{
+	return s == (LONG)SCARD_E_NO_SERVICE ||
+	    s == (LONG)SCARD_E_SERVICE_STOPPED ||
+	    s == (LONG)SCARD_E_INVALID_HANDLE;
+}
+
+static LONG
+ctx_get(SCARDCONTEXT *ctx)
+{
+	LONG s;
+
+	*ctx = 0;
+
+	shared_lock();
+	if (shared.nidle > 0)
+		*ctx = shared.idle[--shared.nidle];
+	shared_unlock();
+
+	if (*ctx != 0)
+		return (LONG)SCARD_S_SUCCESS;
+
+	if ((s = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL,
+	    ctx)) != SCARD_S_SUCCESS || *ctx == 0) {
+		fido_log_debug("%s: SCardEstablishContext 0x%lx", __func__,
+		    (long)s);
+		*ctx = 0;
+		return s != SCARD_S_SUCCESS ? s : (LONG)SCARD_E_INVALID_HANDLE;
+	}
+
+	return (LONG)SCARD_S_SUCCESS;
+}
+
+/*
+ * Keeps ctx for reuse. If s says the manager no longer knows it, the
+ * manager was restarted, and the idle contexts are dropped with it.
+ */
+static void
+ctx_put(SCARDCONTEXT ctx, LONG s)
+{
+	SCARDCONTEXT stale[nitems(shared.idle)];
+	size_t n = 0;
+
+	if (ctx == 0)
+		return;
+
+	shared_lock();
+	if (ctx_stale(s))
+		while (shared.nidle > 0)
+			stale[n++] = shared.idle[--shared.nidle];
+#ifndef FIDO_FUZZ /* keep runs independent */
+	else if (shared.nidle < nitems(shared.idle)) {
+		shared.idle[shared.nidle++] = ctx;
+		ctx = 0;
+	}
+#endif
+	shared_unlock();
+
+	if (ctx != 0)
+		SCardReleaseContext(ctx);
+	while (n > 0)
+		SCardReleaseContext(stale[--n]);
+}
+
 static LONG
 list_readers(SCARDCONTEXT ctx, char **buf)
 {
@@ -70,37 +177,106 @@ fail:
 	return (LONG)SCARD_E_NO_READERS_AVAILABLE;
 }
 
-static char *
-get_reader(SCARDCONTEXT ctx, const char *path)
+/* Called with the shared state locked. */
+static LONG
+update_readers(SCARDCONTEXT ctx)
+{
+	SCARD_READERSTATE rs;
+	char *buf;
+	LONG pnp, s;
+
+	memset(&rs, 0, sizeof(rs));
+	rs.szReader = PNP_READER;
+	rs.dwCurrentState = shared.pnp_state;
+
+	/* not every manager supports PNP_READER; list if in doubt */
+	if ((pnp = SCardGetStatusChange(ctx, 0, &rs, 1)) == SCARD_E_TIMEOUT &&
+	    shared.readers != NULL)
+		return (LONG)SCARD_S_SUCCESS;
+	if (ctx_stale(pnp)) {
+		fido_log_debug("%s: SCardGetStatusChange 0x%lx", __func__,
+		    (long)pnp);
+		return pnp;
+	}
+
+	free(shared.readers);
+	shared.readers = NULL;
+
+	if ((s = list_readers(ctx, &buf)) != SCARD_S_SUCCESS) {
+		fido_log_debug("%s: list_readers 0x%lx", __func__, (long)s);
+		return s;
+	}
+
+	shared.readers = buf;
+	if (pnp == SCARD_S_SUCCESS)
+		shared.pnp_state = rs.dwEventState &
+		    ~(DWORD)SCARD_STATE_CHANGED;
+
+	return (LONG)SCARD_S_SUCCESS;
+}
+
+/* A copy of the cached multi-string of reader names. */
+static LONG
+copy_readers(SCARDCONTEXT ctx, char **buf)
+{
+	const char *name;
+	LONG s;
+
+	*buf = NULL;
+
+	shared_lock();
+	if ((s = update_readers(ctx)) == SCARD_S_SUCCESS) {
+		for (name = shared.readers; *name != 0;
+		    name += strlen(name) + 1)
+			continue;
+		if ((*buf = malloc((size_t)(name - shared.readers) + 1)) ==
+		    NULL)
+			s = (LONG)SCARD_E_NO_MEMORY;
+		else
+			memcpy(*buf, shared.readers,
+			    (size_t)(name - shared.readers) + 1);
+	}
+	shared_unlock();
+
+	return s;
+}
+
+static LONG
+get_reader(SCARDCONTEXT ctx, const char *path, char **reader)
 {
-	char *reader = NULL, *buf = NULL;
 	const char prefix[] = FIDO_PCSC_PREFIX "//slot";
 	uint64_t n;
+	LONG s;
 
-	if (path == NULL)
-		goto out;
-	if (strncmp(path, prefix, strlen(prefix)) != 0 ||
+	*reader = NULL;
+
+	if (path == NULL || strncmp(path, prefix, strlen(prefix)) != 0 ||
 	    fido_to_uint64(path + strlen(prefix), 10, &n) < 0 ||
 	    n > READERS - 1) {
 		fido_log_debug("%s: invalid path %s", __func__, path);
-		goto out;
+		return (LONG)SCARD_E_UNKNOWN_READER;
 	}
-	if (list_readers(ctx, &buf) != SCARD_S_SUCCESS) {
-		fido_log_debug("%s: list_readers", __func__);
+
+	shared_lock();
+	if ((s = update_readers(ctx)) != SCARD_S_SUCCESS) {
+		fido_log_debug("%s: update_readers", __func__);
 		goto out;
 	}
-	for (const char *name = buf; *name != 0; name += strlen(name) + 1) {
+	for (const char *name = shared.readers; *name != 0;
+	    name += strlen(name) + 1) {
 		if (n == 0) {
-			reader = strdup(name);
+			if ((*reader = strdup(name)) == NULL)
+				s = (LONG)SCARD_E_NO_MEMORY;
 			goto out;
 		}
 		n--;
 	}
 	fido_log_debug("%s: failed to find reader %s", __func__, path);
+	s = (LONG)SCARD_E_UNKNOWN_READER;
 out:
-	free(buf);
+	shared_unlock();
 
-	return reader;
+	return s;
 }
 
 static int
@@ -188,17 +364,15 @@ fido_pcsc_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
 	if (devlist == NULL)
 		return FIDO_ERR_INVALID_ARGUMENT;
 
-	if ((s = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL,
-	    &ctx)) != SCARD_S_SUCCESS || ctx == 0) {
-		fido_log_debug("%s: SCardEstablishContext 0x%lx", __func__,
-		    (long)s);
+	if ((s = ctx_get(&ctx)) != SCARD_S_SUCCESS) {
+		fido_log_debug("%s: ctx_get 0x%lx", __func__, (long)s);
 		if (s == (LONG)SCARD_E_NO_SERVICE ||
 		    s == (LONG)SCARD_E_NO_SMARTCARD)
 			r = FIDO_OK; /* suppress error */
 		goto out;
 	}
-	if ((s = list_readers(ctx, &buf)) != SCARD_S_SUCCESS) {
-		fido_log_debug("%s: list_readers 0x%lx", __func__, (long)s);
+	if ((s = copy_readers(ctx, &buf)) != SCARD_S_SUCCESS) {
+		fido_log_debug("%s: copy_readers 0x%lx", __func__, (long)s);
 		if (s == (LONG)SCARD_E_NO_READERS_AVAILABLE)
 			r = FIDO_OK; /* suppress error */
 		goto out;
@@ -230,8 +404,7 @@ fido_pcsc_manifest(fido_dev_info_t *devlist, size_t ilen, size_t *olen)
 	r = FIDO_OK;
 out:
 	free(buf);
-	if (ctx != 0)
-		SCardReleaseContext(ctx);
+	ctx_put(ctx, s);
 
 	return r;
 }
@@ -249,21 +422,26 @@ fido_pcsc_open(const char *path)
 
 	memset(&req, 0, sizeof(req));
 
-	if ((s = SCardEstablishContext(SCARD_SCOPE_SYSTEM, NULL, NULL,
-	    &ctx)) != SCARD_S_SUCCESS || ctx == 0) {
-		fido_log_debug("%s: SCardEstablishContext 0x%lx", __func__,
-		    (long)s);
-		goto fail;
-
-	}
-	if ((reader = get_reader(ctx, path)) == NULL) {
-		fido_log_debug("%s: get_reader(%s)", __func__, path);
-		goto fail;
-	}
-	if ((s = SCardConnect(ctx, reader, SCARD_SHARE_SHARED,
-	    SCARD_PROTOCOL_Tx, &h, &prot)) != SCARD_S_SUCCESS) {
-		fido_log_debug("%s: SCardConnect 0x%lx", __func__, (long)s);
-		goto fail;
+	/* an idle context may have outlived the manager; retry once */
+	for (int retry = 1;; retry--) {
+		if ((s = ctx_get(&ctx)) != SCARD_S_SUCCESS) {
+			fido_log_debug("%s: ctx_get 0x%lx", __func__, (long)s);
+			goto fail;
+		}
+		if ((s = get_reader(ctx, path, &reader)) != SCARD_S_SUCCESS)
+			fido_log_debug("%s: get_reader(%s)", __func__, path);
+		else if ((s = SCardConnect(ctx, reader, SCARD_SHARE_SHARED,
+		    SCARD_PROTOCOL_Tx, &h, &prot)) != SCARD_S_SUCCESS)
+			fido_log_debug("%s: SCardConnect 0x%lx", __func__,
+			    (long)s);
+		else
+			break;
+		ctx_put(ctx, s);
+		ctx = 0;
+		free(reader);
+		reader = NULL;
+		if (retry == 0 || !ctx_stale(s))
+			goto fail;
 	}
 	if (prepare_io_request(prot, &req) < 0) {
 		fido_log_debug("%s: prepare_io_request", __func__);
@@ -280,8 +458,7 @@ fido_pcsc_open(const char *path)
 fail:
 	if (h != 0)
 		SCardDisconnect(h, SCARD_LEAVE_CARD);
-	if (ctx != 0)
-		SCardReleaseContext(ctx);
+	ctx_put(ctx, s);
 	free(reader);
 
 	return dev;
@@ -294,8 +471,7 @@ fido_pcsc_close(void *handle)
 
 	if (dev->h != 0)
 		SCardDisconnect(dev->h, SCARD_LEAVE_CARD);
-	if (dev->ctx != 0)
-		SCardReleaseContext(dev->ctx);
+	ctx_put(dev->ctx, dev->s);
 
 	explicit_bzero(dev->rx_buf, sizeof(dev->rx_buf));
 	free(dev);
@@ -315,7 +491,7 @@ fido_pcsc_read(void *handle, unsigned char *buf, size_t len, int ms)
 	}
 	fido_log_xxd(dev->rx_buf, dev->rx_len, "%s: reading", __func__);
 	memcpy(buf, dev->rx_buf, dev->rx_len);
-	explicit_bzero(dev->rx_buf, sizeof(dev->rx_buf));
+	explicit_bzero(dev->rx_buf, dev->rx_len);
 	r = (int)dev->rx_len;
 	dev->rx_len = 0;
 
@@ -334,7 +510,8 @@ fido_pcsc_write(void *handle, const unsigned char *buf, size_t len)
 		return -1;
 	}
 
-	explicit_bzero(dev->rx_buf, sizeof(dev->rx_buf));
+	/* only the last reply can be left in rx_buf */
+	explicit_bzero(dev->rx_buf, dev->rx_len);
 	dev->rx_len = 0;
 	n = (DWORD)sizeof(dev->rx_buf);
 
@@ -343,6 +520,7 @@ fido_pcsc_write(void *handle, const unsigned char *buf, size_t len)
 	if ((s = SCardTransmit(dev->h, &dev->req, buf, (DWORD)len, NULL,
 	    dev->rx_buf, &n)) != SCARD_S_SUCCESS) {
 		fido_log_debug("%s: SCardTransmit 0x%lx", __func__, (long)s);
+		dev->s = s;
 		explicit_bzero(dev->rx_buf, sizeof(dev->rx_buf));
 		return -1;
 	}
@@ -385,6 +563,9 @@ fido_dev_set_pcsc(fido_dev_t *d)
 		fido_pcsc_read,
 		fido_pcsc_write,
 	};
+	d->io_writev = NULL;
+	d->io_pollfd = NULL;
+	d->io_wakeup = NULL;
 	d->transport = (fido_dev_transport_t) {
 		fido_pcsc_rx,
 		fido_pcsc_tx,
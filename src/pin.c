@@ -9,13 +9,6 @@
 #include "fido.h"
 #include "fido/es256.h"
 
-#define CTAP21_UV_TOKEN_PERM_MAKECRED	0x01
-#define CTAP21_UV_TOKEN_PERM_ASSERT	0x02
-#define CTAP21_UV_TOKEN_PERM_CRED_MGMT	0x04
-#define CTAP21_UV_TOKEN_PERM_BIO	0x08
-#define CTAP21_UV_TOKEN_PERM_LARGEBLOB	0x10
-#define CTAP21_UV_TOKEN_PERM_CONFIG	0x20
-
 int
 fido_sha256(fido_blob_t *digest, const u_char *data, size_t data_len)
 {
@@ -124,25 +117,25 @@ fail:
 	return (r);
 }
 
-static cbor_item_t *
-encode_uv_permission(uint8_t cmd)
+static uint8_t
+uv_permission(uint8_t cmd)
 {
 	switch (cmd) {
 	case CTAP_CBOR_ASSERT:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_ASSERT));
+		return (FIDO_UV_TOKEN_PERM_ASSERT);
 	case CTAP_CBOR_BIO_ENROLL_PRE:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_BIO));
+		return (FIDO_UV_TOKEN_PERM_BIO);
 	case CTAP_CBOR_CONFIG:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_CONFIG));
+		return (FIDO_UV_TOKEN_PERM_CONFIG);
 	case CTAP_CBOR_MAKECRED:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_MAKECRED));
+		return (FIDO_UV_TOKEN_PERM_MAKECRED);
 	case CTAP_CBOR_CRED_MGMT_PRE:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_CRED_MGMT));
+		return (FIDO_UV_TOKEN_PERM_CRED_MGMT);
 	case CTAP_CBOR_LARGEBLOB:
-		return (cbor_build_uint8(CTAP21_UV_TOKEN_PERM_LARGEBLOB));
+		return (FIDO_UV_TOKEN_PERM_LARGEBLOB);
 	default:
 		fido_log_debug("%s: cmd 0x%02x", __func__, cmd);
-		return (NULL);
+		return (0);
 	}
 }
 
@@ -186,7 +179,7 @@ ctap20_uv_token_tx(fido_dev_t *dev, const char *pin, const fido_blob_t *ecdh,
 		goto fail;
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -205,7 +198,7 @@ fail:
 
 static int
 ctap21_uv_token_tx(fido_dev_t *dev, const char *pin, const fido_blob_t *ecdh,
-    const es256_pk_t *pk, uint8_t cmd, const char *rpid, int *ms)
+    const es256_pk_t *pk, uint8_t perms, const char *rpid, int *ms)
 {
 	fido_blob_t	 f;
 	fido_blob_t	*p = NULL;
@@ -242,14 +235,14 @@ ctap21_uv_token_tx(fido_dev_t *dev, const char *pin, const fido_blob_t *ecdh,
 	    (argv[1] = cbor_build_uint8(subcmd)) == NULL ||
 	    (argv[2] = es256_pk_encode(pk, 1)) == NULL ||
 	    (phe != NULL && (argv[5] = fido_blob_encode(phe)) == NULL) ||
-	    (argv[8] = encode_uv_permission(cmd)) == NULL ||
+	    perms == 0 || (argv[8] = cbor_build_uint8(perms)) == NULL ||
 	    (rpid != NULL && (argv[9] = cbor_build_string(rpid)) == NULL)) {
 		fido_log_debug("%s: cbor encode", __func__);
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s:  fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -285,22 +278,17 @@ static int
 uv_token_rx(fido_dev_t *dev, const fido_blob_t *ecdh, fido_blob_t *token,
     int *ms)
 {
-	fido_blob_t	*aes_token = NULL;
-	unsigned char	*msg = NULL;
-	int		 msglen;
-	int		 r;
+	fido_blob_t		*aes_token = NULL;
+	const unsigned char	*msg;
+	int			 msglen = -1;
+	int			 r;
 
 	if ((aes_token = fido_blob_new()) == NULL) {
 		r = FIDO_ERR_INTERNAL;
 		goto fail;
 	}
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto fail;
@@ -320,14 +308,14 @@ uv_token_rx(fido_dev_t *dev, const fido_blob_t *ecdh, fido_blob_t *token,
 
 	r = FIDO_OK;
 fail:
+	fido_rx_msg_clear(dev, msglen);
 	fido_blob_free(&aes_token);
-	freezero(msg, FIDO_MAXMSG);
 
 	return (r);
 }
 
 static int
-uv_token_wait(fido_dev_t *dev, uint8_t cmd, const char *pin,
+uv_token_wait(fido_dev_t *dev, uint8_t perms, const char *pin,
     const fido_blob_t *ecdh, const es256_pk_t *pk, const char *rpid,
     fido_blob_t *token, int *ms)
 {
@@ -336,12 +324,15 @@ uv_token_wait(fido_dev_t *dev, uint8_t cmd, const char *pin,
 	if (ecdh == NULL || pk == NULL)
 		return (FIDO_ERR_INVALID_ARGUMENT);
 	if (fido_dev_supports_permissions(dev))
-		r = ctap21_uv_token_tx(dev, pin, ecdh, pk, cmd, rpid, ms);
+		r = ctap21_uv_token_tx(dev, pin, ecdh, pk, perms, rpid, ms);
 	else
 		r = ctap20_uv_token_tx(dev, pin, ecdh, pk, ms);
 	if (r != FIDO_OK)
 		return (r);
 
+	/* the authenticator no longer honours previously issued tokens */
+	fido_uv_token_invalidate(dev);
+
 	return (uv_token_rx(dev, ecdh, token, ms));
 }
 
@@ -350,7 +341,127 @@ fido_dev_get_uv_token(fido_dev_t *dev, uint8_t cmd, const char *pin,
     const fido_blob_t *ecdh, const es256_pk_t *pk, const char *rpid,
     fido_blob_t *token, int *ms)
 {
-	return (uv_token_wait(dev, cmd, pin, ecdh, pk, rpid, token, ms));
+	return (uv_token_wait(dev, uv_permission(cmd), pin, ecdh, pk, rpid,
+	    token, ms));
+}
+
+fido_uv_token_t *
+fido_uv_token_new(void)
+{
+	return (calloc(1, sizeof(fido_uv_token_t)));
+}
+
+static void
+uv_token_reset(fido_uv_token_t *token)
+{
+	fido_blob_reset(&token->token);
+	token->perms = 0;
+	token->dev = NULL;
+}
+
+void
+fido_uv_token_free(fido_uv_token_t **token_p)
+{
+	fido_uv_token_t *token;
+
+	if (token_p == NULL || (token = *token_p) == NULL)
+		return;
+
+	if (token->dev != NULL && token->dev->uv_token == token)
+		token->dev->uv_token = NULL;
+
+	uv_token_reset(token);
+	free(token);
+
+	*token_p = NULL;
+}
+
+void
+fido_uv_token_invalidate(fido_dev_t *dev)
+{
+	if (dev->uv_token == NULL)
+		return;
+
+	uv_token_reset(dev->uv_token);
+	dev->uv_token = NULL;
+}
+
+const fido_blob_t *
+fido_uv_token_blob(const fido_dev_t *dev, const fido_uv_token_t *token,
+    uint8_t perm)
+{
+	if (token == NULL || token->dev != dev || dev->uv_token != token ||
+	    fido_blob_is_empty(&token->token)) {
+		fido_log_debug("%s: token not issued by dev", __func__);
+		return (NULL);
+	}
+
+	if ((token->perms & perm) != perm) {
+		fido_log_debug("%s: perms=0x%02x, perm=0x%02x", __func__,
+		    token->perms, perm);
+		return (NULL);
+	}
+
+	return (&token->token);
+}
+
+static int
+uv_token_acquire_wait(fido_dev_t *dev, fido_uv_token_t *token, uint8_t perms,
+    const char *pin, const char *rpid, int *ms)
+{
+	fido_blob_t	*ecdh = NULL;
+	es256_pk_t	*pk = NULL;
+	int		 r;
+
+	if ((r = fido_do_ecdh(dev, &pk, &ecdh, ms)) != FIDO_OK) {
+		fido_log_debug("%s: fido_do_ecdh", __func__);
+		goto fail;
+	}
+
+	if ((r = uv_token_wait(dev, perms, pin, ecdh, pk, rpid, &token->token,
+	    ms)) != FIDO_OK) {
+		fido_log_debug("%s: uv_token_wait", __func__);
+		goto fail;
+	}
+
+	token->perms = perms;
+	token->dev = dev;
+	dev->uv_token = token;
+
+	r = FIDO_OK;
+fail:
+	es256_pk_free(&pk);
+	fido_blob_free(&ecdh);
+
+	if (r != FIDO_OK)
+		uv_token_reset(token);
+
+	return (r);
+}
+
+int
+fido_uv_token_acquire(fido_uv_token_t *token, fido_dev_t *dev, int perms,
+    const char *pin, const char *rpid)
+{
+	int ms = dev->timeout_ms;
+
+	if (perms <= 0 || perms > UINT8_MAX) {
+		fido_log_debug("%s: perms=0x%x", __func__, perms);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+	if (fido_dev_is_fido2(dev) == false)
+		return (FIDO_ERR_INVALID_COMMAND);
+	if (pin == NULL && fido_dev_supports_permissions(dev) == false) {
+		fido_log_debug("%s: pin required", __func__);
+		return (FIDO_ERR_PIN_REQUIRED);
+	}
+
+	if (token->dev != NULL && token->dev->uv_token == token)
+		fido_uv_token_invalidate(token->dev);
+	uv_token_reset(token);
+
+	return (uv_token_acquire_wait(dev, token, (uint8_t)perms, pin, rpid,
+	    &ms));
 }
 
 static int
@@ -404,7 +515,7 @@ fido_dev_change_pin_tx(fido_dev_t *dev, const char *pin, const char *oldpin,
 		goto fail;
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -458,7 +569,7 @@ fido_dev_set_pin_tx(fido_dev_t *dev, const char *pin, int *ms)
 		goto fail;
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -568,7 +679,7 @@ fido_dev_get_retry_count_tx(fido_dev_t *dev, uint8_t subcmd, int *ms)
 		goto fail;
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
+	if (cbor_build_frame(dev, CTAP_CBOR_CLIENT_PIN, argv, nitems(argv),
 	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
@@ -586,18 +697,13 @@ fail:
 static int
 fido_dev_get_pin_retry_count_rx(fido_dev_t *dev, int *retries, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	*retries = 0;
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto fail;
@@ -611,7 +717,7 @@ fido_dev_get_pin_retry_count_rx(fido_dev_t *dev, int *retries, int *ms)
 
 	r = FIDO_OK;
 fail:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -639,18 +745,13 @@ fido_dev_get_retry_count(fido_dev_t *dev, int *retries)
 static int
 fido_dev_get_uv_retry_count_rx(fido_dev_t *dev, int *retries, int *ms)
 {
-	unsigned char	*msg;
-	int		 msglen;
-	int		 r;
+	const unsigned char	*msg;
+	int			 msglen;
+	int			 r;
 
 	*retries = 0;
 
-	if ((msg = malloc(FIDO_MAXMSG)) == NULL) {
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	if ((msglen = fido_rx(dev, CTAP_CMD_CBOR, msg, FIDO_MAXMSG, ms)) < 0) {
+	if ((msglen = fido_rx_msg(dev, CTAP_CMD_CBOR, &msg, ms)) < 0) {
 		fido_log_debug("%s: fido_rx", __func__);
 		r = FIDO_ERR_RX;
 		goto fail;
@@ -664,7 +765,7 @@ fido_dev_get_uv_retry_count_rx(fido_dev_t *dev, int *retries, int *ms)
 
 	r = FIDO_OK;
 fail:
-	freezero(msg, FIDO_MAXMSG);
+	fido_rx_msg_clear(dev, msglen);
 
 	return (r);
 }
@@ -689,10 +790,12 @@ fido_dev_get_uv_retry_count(fido_dev_t *dev, int *retries)
 	return (fido_dev_get_uv_retry_count_wait(dev, retries, &ms));
 }
 
+/* perms are asked for on top of those cmd needs; see uv_permission(). */
 int
-cbor_add_uv_params(fido_dev_t *dev, uint8_t cmd, const fido_blob_t *hmac_data,
-    const es256_pk_t *pk, const fido_blob_t *ecdh, const char *pin,
-    const char *rpid, cbor_item_t **auth, cbor_item_t **opt, int *ms)
+cbor_add_uv_params(fido_dev_t *dev, uint8_t cmd, uint8_t perms,
+    const fido_blob_t *hmac_data, const es256_pk_t *pk,
+    const fido_blob_t *ecdh, const char *pin, const char *rpid,
+    cbor_item_t **auth, cbor_item_t **opt, int *ms)
 {
 	fido_blob_t	*token = NULL;
 	int		 r;
@@ -702,8 +805,8 @@ cbor_add_uv_params(fido_dev_t *dev, uint8_t cmd, const fido_blob_t *hmac_data,
 		goto fail;
 	}
 
-	if ((r = fido_dev_get_uv_token(dev, cmd, pin, ecdh, pk, rpid,
-	    token, ms)) != FIDO_OK) {
+	if ((r = uv_token_wait(dev, uv_permission(cmd) | perms, pin, ecdh, pk,
+	    rpid, token, ms)) != FIDO_OK) {
 		fido_log_debug("%s: fido_dev_get_uv_token", __func__);
 		goto fail;
 	}
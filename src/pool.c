@@ -0,0 +1,524 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+
+#include "fido.h"
+
+/*
+ * A pool of devices kept open between uses. fido_dev_pool_lease() hands
+ * out the device that has been idle the longest, after checking that it
+ * still answers: with a CTAPHID_PING over HID, or authenticatorGetInfo
+ * over NFC and PC/SC. A device that doesn't is reopened by path, and
+ * only handed out if it is the authenticator first opened there, going
+ * by its AAGUID and CTAPHID device version. An entry being checked is
+ * marked leased, so the pool's lock is never held across i/o. Each step
+ * of a check takes at most the pool's timeout, or else the device's, and
+ * none goes past the deadline of a lease that has one; a lease of 0 ms
+ * waits for no release, but its checks take the time they need.
+ */
+
+struct pool_id {
+	bool		known;      /* the device has been opened */
+	unsigned char	aaguid[16]; /* zero if not fido2 */
+	uint8_t		major;      /* CTAPHID device version */
+	uint8_t		minor;
+	uint8_t		build;
+};
+
+struct pool_entry {
+	fido_dev_t	*dev;
+	struct pool_id	*id;      /* the device first opened */
+	bool		 leased;
+	struct timespec	 ts_used; /* last released */
+};
+
+struct fido_dev_pool {
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t		 mtx;
+	pthread_cond_t		 cond;
+#endif
+	struct pool_entry	*entry;
+	size_t			 len;
+	int			 timeout_ms; /* of a check step, or -1 */
+};
+
+static void
+pool_lock(fido_dev_pool_t *pool)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&pool->mtx);
+#else
+	(void)pool;
+#endif
+}
+
+static void
+pool_unlock(fido_dev_pool_t *pool)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&pool->mtx);
+#else
+	(void)pool;
+#endif
+}
+
+/* Waits for a release until deadline; -1 if there is no point. */
+static int
+pool_wait(fido_dev_pool_t *pool, const struct timespec *deadline)
+{
+#ifdef HAVE_PTHREAD
+	struct timespec ts_now, ts_left, ts_abs;
+
+	if (deadline == NULL)
+		return (pthread_cond_wait(&pool->cond, &pool->mtx));
+
+	if (fido_time_now(&ts_now) != 0 ||
+	    timespeccmp(&ts_now, deadline, >=) ||
+	    clock_gettime(CLOCK_REALTIME, &ts_abs) != 0)
+		return (-1);
+
+	timespecsub(deadline, &ts_now, &ts_left);
+	timespecadd(&ts_abs, &ts_left, &ts_abs);
+
+	if (pthread_cond_timedwait(&pool->cond, &pool->mtx, &ts_abs) != 0)
+		return (-1);
+
+	return (0);
+#else
+	(void)pool;
+	(void)deadline;
+
+	return (-1); /* nobody else to release a device */
+#endif
+}
+
+/* How long a step of a check of dev may take, in ms, or -1. */
+static int
+check_ms(const fido_dev_t *dev, int tmo, const struct timespec *deadline)
+{
+	struct timespec	ts_now, ts_left;
+	long long	left;
+
+	if (tmo < 0)
+		tmo = dev->timeout_ms;
+	if (deadline == NULL)
+		return (tmo);
+	if (fido_time_now(&ts_now) != 0 || timespeccmp(&ts_now, deadline, >=))
+		return (0);
+
+	timespecsub(deadline, &ts_now, &ts_left);
+	left = (long long)ts_left.tv_sec * 1000 + ts_left.tv_nsec / 1000000;
+	if (left > INT_MAX)
+		left = INT_MAX;
+	if (tmo >= 0 && tmo < left)
+		return (tmo);
+
+	return ((int)left);
+}
+
+static int
+ping(fido_dev_t *dev, int *ms)
+{
+	unsigned char	nonce[8];
+	unsigned char	reply[sizeof(nonce)];
+	int		n;
+
+	if (fido_get_random(nonce, sizeof(nonce)) < 0) {
+		fido_log_debug("%s: fido_get_random", __func__);
+		return (FIDO_ERR_INTERNAL);
+	}
+	if (fido_tx(dev, CTAP_CMD_PING, nonce, sizeof(nonce), ms) < 0) {
+		fido_log_debug("%s: fido_tx", __func__);
+		return (FIDO_ERR_TX);
+	}
+	if ((n = fido_rx(dev, CTAP_CMD_PING, reply, sizeof(reply),
+	    ms)) < 0) {
+		fido_log_debug("%s: fido_rx", __func__);
+		return (FIDO_ERR_RX);
+	}
+	if ((size_t)n != sizeof(reply) ||
+	    timingsafe_bcmp(nonce, reply, sizeof(reply)) != 0) {
+		fido_log_debug("%s: invalid reply", __func__);
+		return (FIDO_ERR_RX);
+	}
+
+	return (FIDO_OK);
+}
+
+/* Reads what identifies the open dev, asking for authenticatorGetInfo. */
+static int
+identify(fido_dev_t *dev, struct pool_id *id, int *ms)
+{
+	fido_cbor_info_t	*info;
+	int			 r;
+
+	memset(id, 0, sizeof(*id));
+	id->known = true;
+	id->major = dev->attr.major;
+	id->minor = dev->attr.minor;
+	id->build = dev->attr.build;
+
+	if (fido_dev_is_fido2(dev) == false)
+		return (FIDO_OK);
+
+	if ((info = fido_cbor_info_new()) == NULL)
+		return (FIDO_ERR_INTERNAL);
+	if ((r = fido_dev_get_cbor_info_wait(dev, info, ms)) != FIDO_OK)
+		fido_log_debug("%s: fido_dev_get_cbor_info_wait", __func__);
+	else
+		memcpy(id->aaguid, fido_cbor_info_aaguid_ptr(info),
+		    sizeof(id->aaguid));
+	fido_cbor_info_free(&info);
+
+	return (r);
+}
+
+static bool
+same_id(const struct pool_id *a, const struct pool_id *b)
+{
+	return (a->major == b->major && a->minor == b->minor &&
+	    a->build == b->build &&
+	    timingsafe_bcmp(a->aaguid, b->aaguid, sizeof(a->aaguid)) == 0);
+}
+
+/* Whether the open dev still answers, and is still the device in id. */
+static bool
+alive(fido_dev_t *dev, const struct pool_id *id, int *ms)
+{
+	struct pool_id now;
+
+	if (dev->flags & FIDO_DEV_WINHELLO)
+		return (true); /* nothing to unplug */
+	if (dev->transport.tx == NULL)
+		return (ping(dev, ms) == FIDO_OK);
+	if (fido_dev_is_fido2(dev) == false)
+		return (true); /* no way to ask; see fido_dev_pool_new(3) */
+
+	return (identify(dev, &now, ms) == FIDO_OK && same_id(id, &now));
+}
+
+/*
+ * Makes sure the leased dev is open and answering, and that a device
+ * reopened by path is the one first opened there. Each step takes at most
+ * tmo ms, or -1, and ends by deadline if not NULL.
+ */
+static int
+check(fido_dev_t *dev, struct pool_id *id, int tmo,
+    const struct timespec *deadline)
+{
+	struct pool_id	now;
+	int		ms = check_ms(dev, tmo, deadline);
+	int		r;
+
+	if (dev->io_handle != NULL) {
+		if (alive(dev, id, &ms))
+			return (FIDO_OK);
+		fido_log_debug("%s: %s: reopening", __func__, dev->path);
+		fido_dev_close(dev);
+		ms = check_ms(dev, tmo, deadline);
+	}
+
+	if ((r = fido_dev_open_wait(dev, dev->path, &ms)) != FIDO_OK) {
+		fido_log_debug("%s: %s: 0x%x", __func__, dev->path, r);
+		return (r);
+	}
+	if ((r = identify(dev, &now, &ms)) != FIDO_OK) {
+		fido_log_debug("%s: %s: identify", __func__, dev->path);
+		goto fail;
+	}
+	if (id->known && !same_id(id, &now)) {
+		fido_log_debug("%s: %s: different device", __func__,
+		    dev->path);
+		r = FIDO_ERR_NOTFOUND;
+		goto fail;
+	}
+
+	*id = now;
+
+	return (FIDO_OK);
+fail:
+	fido_dev_close(dev);
+
+	return (r);
+}
+
+/*
+ * An entry's dev and id don't move, so a leaseholder may use them
+ * unlocked.
+ */
+static fido_dev_t *
+pool_dev(fido_dev_pool_t *pool, size_t idx, struct pool_id **id)
+{
+	fido_dev_t *dev;
+
+	pool_lock(pool);
+	dev = pool->entry[idx].dev;
+	*id = pool->entry[idx].id;
+	pool_unlock(pool);
+
+	return (dev);
+}
+
+/* The first n entries' idle one released longest ago, or -1. */
+static ssize_t
+pick(const fido_dev_pool_t *pool, const bool *tried, size_t n)
+{
+	ssize_t idx = -1;
+
+	for (size_t i = 0; i < n; i++) {
+		if (pool->entry[i].leased || tried[i])
+			continue;
+		if (idx < 0 || timespeccmp(&pool->entry[i].ts_used,
+		    &pool->entry[idx].ts_used, <))
+			idx = (ssize_t)i;
+	}
+
+	return (idx);
+}
+
+fido_dev_pool_t *
+fido_dev_pool_new(void)
+{
+	fido_dev_pool_t *pool;
+
+	if ((pool = calloc(1, sizeof(*pool))) == NULL)
+		return (NULL);
+
+	pool->timeout_ms = -1;
+
+#ifdef HAVE_PTHREAD
+	if (pthread_mutex_init(&pool->mtx, NULL) != 0) {
+		free(pool);
+		return (NULL);
+	}
+	if (pthread_cond_init(&pool->cond, NULL) != 0) {
+		pthread_mutex_destroy(&pool->mtx);
+		free(pool);
+		return (NULL);
+	}
+#endif
+
+	return (pool);
+}
+
+void
+fido_dev_pool_free(fido_dev_pool_t **pool_p)
+{
+	fido_dev_pool_t *pool;
+
+	if (pool_p == NULL || (pool = *pool_p) == NULL)
+		return;
+
+	for (size_t i = 0; i < pool->len; i++) {
+		if (pool->entry[i].dev->io_handle != NULL)
+			fido_dev_close(pool->entry[i].dev);
+		fido_dev_free(&pool->entry[i].dev);
+		free(pool->entry[i].id);
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_cond_destroy(&pool->cond);
+	pthread_mutex_destroy(&pool->mtx);
+#endif
+	free(pool->entry);
+	free(pool);
+
+	*pool_p = NULL;
+}
+
+int
+fido_dev_pool_add(fido_dev_pool_t *pool, const fido_dev_info_t *di)
+{
+	struct pool_entry	*entry;
+	struct pool_id		*id;
+	fido_dev_t		*dev;
+
+	if (di == NULL || di->path == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	if ((id = calloc(1, sizeof(*id))) == NULL)
+		return (FIDO_ERR_INTERNAL);
+	if ((dev = fido_dev_new_with_info(di)) == NULL) {
+		free(id);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	pool_lock(pool);
+	if ((entry = recallocarray(pool->entry, pool->len, pool->len + 1,
+	    sizeof(*entry))) == NULL) {
+		pool_unlock(pool);
+		fido_log_debug("%s: recallocarray", __func__);
+		fido_dev_free(&dev);
+		free(id);
+		return (FIDO_ERR_INTERNAL);
+	}
+	pool->entry = entry;
+	pool->entry[pool->len].dev = dev;
+	pool->entry[pool->len++].id = id;
+	pool_unlock(pool);
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_pool_lease(fido_dev_pool_t *pool, fido_dev_t **dev_p, int ms)
+{
+	struct timespec		 ts_deadline, ts_ms;
+	struct timespec		*deadline = NULL;
+	struct pool_id		*id;
+	bool			*tried = NULL;
+	fido_dev_t		*dev;
+	size_t			 i, n;
+	ssize_t			 idx;
+	int			 tmo;
+	int			 r = FIDO_ERR_NOTFOUND;
+
+	*dev_p = NULL;
+
+	if (ms < -1)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	if (ms >= 0) {
+		if (fido_time_now(&ts_deadline) != 0)
+			return (FIDO_ERR_INTERNAL);
+		ts_ms.tv_sec = ms / 1000;
+		ts_ms.tv_nsec = (ms % 1000) * 1000000L;
+		timespecadd(&ts_deadline, &ts_ms, &ts_deadline);
+		deadline = &ts_deadline;
+	}
+
+	pool_lock(pool);
+
+	/* devices added from now on are left for the next lease */
+	if ((n = pool->len) == 0 ||
+	    (tried = calloc(n, sizeof(*tried))) == NULL) {
+		pool_unlock(pool);
+		return (n == 0 ? FIDO_ERR_NOTFOUND : FIDO_ERR_INTERNAL);
+	}
+
+	for (;;) {
+		if ((idx = pick(pool, tried, n)) < 0) {
+			/* wait for one not tried yet to be released */
+			for (i = 0; i < n; i++)
+				if (pool->entry[i].leased && !tried[i])
+					break;
+			if (i == n || pool_wait(pool, deadline) != 0)
+				goto out;
+			continue;
+		}
+		pool->entry[idx].leased = true;
+		tried[idx] = true;
+		tmo = pool->timeout_ms;
+		pool_unlock(pool);
+		dev = pool_dev(pool, (size_t)idx, &id);
+		r = check(dev, id, tmo, ms > 0 ? deadline : NULL);
+		pool_lock(pool);
+		if (r == FIDO_OK) {
+			*dev_p = pool->entry[idx].dev;
+			break;
+		}
+		pool->entry[idx].leased = false;
+		r = FIDO_ERR_NOTFOUND;
+	}
+out:
+	pool_unlock(pool);
+	free(tried);
+
+	return (r);
+}
+
+int
+fido_dev_pool_release(fido_dev_pool_t *pool, fido_dev_t *dev)
+{
+	int r = FIDO_ERR_INVALID_ARGUMENT;
+
+	pool_lock(pool);
+	for (size_t i = 0; i < pool->len; i++) {
+		if (pool->entry[i].dev != dev || !pool->entry[i].leased)
+			continue;
+		pool->entry[i].leased = false;
+		if (fido_time_now(&pool->entry[i].ts_used) != 0)
+			memset(&pool->entry[i].ts_used, 0,
+			    sizeof(pool->entry[i].ts_used));
+#ifdef HAVE_PTHREAD
+		pthread_cond_signal(&pool->cond);
+#endif
+		r = FIDO_OK;
+		break;
+	}
+	pool_unlock(pool);
+
+	return (r);
+}
+
+/*
+ * Checks every device that has been idle for idle_ms or more, keeping it
+ * from being suspended and reopening it if it was unplugged.
+ */
+int
+fido_dev_pool_maintain(fido_dev_pool_t *pool, int idle_ms)
+{
+	struct timespec		 ts_now, ts_idle, ts_since;
+	struct pool_entry	*e;
+	struct pool_id		*id;
+	fido_dev_t		*dev;
+	size_t			 n;
+	int			 tmo;
+
+	if (idle_ms < 0)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	if (fido_time_now(&ts_now) != 0)
+		return (FIDO_ERR_INTERNAL);
+
+	ts_idle.tv_sec = idle_ms / 1000;
+	ts_idle.tv_nsec = (idle_ms % 1000) * 1000000L;
+
+	pool_lock(pool);
+	n = pool->len;
+	for (size_t i = 0; i < n; i++) {
+		e = &pool->entry[i];
+		if (e->leased)
+			continue;
+		timespecadd(&e->ts_used, &ts_idle, &ts_since);
+		if (timespeccmp(&ts_since, &ts_now, >))
+			continue;
+		e->leased = true;
+		tmo = pool->timeout_ms;
+		pool_unlock(pool);
+		dev = pool_dev(pool, i, &id);
+		check(dev, id, tmo, NULL);
+		pool_lock(pool);
+		e = &pool->entry[i]; /* may have moved */
+		e->leased = false;
+		if (fido_time_now(&e->ts_used) != 0)
+			memset(&e->ts_used, 0, sizeof(e->ts_used));
+#ifdef HAVE_PTHREAD
+		pthread_cond_signal(&pool->cond);
+#endif
+	}
+	pool_unlock(pool);
+
+	return (FIDO_OK);
+}
+
+/* Bounds each step of a device check, or -1 for the device's timeout. */
+int
+fido_dev_pool_set_timeout(fido_dev_pool_t *pool, int ms)
+{
+	if (ms < -1)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	pool_lock(pool);
+	pool->timeout_ms = ms;
+	pool_unlock(pool);
+
+	return (FIDO_OK);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+/*
+ * An NFC adapter kept ready between taps. The platform's monitor powers
+ * the adapter and starts polling once, when the reader is created, and
+ * from then on reports targets arriving and leaving; fido_dev_open() of
+ * the reader's path connects to the target present without redoing that
+ * setup. Only the Linux netlink backend has a monitor; elsewhere
+ * fido_nfc_reader_new() fails.
+ */
+
+void
+fido_nfc_reader_event(fido_nfc_reader_t *reader, int present)
+{
+	fido_log_debug("%s: %s: %s", __func__, reader->path,
+	    present ? "found" : "lost");
+
+	if (reader->handler != NULL)
+		reader->handler(reader->path, present, reader->handler_arg);
+}
+
+fido_nfc_reader_t *
+fido_nfc_reader_new(const char *path)
+{
+#ifdef USE_NFC
+	fido_nfc_reader_t *reader;
+	int r;
+
+	if (path == NULL || (reader = calloc(1, sizeof(*reader))) == NULL)
+		return (NULL);
+
+	if ((reader->path = strdup(path)) == NULL) {
+		fido_nfc_reader_free(&reader);
+		return (NULL);
+	}
+
+	if ((r = fido_nfc_monitor_open(reader)) != FIDO_OK) {
+		fido_log_debug("%s: fido_nfc_monitor_open: 0x%x", __func__, r);
+		fido_nfc_reader_free(&reader);
+	}
+
+	return (reader);
+#else
+	(void)path;
+
+	fido_log_debug("%s: no nfc monitor", __func__);
+
+	return (NULL);
+#endif
+}
+
+void
+fido_nfc_reader_free(fido_nfc_reader_t **reader_p)
+{
+	fido_nfc_reader_t *reader;
+
+	if (reader_p == NULL || (reader = *reader_p) == NULL)
+		return;
+
+#ifdef USE_NFC
+	fido_nfc_monitor_close(reader->monitor);
+#endif
+	free(reader->path);
+	free(reader);
+
+	*reader_p = NULL;
+}
+
+int
+fido_nfc_reader_set_handler(fido_nfc_reader_t *reader,
+    fido_nfc_reader_handler_t *handler, void *arg)
+{
+	reader->handler = handler;
+	reader->handler_arg = arg;
+
+	return (FIDO_OK);
+}
+
+int
+fido_nfc_reader_pollfd(const fido_nfc_reader_t *reader)
+{
+#ifdef USE_NFC
+	return (fido_nfc_monitor_pollfd(reader->monitor));
+#else
+	(void)reader;
+
+	return (-1);
+#endif
+}
+
+int
+fido_nfc_reader_update(fido_nfc_reader_t *reader)
+{
+#ifdef USE_NFC
+	return (fido_nfc_monitor_update(reader));
+#else
+	(void)reader;
+
+	return (FIDO_ERR_INTERNAL);
+#endif
+}
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+/*
+ * A live list of HID authenticators. The platform's hotplug monitor
+ * enumerates the devices present once, when the registry is created, and
+ * from then on only applies the add and remove events it receives, so
+ * that fido_dev_registry_manifest() is a copy of the list rather than a
+ * rescan. Only the Linux hidraw backend has a monitor; elsewhere
+ * fido_dev_registry_new() fails.
+ */
+
+static void
+info_reset(fido_dev_info_t *di)
+{
+	free(di->path);
+	free(di->manufacturer);
+	free(di->product);
+	memset(di, 0, sizeof(*di));
+}
+
+static fido_dev_info_t *
+lookup(const fido_dev_registry_t *reg, const char *path)
+{
+	for (size_t i = 0; i < reg->len; i++)
+		if (strcmp(reg->devlist[i].path, path) == 0)
+			return (&reg->devlist[i]);
+
+	return (NULL);
+}
+
+/* Takes ownership of the contents of *di. */
+int
+fido_dev_registry_add(fido_dev_registry_t *reg, fido_dev_info_t *di)
+{
+	fido_dev_info_t	*devlist;
+	size_t		 cap;
+
+	if (lookup(reg, di->path) != NULL) {
+		/* enumerated and announced */
+		info_reset(di);
+		return (FIDO_OK);
+	}
+
+	if (reg->len == reg->cap) {
+		cap = reg->cap == 0 ? 8 : reg->cap * 2;
+		if ((devlist = recallocarray(reg->devlist, reg->cap, cap,
+		    sizeof(*devlist))) == NULL) {
+			fido_log_debug("%s: recallocarray", __func__);
+			info_reset(di);
+			return (FIDO_ERR_INTERNAL);
+		}
+		reg->devlist = devlist;
+		reg->cap = cap;
+	}
+
+	reg->devlist[reg->len++] = *di;
+	memset(di, 0, sizeof(*di));
+
+	fido_log_debug("%s: %s", __func__, reg->devlist[reg->len - 1].path);
+
+	if (reg->handler != NULL)
+		reg->handler(&reg->devlist[reg->len - 1], 1, reg->handler_arg);
+
+	return (FIDO_OK);
+}
+
+void
+fido_dev_registry_remove(fido_dev_registry_t *reg, const char *path)
+{
+	fido_dev_info_t	*di;
+	size_t		 i;
+
+	if ((di = lookup(reg, path)) == NULL)
+		return;
+
+	fido_log_debug("%s: %s", __func__, path);
+
+	if (reg->handler != NULL)
+		reg->handler(di, 0, reg->handler_arg);
+
+	info_reset(di);
+	i = (size_t)(di - reg->devlist);
+	memmove(di, di + 1, (reg->len - i - 1) * sizeof(*di));
+	memset(&reg->devlist[--reg->len], 0, sizeof(*di));
+}
+
+/* Copies the registry into devlist, without looking for changes. */
+int
+fido_dev_registry_copy(const fido_dev_registry_t *reg,
+    fido_dev_info_t *devlist, size_t ilen, size_t *olen)
+{
+	const fido_dev_info_t	*di;
+	int			 r;
+
+	*olen = 0;
+
+	for (size_t i = 0; i < reg->len && *olen < ilen; i++) {
+		di = &reg->devlist[i];
+		if ((r = fido_dev_info_set(devlist, *olen, di->path,
+		    di->manufacturer, di->product, &di->io,
+		    NULL)) != FIDO_OK) {
+			fido_log_debug("%s: fido_dev_info_set", __func__);
+			return (r);
+		}
+		devlist[*olen].vendor_id = di->vendor_id;
+		devlist[*olen].product_id = di->product_id;
+		(*olen)++;
+	}
+
+	return (FIDO_OK);
+}
+
+fido_dev_registry_t *
+fido_dev_registry_new(void)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI)
+	fido_dev_registry_t *reg;
+
+	if ((reg = calloc(1, sizeof(*reg))) == NULL)
+		return (NULL);
+
+	if (fido_hid_monitor_open(reg) != FIDO_OK) {
+		fido_log_debug("%s: fido_hid_monitor_open", __func__);
+		fido_dev_registry_free(&reg);
+	}
+
+	return (reg);
+#else
+	fido_log_debug("%s: no hotplug monitor", __func__);
+
+	return (NULL);
+#endif
+}
+
+void
+fido_dev_registry_free(fido_dev_registry_t **reg_p)
+{
+	fido_dev_registry_t *reg;
+
+	if (reg_p == NULL || (reg = *reg_p) == NULL)
+		return;
+
+#if defined(__linux__) && !defined(USE_HIDAPI)
+	fido_hid_monitor_close(reg->monitor);
+#endif
+	fido_dev_info_free(&reg->devlist, reg->len);
+	free(reg);
+
+	*reg_p = NULL;
+}
+
+int
+fido_dev_registry_set_handler(fido_dev_registry_t *reg,
+    fido_dev_registry_handler_t *handler, void *arg)
+{
+	reg->handler = handler;
+	reg->handler_arg = arg;
+
+	return (FIDO_OK);
+}
+
+int
+fido_dev_registry_pollfd(const fido_dev_registry_t *reg)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI)
+	return (fido_hid_monitor_pollfd(reg->monitor));
+#else
+	(void)reg;
+
+	return (-1);
+#endif
+}
+
+int
+fido_dev_registry_update(fido_dev_registry_t *reg)
+{
+#if defined(__linux__) && !defined(USE_HIDAPI)
+	return (fido_hid_monitor_update(reg));
+#else
+	(void)reg;
+
+	return (FIDO_ERR_INTERNAL);
+#endif
+}
@@ -25,6 +25,9 @@ fido_dev_reset_wait(fido_dev_t *dev, int *ms)
 {
 	int r;
 
+	fido_dev_clear_session(dev);
+	fido_uv_token_invalidate(dev);
+
 	if ((r = fido_dev_reset_tx(dev, ms)) != FIDO_OK ||
 	    (r = fido_rx_cbor_status(dev, ms)) != FIDO_OK)
 		return (r);
@@ -0,0 +1,212 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+
+#ifndef TLS
+#define TLS
+#endif
+
+/*
+ * Per-device statistics. The i/o layer bumps counters through
+ * fido_dev_stats_count(), which is a NULL check when no fido_dev_stats_t
+ * is attached. Latencies are kept per authenticator command in log2
+ * microsecond buckets, split into three phases:
+ *
+ *  - encode: cbor_build_frame() or cbor_frame_*() serialising the request;
+ *  - wire: fido_tx() starting to send it until its reply is complete;
+ *  - decode: cbor_parse_reply*() parsing that reply.
+ *
+ * The frame builders are given the device they encode for and, only if it
+ * has statistics attached, leave the encode duration with it for fido_tx()
+ * to record against the next request. cbor_parse_reply*() doesn't know
+ * the device it works for, so fido_rx() arms the decode phase for the
+ * thread's next parse.
+ */
+
+static TLS struct {
+	fido_dev_stats_t	*stats; /* where to record the next parse */
+	int			 cmd;   /* latency slot */
+} decode;
+
+static uint64_t
+elapsed_us(const struct timespec *ts_start)
+{
+	struct timespec ts_now, ts_delta;
+
+	if (fido_time_now(&ts_now) != 0 ||
+	    timespeccmp(&ts_now, ts_start, <))
+		return (0);
+
+	timespecsub(&ts_now, ts_start, &ts_delta);
+
+	return ((uint64_t)ts_delta.tv_sec * 1000000ULL +
+	    (uint64_t)ts_delta.tv_nsec / 1000ULL);
+}
+
+static void
+record(fido_dev_stats_t *stats, int cmd, int phase, uint64_t us)
+{
+	size_t bucket = 0;
+
+	while (us > 1 && bucket < FIDO_STATS_NBUCKETS - 1) {
+		us >>= 1;
+		bucket++;
+	}
+
+	stats->latency[cmd][phase][bucket]++;
+}
+
+/* Map a request to its latency slot, or -1 if it doesn't have one. */
+static int
+cmd_slot(uint8_t cmd, const unsigned char *buf, size_t count)
+{
+	if (cmd == CTAP_CMD_MSG)
+		return (CTAP_CMD_MSG);
+	if (cmd != CTAP_CMD_CBOR || count == 0)
+		return (-1);
+
+	switch (buf[0]) {
+	case CTAP_CBOR_BIO_ENROLL_PRE:
+		return (0x09); /* authenticatorBioEnrollment */
+	case CTAP_CBOR_CRED_MGMT_PRE:
+		return (0x0a); /* authenticatorCredentialManagement */
+	}
+
+	if (buf[0] == 0 || buf[0] >= FIDO_STATS_NCMDS)
+		return (-1);
+
+	return (buf[0]);
+}
+
+fido_dev_stats_t *
+fido_dev_stats_new(void)
+{
+	return (calloc(1, sizeof(fido_dev_stats_t)));
+}
+
+void
+fido_dev_stats_reset(fido_dev_stats_t *stats)
+{
+	if (stats != NULL)
+		memset(stats, 0, sizeof(*stats));
+}
+
+void
+fido_dev_stats_free(fido_dev_stats_t **stats_p)
+{
+	fido_dev_stats_t *stats;
+
+	if (stats_p == NULL || (stats = *stats_p) == NULL)
+		return;
+
+	if (decode.stats == stats)
+		decode.stats = NULL;
+
+	free(stats);
+
+	*stats_p = NULL;
+}
+
+uint64_t
+fido_dev_stats_counter(const fido_dev_stats_t *stats, int idx)
+{
+	if (idx < 0 || idx >= FIDO_STATS_NCOUNTERS)
+		return (0);
+
+	return (stats->counter[idx]);
+}
+
+uint64_t
+fido_dev_stats_latency(const fido_dev_stats_t *stats, uint8_t cmd, int phase,
+    size_t bucket)
+{
+	if (cmd >= FIDO_STATS_NCMDS || phase < 0 ||
+	    phase >= FIDO_STATS_NPHASES || bucket >= FIDO_STATS_NBUCKETS)
+		return (0);
+
+	return (stats->latency[cmd][phase][bucket]);
+}
+
+/* Called by the frame builders; false if d's encoding isn't timed. */
+bool
+fido_dev_stats_encode_begin(const fido_dev_t *d, struct timespec *ts_start)
+{
+	return (d != NULL && d->stats != NULL && fido_time_now(ts_start) == 0);
+}
+
+/* Called by the frame builders once the frame has been built. */
+void
+fido_dev_stats_encode_end(fido_dev_t *d, const struct timespec *ts_start)
+{
+	d->stats_encode_us = (int64_t)elapsed_us(ts_start);
+}
+
+/* Called by cbor_parse_reply*() before parsing; NULL if not armed. */
+fido_dev_stats_t *
+fido_stats_decode_begin(int *cmd, struct timespec *ts_start)
+{
+	fido_dev_stats_t *stats;
+
+	if ((stats = decode.stats) == NULL)
+		return (NULL);
+
+	decode.stats = NULL;
+	if (fido_time_now(ts_start) != 0)
+		return (NULL);
+	*cmd = decode.cmd;
+
+	return (stats);
+}
+
+void
+fido_stats_decode_end(fido_dev_stats_t *stats, int cmd,
+    const struct timespec *ts_start)
+{
+	record(stats, cmd, FIDO_STATS_DECODE, elapsed_us(ts_start));
+}
+
+/* Called by fido_tx() for every request. */
+void
+fido_dev_stats_tx(fido_dev_t *d, uint8_t cmd, const void *buf, size_t count)
+{
+	int64_t encode_us = d->stats_encode_us;
+
+	if (cmd == CTAP_CMD_CANCEL)
+		return; /* not a request of its own */
+
+	d->stats_encode_us = -1;
+	decode.stats = NULL;
+
+	if (d->stats == NULL)
+		return;
+
+	if ((d->stats_cmd = cmd_slot(cmd, buf, count)) >= 0 && encode_us >= 0)
+		record(d->stats, d->stats_cmd, FIDO_STATS_ENCODE,
+		    (uint64_t)encode_us);
+}
+
+/* Called once a reply to cmd has been received, or failed to. */
+void
+fido_dev_stats_rx(fido_dev_t *d, uint8_t cmd, bool ok)
+{
+	decode.stats = NULL;
+
+	if (d->stats == NULL || d->stats_cmd < 0)
+		return;
+
+	if (ok) {
+		record(d->stats, d->stats_cmd, FIDO_STATS_WIRE,
+		    elapsed_us(&d->keepalive.ts));
+		if (cmd == CTAP_CMD_CBOR) {
+			decode.stats = d->stats;
+			decode.cmd = d->stats_cmd;
+		}
+	}
+
+	d->stats_cmd = -1;
+}
@@ -40,6 +40,27 @@ fido_time_now(struct timespec *ts_now)
 	return 0;
 }
 
+/* Milliseconds since ts_start, or -1 on error. */
+int
+fido_time_elapsed(const struct timespec *ts_start)
+{
+	struct timespec ts_end, ts_delta;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts_end) != 0) {
+		fido_log_error(errno, "%s: clock_gettime", __func__);
+		return -1;
+	}
+
+	if (timespeccmp(&ts_end, ts_start, <)) {
+		fido_log_debug("%s: timespeccmp", __func__);
+		return -1;
+	}
+
+	timespecsub(&ts_end, ts_start, &ts_delta);
+
+	return timespec_to_ms(&ts_delta);
+}
+
 int
 fido_time_delta(const struct timespec *ts_start, int *ms_remain)
 {
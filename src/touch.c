@@ -5,9 +5,25 @@
  * SPDX-License-Identifier: BSD-2-Clause
  */
 
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#endif
+
 #include <openssl/sha.h>
 #include "fido.h"
 
+#define SELECT_STEP_MS	100	/* per status check of an unpollable device */
+#define SELECT_CANCEL_MS	100
+
+struct select_dev {
+	fido_dev_t	*dev;
+	bool		 pending;	/* touch request outstanding */
+	bool		 polled;	/* via fido_dev_poll() */
+	int		 touched;
+	int		 err;		/* why it dropped out */
+};
+
 int
 fido_dev_get_touch_begin(fido_dev_t *dev)
 {
@@ -62,8 +78,8 @@ fido_dev_get_touch_begin(fido_dev_t *dev)
 		}
 	}
 
-	if (cbor_build_frame(CTAP_CBOR_MAKECRED, argv, nitems(argv), &f) < 0 ||
-	    fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, &ms) < 0) {
+	if (cbor_build_frame(dev, CTAP_CBOR_MAKECRED, argv, nitems(argv),
+	    &f) < 0 || fido_tx(dev, CTAP_CMD_CBOR, f.ptr, f.len, &ms) < 0) {
 		fido_log_debug("%s: fido_tx", __func__);
 		r = FIDO_ERR_TX;
 		goto fail;
@@ -107,3 +123,262 @@ fido_dev_get_touch_status(fido_dev_t *dev, int *touched, int ms)
 
 	return (FIDO_OK);
 }
+
+/*
+ * fido_dev_select(): the touch request, or authenticatorSelection where the
+ * authenticator implements CTAP 2.1, is sent to every device at once. Devices
+ * with a descriptor are waited on together with poll(2) and read with
+ * fido_dev_poll(); the others, U2F devices among them, are asked for their
+ * status in turn. The first device touched wins and the others are sent
+ * CTAPHID_CANCEL, their replies left for the resync before their next
+ * request.
+ */
+
+static int
+select_async_rx(fido_dev_t *dev, const unsigned char *reply, size_t reply_len,
+    bool *done)
+{
+	int *touched = dev->async.obj;
+
+	*done = true;
+
+	if (reply_len < 1) {
+		fido_log_debug("%s: reply_len=%zu", __func__, reply_len);
+		return (FIDO_ERR_RX);
+	}
+
+	switch (reply[0]) {
+	case FIDO_ERR_PIN_AUTH_INVALID:
+	case FIDO_ERR_PIN_INVALID:
+	case FIDO_ERR_PIN_NOT_SET:
+	case FIDO_ERR_SUCCESS:
+		*touched = 1;
+		return (FIDO_OK);
+	default:
+		return (reply[0]);
+	}
+}
+
+static int
+select_begin(struct select_dev *s)
+{
+	fido_dev_t		*dev = s->dev;
+	const unsigned char	 cbor[] = { CTAP_CBOR_SELECTION };
+	int			 ms = dev->timeout_ms;
+	int			 r;
+
+	if (dev->io_handle == NULL || (dev->flags & FIDO_DEV_WINHELLO)) {
+		fido_log_debug("%s: unsupported device", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+#ifndef _WIN32
+	s->polled = fido_dev_async_check(dev) == FIDO_OK &&
+	    fido_dev_pollfd(dev) >= 0;
+#endif
+
+	if (fido_dev_is_fido2(dev) && (dev->flags & FIDO_DEV_SELECTION)) {
+		if (fido_tx(dev, CTAP_CMD_CBOR, cbor, sizeof(cbor), &ms) < 0) {
+			fido_log_debug("%s: fido_tx", __func__);
+			return (FIDO_ERR_TX);
+		}
+	} else if ((r = fido_dev_get_touch_begin(dev)) != FIDO_OK) {
+		fido_log_debug("%s: fido_dev_get_touch_begin", __func__);
+		return (r);
+	}
+
+	if (s->polled)
+		fido_dev_async_start(dev, &s->touched, select_async_rx, NULL,
+		    NULL);
+
+	s->pending = true;
+
+	return (FIDO_OK);
+}
+
+static void
+select_cancel(struct select_dev *s)
+{
+	fido_dev_t	*dev = s->dev;
+	int		 ms = SELECT_CANCEL_MS;
+
+	if (fido_dev_is_fido2(dev) &&
+	    fido_tx(dev, CTAP_CMD_CANCEL, NULL, 0, &ms) < 0)
+		fido_log_debug("%s: fido_tx", __func__);
+	if (s->polled)
+		fido_dev_async_reset(dev);
+	if (dev->transport.rx == NULL)
+		dev->resync = true;
+
+	s->pending = false;
+}
+
+/* Reads what the pollable devices have to say, waiting up to ms. */
+static int
+select_poll(struct select_dev *sel, struct pollfd *pfd, size_t n, int ms,
+    size_t *idx)
+{
+#ifndef _WIN32
+	size_t	npfd = 0;
+	int	done, r;
+
+	for (size_t i = 0; i < n; i++)
+		if (sel[i].pending && sel[i].polled) {
+			pfd[npfd].fd = fido_dev_pollfd(sel[i].dev);
+			pfd[npfd].events = POLLIN;
+			pfd[npfd].revents = 0;
+			npfd++;
+		}
+
+	if (npfd == 0)
+		return (FIDO_OK);
+
+	if (poll(pfd, (nfds_t)npfd, ms) < 0 && errno != EINTR) {
+		fido_log_error(errno, "%s: poll", __func__);
+		return (FIDO_ERR_INTERNAL);
+	}
+
+	npfd = 0;
+	for (size_t i = 0; i < n; i++) {
+		if (!sel[i].pending || !sel[i].polled)
+			continue;
+		if ((pfd[npfd++].revents & (POLLIN|POLLERR|POLLHUP)) == 0)
+			continue;
+		if ((r = fido_dev_poll(sel[i].dev, &done)) != FIDO_OK) {
+			fido_log_debug("%s: dev %zu: 0x%x", __func__, i, r);
+			sel[i].pending = false;
+			sel[i].err = r;
+			continue;
+		}
+		if (done) {
+			sel[i].pending = false;
+			if (sel[i].touched) {
+				*idx = i;
+				return (FIDO_OK);
+			}
+		}
+	}
+#else
+	(void)sel;
+	(void)pfd;
+	(void)n;
+	(void)ms;
+	(void)idx;
+#endif
+
+	return (FIDO_OK);
+}
+
+/* Asks each unpollable device for its status, waiting up to ms for each. */
+static void
+select_step(struct select_dev *sel, size_t n, int ms, size_t *idx)
+{
+	int r;
+
+	for (size_t i = 0; i < n && *idx == SIZE_MAX; i++) {
+		if (!sel[i].pending || sel[i].polled)
+			continue;
+		if ((r = fido_dev_get_touch_status(sel[i].dev,
+		    &sel[i].touched, ms)) != FIDO_OK) {
+			fido_log_debug("%s: dev %zu: 0x%x", __func__, i, r);
+			sel[i].pending = false;
+			sel[i].err = r;
+			continue;
+		}
+		if (sel[i].touched) {
+			sel[i].pending = false;
+			*idx = i;
+		}
+	}
+}
+
+int
+fido_dev_select(fido_dev_t **devs, size_t n, size_t *idx, int ms)
+{
+	struct select_dev	*sel = NULL;
+	struct pollfd		*pfd = NULL;
+	struct timespec		 ts_start;
+	size_t			 npending, nstepped;
+	int			 left, r;
+
+	if (idx == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	*idx = SIZE_MAX;
+
+	if (devs == NULL || n == 0 || ms < -1)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	if (fido_time_now(&ts_start) != 0)
+		return (FIDO_ERR_INTERNAL);
+
+	if ((sel = calloc(n, sizeof(*sel))) == NULL) {
+		r = FIDO_ERR_INTERNAL;
+		goto out;
+	}
+#ifndef _WIN32
+	if ((pfd = calloc(n, sizeof(*pfd))) == NULL) {
+		r = FIDO_ERR_INTERNAL;
+		goto out;
+	}
+#endif
+
+	for (size_t i = 0; i < n; i++) {
+		sel[i].dev = devs[i];
+		if (devs[i] == NULL)
+			sel[i].err = FIDO_ERR_INVALID_ARGUMENT;
+		else
+			sel[i].err = select_begin(&sel[i]);
+		if (sel[i].err != FIDO_OK)
+			fido_log_debug("%s: dev %zu: 0x%x", __func__, i,
+			    sel[i].err);
+	}
+
+	for (;;) {
+		npending = nstepped = 0;
+		for (size_t i = 0; i < n; i++)
+			if (sel[i].pending) {
+				npending++;
+				if (!sel[i].polled)
+					nstepped++;
+			}
+		if (npending == 0) {
+			/* none touched; pass on one of the failures */
+			fido_log_debug("%s: no device left", __func__);
+			r = FIDO_ERR_INTERNAL;
+			for (size_t i = 0; i < n; i++)
+				if (sel[i].err != FIDO_OK)
+					r = sel[i].err;
+			goto out;
+		}
+		left = ms;
+		if (fido_time_delta(&ts_start, &left) != 0) {
+			r = FIDO_ERR_INTERNAL;
+			goto out;
+		}
+		if (left == 0) {
+			fido_log_debug("%s: timeout", __func__);
+			r = FIDO_ERR_USER_ACTION_TIMEOUT;
+			goto out;
+		}
+		if ((r = select_poll(sel, pfd, n, nstepped ? 0 : left,
+		    idx)) != FIDO_OK)
+			goto out;
+		if (*idx == SIZE_MAX && nstepped)
+			select_step(sel, n, left < 0 || left > SELECT_STEP_MS ?
+			    SELECT_STEP_MS : left, idx);
+		if (*idx != SIZE_MAX) {
+			r = FIDO_OK;
+			goto out;
+		}
+	}
+out:
+	for (size_t i = 0; sel != NULL && i < n; i++)
+		if (sel[i].pending)
+			select_cancel(&sel[i]);
+
+	free(sel);
+	free(pfd);
+
+	return (r);
+}
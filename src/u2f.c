@@ -15,9 +15,9 @@
 
 #include "fido.h"
 #include "fido/es256.h"
-#include "fallthrough.h"
 
 #define U2F_PACE_MS (100)
+#define U2F_PACE_MIN_MS (10)
 
 #if defined(_MSC_VER)
 static int
@@ -51,6 +51,60 @@ delay_ms(unsigned int ms, int *ms_remain)
 	return (0);
 }
 
+/* Whether a request awaiting user presence should be repeated. */
+static bool
+retry(fido_dev_t *dev, const unsigned char *reply)
+{
+	if (((reply[0] << 8) | reply[1]) != SW_CONDITIONS_NOT_SATISFIED)
+		return (false);
+
+	fido_dev_stats_count(dev, FIDO_STATS_RETRIES, 1);
+
+	return (true);
+}
+
+/*
+ * Sends apdu until the authenticator stops asking for user presence. The
+ * first retry follows U2F_PACE_MIN_MS after the first refusal, and the
+ * interval then doubles up to U2F_PACE_MS, but is never shorter than the
+ * device took to answer: a touch is noticed soon after it happens, and a
+ * slow device is not asked more often than it can reply.
+ */
+static int
+send_until_present(fido_dev_t *dev, const iso7816_apdu_t *apdu,
+    unsigned char *reply, int *reply_len, int *ms)
+{
+	struct timespec	ts_tx;
+	unsigned int	pace = U2F_PACE_MIN_MS;
+	int		rtt;
+
+	for (;;) {
+		if (fido_time_now(&ts_tx) != 0)
+			return (FIDO_ERR_INTERNAL);
+		if (fido_tx(dev, CTAP_CMD_MSG, iso7816_ptr(apdu),
+		    iso7816_len(apdu), ms) < 0) {
+			fido_log_debug("%s: fido_tx", __func__);
+			return (FIDO_ERR_TX);
+		}
+		if ((*reply_len = fido_rx(dev, CTAP_CMD_MSG, reply,
+		    FIDO_MAXMSG, ms)) < 2) {
+			fido_log_debug("%s: fido_rx", __func__);
+			return (FIDO_ERR_RX);
+		}
+		if (!retry(dev, reply))
+			return (FIDO_OK);
+		if ((rtt = fido_time_elapsed(&ts_tx)) > (int)pace)
+			pace = (unsigned int)rtt;
+		if (delay_ms(pace < U2F_PACE_MS ? pace : U2F_PACE_MS,
+		    ms) != 0) {
+			fido_log_debug("%s: delay_ms", __func__);
+			return (FIDO_ERR_RX);
+		}
+		if (pace < U2F_PACE_MS)
+			pace *= 2;
+	}
+}
+
 static int
 sig_get(fido_blob_t *sig, const unsigned char **buf, size_t *len)
 {
@@ -148,6 +202,7 @@ send_dummy_register(fido_dev_t *dev, int *ms)
 	unsigned char	*reply = NULL;
 	unsigned char	 challenge[SHA256_DIGEST_LENGTH];
 	unsigned char	 application[SHA256_DIGEST_LENGTH];
+	int		 reply_len;
 	int		 r;
 
 	/* dummy challenge & application */
@@ -169,24 +224,11 @@ send_dummy_register(fido_dev_t *dev, int *ms)
 		goto fail;
 	}
 
-	do {
-		if (fido_tx(dev, CTAP_CMD_MSG, iso7816_ptr(apdu),
-		    iso7816_len(apdu), ms) < 0) {
-			fido_log_debug("%s: fido_tx", __func__);
-			r = FIDO_ERR_TX;
-			goto fail;
-		}
-		if (fido_rx(dev, CTAP_CMD_MSG, reply, FIDO_MAXMSG, ms) < 2) {
-			fido_log_debug("%s: fido_rx", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-		if (delay_ms(U2F_PACE_MS, ms) != 0) {
-			fido_log_debug("%s: delay_ms", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-	} while (((reply[0] << 8) | reply[1]) == SW_CONDITIONS_NOT_SATISFIED);
+	if ((r = send_until_present(dev, apdu, reply, &reply_len,
+	    ms)) != FIDO_OK) {
+		fido_log_debug("%s: send_until_present", __func__);
+		goto fail;
+	}
 
 	r = FIDO_OK;
 fail:
@@ -358,25 +400,11 @@ do_auth(fido_dev_t *dev, const fido_blob_t *cdh, const char *rp_id,
 		goto fail;
 	}
 
-	do {
-		if (fido_tx(dev, CTAP_CMD_MSG, iso7816_ptr(apdu),
-		    iso7816_len(apdu), ms) < 0) {
-			fido_log_debug("%s: fido_tx", __func__);
-			r = FIDO_ERR_TX;
-			goto fail;
-		}
-		if ((reply_len = fido_rx(dev, CTAP_CMD_MSG, reply,
-		    FIDO_MAXMSG, ms)) < 2) {
-			fido_log_debug("%s: fido_rx", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-		if (delay_ms(U2F_PACE_MS, ms) != 0) {
-			fido_log_debug("%s: delay_ms", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-	} while (((reply[0] << 8) | reply[1]) == SW_CONDITIONS_NOT_SATISFIED);
+	if ((r = send_until_present(dev, apdu, reply, &reply_len,
+	    ms)) != FIDO_OK) {
+		fido_log_debug("%s: send_until_present", __func__);
+		goto fail;
+	}
 
 	if ((r = parse_auth_reply(sig, ad, rp_id, reply,
 	    (size_t)reply_len)) != FIDO_OK) {
@@ -723,25 +751,11 @@ u2f_register(fido_dev_t *dev, fido_cred_t *cred, int *ms)
 		goto fail;
 	}
 
-	do {
-		if (fido_tx(dev, CTAP_CMD_MSG, iso7816_ptr(apdu),
-		    iso7816_len(apdu), ms) < 0) {
-			fido_log_debug("%s: fido_tx", __func__);
-			r = FIDO_ERR_TX;
-			goto fail;
-		}
-		if ((reply_len = fido_rx(dev, CTAP_CMD_MSG, reply,
-		    FIDO_MAXMSG, ms)) < 2) {
-			fido_log_debug("%s: fido_rx", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-		if (delay_ms(U2F_PACE_MS, ms) != 0) {
-			fido_log_debug("%s: delay_ms", __func__);
-			r = FIDO_ERR_RX;
-			goto fail;
-		}
-	} while (((reply[0] << 8) | reply[1]) == SW_CONDITIONS_NOT_SATISFIED);
+	if ((r = send_until_present(dev, apdu, reply, &reply_len,
+	    ms)) != FIDO_OK) {
+		fido_log_debug("%s: send_until_present", __func__);
+		goto fail;
+	}
 
 	if ((r = parse_register_reply(cred, reply,
 	    (size_t)reply_len)) != FIDO_OK) {
@@ -756,42 +770,18 @@ fail:
 }
 
 static int
-u2f_authenticate_single(fido_dev_t *dev, const fido_blob_t *key_id,
-    fido_assert_t *fa, size_t idx, int *ms)
+u2f_authenticate_single(fido_dev_t *dev, fido_assert_t *fa, size_t idx,
+    int *ms)
 {
 	fido_blob_t	sig;
 	fido_blob_t	ad;
-	int		found;
 	int		r;
 
 	memset(&sig, 0, sizeof(sig));
 	memset(&ad, 0, sizeof(ad));
 
-	if ((r = key_lookup(dev, fa->rp_id, key_id, &found, ms)) != FIDO_OK) {
-		fido_log_debug("%s: key_lookup", __func__);
-		goto fail;
-	}
-
-	if (!found) {
-		fido_log_debug("%s: not found", __func__);
-		r = FIDO_ERR_CREDENTIAL_EXCLUDED;
-		goto fail;
-	}
-
-	if (fido_blob_set(&fa->stmt[idx].id, key_id->ptr, key_id->len) < 0) {
-		fido_log_debug("%s: fido_blob_set", __func__);
-		r = FIDO_ERR_INTERNAL;
-		goto fail;
-	}
-
-	if (fa->up == FIDO_OPT_FALSE) {
-		fido_log_debug("%s: checking for key existence only", __func__);
-		r = FIDO_ERR_USER_PRESENCE_REQUIRED;
-		goto fail;
-	}
-
-	if ((r = do_auth(dev, &fa->cdh, fa->rp_id, key_id, &sig, &ad,
-	    ms)) != FIDO_OK) {
+	if ((r = do_auth(dev, &fa->cdh, fa->rp_id, &fa->stmt[idx].id, &sig,
+	    &ad, ms)) != FIDO_OK) {
 		fido_log_debug("%s: do_auth", __func__);
 		goto fail;
 	}
@@ -814,9 +804,10 @@ fail:
 int
 u2f_authenticate(fido_dev_t *dev, fido_assert_t *fa, int *ms)
 {
-	size_t	nfound = 0;
-	size_t	nauth_ok = 0;
-	int	r;
+	const fido_blob_t	*key_id;
+	size_t			 nfound = 0;
+	int			 found;
+	int			 r;
 
 	if (fa->uv == FIDO_OPT_TRUE || fa->allow_list.ptr == NULL) {
 		fido_log_debug("%s: uv=%d, allow_list=%p", __func__, fa->uv,
@@ -829,31 +820,40 @@ u2f_authenticate(fido_dev_t *dev, fido_assert_t *fa, int *ms)
 		return (r);
 	}
 
+	/* look up every key before waiting for the user */
 	for (size_t i = 0; i < fa->allow_list.len; i++) {
-		switch ((r = u2f_authenticate_single(dev,
-		    &fa->allow_list.ptr[i], fa, nfound, ms))) {
-		case FIDO_OK:
-			nauth_ok++;
-			FALLTHROUGH
-		case FIDO_ERR_USER_PRESENCE_REQUIRED:
-			nfound++;
-			break;
-		default:
-			if (r != FIDO_ERR_CREDENTIAL_EXCLUDED) {
-				fido_log_debug("%s: u2f_authenticate_single",
-				    __func__);
-				return (r);
-			}
-			/* ignore credentials that don't exist */
+		key_id = &fa->allow_list.ptr[i];
+		if ((r = key_lookup(dev, fa->rp_id, key_id, &found,
+		    ms)) != FIDO_OK) {
+			fido_log_debug("%s: key_lookup", __func__);
+			return (r);
+		}
+		if (!found)
+			continue; /* ignore credentials that don't exist */
+		if (fido_blob_set(&fa->stmt[nfound].id, key_id->ptr,
+		    key_id->len) < 0) {
+			fido_log_debug("%s: fido_blob_set", __func__);
+			return (FIDO_ERR_INTERNAL);
 		}
+		nfound++;
 	}
 
 	fa->stmt_len = nfound;
 
 	if (nfound == 0)
 		return (FIDO_ERR_NO_CREDENTIALS);
-	if (nauth_ok == 0)
+
+	if (fa->up == FIDO_OPT_FALSE) {
+		fido_log_debug("%s: checking for key existence only", __func__);
 		return (FIDO_ERR_USER_PRESENCE_REQUIRED);
+	}
+
+	for (size_t i = 0; i < nfound; i++)
+		if ((r = u2f_authenticate_single(dev, fa, i, ms)) != FIDO_OK) {
+			fido_log_debug("%s: u2f_authenticate_single",
+			    __func__);
+			return (r);
+		}
 
 	return (FIDO_OK);
 }
@@ -0,0 +1,111 @@
+/*
+ * Copyright (c) 2026 Yubico AB. All rights reserved.
+ * Use of this source code is governed by a BSD-style
+ * license that can be found in the LICENSE file.
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+#include "fido.h"
+#include "fido/es256.h"
+#include "fido/es384.h"
+#include "fido/rs256.h"
+#include "fido/eddsa.h"
+
+static EVP_PKEY *
+pk_to_EVP_PKEY(int cose_alg, const void *pk)
+{
+	switch (cose_alg) {
+	case COSE_ES256:
+		return (es256_pk_to_EVP_PKEY(pk));
+	case COSE_ES384:
+		return (es384_pk_to_EVP_PKEY(pk));
+	case COSE_RS256:
+		return (rs256_pk_to_EVP_PKEY(pk));
+	case COSE_EDDSA:
+		return (eddsa_pk_to_EVP_PKEY(pk));
+	default:
+		fido_log_debug("%s: unsupported cose_alg %d", __func__,
+		    cose_alg);
+		return (NULL);
+	}
+}
+
+fido_verifier_t *
+fido_verifier_new(void)
+{
+	fido_verifier_t *v;
+
+	if ((v = calloc(1, sizeof(*v))) == NULL)
+		return (NULL);
+
+	v->cose_alg = COSE_UNSPEC;
+
+	return (v);
+}
+
+static void
+verifier_reset(fido_verifier_t *v)
+{
+	EVP_PKEY_free(v->pkey);
+	v->pkey = NULL;
+	v->cose_alg = COSE_UNSPEC;
+}
+
+void
+fido_verifier_free(fido_verifier_t **vp)
+{
+	fido_verifier_t *v;
+
+	if (vp == NULL || (v = *vp) == NULL)
+		return;
+
+	verifier_reset(v);
+	free(v);
+
+	*vp = NULL;
+}
+
+int
+fido_verifier_set_pk(fido_verifier_t *v, int cose_alg, const void *pk)
+{
+	if (v == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+
+	verifier_reset(v);
+
+	if (pk == NULL)
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	if ((v->pkey = pk_to_EVP_PKEY(cose_alg, pk)) == NULL) {
+		fido_log_debug("%s: pk_to_EVP_PKEY", __func__);
+		return (FIDO_ERR_INVALID_ARGUMENT);
+	}
+
+	v->cose_alg = cose_alg;
+
+	return (FIDO_OK);
+}
+
+int
+fido_verifier_verify_sig(const fido_verifier_t *v, const fido_blob_t *dgst,
+    const fido_blob_t *sig)
+{
+	if (v->pkey == NULL) {
+		fido_log_debug("%s: no pkey", __func__);
+		return (-1);
+	}
+
+	switch (v->cose_alg) {
+	case COSE_ES256:
+		return (es256_verify_sig(dgst, v->pkey, sig));
+	case COSE_ES384:
+		return (es384_verify_sig(dgst, v->pkey, sig));
+	case COSE_RS256:
+		return (rs256_verify_sig(dgst, v->pkey, sig));
+	case COSE_EDDSA:
+		return (eddsa_verify_sig(dgst, v->pkey, sig));
+	default:
+		fido_log_debug("%s: unsupported cose_alg %d", __func__,
+		    v->cose_alg);
+		return (-1);
+	}
+}